@@ -0,0 +1,8 @@
+// per-frame uniforms, frame_uniforms in frame_packet.hpp
+layout (std140) uniform frame_data {
+  mat4 view;
+  mat4 proj;
+  mat4 view_proj;
+  vec4 camera_pos;
+  vec4 time;
+};
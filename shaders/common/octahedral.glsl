@@ -0,0 +1,20 @@
+// unit vectors folded onto an octahedron and unfolded into a square,
+// two components in [0, 1] with about even precision over the sphere
+vec2
+octahedral_encode(vec3 n) {
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 e = n.xy;
+  if (n.z < 0.0)
+    e = (1.0 - abs(n.yx))*vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return e*0.5 + 0.5;
+}
+
+vec3
+octahedral_decode(vec2 e) {
+  e = e*2.0 - 1.0;
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += (n.x >= 0.0) ? -t : t;
+  n.y += (n.y >= 0.0) ? -t : t;
+  return normalize(n);
+}
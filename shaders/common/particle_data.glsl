@@ -0,0 +1,11 @@
+// per-frame emitter and forces of the GPU particles,
+// gpu_particle_uniforms in gpu_particles.hpp
+layout (std140) uniform particle_data {
+  vec4 emitter;      // position, radius, spread
+  vec4 motion;       // initial velocity, gravity
+  vec4 life_params;  // lifetime, jitter, drag, unused
+  vec4 sizes;        // start size, end size, unused, unused
+  vec4 start_color;
+  vec4 end_color;
+  uvec4 emission;    // first slot to emit into, slots, capacity, seed
+};
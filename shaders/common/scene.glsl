@@ -0,0 +1,16 @@
+// per material: base layer, overlay layer, roughness from 0 to 255,
+// unused
+layout (std140) uniform material_data {
+  ivec4 materials[1024];
+};
+
+// world matrices of the scene graph, four texels per matrix
+uniform samplerBuffer world_matrices;
+
+mat4
+world_matrix(int index) {
+  return mat4(texelFetch(world_matrices, 4*index),
+              texelFetch(world_matrices, 4*index + 1),
+              texelFetch(world_matrices, 4*index + 2),
+              texelFetch(world_matrices, 4*index + 3));
+}
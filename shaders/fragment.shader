@@ -1,13 +1,45 @@
 #version 330 core
 in vec3 vertex_color;
 in vec2 tex_coord;
+flat in ivec2 layers;
 
+#if defined(GBUFFER)
+#include "common/frame_data.glsl"
+#include "common/octahedral.glsl"
+in vec3 world_pos;
+flat in float roughness;
+// the G-buffer: albedo and roughness, RGBA8, and the normal, RG16;
+// positions come back from the depth buffer
+layout (location = 0) out vec4 albedo_roughness;
+layout (location = 1) out vec2 packed_normal;
+#else
 out vec4 FragColor;
+#endif
 
-uniform sampler2D texture1;
-uniform sampler2D texture2;
+// texture arrays of the batch, layers picked per material
+uniform sampler2DArray base_textures;
+uniform sampler2DArray overlay_textures;
 
 
 void main() {
-  FragColor = mix(texture(texture1, tex_coord), texture(texture2, tex_coord), 0.2) * vec4(vertex_color, 1.0);
+  vec4 color;
+#if defined(WIREFRAME)
+  color = vec4(vertex_color, 1.0);
+#elif defined(HAS_TEXTURE2)
+  color = mix(texture(base_textures, vec3(tex_coord, layers.x)),
+              texture(overlay_textures, vec3(tex_coord, layers.y)), 0.2) * vec4(vertex_color, 1.0);
+#else
+  color = texture(base_textures, vec3(tex_coord, layers.x)) * vec4(vertex_color, 1.0);
+#endif
+
+#if defined(GBUFFER)
+  // the meshes have no normals: faces are flat, turned to the camera
+  vec3 n = normalize(cross(dFdx(world_pos), dFdy(world_pos)));
+  if (dot(n, camera_pos.xyz - world_pos) < 0.0)
+    n = -n;
+  albedo_roughness = vec4(color.rgb, roughness);
+  packed_normal = octahedral_encode(n);
+#else
+  FragColor = color;
+#endif
 }
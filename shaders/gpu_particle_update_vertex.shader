@@ -0,0 +1,55 @@
+#version 330 core
+#include "common/frame_data.glsl"
+#include "common/particle_data.glsl"
+
+// One particle per vertex, drawn as points with the rasterizer off: its
+// next state goes to the other buffer by transform feedback. Dead slots
+// inside this frame's emission window (a ring over the slots, moved on
+// by the renderer) are spawned again from the emitter.
+layout (location = 0) in vec4 a_state;  // position, velocity
+layout (location = 1) in vec2 a_life;   // seconds left, 1/lifetime
+
+out vec4 state;
+out vec2 life;
+
+// uniform in [0, 1) from a counter, a few good rounds of mixing
+float
+random01(inout uint s) {
+  s = s*747796405u + 2891336453u;
+  uint x = ((s >> ((s >> 28u) + 4u)) ^ s)*277803737u;
+  return float((x >> 22u) ^ x >> 8u)*(1.0/16777216.0);
+}
+
+vec2
+in_disc(inout uint s) {
+  float r = sqrt(random01(s));
+  float a = 6.2831853*random01(s);
+  return r*vec2(cos(a), sin(a));
+}
+
+void
+main() {
+  uint slot = uint(gl_VertexID);
+  uint capacity = emission.z;
+  bool spawn = a_life.x <= 0.0 &&
+               (slot + capacity - emission.x) % capacity < emission.y;
+  if (spawn) {
+    uint s = slot*0x9e3779b9u ^ emission.w;
+    vec2 pos = emitter.xy + emitter.z*in_disc(s);
+    vec2 vel = motion.xy + emitter.w*in_disc(s);
+    float lifetime = max(life_params.x*(1.0 + life_params.y*(2.0*random01(s) - 1.0)), 1e-3);
+    state = vec4(pos, vel);
+    life = vec2(lifetime, 1.0/lifetime);
+  }
+  else if (a_life.x > 0.0) {
+    // semi-implicit euler, as particle_system does on the CPU
+    float dt = time.y;
+    vec2 vel = a_state.zw + (motion.zw - life_params.z*a_state.zw)*dt;
+    state = vec4(a_state.xy + vel*dt, vel);
+    life = vec2(a_life.x - dt, a_life.y);
+  }
+  else {
+    state = a_state;
+    life = a_life;
+  }
+}
@@ -0,0 +1,22 @@
+#version 330 core
+#include "common/frame_data.glsl"
+#include "common/particle_data.glsl"
+
+// per instance, a particle as gpu_particle_update_vertex wrote it; the
+// corners come from gl_VertexID, a strip of 4, and dead particles are
+// collapsed to nothing
+layout (location = 0) in vec4 a_state;
+layout (location = 1) in vec2 a_life;
+
+out vec2 offset;
+out vec4 tint;
+
+void
+main() {
+  float t = clamp(1.0 - a_life.x*a_life.y, 0.0, 1.0);
+  float size = (a_life.x > 0.0) ? mix(sizes.x, sizes.y, t) : 0.0;
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1)*2.0 - 1.0;
+  gl_Position = view_proj*vec4(a_state.xy + 0.5*size*corner, 0.0, 1.0);
+  offset = corner;
+  tint = mix(start_color, end_color, t);
+}
@@ -0,0 +1,60 @@
+#version 330 core
+#include "common/frame_data.glsl"
+#include "common/octahedral.glsl"
+
+flat in vec4 light_position;
+flat in vec3 light_color;
+
+out vec4 FragColor;
+
+// the G-buffer, read at this pixel
+uniform sampler2D gbuffer_albedo;  // and roughness
+uniform sampler2D gbuffer_normal;
+uniform sampler2D gbuffer_depth;
+uniform mat4 inv_view_proj;
+uniform bool reversed_z;  // depth in [0, 1] clip space, cleared to 0
+uniform vec3 background;  // where nothing was drawn
+
+void
+main() {
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  float depth = texelFetch(gbuffer_depth, pixel, 0).r;
+  bool empty = depth == (reversed_z ? 0.0 : 1.0);
+
+  // ambient light, also writing every pixel the scene did not cover
+  if (light_position.w <= 0.0) {
+    vec3 albedo = texelFetch(gbuffer_albedo, pixel, 0).rgb;
+    FragColor = vec4(empty ? background : albedo*light_color, 1.0);
+    return;
+  }
+  if (empty)
+    discard;
+
+  // the position back from the pixel and its depth
+  vec2 uv = (vec2(pixel) + 0.5)/vec2(textureSize(gbuffer_depth, 0));
+  vec4 ndc = vec4(uv*2.0 - 1.0, reversed_z ? depth : depth*2.0 - 1.0, 1.0);
+  vec4 world = inv_view_proj*ndc;
+  vec3 pos = world.xyz/world.w;
+
+  vec3 to_light = light_position.xyz - pos;
+  float dist2 = dot(to_light, to_light);
+  float radius2 = light_position.w*light_position.w;
+  if (dist2 >= radius2)
+    discard;
+
+  // inverse square, windowed down to 0 at the radius
+  float window = clamp(1.0 - dist2*dist2/(radius2*radius2), 0.0, 1.0);
+  float falloff = window*window/(dist2 + 1.0);
+
+  vec4 albedo = texelFetch(gbuffer_albedo, pixel, 0);
+  vec3 n = octahedral_decode(texelFetch(gbuffer_normal, pixel, 0).xy);
+  vec3 l = to_light*inversesqrt(dist2);
+  float n_dot_l = max(dot(n, l), 0.0);
+
+  // normalized Blinn-Phong, rougher is wider and dimmer
+  vec3 h = normalize(l + normalize(camera_pos.xyz - pos));
+  float shininess = exp2(11.0*(1.0 - albedo.a)) + 1.0;
+  float specular = 0.04*(shininess + 8.0)/8.0*pow(max(dot(n, h), 0.0), shininess);
+
+  FragColor = vec4((albedo.rgb + specular)*light_color*n_dot_l*falloff, 1.0);
+}
@@ -0,0 +1,39 @@
+#version 330 core
+#include "common/frame_data.glsl"
+
+// per instance, point_light in frame_packet.hpp: position and radius,
+// color and intensity. A radius of 0 is the ambient light and covers the
+// screen; a point light covers the screen rectangle of the box around
+// its sphere, or the screen when part of the box is behind the camera,
+// so it only shades the pixels it can reach. Corners from gl_VertexID.
+layout (location = 0) in vec4 a_position_radius;
+layout (location = 1) in vec4 a_color_intensity;
+
+flat out vec4 light_position;  // and radius
+flat out vec3 light_color;     // times intensity
+
+void
+main() {
+  vec2 lo = vec2(-1.0), hi = vec2(1.0);
+  float radius = a_position_radius.w;
+  if (radius > 0.0) {
+    vec2 box_lo = vec2(1e30), box_hi = vec2(-1e30);
+    bool behind = false;
+    for (int i = 0; i < 8; ++i) {
+      vec3 side = vec3(i & 1, (i >> 1) & 1, i >> 2)*2.0 - 1.0;
+      vec4 clip = view_proj*vec4(a_position_radius.xyz + radius*side, 1.0);
+      behind = behind || clip.w <= 1e-5;
+      vec2 ndc = clip.xy/max(clip.w, 1e-5);
+      box_lo = min(box_lo, ndc);
+      box_hi = max(box_hi, ndc);
+    }
+    if (!behind) {
+      lo = max(box_lo, lo);
+      hi = max(min(box_hi, hi), lo);  // off screen lights collapse
+    }
+  }
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  gl_Position = vec4(mix(lo, hi, corner), 0.0, 1.0);
+  light_position = a_position_radius;
+  light_color = a_color_intensity.rgb*a_color_intensity.a;
+}
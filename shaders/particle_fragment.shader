@@ -0,0 +1,17 @@
+#version 330 core
+in vec2 offset;  // -1 to 1 across the quad
+in vec4 tint;
+
+out vec4 FragColor;
+
+void main() {
+#if defined(WIREFRAME)
+  FragColor = vec4(tint.rgb, 1.0);
+#else
+  // a round dot fading out to its edge
+  float falloff = 1.0 - dot(offset, offset);
+  if (falloff <= 0.0)
+    discard;
+  FragColor = vec4(tint.rgb, tint.a*falloff);
+#endif
+}
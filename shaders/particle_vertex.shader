@@ -0,0 +1,22 @@
+#version 330 core
+
+// per instance, one array each in particle_list (frame_packet.hpp):
+// center, size and RGBA8 color. The corners come from gl_VertexID, a
+// strip of 4.
+layout (location = 0) in float a_x;
+layout (location = 1) in float a_y;
+layout (location = 2) in float a_size;
+layout (location = 3) in vec4 a_color;
+
+out vec2 offset;
+out vec4 tint;
+
+uniform mat4 particle_transform;
+
+void
+main() {
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1)*2.0 - 1.0;
+  gl_Position = particle_transform*vec4(vec2(a_x, a_y) + 0.5*a_size*corner, 0.0, 1.0);
+  offset = corner;
+  tint = a_color;
+}
@@ -0,0 +1,23 @@
+#version 330 core
+in vec2 tex_coord;
+in vec4 tint;
+flat in int layer;
+
+out vec4 FragColor;
+
+// texture array of the run being drawn
+uniform sampler2DArray sprite_textures;
+
+void main() {
+#if defined(WIREFRAME)
+  FragColor = vec4(tint.rgb, 1.0);
+#elif defined(SDF)
+  // coverage from the distance, 0.5 on the outline, antialiased over
+  // about a pixel at whatever size it is drawn
+  float d = texture(sprite_textures, vec3(tex_coord, layer)).r;
+  float w = fwidth(d);
+  FragColor = vec4(tint.rgb, tint.a*smoothstep(0.5 - w, 0.5 + w, d));
+#else
+  FragColor = texture(sprite_textures, vec3(tex_coord, layer))*tint;
+#endif
+}
@@ -0,0 +1,29 @@
+#version 330 core
+
+// per instance, sprite_instance in frame_packet.hpp: center and size,
+// texture rectangle (offset, scale), rotation, RGBA8 tint and layer of
+// the texture array. The corners come from gl_VertexID, a strip of 4.
+layout (location = 0) in vec4 a_rect;
+layout (location = 1) in vec4 a_uv_rect;
+layout (location = 2) in float a_rotation;
+layout (location = 3) in vec4 a_color;
+layout (location = 4) in int a_layer;
+
+out vec2 tex_coord;
+out vec4 tint;
+flat out int layer;
+
+uniform mat4 sprite_transform;
+
+void
+main() {
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  vec2 local = (corner - 0.5)*a_rect.zw;
+  float c = cos(a_rotation);
+  float s = sin(a_rotation);
+  vec2 pos = a_rect.xy + vec2(c*local.x - s*local.y, s*local.x + c*local.y);
+  gl_Position = sprite_transform*vec4(pos, 0.0, 1.0);
+  tex_coord = a_uv_rect.xy + corner*a_uv_rect.zw;
+  tint = a_color;
+  layer = a_layer;
+}
@@ -4,13 +4,33 @@
 layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec3 a_color;
 layout (location = 2) in vec2 a_texcoord;
+// per instance: world matrix and material index, and the texture
+// rectangle, (offset, scale), that a_texcoord is mapped into (whole
+// texture or atlas region)
+layout (location = 3) in ivec2 a_index;
+layout (location = 4) in vec4 a_uv_rect;
 
 out vec3 vertex_color;
 out vec2 tex_coord;
+// base and overlay layer in the bound texture arrays
+flat out ivec2 layers;
+#if defined(GBUFFER)
+out vec3 world_pos;
+flat out float roughness;
+#endif
+
+#include "common/frame_data.glsl"
+#include "common/scene.glsl"
 
 void
 main() {
-  gl_Position = vec4(a_pos, 1.0);
+  vec4 world = world_matrix(a_index.x) * vec4(a_pos, 1.0);
+  gl_Position = view_proj * world;
   vertex_color = a_color;
-  tex_coord = a_texcoord;
+  tex_coord = a_uv_rect.xy + a_texcoord*a_uv_rect.zw;
+  layers = materials[a_index.y].xy;
+#if defined(GBUFFER)
+  world_pos = world.xyz;
+  roughness = float(materials[a_index.y].z)/255.0;
+#endif
 }
@@ -0,0 +1,212 @@
+#include "asset_pack.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+#include "lz4.hpp"
+
+using std::string;
+using std::vector;
+using std::ofstream;
+using std::runtime_error;
+using std::unique_ptr;
+
+static const char PACK_MAGIC[4] = {'A', 'P', 'A', 'K'};
+static const uint32_t PACK_VERSION = 1;
+static_assert(sizeof(pack_header) == 32 && sizeof(pack_entry) == 40,
+              "pack structs are written as they are");
+
+uint64_t
+asset_name_hash(const char *name, const size_t size) {
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    h ^= static_cast<uint8_t>(name[i]);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/****************** reading *******************/
+asset_pack::asset_pack(const string &fn) : filename(fn), file(fn),
+                                           entries(nullptr), count(0),
+                                           names(nullptr) {
+  const uint8_t *base = file.data();
+  const size_t bytes = file.size();
+  if (bytes < sizeof(pack_header))
+    throw runtime_error("not an asset pack: " + filename);
+
+  // everything the entries point at has to be inside the file
+  pack_header h;
+  memcpy(&h, base, sizeof(h));
+  const uint64_t toc_bytes = static_cast<uint64_t>(h.count)*sizeof(pack_entry);
+  if (memcmp(h.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+      h.version != PACK_VERSION || h.toc_offset % alignof(pack_entry) != 0 ||
+      h.toc_offset > bytes || toc_bytes > bytes - h.toc_offset ||
+      h.names_offset > bytes)
+    throw runtime_error("bad asset pack header in " + filename);
+  entries = reinterpret_cast<const pack_entry *>(base + h.toc_offset);
+  count = h.count;
+  names = reinterpret_cast<const char *>(base + h.names_offset);
+  const size_t names_bytes = bytes - h.names_offset;
+  for (const pack_entry &e : *this)
+    if (e.offset > bytes || e.stored_size > bytes - e.offset ||
+        e.name_offset > names_bytes || e.name_size > names_bytes - e.name_offset ||
+        e.compression > PACK_LZ4 ||
+        (e.compression == PACK_NONE && e.size != e.stored_size))
+      throw runtime_error("bad asset pack entry in " + filename);
+}
+
+string
+asset_pack::name(const pack_entry &e) const {
+  return string(names + e.name_offset, e.name_size);
+}
+
+const pack_entry *
+asset_pack::find(const string &name) const {
+  const uint64_t hash = asset_name_hash(name.data(), name.size());
+  const pack_entry *e = std::lower_bound(begin(), end(), hash,
+    [](const pack_entry &a, const uint64_t h) { return a.hash < h; });
+  for (; e != end() && e->hash == hash; ++e)
+    if (e->name_size == name.size() &&
+        memcmp(names + e->name_offset, name.data(), name.size()) == 0)
+      return e;
+  return nullptr;
+}
+
+asset_data
+asset_pack::read(const pack_entry &e) const {
+  asset_data a;
+  if (e.compression == PACK_NONE) {
+    a.data = file.data() + e.offset;
+    a.size = e.stored_size;
+    return a;
+  }
+  a.owned.resize(e.size);
+  lz4_decompress(file.data() + e.offset, e.stored_size, a.owned.data(), a.owned.size());
+  a.data = a.owned.data();
+  a.size = a.owned.size();
+  return a;
+}
+
+/****************** writing *******************/
+static void
+pad_to(ofstream &out, uint64_t &pos, const uint64_t alignment) {
+  static const char zeros[256] = {};
+  while (pos % alignment != 0) {
+    const uint64_t n = std::min<uint64_t>(alignment - pos % alignment, sizeof(zeros));
+    out.write(zeros, n);
+    pos += n;
+  }
+}
+
+void
+write_asset_pack(const string &filename, const vector<string> &files,
+                 const bool lz4, const uint32_t alignment) {
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0 ||
+      alignment < alignof(pack_entry))
+    throw runtime_error("pack alignment must be a power of two of at least 8");
+
+  ofstream out(filename, std::ios::binary);
+  if (!out)
+    throw runtime_error("cannot write " + filename);
+  pack_header h;
+  memcpy(h.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+  h.version = PACK_VERSION;
+  h.count = static_cast<uint32_t>(files.size());
+  h.alignment = alignment;
+  h.toc_offset = h.names_offset = 0;
+  out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  uint64_t pos = sizeof(h);
+
+  vector<pack_entry> toc;
+  string names;
+  for (const string &file : files) {
+    if (file.size() > 0xffff)
+      throw runtime_error("asset name too long: " + file);
+    const mapped_file data(file);
+    pack_entry e;
+    memset(&e, 0, sizeof(e));
+    e.hash = asset_name_hash(file.data(), file.size());
+    e.size = data.size();
+    e.name_offset = static_cast<uint32_t>(names.size());
+    e.name_size = static_cast<uint16_t>(file.size());
+    names += file;
+
+    vector<uint8_t> packed;
+    if (lz4 && data.size() > 0)
+      packed = lz4_compress(data.data(), data.size());
+    const bool compressed = lz4 && data.size() > 0 &&
+                            packed.size() < data.size() - data.size()/8;
+    e.compression = compressed ? PACK_LZ4 : PACK_NONE;
+
+    pad_to(out, pos, alignment);
+    e.offset = pos;
+    e.stored_size = compressed ? packed.size() : data.size();
+    out.write(reinterpret_cast<const char *>(compressed ? packed.data() : data.data()),
+              e.stored_size);
+    pos += e.stored_size;
+    toc.push_back(e);
+  }
+
+  // sorted for the binary search of find(), same hashes by name
+  std::sort(toc.begin(), toc.end(), [&](const pack_entry &a, const pack_entry &b) {
+    if (a.hash != b.hash)
+      return a.hash < b.hash;
+    return names.compare(a.name_offset, a.name_size, names, b.name_offset, b.name_size) < 0;
+  });
+  for (size_t i = 1; i < toc.size(); ++i)
+    if (toc[i].hash == toc[i - 1].hash &&
+        names.compare(toc[i].name_offset, toc[i].name_size, names,
+                      toc[i - 1].name_offset, toc[i - 1].name_size) == 0)
+      throw runtime_error("asset packed twice: " +
+                          names.substr(toc[i].name_offset, toc[i].name_size));
+
+  pad_to(out, pos, alignof(pack_entry));
+  h.toc_offset = pos;
+  out.write(reinterpret_cast<const char *>(toc.data()), toc.size()*sizeof(pack_entry));
+  pos += toc.size()*sizeof(pack_entry);
+  h.names_offset = pos;
+  out.write(names.data(), names.size());
+
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  if (!out)
+    throw runtime_error("failed writing " + filename);
+}
+
+/****************** mounted packs *******************/
+static vector<unique_ptr<asset_pack>> &
+mounted_packs() {
+  static vector<unique_ptr<asset_pack>> packs;
+  return packs;
+}
+
+void
+mount_asset_pack(const string &filename) {
+  mounted_packs().emplace_back(new asset_pack(filename));
+}
+
+asset_data
+load_asset(const string &name) {
+  const vector<unique_ptr<asset_pack>> &packs = mounted_packs();
+  for (auto p = packs.rbegin(); p != packs.rend(); ++p)
+    if (const pack_entry *e = (*p)->find(name))
+      return (*p)->read(*e);
+
+  asset_data a;
+  a.file = std::make_shared<const mapped_file>(name);
+  a.data = a.file->data();
+  a.size = a.file->size();
+  return a;
+}
+
+bool
+asset_is_packed(const string &name) {
+  for (const unique_ptr<asset_pack> &p : mounted_packs())
+    if (p->find(name) != nullptr)
+      return true;
+  return false;
+}
@@ -0,0 +1,93 @@
+#ifndef ASSET_PACK_HPP
+#define ASSET_PACK_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+// Bytes of an asset: pointing into a mapped pack or a loose file it
+// keeps open, or owned when they had to be decompressed. Moves keep
+// data valid, copies are not allowed.
+struct asset_data {
+  const uint8_t *data;
+  size_t size;
+  std::vector<uint8_t> owned;
+  std::shared_ptr<const mapped_file> file;
+
+  asset_data() : data(nullptr), size(0) {}
+  asset_data(asset_data &&) = default;
+  asset_data &operator=(asset_data &&) = default;
+  asset_data(const asset_data &) = delete;
+  asset_data &operator=(const asset_data &) = delete;
+};
+
+enum pack_compression : uint8_t {
+  PACK_NONE = 0,
+  PACK_LZ4 = 1
+};
+
+// Pack layout, little endian: header, the data of every entry at a
+// multiple of the alignment, the entries sorted by name hash, the names.
+struct pack_header {
+  char magic[4];         // "APAK"
+  uint32_t version;
+  uint32_t count;        // entries
+  uint32_t alignment;
+  uint64_t toc_offset;   // entries
+  uint64_t names_offset;
+};
+
+struct pack_entry {
+  uint64_t hash;         // asset_name_hash of the name
+  uint64_t offset;       // of the data
+  uint64_t stored_size;  // in the pack
+  uint64_t size;         // decompressed
+  uint32_t name_offset;  // into the names
+  uint16_t name_size;
+  uint8_t compression;   // pack_compression
+  uint8_t pad;
+};
+
+// FNV-1a, 64 bits
+uint64_t asset_name_hash(const char *name, const size_t size);
+
+// A pack mapped read-only. Uncompressed entries are handed out as
+// pointers into the mapping, which lives as long as the pack.
+class asset_pack {
+public:
+  explicit asset_pack(const std::string &filename);
+
+  // NULL when the pack has no asset of that name
+  const pack_entry *find(const std::string &name) const;
+  asset_data read(const pack_entry &e) const;
+  std::string name(const pack_entry &e) const;
+
+  const pack_entry *begin() const { return entries; }
+  const pack_entry *end() const { return entries + count; }
+
+private:
+  std::string filename;
+  mapped_file file;
+  const pack_entry *entries;
+  uint32_t count;
+  const char *names;
+};
+
+// Stores the files under their names (paths as given). With lz4, entries
+// that do not shrink by an eighth are stored as they are.
+void write_asset_pack(const std::string &filename,
+                      const std::vector<std::string> &files,
+                      const bool lz4, const uint32_t alignment = 64);
+
+// Packs searched by load_asset, the last mounted first. Mount them
+// before other threads load assets.
+void mount_asset_pack(const std::string &filename);
+
+// from the mounted packs, else the file of that name
+asset_data load_asset(const std::string &name);
+bool asset_is_packed(const std::string &name);
+
+#endif
@@ -0,0 +1,304 @@
+#include "atlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using std::runtime_error;
+
+static const char ATLAS_MAGIC[4] = {'A', 'T', 'L', 'S'};
+static const uint32_t ATLAS_VERSION = 1;
+static const int MIN_PAGE_SIZE = 256;
+
+/****************** skyline *******************/
+skyline_packer::skyline_packer(const int width, const int height) :
+  atlas_w(width), atlas_h(height) {
+  node n;
+  n.x = 0;
+  n.y = 0;
+  n.width = width;
+  skyline.push_back(n);
+}
+
+int
+skyline_packer::fit(const size_t i, const int w, const int h) const {
+  const int x = skyline[i].x;
+  if (x + w > atlas_w)
+    return -1;
+
+  // rests on the highest segment under its width
+  int y = 0;
+  int left = w;
+  for (size_t j = i; left > 0; ++j) {
+    y = std::max(y, skyline[j].y);
+    if (y + h > atlas_h)
+      return -1;
+    left -= skyline[j].width;
+  }
+  return y;
+}
+
+bool
+skyline_packer::insert(const int w, const int h, int &x, int &y) {
+  size_t best = skyline.size();
+  int best_top = atlas_h + 1;
+  int best_width = atlas_w + 1;
+  for (size_t i = 0; i < skyline.size(); ++i) {
+    const int fy = fit(i, w, h);
+    if (fy < 0)
+      continue;
+    if (fy + h < best_top ||
+        (fy + h == best_top && skyline[i].width < best_width)) {
+      best = i;
+      best_top = fy + h;
+      best_width = skyline[i].width;
+      y = fy;
+    }
+  }
+  if (best == skyline.size())
+    return false;
+  x = skyline[best].x;
+
+  // the new segment covers the rectangle's top, shortening or removing
+  // the segments it lies over
+  node n;
+  n.x = x;
+  n.y = y + h;
+  n.width = w;
+  skyline.insert(skyline.begin() + best, n);
+  for (size_t i = best + 1; i < skyline.size(); ) {
+    const int shrink = skyline[i - 1].x + skyline[i - 1].width - skyline[i].x;
+    if (shrink <= 0)
+      break;
+    skyline[i].x += shrink;
+    skyline[i].width -= shrink;
+    if (skyline[i].width > 0)
+      break;
+    skyline.erase(skyline.begin() + i);
+  }
+
+  // neighbours at the same height become one segment
+  for (size_t i = 0; i + 1 < skyline.size(); ) {
+    if (skyline[i].y == skyline[i + 1].y) {
+      skyline[i].width += skyline[i + 1].width;
+      skyline.erase(skyline.begin() + i + 1);
+    }
+    else ++i;
+  }
+  return true;
+}
+
+/****************** packing *******************/
+static int
+round_up(const int v, const int multiple) {
+  return (v + multiple - 1)/multiple*multiple;
+}
+
+// copies the image into the page and repeats its border pixels over the
+// gutter, so filtering and mips near the edge see the image's own colors
+static void
+blit_with_gutter(rgba_image &page, const rgba_image &img, const int x,
+                 const int y, const int gutter) {
+  for (int py = -gutter; py < img.h + gutter; ++py) {
+    const int sy = std::min(std::max(py, 0), img.h - 1);
+    uint8_t *dst = &page.pixels[4*(static_cast<size_t>(y + py)*page.w + x)];
+    const uint8_t *src = &img.pixels[4*static_cast<size_t>(sy)*img.w];
+    for (int px = -gutter; px < 0; ++px)
+      memcpy(dst + 4*px, src, 4);
+    memcpy(dst, src, 4*static_cast<size_t>(img.w));
+    for (int px = img.w; px < img.w + gutter; ++px)
+      memcpy(dst + 4*px, src + 4*(img.w - 1), 4);
+  }
+}
+
+// places as many of `order` as fit into a w x h page; returns the
+// indices that did not fit, their xs set to -1
+static vector<size_t>
+place(const vector<atlas_image> &images, const vector<size_t> &order,
+      const int page_w, const int page_h, const atlas_options &opts,
+      vector<int> &xs, vector<int> &ys) {
+  skyline_packer packer(page_w, page_h);
+  vector<size_t> rest;
+  for (const size_t i : order) {
+    const rgba_image &img = images[i].image;
+    const int border = opts.gutter + opts.padding;
+    const int w = round_up(img.w + 2*border, opts.align);
+    const int h = round_up(img.h + 2*border, opts.align);
+    int x = 0, y = 0;
+    if (packer.insert(w, h, x, y)) {
+      xs[i] = x + border;
+      ys[i] = y + border;
+    }
+    else {
+      xs[i] = -1;
+      rest.push_back(i);
+    }
+  }
+  return rest;
+}
+
+texture_atlas
+pack_atlas(const vector<atlas_image> &images, const atlas_options &opts) {
+  if (opts.align < 1 || (opts.align & (opts.align - 1)) != 0)
+    throw runtime_error("atlas alignment must be a power of two");
+
+  // big images first, small ones fill the gaps they leave
+  vector<size_t> order;
+  for (size_t i = 0; i < images.size(); ++i) {
+    const rgba_image &img = images[i].image;
+    if (img.w <= 0 || img.h <= 0 ||
+        img.pixels.size() != 4*static_cast<size_t>(img.w)*img.h)
+      throw runtime_error("bad atlas image: " + images[i].name);
+    const int border = 2*(opts.gutter + opts.padding);
+    if (img.w + border > opts.max_size || img.h + border > opts.max_size)
+      throw runtime_error("image larger than an atlas page: " + images[i].name);
+    order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&images](size_t a, size_t b) {
+    const rgba_image &ia = images[a].image, &ib = images[b].image;
+    return std::max(ia.w, ia.h) > std::max(ib.w, ib.h);
+  });
+
+  texture_atlas atlas;
+  atlas.regions.resize(images.size());
+  vector<int> xs(images.size()), ys(images.size());
+  while (!order.empty()) {
+    // smallest page that takes everything left, growing width and
+    // height in turn, else a full page and the rest spills over to the
+    // next one
+    int w = std::min(MIN_PAGE_SIZE, opts.max_size), h = w;
+    vector<size_t> rest = place(images, order, w, h, opts, xs, ys);
+    while (!rest.empty() && h < opts.max_size) {
+      if (w <= h && w < opts.max_size)
+        w = std::min(2*w, opts.max_size);
+      else h = std::min(2*h, opts.max_size);
+      rest = place(images, order, w, h, opts, xs, ys);
+    }
+
+    rgba_image page;
+    page.w = w;
+    page.h = h;
+    page.pixels.assign(4*static_cast<size_t>(w)*h, 0);
+    const uint32_t page_index = static_cast<uint32_t>(atlas.pages.size());
+    for (const size_t i : order) {
+      if (xs[i] < 0)
+        continue;  // next page
+      const rgba_image &img = images[i].image;
+      blit_with_gutter(page, img, xs[i], ys[i], opts.gutter);
+
+      atlas_region &r = atlas.regions[i];
+      r.name = images[i].name;
+      r.page = page_index;
+      r.x = xs[i];
+      r.y = ys[i];
+      r.w = img.w;
+      r.h = img.h;
+      r.uv_rect = glm::vec4(static_cast<float>(r.x)/w,
+                            static_cast<float>(r.y)/h,
+                            static_cast<float>(r.w)/w,
+                            static_cast<float>(r.h)/h);
+    }
+    atlas.pages.push_back(page);
+    if (rest.size() == order.size())
+      throw runtime_error("atlas packing made no progress");
+    order = rest;
+  }
+  return atlas;
+}
+
+const atlas_region &
+texture_atlas::region(const string &name) const {
+  for (const atlas_region &r : regions)
+    if (r.name == name)
+      return r;
+  throw runtime_error("no atlas region named " + name);
+}
+
+/****************** files *******************/
+template<typename T> static void
+put(ofstream &out, const T &v) {
+  out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template<typename T> static T
+get(ifstream &in) {
+  T v;
+  if (!in.read(reinterpret_cast<char *>(&v), sizeof(T)))
+    throw runtime_error("truncated atlas file");
+  return v;
+}
+
+void
+write_atlas(const string &filename, const texture_atlas &atlas) {
+  ofstream out(filename, std::ios::binary);
+  if (!out)
+    throw runtime_error("cannot write atlas " + filename);
+  out.write(ATLAS_MAGIC, sizeof(ATLAS_MAGIC));
+  put<uint32_t>(out, ATLAS_VERSION);
+  put<uint32_t>(out, atlas.pages.size());
+  put<uint32_t>(out, atlas.regions.size());
+  for (const rgba_image &p : atlas.pages) {
+    put<int32_t>(out, p.w);
+    put<int32_t>(out, p.h);
+    out.write(reinterpret_cast<const char *>(p.pixels.data()), p.pixels.size());
+  }
+  for (const atlas_region &r : atlas.regions) {
+    put<uint32_t>(out, r.name.size());
+    out.write(r.name.data(), r.name.size());
+    put<uint32_t>(out, r.page);
+    put<int32_t>(out, r.x);
+    put<int32_t>(out, r.y);
+    put<int32_t>(out, r.w);
+    put<int32_t>(out, r.h);
+  }
+  if (!out)
+    throw runtime_error("failed writing atlas " + filename);
+}
+
+texture_atlas
+read_atlas(const string &filename) {
+  ifstream in(filename, std::ios::binary);
+  if (!in)
+    throw runtime_error("cannot open atlas " + filename);
+  char magic[4];
+  if (!in.read(magic, sizeof(magic)) || memcmp(magic, ATLAS_MAGIC, 4) != 0)
+    throw runtime_error("not an atlas file: " + filename);
+  if (get<uint32_t>(in) != ATLAS_VERSION)
+    throw runtime_error("unsupported atlas version: " + filename);
+
+  texture_atlas atlas;
+  atlas.pages.resize(get<uint32_t>(in));
+  atlas.regions.resize(get<uint32_t>(in));
+  for (rgba_image &p : atlas.pages) {
+    p.w = get<int32_t>(in);
+    p.h = get<int32_t>(in);
+    if (p.w <= 0 || p.h <= 0 || p.w > (1 << 15) || p.h > (1 << 15))
+      throw runtime_error("bad atlas page size in " + filename);
+    p.pixels.resize(4*static_cast<size_t>(p.w)*p.h);
+    if (!in.read(reinterpret_cast<char *>(p.pixels.data()), p.pixels.size()))
+      throw runtime_error("truncated atlas file: " + filename);
+  }
+  for (atlas_region &r : atlas.regions) {
+    r.name.resize(get<uint32_t>(in));
+    if (!in.read(&r.name[0], r.name.size()))
+      throw runtime_error("truncated atlas file: " + filename);
+    r.page = get<uint32_t>(in);
+    r.x = get<int32_t>(in);
+    r.y = get<int32_t>(in);
+    r.w = get<int32_t>(in);
+    r.h = get<int32_t>(in);
+    if (r.page >= atlas.pages.size())
+      throw runtime_error("bad atlas region " + r.name + " in " + filename);
+    const rgba_image &p = atlas.pages[r.page];
+    r.uv_rect = glm::vec4(static_cast<float>(r.x)/p.w,
+                          static_cast<float>(r.y)/p.h,
+                          static_cast<float>(r.w)/p.w,
+                          static_cast<float>(r.h)/p.h);
+  }
+  return atlas;
+}
@@ -0,0 +1,89 @@
+#ifndef ATLAS_HPP
+#define ATLAS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "texture.hpp"
+
+// Bottom-left skyline rectangle packer. The skyline is the top edge of
+// everything placed so far, one segment per node; a rectangle goes where
+// its top ends lowest, ties broken by the narrower segment.
+class skyline_packer {
+public:
+  skyline_packer(const int width, const int height);
+
+  // false if w x h no longer fits anywhere
+  bool insert(const int w, const int h, int &x, int &y);
+
+  int width() const { return atlas_w; }
+  int height() const { return atlas_h; }
+
+private:
+  struct node {
+    int x;
+    int y;
+    int width;
+  };
+
+  int atlas_w;
+  int atlas_h;
+  std::vector<node> skyline;
+
+  // y of a w x h rectangle with its left edge on skyline[i], or -1
+  int fit(const size_t i, const int w, const int h) const;
+};
+
+struct atlas_options {
+  int max_size;  // atlas pages are powers of two up to this per side
+  int padding;   // empty pixels between gutters
+  int gutter;    // image edges are repeated this far out on every side
+  int align;     // placements start and end on multiples of this, so the
+                 // first log2(align) mip levels never mix two images
+
+  atlas_options() : max_size(4096), padding(0), gutter(4), align(4) {}
+};
+
+// where one image ended up; uv_rect is (offset, scale) in the page's
+// texture coordinates and covers the image's own pixels only
+struct atlas_region {
+  std::string name;
+  uint32_t page;
+  int x, y, w, h;
+  glm::vec4 uv_rect;
+
+  // maps a texture coordinate of the image to the atlas page
+  glm::vec2 remap(const glm::vec2 &uv) const {
+    return glm::vec2(uv_rect.x + uv.x*uv_rect.z, uv_rect.y + uv.y*uv_rect.w);
+  }
+};
+
+struct atlas_image {
+  std::string name;
+  rgba_image image;
+};
+
+// One or more RGBA pages and the regions packed into them. Built at
+// runtime with pack_atlas() or offline by atlas_pack into a .atlas file.
+struct texture_atlas {
+  std::vector<rgba_image> pages;
+  std::vector<atlas_region> regions;
+
+  // throws if no image had that name
+  const atlas_region &region(const std::string &name) const;
+};
+
+texture_atlas
+pack_atlas(const std::vector<atlas_image> &images,
+           const atlas_options &opts = atlas_options());
+
+// .atlas files: "ATLS", version, pages (w, h, raw RGBA), regions
+void
+write_atlas(const std::string &filename, const texture_atlas &atlas);
+texture_atlas
+read_atlas(const std::string &filename);
+
+#endif
@@ -0,0 +1,70 @@
+// Offline atlas packer: packs images into .atlas pages that load without
+// decoding or packing at runtime (read_atlas in atlas.hpp).
+//
+//   src/atlas_pack [--max-size 4096] [--padding 0] [--gutter 4]
+//                  [--align 4] out.atlas image...
+//
+// Regions are named after the image paths as given.
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "atlas.hpp"
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+using std::runtime_error;
+using std::stoi;
+
+int
+main(int argc, const char **argv) {
+  try {
+    atlas_options opts;
+    string out_file;
+    vector<atlas_image> images;
+    for (int i = 1; i < argc; ++i) {
+      const string arg = argv[i];
+      const bool has_value = (i + 1 < argc);
+      if (arg == "--max-size" && has_value)
+        opts.max_size = stoi(argv[++i]);
+      else if (arg == "--padding" && has_value)
+        opts.padding = stoi(argv[++i]);
+      else if (arg == "--gutter" && has_value)
+        opts.gutter = stoi(argv[++i]);
+      else if (arg == "--align" && has_value)
+        opts.align = stoi(argv[++i]);
+      else if (arg.compare(0, 2, "--") == 0)
+        throw runtime_error("unknown argument: " + arg);
+      else if (out_file.empty())
+        out_file = arg;
+      else {
+        atlas_image img;
+        img.name = arg;
+        img.image = load_rgba_image(arg);
+        images.push_back(img);
+      }
+    }
+    if (out_file.empty() || images.empty())
+      throw runtime_error("usage: atlas_pack [options] out.atlas image...");
+
+    const texture_atlas atlas = pack_atlas(images, opts);
+    write_atlas(out_file, atlas);
+
+    size_t used = 0, total = 0;
+    for (const atlas_region &r : atlas.regions)
+      used += static_cast<size_t>(r.w)*r.h;
+    for (const rgba_image &p : atlas.pages)
+      total += static_cast<size_t>(p.w)*p.h;
+    cerr << images.size() << " images in " << atlas.pages.size()
+         << " page(s), " << 100*used/total << "% covered" << endl;
+  }
+  catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
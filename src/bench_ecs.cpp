@@ -0,0 +1,129 @@
+// Times transform + velocity updates over one million entities, serial
+// and spread over the job system, against a plain array-of-structs
+// baseline holding the same data.
+//
+//   make bench_ecs && ./bench_ecs [num_entities] [iterations]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "ecs.hpp"
+#include "components.hpp"
+#include "fixed_timestep.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::stoul;
+
+// what an object would look like without an entity model
+struct fat_object {
+  transform t;
+  prev_transform pt;
+  velocity v;
+  renderable r;
+  bool has_velocity;
+};
+
+template<typename F>
+static double
+best_of(const size_t iterations, F &&fn) {
+  double best = 1e30;
+  for (size_t i = 0; i < iterations; ++i) {
+    const double start = clock_seconds();
+    fn();
+    best = std::min(best, clock_seconds() - start);
+  }
+  return best;
+}
+
+static void
+report(const char *name, const double secs, const size_t n) {
+  cout << name << ": " << secs*1e3 << " ms ("
+       << secs*1e9/n << " ns/entity)" << endl;
+}
+
+int
+main(int argc, const char **argv) {
+  size_t n = 1000000;
+  size_t iterations = 10;
+  try {
+    if (argc > 1)
+      n = stoul(argv[1]);
+    if (argc > 2)
+      iterations = stoul(argv[2]);
+  }
+  catch (const std::exception &) {
+    cerr << "usage: bench_ecs [num_entities] [iterations]" << endl;
+    return EXIT_FAILURE;
+  }
+  const float h = 1.f/60.f;
+
+  job_system jobs;
+  world w;
+
+  // a quarter of the entities is static and lives in another archetype
+  double start = clock_seconds();
+  for (size_t i = 0; i < n; ++i) {
+    transform t;
+    t.pos = glm::vec3(static_cast<float>(i % 1000), static_cast<float>(i/1000), 0.f);
+    t.angle = 0.f;
+    prev_transform pt;
+    pt.pos = t.pos;
+    pt.angle = 0.f;
+    renderable r;
+    r.mesh = 0;
+    r.material = 0;
+    r.uv_rect = glm::vec4(0.f, 0.f, 1.f, 1.f);
+    if (i % 4 == 0) {
+      w.create(t, pt, r);
+      continue;
+    }
+    velocity v;
+    v.linear = glm::vec3(1.f, 0.5f, 0.f);
+    v.angular = 0.1f;
+    w.create(t, pt, v, r);
+  }
+  report("create", clock_seconds() - start, n);
+
+  vector<fat_object> objects(n);
+  for (size_t i = 0; i < n; ++i) {
+    objects[i].t.pos = glm::vec3(static_cast<float>(i % 1000), static_cast<float>(i/1000), 0.f);
+    objects[i].t.angle = 0.f;
+    objects[i].v.linear = glm::vec3(1.f, 0.5f, 0.f);
+    objects[i].v.angular = 0.1f;
+    objects[i].has_velocity = (i % 4 != 0);
+  }
+
+  const auto integrate = [h](const size_t count, const entity *,
+                             transform *t, velocity *v) {
+    for (size_t i = 0; i < count; ++i) {
+      t[i].pos += v[i].linear*h;
+      t[i].angle += v[i].angular*h;
+    }
+  };
+
+  report("aos update", best_of(iterations, [&] {
+    for (fat_object &o : objects) {
+      if (!o.has_velocity) continue;
+      o.t.pos += o.v.linear*h;
+      o.t.angle += o.v.angular*h;
+    }
+  }), n);
+
+  report("ecs update", best_of(iterations, [&] {
+    w.each_chunk<transform, velocity>(integrate);
+  }), n);
+
+  report("ecs parallel update", best_of(iterations, [&] {
+    w.par_each_chunk<transform, velocity>(jobs, integrate);
+  }), n);
+
+  cout << "entities: " << w.size() << ", threads: " << jobs.concurrency()
+       << ", chunk bytes: " << CHUNK_BYTES << endl;
+  return EXIT_SUCCESS;
+}
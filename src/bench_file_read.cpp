@@ -0,0 +1,115 @@
+// Times whole file reads the way shaders used to be read (ifstream into
+// an ostringstream, str() copies and a strcpy into a malloc'd buffer)
+// against mapped_file, over files from shader size to texture size.
+// Both touch every byte, so mapping pays for its page faults. Files
+// are in the page cache after the first pass: this is the warm start.
+//
+//   make bench_file_read && ./bench_file_read [dir] [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "fixed_timestep.hpp"
+#include "mapped_file.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using std::ostringstream;
+using std::stoul;
+
+// the old read_file_to_string, without its 64 KiB limit
+static size_t
+read_streamed(const string &fn) {
+  ostringstream oss;
+  ifstream in(fn);
+  oss << in.rdbuf();
+  char *str = static_cast<char *>(malloc(oss.str().size() + 1));
+  strcpy(str, oss.str().c_str());
+
+  size_t sum = 0;
+  for (size_t i = 0, n = oss.str().size(); i < n; ++i)
+    sum += static_cast<unsigned char>(str[i]);
+  free(str);
+  return sum;
+}
+
+static size_t
+read_mapped(const string &fn) {
+  const mapped_file f(fn);
+  size_t sum = 0;
+  for (size_t i = 0; i < f.size(); ++i)
+    sum += f.data()[i];
+  return sum;
+}
+
+template<typename F>
+static double
+best_of(const size_t iterations, F &&fn) {
+  double best = 1e30;
+  for (size_t i = 0; i < iterations; ++i) {
+    const double start = clock_seconds();
+    fn();
+    best = std::min(best, clock_seconds() - start);
+  }
+  return best;
+}
+
+int
+main(int argc, const char **argv) {
+  const string dir = (argc > 1) ? argv[1] : "/tmp";
+  size_t iterations = 20;
+  try {
+    if (argc > 2)
+      iterations = stoul(argv[2]);
+  }
+  catch (const std::exception &) {
+    cerr << "usage: bench_file_read [dir] [iterations]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  // text, so that strcpy sees the whole file
+  const size_t sizes[] = {1 << 10, 16 << 10, 256 << 10, 4 << 20, 64 << 20};
+  for (const size_t size : sizes) {
+    const string fn = dir + "/bench_file_read." + std::to_string(size);
+    {
+      ofstream out(fn, std::ios::binary);
+      string text(size, ' ');
+      for (size_t i = 0; i < size; ++i)
+        text[i] = "void main() {}\n"[i % 15];
+      out << text;
+    }
+    // many small files per timing, like a scene's shaders
+    const size_t reps = std::max<size_t>(1, (1 << 20)/size);
+
+    size_t a = 0, b = 0;
+    const double streamed = best_of(iterations, [&]() {
+      for (size_t r = 0; r < reps; ++r)
+        a += read_streamed(fn);
+    });
+    const double mapped = best_of(iterations, [&]() {
+      for (size_t r = 0; r < reps; ++r)
+        b += read_mapped(fn);
+    });
+    if (a != b)
+      cout << "mismatch!" << endl;
+
+    const mapped_file probe(fn);
+    cout << size/1024 << " KiB (" << (probe.mapped() ? "mapped" : "read")
+         << "): streamed " << streamed*1e6/reps << " us, mapped_file "
+         << mapped*1e6/reps << " us, " << streamed/mapped << "x" << endl;
+    remove(fn.c_str());
+  }
+  return 0;
+}
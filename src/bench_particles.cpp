@@ -0,0 +1,111 @@
+// Times updating a million live particles, emitting as fast as they
+// die once the first burst has turned over, with each kernel on the calling thread and the best one on the
+// job system's workers, and checks the kernels agree on the instances.
+//
+//   make bench_particles && ./bench_particles [num_particles] [frames]
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fixed_timestep.hpp"
+#include "job_system.hpp"
+#include "particles.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::stoul;
+
+static const float DT = 1.f/60.f;
+static const float LIFETIME = 2.f;
+static const float JITTER = 0.5f;
+// untimed frames until every particle of the burst has died, so the
+// timed ones remove and spawn about n*DT/LIFETIME particles each
+static const size_t TURNOVER_FRAMES =
+  static_cast<size_t>(LIFETIME*(1.f + JITTER)/DT) + 1;
+
+// a fountain holding about n particles once it is going
+static void
+fill(particle_system &ps, const size_t n) {
+  particle_emitter e;
+  e.radius = 0.05f;
+  e.velocity = glm::vec2(0.f, 1.5f);
+  e.spread = 0.6f;
+  e.rate = n/LIFETIME;
+  e.lifetime = LIFETIME;
+  e.lifetime_jitter = JITTER;
+  e.start_size = 0.02f;
+  e.end_size = 0.005f;
+  e.start_color = 0xff40c0ffu;
+  e.end_color = 0x002040ffu;
+  ps.forces.gravity = glm::vec2(0.f, -1.f);
+  ps.forces.drag = 0.3f;
+  ps.burst(ps.add_emitter(e), n);
+}
+
+static double
+run(const particle_simd simd, const size_t n, const size_t frames,
+    job_system *jobs, particle_list &out) {
+  particle_system ps(n, simd);
+  fill(ps, n);
+  for (size_t f = 0; f < TURNOVER_FRAMES; ++f)
+    ps.update(DT, out, jobs);
+  double best = 1e30;
+  size_t live = 0;
+  for (size_t f = 0; f < frames; ++f) {
+    const double start = clock_seconds();
+    ps.update(DT, out, jobs);
+    best = std::min(best, clock_seconds() - start);
+    live += ps.size();
+  }
+  cout << particle_simd_name(simd) << (jobs ? " + workers" : "") << ": "
+       << best*1e3 << " ms (" << best*1e9/n << " ns/particle, "
+       << live/frames << " live)" << endl;
+  return best;
+}
+
+static bool
+same(const particle_list &a, const particle_list &b) {
+  return a.count == b.count &&
+    memcmp(a.x.data(), b.x.data(), a.count*sizeof(float)) == 0 &&
+    memcmp(a.y.data(), b.y.data(), a.count*sizeof(float)) == 0 &&
+    memcmp(a.size.data(), b.size.data(), a.count*sizeof(float)) == 0 &&
+    memcmp(a.color.data(), b.color.data(), a.count*sizeof(uint32_t)) == 0;
+}
+
+int
+main(int argc, const char **argv) {
+  size_t n = 1000000;
+  size_t frames = 60;
+  try {
+    if (argc > 1)
+      n = stoul(argv[1]);
+    if (argc > 2)
+      frames = stoul(argv[2]);
+  }
+  catch (const std::exception &) {
+    cerr << "usage: bench_particles [num_particles] [frames]" << endl;
+    return EXIT_FAILURE;
+  }
+  job_system jobs;
+  cout << n << " particles, " << jobs.concurrency() << " threads" << endl;
+
+  // same seed and steps, so every kernel should write the same list
+  vector<particle_list> lists(3);
+  const particle_simd levels[] = {PARTICLE_SIMD_SCALAR, PARTICLE_SIMD_SSE2,
+                                  PARTICLE_SIMD_AVX2};
+  for (int i = 0; i < 3; ++i)
+    run(levels[i], n, frames, nullptr, lists[i]);
+  particle_list threaded;
+  run(PARTICLE_SIMD_AUTO, n, frames, &jobs, threaded);
+
+  const bool agree = same(lists[0], lists[1]) && same(lists[0], lists[2]) &&
+                     same(lists[0], threaded);
+  cout << "kernels " << (agree ? "agree" : "DIFFER") << endl;
+  return agree ? 0 : 1;
+}
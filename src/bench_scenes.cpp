@@ -0,0 +1,624 @@
+// Scenario benchmarks: builds stress scenes with the game's own systems,
+// renders them offscreen (hidden window, meant for Mesa's software
+// rasterizer with LIBGL_ALWAYS_SOFTWARE=1), writes the frame times as
+// JSON and compares them with a baseline written by an earlier run.
+//
+// Run from the repository root so shaders and textures are found:
+//   src/bench_scenes [--scenario NAME]... [--frames 300] [--warmup 30]
+//                    [--out results.json] [--baseline baseline.json]
+//                    [--tolerance 0.10]
+// Exits with 1 when a scenario is slower than the baseline by more than
+// the tolerance.
+#include "glad.h"
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "atlas.hpp"
+#include "components.hpp"
+#include "fixed_timestep.hpp"
+#include "game_state.hpp"
+#include "gl_stats.hpp"
+#include "job_system.hpp"
+#include "renderer.hpp"
+#include "replay.hpp"
+#include "sprite_batch.hpp"
+
+using std::string;
+using std::vector;
+using std::map;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::ifstream;
+using std::ofstream;
+using std::ostream;
+using std::ostringstream;
+using std::runtime_error;
+
+static const int BENCH_WIDTH = 1024;
+static const int BENCH_HEIGHT = 768;
+static const double BENCH_DT = 1.0/60.0;
+static const float VIEW_HALF_W = 1.3f;   // visible area at z = 0
+static const float VIEW_HALF_H = 1.0f;
+
+/****************** scene helpers *******************/
+static uint32_t
+xorshift(uint32_t &s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+static float
+uniform(uint32_t &s, const float lo, const float hi) {
+  return lo + (hi - lo)*(xorshift(s) & 0xffffff)/16777216.f;
+}
+
+// tiled RGBA pattern
+static rgba_image
+make_texture(const int size, uint32_t seed) {
+  rgba_image img;
+  img.w = size;
+  img.h = size;
+  img.pixels.resize(4*static_cast<size_t>(size)*size);
+  const int tile = std::max(size/16, 1);
+  for (int y = 0; y < size; ++y)
+    for (int x = 0; x < size; ++x) {
+      uint32_t s = seed ^ ((x/tile)*73856093u) ^ ((y/tile)*19349663u);
+      s = s ? s : 1;
+      const uint32_t c = xorshift(s) | 0xff000000u;
+      memcpy(&img.pixels[4*(static_cast<size_t>(y)*size + x)], &c, 4);
+    }
+  return img;
+}
+
+// a square at pos; moving ones get a velocity so the simulation steps them
+static void
+spawn(game_state &state, const glm::vec3 &pos, const float scale,
+      const glm::vec3 &linear, const float spin, const uint32_t material,
+      const glm::vec4 &uv_rect = glm::vec4(0.f, 0.f, 1.f, 1.f)) {
+  transform t;
+  t.pos = pos;
+  t.angle = 0.f;
+  prev_transform pt;
+  pt.pos = pos;
+  pt.angle = 0.f;
+  renderable r;
+  r.mesh = MESH_SQUARE;
+  r.material = material;
+  r.uv_rect = uv_rect;
+  scene_node sn;
+  sn.node = state.scene.create();
+  state.scene.set_scale(sn.node, glm::vec3(scale));
+
+  if (linear == glm::vec3(0.f) && spin == 0.f) {
+    state.entities.create(t, pt, r, sn);
+    return;
+  }
+  velocity v;
+  v.linear = linear;
+  v.angular = spin;
+  state.entities.create(t, pt, v, r, sn);
+}
+
+/****************** scenarios *******************/
+struct scenario {
+  const char *name;
+  // builds the scene, textures go into the renderer's pools
+  void (*setup)(game_state &, renderer &);
+  // extra system run after every simulation tick, may be NULL
+  void (*update)(game_state &);
+  // adds the frame's sprites, may be NULL
+  void (*sprites)(sprite_batch &, const uint64_t frame);
+};
+
+// instance bound: a grid of tiny static squares in one instanced draw,
+// paying for the per-frame matrix and instance upload and vertex work
+static void
+setup_many_objects(game_state &state, renderer &) {
+  static const int COLS = 200, ROWS = 100;
+  for (int y = 0; y < ROWS; ++y)
+    for (int x = 0; x < COLS; ++x) {
+      const glm::vec3 pos(VIEW_HALF_W*(2.f*(x + 0.5f)/COLS - 1.f),
+                          VIEW_HALF_H*(2.f*(y + 0.5f)/ROWS - 1.f), 0.f);
+      spawn(state, pos, 0.01f, glm::vec3(0.f), 0.f, 0);
+    }
+}
+
+// sampling and memory bound: layers of screen sized quads over two
+// 4096^2 textures, drawn back to front so every layer is shaded
+static void
+setup_huge_textures(game_state &state, renderer &r) {
+  static const int SIZE = 4096, LAYERS = 24;
+  const texture_ref t0 = r.add_texture(make_texture(SIZE, 0x1234567u));
+  const texture_ref t1 = r.add_texture(make_texture(SIZE, 0x89abcdeu));
+  const uint32_t a = r.add_material(t0, t1);
+  const uint32_t b = r.add_material(t1, t0);
+  for (int i = 0; i < LAYERS; ++i)
+    spawn(state, glm::vec3(0.f, 0.f, 0.01f*i), 2.6f, glm::vec3(0.f),
+          (i % 2 ? 0.1f : -0.1f), i % 2 ? a : b);
+}
+
+// 256 materials over 256 textures of one size: one texture array, so
+// one batch; was a texture bind and draw per material before pooling
+static void
+setup_many_materials(game_state &state, renderer &r) {
+  static const int MATERIALS = 256, OBJECTS = 10000, SIZE = 64;
+  vector<texture_ref> textures;
+  for (int i = 0; i < MATERIALS; ++i)
+    textures.push_back(r.add_texture(make_texture(SIZE, 0x9e3779b9u*(i + 1))));
+  vector<uint32_t> materials;
+  for (int i = 0; i < MATERIALS; ++i)
+    materials.push_back(r.add_material(textures[i],
+                                       textures[(7*i + 1) % MATERIALS]));
+
+  uint32_t seed = 0x2545f491u;
+  for (int i = 0; i < OBJECTS; ++i) {
+    const glm::vec3 pos(uniform(seed, -VIEW_HALF_W, VIEW_HALF_W),
+                        uniform(seed, -VIEW_HALF_H, VIEW_HALF_H),
+                        uniform(seed, 0.f, 0.1f));
+    spawn(state, pos, 0.03f, glm::vec3(0.f), 0.f, materials[i % MATERIALS]);
+  }
+}
+
+// the many_materials scene with its images packed into an atlas at
+// runtime: one material per page, so one instanced draw per page
+static void
+setup_atlas_sprites(game_state &state, renderer &r) {
+  static const int IMAGES = 256, OBJECTS = 10000;
+  uint32_t seed = 0x2545f491u;
+  vector<atlas_image> images(IMAGES);
+  for (int i = 0; i < IMAGES; ++i) {
+    rgba_image &img = images[i].image;
+    img.w = 16 + xorshift(seed) % 49;
+    img.h = 16 + xorshift(seed) % 49;
+    img.pixels.resize(4*static_cast<size_t>(img.w)*img.h);
+    uint32_t color = 0x9e3779b9u*(i + 1);
+    for (size_t p = 0; p < img.pixels.size(); p += 4) {
+      if (p % (4*8) == 0)
+        xorshift(color);
+      img.pixels[p] = color & 0xff;
+      img.pixels[p + 1] = (color >> 8) & 0xff;
+      img.pixels[p + 2] = (color >> 16) & 0xff;
+      img.pixels[p + 3] = 0xff;
+    }
+  }
+  const texture_atlas atlas = pack_atlas(images);
+  vector<uint32_t> page_materials;
+  for (const rgba_image &page : atlas.pages) {
+    const texture_ref t = r.add_texture(page);
+    page_materials.push_back(r.add_material(t));
+  }
+
+  for (int i = 0; i < OBJECTS; ++i) {
+    const atlas_region &region = atlas.regions[i % IMAGES];
+    const glm::vec3 pos(uniform(seed, -VIEW_HALF_W, VIEW_HALF_W),
+                        uniform(seed, -VIEW_HALF_H, VIEW_HALF_H),
+                        uniform(seed, 0.f, 0.1f));
+    spawn(state, pos, 0.03f, glm::vec3(0.f), 0.f,
+          page_materials[region.page], region.uv_rect);
+  }
+}
+
+// simulation and upload bound: every matrix changes every frame
+static void
+setup_particle_storm(game_state &state, renderer &) {
+  static const int PARTICLES = 50000;
+  uint32_t seed = 0x6b43a9b5u;
+  for (int i = 0; i < PARTICLES; ++i) {
+    const glm::vec3 pos(uniform(seed, -VIEW_HALF_W, VIEW_HALF_W),
+                        uniform(seed, -VIEW_HALF_H, VIEW_HALF_H),
+                        uniform(seed, 0.f, 0.1f));
+    const glm::vec3 vel(uniform(seed, -0.5f, 0.5f),
+                        uniform(seed, -0.5f, 0.5f), 0.f);
+    spawn(state, pos, 0.008f, vel, uniform(seed, -4.f, 4.f), 0);
+  }
+}
+
+// keeps the storm on screen
+static void
+bounce_particles(game_state &state) {
+  state.entities.par_each<transform, velocity>(*state.jobs,
+    [](transform &t, velocity &v) {
+      if ((t.pos.x < -VIEW_HALF_W && v.linear.x < 0.f) ||
+          (t.pos.x > VIEW_HALF_W && v.linear.x > 0.f))
+        v.linear.x = -v.linear.x;
+      if ((t.pos.y < -VIEW_HALF_H && v.linear.y < 0.f) ||
+          (t.pos.y > VIEW_HALF_H && v.linear.y > 0.f))
+        v.linear.y = -v.linear.y;
+    });
+}
+
+// sprite batching bound: 200k small spinning sprites over 8 textures
+// in two arrays and 4 layers, sorted and streamed every frame
+static const size_t SPRITES = 200000;
+static vector<sprite> sprite_scene;
+
+static void
+setup_sprites(game_state &, renderer &r) {
+  vector<texture_ref> textures;
+  for (int i = 0; i < 8; ++i)
+    textures.push_back(r.add_texture(make_texture(i < 4 ? 32 : 64,
+                                                  0x51ed270bu*(i + 1))));
+  uint32_t seed = 0x1b873593u;
+  sprite_scene.assign(SPRITES, sprite());
+  for (sprite &s : sprite_scene) {
+    s.position = glm::vec2(uniform(seed, -VIEW_HALF_W, VIEW_HALF_W),
+                           uniform(seed, -VIEW_HALF_H, VIEW_HALF_H));
+    s.size = glm::vec2(uniform(seed, 0.004f, 0.012f));
+    s.rotation = uniform(seed, 0.f, 6.283f);
+    s.color = xorshift(seed) | 0x80000000u;
+    s.texture = textures[xorshift(seed) % textures.size()];
+    s.layer = static_cast<uint16_t>(xorshift(seed) % 4);
+  }
+}
+
+static void
+spin_sprites(sprite_batch &batch, const uint64_t) {
+  for (sprite &s : sprite_scene)
+    s.rotation += 0.02f;
+  batch.add(sprite_scene.data(), sprite_scene.size());
+}
+
+// particle update and upload bound: a million live particles in the
+// game's effects, falling from a fountain as fast as it refills them
+static const size_t CPU_PARTICLES = 1000000;
+
+static void
+setup_cpu_particles(game_state &state, renderer &) {
+  static const float LIFETIME = 2.f;
+  state.effects = particle_system(CPU_PARTICLES);
+  particle_emitter e;
+  e.position = glm::vec2(0.f, -VIEW_HALF_H);
+  e.radius = 0.05f;
+  e.velocity = glm::vec2(0.f, 1.8f);
+  e.spread = 0.7f;
+  e.rate = CPU_PARTICLES/LIFETIME;
+  e.lifetime = LIFETIME;
+  e.lifetime_jitter = 0.5f;
+  e.start_size = 0.01f;
+  e.end_size = 0.003f;
+  e.start_color = 0x8040c0ffu;
+  e.end_color = 0x002040ffu;
+  state.effects.forces.gravity = glm::vec2(0.f, -1.2f);
+  state.effects.forces.drag = 0.2f;
+  state.effects.burst(state.effects.add_emitter(e), CPU_PARTICLES);
+}
+
+// the cpu_particles fountain as GPU particles, updated by transform
+// feedback; the CPU only sends the emitter
+static const size_t GPU_PARTICLES = 1 << 20;
+
+static void
+setup_gpu_particles(game_state &state, renderer &r) {
+  static const float LIFETIME = 2.f;
+  r.gpu_effects.resize(GPU_PARTICLES);
+  particle_emitter &e = state.dust;
+  e = particle_emitter();
+  e.position = glm::vec2(0.f, -VIEW_HALF_H);
+  e.radius = 0.05f;
+  e.velocity = glm::vec2(0.f, 1.8f);
+  e.spread = 0.7f;
+  e.rate = CPU_PARTICLES/LIFETIME;
+  e.lifetime = LIFETIME;
+  e.lifetime_jitter = 0.5f;
+  e.start_size = 0.01f;
+  e.end_size = 0.003f;
+  e.start_color = 0x8040c0ffu;
+  e.end_color = 0x002040ffu;
+  state.dust_forces.gravity = glm::vec2(0.f, -1.2f);
+  state.dust_forces.drag = 0.2f;
+}
+
+// lighting bound: the many_objects grid under 500 point lights, each
+// shading only the pixels of its screen rectangle
+static void
+setup_many_lights(game_state &state, renderer &r) {
+  setup_many_objects(state, r);
+  state.ambient = glm::vec3(0.3f);
+  state.add_lights(500, glm::vec2(VIEW_HALF_W, VIEW_HALF_H), 0.25f);
+}
+
+static const scenario SCENARIOS[] = {
+  {"many_objects", setup_many_objects, NULL, NULL},
+  {"huge_textures", setup_huge_textures, NULL, NULL},
+  {"many_materials", setup_many_materials, NULL, NULL},
+  {"atlas_sprites", setup_atlas_sprites, NULL, NULL},
+  {"particle_storm", setup_particle_storm, bounce_particles, NULL},
+  {"sprites", setup_sprites, NULL, spin_sprites},
+  {"cpu_particles", setup_cpu_particles, NULL, NULL},
+  {"gpu_particles", setup_gpu_particles, NULL, NULL},
+  {"many_lights", setup_many_lights, NULL, NULL}
+};
+
+/****************** running *******************/
+struct bench_options {
+  vector<string> scenarios;  // all when empty
+  size_t frames;
+  size_t warmup;
+  string out_file;
+  string baseline_file;
+  double tolerance;          // allowed slowdown, 0.1 is 10%
+
+  bench_options() : frames(300), warmup(30), tolerance(0.10) {}
+};
+
+struct bench_result {
+  string name;
+  double setup_ms;
+  frame_time_report times;
+  gl_frame_stats gl;
+
+  bench_result() : setup_ms(0.0), times(vector<double>()) {}
+};
+
+static bench_result
+run_scenario(const scenario &sc, const bench_options &opts, job_system &jobs) {
+  bench_result res;
+  res.name = sc.name;
+
+  renderer r;
+  renderer_options ropts;
+  ropts.jobs = &jobs;
+  r.init(ropts);
+  const double setup_start = clock_seconds();
+  // no lights but the ambient one, unless the scenario adds them
+  game_state state(jobs);
+  state.lights.clear();
+  sc.setup(state, r);
+  glFinish();
+  res.setup_ms = (clock_seconds() - setup_start)*1e3;
+
+  // one tick per frame, so every run simulates exactly the same thing
+  const input_state no_input;
+  frame_packet packet;
+  sprite_batch sprites;
+  packet.fb_width = BENCH_WIDTH;
+  packet.fb_height = BENCH_HEIGHT;
+  vector<double> frame_times;
+  for (size_t frame = 0; frame < opts.warmup + opts.frames; ++frame) {
+    const double start = clock_seconds();
+    state.step(no_input, BENCH_DT);
+    if (sc.update)
+      sc.update(state);
+    packet.reset();
+    packet.frame = frame;
+    packet.uniforms.time = glm::vec4(frame*BENCH_DT, BENCH_DT, frame, 0.f);
+    state.build_frame(1.f, r.caps.reversed_z, packet);
+    if (sc.sprites) {
+      sprites.clear();
+      sc.sprites(sprites, frame);
+      sprites.build(packet.sprites, &jobs);
+      packet.sprites.transform = packet.uniforms.view_proj;
+    }
+    r.draw(packet);
+    glFinish();
+    gl_stats_frame();
+    if (frame >= opts.warmup)
+      frame_times.push_back(clock_seconds() - start);
+  }
+  res.times = frame_time_report(frame_times);
+  res.gl = gl_stats_last_frame();
+
+  r.destroy();
+  return res;
+}
+
+/****************** results *******************/
+static void
+write_results(ostream &os, const string &gl_renderer,
+              const vector<bench_result> &results) {
+  os << std::fixed << std::setprecision(3);
+  os << "{" << endl;
+  os << "  \"renderer\": \"" << gl_renderer << "\"," << endl;
+  os << "  \"scenarios\": [" << endl;
+  for (size_t i = 0; i < results.size(); ++i) {
+    const bench_result &b = results[i];
+    os << "    {\"name\": \"" << b.name << "\", "
+       << "\"frames\": " << b.times.frames << ", "
+       << "\"setup_ms\": " << b.setup_ms << ", "
+       << "\"mean_ms\": " << b.times.mean_ms << ", "
+       << "\"p50_ms\": " << b.times.p50_ms << ", "
+       << "\"p95_ms\": " << b.times.p95_ms << ", "
+       << "\"p99_ms\": " << b.times.p99_ms << ", "
+       << "\"max_ms\": " << b.times.max_ms << ", "
+       << "\"draw_calls\": " << b.gl.draws << ", "
+       << "\"state_changes\": " << b.gl.state_changes << ", "
+       << "\"uploaded_bytes\": " << b.gl.upload_bytes << "}"
+       << (i + 1 < results.size() ? "," : "") << endl;
+  }
+  os << "  ]" << endl << "}" << endl;
+}
+
+// Numbers per scenario from a file written by write_results. Not a
+// general JSON reader: it relies on one scenario object per line.
+static map<string, map<string, double> >
+read_results(const string &filename) {
+  ifstream in(filename);
+  if (!in)
+    throw runtime_error("cannot open baseline " + filename);
+
+  map<string, map<string, double> > out;
+  string line;
+  while (getline(in, line)) {
+    const size_t name_at = line.find("{\"name\": \"");
+    if (name_at == string::npos)
+      continue;
+    const size_t name_begin = name_at + 10;
+    const string name = line.substr(name_begin,
+                                    line.find('"', name_begin) - name_begin);
+    map<string, double> &values = out[name];
+    for (size_t pos = line.find("\", ", name_begin); pos != string::npos; ) {
+      const size_t key_begin = line.find('"', pos + 2);
+      if (key_begin == string::npos)
+        break;
+      const size_t key_end = line.find('"', key_begin + 1);
+      const size_t colon = line.find(':', key_end);
+      values[line.substr(key_begin + 1, key_end - key_begin - 1)] =
+        strtod(line.c_str() + colon + 1, NULL);
+      pos = line.find(',', colon);
+    }
+  }
+  return out;
+}
+
+// prints current against baseline; false if anything got slower than
+// the tolerance allows
+static bool
+compare_results(const vector<bench_result> &results,
+                const map<string, map<string, double> > &baseline,
+                const double tolerance) {
+  static const char *const METRICS[] = {"mean_ms", "p95_ms"};
+  bool ok = true;
+  cout << std::fixed << std::setprecision(3);
+  for (const bench_result &b : results) {
+    const auto it = baseline.find(b.name);
+    if (it == baseline.end()) {
+      cout << b.name << ": not in baseline" << endl;
+      continue;
+    }
+    for (const char *metric : METRICS) {
+      const auto base = it->second.find(metric);
+      if (base == it->second.end() || base->second <= 0.0)
+        continue;
+      const double now = (string(metric) == "mean_ms") ? b.times.mean_ms :
+                                                         b.times.p95_ms;
+      const double change = now/base->second - 1.0;
+      const bool slower = change > tolerance;
+      cout << std::left << std::setw(16) << b.name << std::setw(8) << metric
+           << std::right << std::setw(10) << base->second << " -> "
+           << std::setw(10) << now << std::showpos << std::setw(9)
+           << 100.0*change << "%" << std::noshowpos
+           << (slower ? "  REGRESSION" : "") << endl;
+      ok = ok && !slower;
+    }
+  }
+  return ok;
+}
+
+static bench_options
+parse_options(const int argc, const char **argv) {
+  bench_options opts;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    const bool has_value = (i + 1 < argc);
+    if (arg == "--scenario" && has_value)
+      opts.scenarios.push_back(argv[++i]);
+    else if (arg == "--frames" && has_value)
+      opts.frames = std::stoul(argv[++i]);
+    else if (arg == "--warmup" && has_value)
+      opts.warmup = std::stoul(argv[++i]);
+    else if (arg == "--out" && has_value)
+      opts.out_file = argv[++i];
+    else if (arg == "--baseline" && has_value)
+      opts.baseline_file = argv[++i];
+    else if (arg == "--tolerance" && has_value)
+      opts.tolerance = std::stod(argv[++i]);
+    else
+      throw runtime_error("unknown argument: " + arg);
+  }
+  // caught before opening a window
+  for (const string &name : opts.scenarios) {
+    bool known = false;
+    for (const scenario &sc : SCENARIOS)
+      known = known || name == sc.name;
+    if (!known)
+      throw runtime_error("unknown scenario: " + name);
+  }
+  return opts;
+}
+
+static bool
+selected(const bench_options &opts, const string &name) {
+  if (opts.scenarios.empty())
+    return true;
+  for (const string &s : opts.scenarios)
+    if (s == name)
+      return true;
+  return false;
+}
+
+int
+main(int argc, const char **argv) {
+  try {
+    const bench_options opts = parse_options(argc, argv);
+
+    if (!glfwInit())
+      throw runtime_error("Failed to initialize GLFW!");
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(BENCH_WIDTH, BENCH_HEIGHT, "bench",
+                                          NULL, NULL);
+    if (window == NULL) {
+      glfwTerminate();
+      throw runtime_error("Failed to create a window (no display?)");
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)(glfwGetProcAddress)))
+      throw runtime_error("Failed to initialize GLAD!");
+
+    const string gl_renderer =
+      reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+    cerr << "renderer: " << gl_renderer << endl;
+
+    // counts draws and uploads, read back per scenario
+    gl_stats_request(true);
+    gl_stats_frame();
+
+    job_system jobs;
+    vector<bench_result> results;
+    for (const scenario &sc : SCENARIOS) {
+      if (!selected(opts, sc.name))
+        continue;
+      results.push_back(run_scenario(sc, opts, jobs));
+      const bench_result &b = results.back();
+      cerr << std::fixed << std::setprecision(3) << b.name << ": setup "
+           << b.setup_ms << " ms, frame mean " << b.times.mean_ms << " ms, p95 "
+           << b.times.p95_ms << " ms, " << b.gl.draws << " draws" << endl;
+    }
+    gl_stats_shutdown();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    if (results.empty())
+      throw runtime_error("no scenario selected");
+
+    if (!opts.out_file.empty()) {
+      ofstream out(opts.out_file);
+      if (!out)
+        throw runtime_error("cannot write " + opts.out_file);
+      write_results(out, gl_renderer, results);
+    }
+    else write_results(cout, gl_renderer, results);
+
+    if (opts.baseline_file.empty())
+      return EXIT_SUCCESS;
+    if (!ifstream(opts.baseline_file)) {
+      cerr << "no baseline at " << opts.baseline_file
+           << ", record one with `make bench-baseline`" << endl;
+      return EXIT_SUCCESS;
+    }
+    return compare_results(results, read_results(opts.baseline_file),
+                           opts.tolerance) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+}
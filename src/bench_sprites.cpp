@@ -0,0 +1,118 @@
+// Times batching a frame of sprites, adding them and building the
+// sorted instance list, serial and with the job system's workers,
+// against a std::stable_sort of the sprites by layer and texture array
+// followed by the same packing.
+//
+//   make bench_sprites && ./bench_sprites [num_sprites] [iterations]
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fixed_timestep.hpp"
+#include "job_system.hpp"
+#include "sprite_batch.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::stoul;
+
+template<typename F>
+static double
+best_of(const size_t iterations, F &&fn) {
+  double best = 1e30;
+  for (size_t i = 0; i < iterations; ++i) {
+    const double start = clock_seconds();
+    fn();
+    best = std::min(best, clock_seconds() - start);
+  }
+  return best;
+}
+
+static void
+report(const char *name, const double secs, const size_t n) {
+  cout << name << ": " << secs*1e3 << " ms ("
+       << secs*1e9/n << " ns/sprite)" << endl;
+}
+
+int
+main(int argc, const char **argv) {
+  size_t n = 200000;
+  size_t iterations = 20;
+  try {
+    if (argc > 1)
+      n = stoul(argv[1]);
+    if (argc > 2)
+      iterations = stoul(argv[2]);
+  }
+  catch (const std::exception &) {
+    cerr << "usage: bench_sprites [num_sprites] [iterations]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  // 8 textures in 2 arrays, 4 layers, in random order
+  vector<sprite> sprites(n);
+  uint32_t seed = 0x1b873593u;
+  for (sprite &s : sprites) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    s.position = glm::vec2(static_cast<float>(seed % 1000), static_cast<float>(seed % 777));
+    s.size = glm::vec2(8.f);
+    s.rotation = 0.001f*(seed % 6283);
+    s.texture.pool = seed % 2;
+    s.texture.layer = (seed >> 8) % 4;
+    s.layer = static_cast<uint16_t>((seed >> 16) % 4);
+  }
+
+  sprite_batch batch;
+  sprite_list list;
+  report("batch, serial", best_of(iterations, [&] {
+    batch.clear();
+    batch.add(sprites.data(), sprites.size());
+    batch.build(list);
+  }), n);
+
+  job_system jobs;
+  report("batch, jobs", best_of(iterations, [&] {
+    batch.clear();
+    batch.add(sprites.data(), sprites.size());
+    batch.build(list, &jobs);
+  }), n);
+
+  // the obvious way: sort the sprites themselves, then pack them
+  vector<sprite> sorted;
+  sprite_list naive;
+  report("stable_sort", best_of(iterations, [&] {
+    sorted = sprites;
+    std::stable_sort(sorted.begin(), sorted.end(),
+      [](const sprite &a, const sprite &b) {
+        return a.layer != b.layer ? a.layer < b.layer :
+                                    a.texture.pool < b.texture.pool;
+      });
+    naive.instances.resize(sorted.size());
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      sprite_instance &inst = naive.instances[i];
+      inst.position = sorted[i].position;
+      inst.size = sorted[i].size;
+      inst.uv_rect = sorted[i].uv_rect;
+      inst.rotation = sorted[i].rotation;
+      inst.color = sorted[i].color;
+      inst.layer = sorted[i].texture.layer;
+      inst.pad = 0;
+    }
+  }), n);
+
+  // both orders must agree
+  bool same = naive.instances.size() == list.instances.size();
+  for (size_t i = 0; same && i < list.instances.size(); ++i)
+    same = list.instances[i].position == naive.instances[i].position &&
+           list.instances[i].rotation == naive.instances[i].rotation;
+  cout << list.runs.size() << " runs, " << (same ? "same order" : "ORDER DIFFERS")
+       << endl;
+  return same ? 0 : 1;
+}
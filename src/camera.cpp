@@ -0,0 +1,40 @@
+#include "camera.hpp"
+
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+camera::camera() :
+  position(0.f, 0.f, 2.5f), yaw(0.f), pitch(0.f),
+  fov_y(glm::radians(45.f)), near_plane(0.1f), far_plane(1000.f) {}
+
+glm::vec3
+camera::forward() const {
+  return glm::vec3(std::sin(yaw)*std::cos(pitch),
+                   std::sin(pitch),
+                   -std::cos(yaw)*std::cos(pitch));
+}
+
+glm::mat4
+camera::view() const {
+  return glm::lookAt(position, position + forward(), glm::vec3(0.f, 1.f, 0.f));
+}
+
+glm::mat4
+camera::projection(const float aspect, const bool reversed_z) const {
+  if (reversed_z)
+    return reversed_z_infinite_perspective(fov_y, aspect, near_plane);
+  return glm::perspective(fov_y, aspect, near_plane, far_plane);
+}
+
+glm::mat4
+reversed_z_infinite_perspective(const float fov_y, const float aspect,
+                                const float near_plane) {
+  const float f = 1.f/std::tan(0.5f*fov_y);
+  glm::mat4 m(0.f);
+  m[0][0] = f/aspect;
+  m[1][1] = f;
+  m[2][3] = -1.f;        // w = -z_view
+  m[3][2] = near_plane;  // z = near, so depth = near/-z_view
+  return m;
+}
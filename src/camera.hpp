@@ -0,0 +1,32 @@
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+#include <glm/glm.hpp>
+
+// Perspective camera described by position and yaw/pitch.
+struct camera {
+  glm::vec3 position;
+  float yaw;         // radians, 0 looks down -z
+  float pitch;       // radians, positive looks up
+  float fov_y;       // vertical field of view in radians
+  float near_plane;
+  float far_plane;   // ignored by the reversed-Z projection, which has none
+
+  camera();
+
+  glm::vec3 forward() const;
+  glm::mat4 view() const;
+
+  // reversed_z needs depth in [0, 1] clip space (glClipControl) and a
+  // GL_GREATER depth test cleared to 0
+  glm::mat4 projection(const float aspect, const bool reversed_z) const;
+};
+
+// Maps the near plane to depth 1 and infinity to depth 0. Combined with a
+// float depth buffer this spreads precision evenly over distance, since
+// the float exponent cancels the 1/z falloff of perspective depth.
+glm::mat4
+reversed_z_infinite_perspective(const float fov_y, const float aspect,
+                                const float near_plane);
+
+#endif
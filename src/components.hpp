@@ -0,0 +1,41 @@
+#ifndef COMPONENTS_HPP
+#define COMPONENTS_HPP
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// components shared by the game systems, all plain data (see ecs.hpp)
+
+struct transform {
+  glm::vec3 pos;
+  float angle;  // radians around z
+};
+
+// transform at the previous tick, for render interpolation
+struct prev_transform {
+  glm::vec3 pos;
+  float angle;
+};
+
+struct velocity {
+  glm::vec3 linear;
+  float angular;
+};
+
+struct renderable {
+  uint32_t mesh;
+  uint32_t material;
+  glm::vec4 uv_rect;  // whole texture (0, 0, 1, 1) or an atlas region
+};
+
+// node in the scene graph whose local transform follows this entity's
+// (interpolated) transform; world matrices come from the graph
+struct scene_node {
+  uint32_t node;
+};
+
+// tag: steered by the keyboard
+struct player_control {};
+
+#endif
@@ -0,0 +1,784 @@
+#include "compressed_texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "asset_pack.hpp"
+#include "job_system.hpp"
+
+using std::string;
+using std::vector;
+using std::ofstream;
+using std::runtime_error;
+using std::to_string;
+
+/****************** formats *******************/
+const char *
+block_format_name(const block_format f) {
+  switch (f) {
+    case BLOCK_BC1: return "bc1";
+    case BLOCK_BC3: return "bc3";
+    case BLOCK_BC5: return "bc5";
+    case BLOCK_BC7: return "bc7";
+  }
+  return "unknown";
+}
+
+size_t
+block_bytes(const block_format f) {
+  return f == BLOCK_BC1 ? 8 : 16;
+}
+
+GLenum
+block_gl_format(const block_format f) {
+  switch (f) {
+    case BLOCK_BC1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BLOCK_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case BLOCK_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+  }
+  return 0;
+}
+
+int
+compressed_image::level_width(const size_t level) const {
+  return std::max(w >> level, 1);
+}
+
+int
+compressed_image::level_height(const size_t level) const {
+  return std::max(h >> level, 1);
+}
+
+size_t
+compressed_size(const block_format f, const int w, const int h) {
+  return block_bytes(f)*((w + 3)/4)*static_cast<size_t>((h + 3)/4);
+}
+
+/****************** blocks *******************/
+typedef uint8_t pixel_block[16][4];
+
+// edge pixels repeat into blocks hanging over the image
+static void
+fetch_block(const rgba_image &img, const int bx, const int by,
+            pixel_block block) {
+  for (int y = 0; y < 4; ++y) {
+    const int sy = std::min(4*by + y, img.h - 1);
+    for (int x = 0; x < 4; ++x) {
+      const int sx = std::min(4*bx + x, img.w - 1);
+      memcpy(block[4*y + x], &img.pixels[4*(static_cast<size_t>(sy)*img.w + sx)], 4);
+    }
+  }
+}
+
+static void
+store_block(rgba_image &img, const int bx, const int by,
+            const pixel_block block) {
+  for (int y = 0; y < 4 && 4*by + y < img.h; ++y)
+    for (int x = 0; x < 4 && 4*bx + x < img.w; ++x)
+      memcpy(&img.pixels[4*(static_cast<size_t>(4*by + y)*img.w + 4*bx + x)],
+             block[4*y + x], 4);
+}
+
+static int
+distance2(const uint8_t *a, const uint8_t *b, const int channels) {
+  int d = 0;
+  for (int c = 0; c < channels; ++c)
+    d += (a[c] - b[c])*(a[c] - b[c]);
+  return d;
+}
+
+// end points of the line through the block's colors along their
+// principal axis, over the first `channels` channels
+static void
+fit_line(const pixel_block block, const int channels, float lo[4], float hi[4]) {
+  float mean[4] = {0.f, 0.f, 0.f, 0.f};
+  for (int p = 0; p < 16; ++p)
+    for (int c = 0; c < channels; ++c)
+      mean[c] += block[p][c]/16.f;
+
+  float cov[4][4] = {};
+  for (int p = 0; p < 16; ++p)
+    for (int i = 0; i < channels; ++i)
+      for (int j = 0; j < channels; ++j)
+        cov[i][j] += (block[p][i] - mean[i])*(block[p][j] - mean[j]);
+
+  // power iteration, starting from the column of the widest channel
+  int widest = 0;
+  for (int c = 1; c < channels; ++c)
+    if (cov[c][c] > cov[widest][widest])
+      widest = c;
+  float axis[4] = {0.f, 0.f, 0.f, 0.f};
+  for (int c = 0; c < channels; ++c)
+    axis[c] = cov[c][widest];
+  for (int iter = 0; iter < 8; ++iter) {
+    float next[4] = {0.f, 0.f, 0.f, 0.f}, scale = 0.f;
+    for (int i = 0; i < channels; ++i) {
+      for (int j = 0; j < channels; ++j)
+        next[i] += cov[i][j]*axis[j];
+      scale = std::max(scale, std::fabs(next[i]));
+    }
+    if (scale == 0.f)
+      break;
+    for (int c = 0; c < channels; ++c)
+      axis[c] = next[c]/scale;
+  }
+  float len = 0.f;
+  for (int c = 0; c < channels; ++c)
+    len += axis[c]*axis[c];
+  len = std::sqrt(len);
+
+  float tmin = 0.f, tmax = 0.f;
+  if (len > 0.f) {
+    for (int c = 0; c < channels; ++c)
+      axis[c] /= len;
+    tmin = 1e9f;
+    tmax = -1e9f;
+    for (int p = 0; p < 16; ++p) {
+      float t = 0.f;
+      for (int c = 0; c < channels; ++c)
+        t += (block[p][c] - mean[c])*axis[c];
+      tmin = std::min(tmin, t);
+      tmax = std::max(tmax, t);
+    }
+  }
+  for (int c = 0; c < 4; ++c) {
+    lo[c] = std::min(std::max(mean[c] + tmin*axis[c], 0.f), 255.f);
+    hi[c] = std::min(std::max(mean[c] + tmax*axis[c], 0.f), 255.f);
+  }
+}
+
+/****************** BC1 *******************/
+static uint16_t
+pack_565(const float c[3]) {
+  const int r = static_cast<int>(c[0]*31.f/255.f + 0.5f);
+  const int g = static_cast<int>(c[1]*63.f/255.f + 0.5f);
+  const int b = static_cast<int>(c[2]*31.f/255.f + 0.5f);
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void
+bc1_palette(const uint16_t c0, const uint16_t c1, const bool four_colors,
+            uint8_t palette[4][4]) {
+  const int r0 = c0 >> 11, g0 = (c0 >> 5) & 63, b0 = c0 & 31;
+  const int r1 = c1 >> 11, g1 = (c1 >> 5) & 63, b1 = c1 & 31;
+  const int a[3] = {(r0 << 3) | (r0 >> 2), (g0 << 2) | (g0 >> 4), (b0 << 3) | (b0 >> 2)};
+  const int b[3] = {(r1 << 3) | (r1 >> 2), (g1 << 2) | (g1 >> 4), (b1 << 3) | (b1 >> 2)};
+  for (int c = 0; c < 3; ++c) {
+    palette[0][c] = a[c];
+    palette[1][c] = b[c];
+    palette[2][c] = four_colors ? (2*a[c] + b[c])/3 : (a[c] + b[c])/2;
+    palette[3][c] = four_colors ? (a[c] + 2*b[c])/3 : 0;
+  }
+  palette[0][3] = palette[1][3] = palette[2][3] = 255;
+  palette[3][3] = four_colors ? 255 : 0;
+}
+
+// always four colors, so it also serves as BC3's color block
+static void
+encode_bc1(const pixel_block block, uint8_t *out) {
+  float lo[4], hi[4];
+  fit_line(block, 3, lo, hi);
+  uint16_t c0 = pack_565(hi), c1 = pack_565(lo);
+  if (c0 < c1)
+    std::swap(c0, c1);
+
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    uint8_t palette[4][4];
+    bc1_palette(c0, c1, true, palette);
+    for (int p = 0; p < 16; ++p) {
+      uint32_t best = 0;
+      for (uint32_t i = 1; i < 4; ++i)
+        if (distance2(block[p], palette[i], 3) < distance2(block[p], palette[best], 3))
+          best = i;
+      indices |= best << (2*p);
+    }
+  }
+  out[0] = c0 & 0xff;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xff;
+  out[3] = c1 >> 8;
+  for (int i = 0; i < 4; ++i)
+    out[4 + i] = (indices >> (8*i)) & 0xff;
+}
+
+static void
+decode_bc1(const uint8_t *in, const bool always_four_colors, pixel_block out) {
+  const uint16_t c0 = in[0] | (in[1] << 8);
+  const uint16_t c1 = in[2] | (in[3] << 8);
+  uint8_t palette[4][4];
+  bc1_palette(c0, c1, always_four_colors || c0 > c1, palette);
+  const uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) |
+                           (static_cast<uint32_t>(in[7]) << 24);
+  for (int p = 0; p < 16; ++p)
+    memcpy(out[p], palette[(indices >> (2*p)) & 3], 4);
+}
+
+/****************** BC4 (BC3 alpha, BC5) *******************/
+static void
+bc4_palette(const uint8_t a0, const uint8_t a1, uint8_t palette[8]) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int i = 1; i < 7; ++i)
+      palette[i + 1] = static_cast<uint8_t>(((7 - i)*a0 + i*a1 + 3)/7);
+  }
+  else {
+    for (int i = 1; i < 5; ++i)
+      palette[i + 1] = static_cast<uint8_t>(((5 - i)*a0 + i*a1 + 2)/5);
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+static void
+encode_bc4(const pixel_block block, const int channel, uint8_t *out) {
+  uint8_t lo = 255, hi = 0;
+  for (int p = 0; p < 16; ++p) {
+    lo = std::min(lo, block[p][channel]);
+    hi = std::max(hi, block[p][channel]);
+  }
+  uint64_t indices = 0;
+  if (hi > lo) {
+    uint8_t palette[8];
+    bc4_palette(hi, lo, palette);
+    for (int p = 0; p < 16; ++p) {
+      const int v = block[p][channel];
+      uint64_t best = 0;
+      for (uint64_t i = 1; i < 8; ++i)
+        if (std::abs(v - palette[i]) < std::abs(v - palette[best]))
+          best = i;
+      indices |= best << (3*p);
+    }
+  }
+  out[0] = hi;
+  out[1] = lo;
+  for (int i = 0; i < 6; ++i)
+    out[2 + i] = (indices >> (8*i)) & 0xff;
+}
+
+static void
+decode_bc4(const uint8_t *in, const int channel, pixel_block out) {
+  uint8_t palette[8];
+  bc4_palette(in[0], in[1], palette);
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; ++i)
+    indices |= static_cast<uint64_t>(in[2 + i]) << (8*i);
+  for (int p = 0; p < 16; ++p)
+    out[p][channel] = palette[(indices >> (3*p)) & 7];
+}
+
+/****************** BC7 *******************/
+static const int BC7_WEIGHTS2[4] = {0, 21, 43, 64};
+static const int BC7_WEIGHTS3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+static const int BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30,
+                                     34, 38, 43, 47, 51, 55, 60, 64};
+
+static const int *
+bc7_weights(const int bits) {
+  return bits == 2 ? BC7_WEIGHTS2 : bits == 3 ? BC7_WEIGHTS3 : BC7_WEIGHTS4;
+}
+
+static int
+bc7_interpolate(const int e0, const int e1, const int w) {
+  return ((64 - w)*e0 + w*e1 + 32) >> 6;
+}
+
+// blocks are little endian bit streams
+struct bit_writer {
+  uint8_t *out;
+  int pos;
+
+  explicit bit_writer(uint8_t *o) : out(o), pos(0) {}
+  void put(const uint32_t v, const int bits) {
+    for (int i = 0; i < bits; ++i, ++pos)
+      if ((v >> i) & 1)
+        out[pos >> 3] |= 1 << (pos & 7);
+  }
+};
+
+struct bit_reader {
+  const uint8_t *in;
+  int pos;
+
+  explicit bit_reader(const uint8_t *i) : in(i), pos(0) {}
+  uint32_t get(const int bits) {
+    uint32_t v = 0;
+    for (int i = 0; i < bits; ++i, ++pos)
+      v |= static_cast<uint32_t>((in[pos >> 3] >> (pos & 7)) & 1) << i;
+    return v;
+  }
+};
+
+// 7 bits per channel plus a p-bit shared by the end point's channels,
+// whichever p-bit lands closer
+static void
+quantize_bc7_endpoint(const float v[4], int q[4], int &pbit) {
+  float best_err = 1e30f;
+  for (int p = 0; p < 2; ++p) {
+    int cand[4];
+    float err = 0.f;
+    for (int c = 0; c < 4; ++c) {
+      cand[c] = std::min(std::max(static_cast<int>((v[c] - p)/2.f + 0.5f), 0), 127);
+      const float d = ((cand[c] << 1) | p) - v[c];
+      err += d*d;
+    }
+    if (err < best_err) {
+      best_err = err;
+      pbit = p;
+      memcpy(q, cand, sizeof(cand));
+    }
+  }
+}
+
+// mode 6: one subset, RGBA end points of 7 bits + p-bit, 4-bit indices
+static void
+encode_bc7(const pixel_block block, uint8_t *out) {
+  float lo[4], hi[4];
+  fit_line(block, 4, lo, hi);
+  int e[2][4], pbit[2];
+  quantize_bc7_endpoint(lo, e[0], pbit[0]);
+  quantize_bc7_endpoint(hi, e[1], pbit[1]);
+
+  uint8_t palette[16][4];
+  for (int i = 0; i < 16; ++i)
+    for (int c = 0; c < 4; ++c)
+      palette[i][c] = bc7_interpolate((e[0][c] << 1) | pbit[0],
+                                      (e[1][c] << 1) | pbit[1], BC7_WEIGHTS4[i]);
+  int index[16];
+  for (int p = 0; p < 16; ++p) {
+    index[p] = 0;
+    for (int i = 1; i < 16; ++i)
+      if (distance2(block[p], palette[i], 4) < distance2(block[p], palette[index[p]], 4))
+        index[p] = i;
+  }
+
+  // the first index is stored without its top bit, which must be 0
+  if (index[0] & 8) {
+    std::swap(e[0], e[1]);
+    std::swap(pbit[0], pbit[1]);
+    for (int p = 0; p < 16; ++p)
+      index[p] = 15 - index[p];
+  }
+
+  bit_writer bits(out);
+  bits.put(1 << 6, 7);
+  for (int c = 0; c < 4; ++c) {
+    bits.put(e[0][c], 7);
+    bits.put(e[1][c], 7);
+  }
+  bits.put(pbit[0], 1);
+  bits.put(pbit[1], 1);
+  bits.put(index[0], 3);
+  for (int p = 1; p < 16; ++p)
+    bits.put(index[p], 4);
+}
+
+static int
+bc7_expand(const int v, const int bits) {
+  if (bits >= 8)
+    return v;
+  const int shifted = v << (8 - bits);
+  return shifted | (shifted >> bits);
+}
+
+static void
+bc7_read_indices(bit_reader &bits, const int n, int index[16]) {
+  index[0] = bits.get(n - 1);
+  for (int p = 1; p < 16; ++p)
+    index[p] = bits.get(n);
+}
+
+static void
+decode_bc7(const uint8_t *in, pixel_block out) {
+  int mode = 0;
+  while (mode < 8 && !(in[0] & (1 << mode)))
+    ++mode;
+  if (mode == 8) {
+    memset(out, 0, sizeof(pixel_block));  // reserved, transparent black
+    return;
+  }
+  if (mode < 4 || mode == 7)
+    throw runtime_error("BC7 mode " + to_string(mode) +
+                        " blocks cannot be decoded on the CPU");
+
+  bit_reader bits(in);
+  bits.get(mode + 1);
+  int rotation = 0, index_mode = 0;
+  if (mode == 4 || mode == 5)
+    rotation = bits.get(2);
+  if (mode == 4)
+    index_mode = bits.get(1);
+
+  const int color_bits = (mode == 4) ? 5 : 7;
+  const int alpha_bits = (mode == 4) ? 6 : (mode == 5) ? 8 : 7;
+  int e[2][4];
+  for (int c = 0; c < 3; ++c)
+    for (int k = 0; k < 2; ++k)
+      e[k][c] = bits.get(color_bits);
+  for (int k = 0; k < 2; ++k)
+    e[k][3] = bits.get(alpha_bits);
+  if (mode == 6) {
+    for (int k = 0; k < 2; ++k) {
+      const int p = bits.get(1);
+      for (int c = 0; c < 4; ++c)
+        e[k][c] = (e[k][c] << 1) | p;
+    }
+  }
+  else {
+    for (int k = 0; k < 2; ++k) {
+      for (int c = 0; c < 3; ++c)
+        e[k][c] = bc7_expand(e[k][c], color_bits);
+      e[k][3] = bc7_expand(e[k][3], alpha_bits);
+    }
+  }
+
+  // mode 6 has one index per pixel; 4 and 5 a second set for alpha,
+  // swapped in mode 4 by the index mode bit
+  int first[16], second[16];
+  const int first_bits = (mode == 6) ? 4 : 2;
+  const int second_bits = (mode == 4) ? 3 : (mode == 5) ? 2 : 0;
+  bc7_read_indices(bits, first_bits, first);
+  if (second_bits > 0)
+    bc7_read_indices(bits, second_bits, second);
+  else memcpy(second, first, sizeof(first));
+
+  const int *color_index = index_mode ? second : first;
+  const int *alpha_index = index_mode ? first : second;
+  const int *color_w = bc7_weights(index_mode ? second_bits : first_bits);
+  const int *alpha_w = bc7_weights(index_mode ? first_bits :
+                                   (second_bits > 0 ? second_bits : first_bits));
+  for (int p = 0; p < 16; ++p) {
+    for (int c = 0; c < 3; ++c)
+      out[p][c] = bc7_interpolate(e[0][c], e[1][c], color_w[color_index[p]]);
+    out[p][3] = bc7_interpolate(e[0][3], e[1][3], alpha_w[alpha_index[p]]);
+    if (rotation > 0)
+      std::swap(out[p][3], out[p][rotation - 1]);
+  }
+}
+
+/****************** images *******************/
+static void
+encode_row(const rgba_image &img, const block_format f, const int by,
+           vector<uint8_t> &out) {
+  const int bw = (img.w + 3)/4;
+  const size_t bytes = block_bytes(f);
+  pixel_block block;
+  for (int bx = 0; bx < bw; ++bx) {
+    fetch_block(img, bx, by, block);
+    uint8_t *dst = &out[bytes*(static_cast<size_t>(by)*bw + bx)];
+    switch (f) {
+      case BLOCK_BC1: encode_bc1(block, dst); break;
+      case BLOCK_BC3: encode_bc4(block, 3, dst); encode_bc1(block, dst + 8); break;
+      case BLOCK_BC5: encode_bc4(block, 0, dst); encode_bc4(block, 1, dst + 8); break;
+      case BLOCK_BC7: encode_bc7(block, dst); break;
+    }
+  }
+}
+
+static vector<uint8_t>
+encode_level(const rgba_image &img, const block_format f, job_system *jobs) {
+  const int bh = (img.h + 3)/4;
+  vector<uint8_t> out(compressed_size(f, img.w, img.h), 0);
+  if (jobs != nullptr && bh > 1)
+    jobs->parallel_for(bh, [&](size_t by) {
+      encode_row(img, f, static_cast<int>(by), out);
+    });
+  else for (int by = 0; by < bh; ++by)
+    encode_row(img, f, by, out);
+  return out;
+}
+
+compressed_image
+compress_image(const rgba_image &img, const vector<rgba_image> &mips,
+               const block_format f, job_system *jobs) {
+  if (img.w <= 0 || img.h <= 0 ||
+      img.pixels.size() != 4*static_cast<size_t>(img.w)*img.h)
+    throw runtime_error("cannot compress an empty image");
+
+  compressed_image out;
+  out.format = f;
+  out.w = img.w;
+  out.h = img.h;
+  out.levels.push_back(encode_level(img, f, jobs));
+  for (const rgba_image &mip : mips) {
+    const size_t level = out.levels.size();
+    if (mip.w != out.level_width(level) || mip.h != out.level_height(level))
+      throw runtime_error("mip level " + to_string(level) + " has the wrong size");
+    out.levels.push_back(encode_level(mip, f, jobs));
+  }
+  return out;
+}
+
+rgba_image
+decompress_level(const compressed_image &img, const size_t level) {
+  if (level >= img.levels.size())
+    throw runtime_error("no mip level " + to_string(level));
+  rgba_image out;
+  out.w = img.level_width(level);
+  out.h = img.level_height(level);
+  out.pixels.resize(4*static_cast<size_t>(out.w)*out.h);
+
+  const int bw = (out.w + 3)/4, bh = (out.h + 3)/4;
+  const size_t bytes = block_bytes(img.format);
+  const vector<uint8_t> &data = img.levels[level];
+  pixel_block block;
+  for (int by = 0; by < bh; ++by)
+    for (int bx = 0; bx < bw; ++bx) {
+      const uint8_t *src = &data[bytes*(static_cast<size_t>(by)*bw + bx)];
+      switch (img.format) {
+        case BLOCK_BC1: decode_bc1(src, false, block); break;
+        case BLOCK_BC3: decode_bc1(src + 8, true, block); decode_bc4(src, 3, block); break;
+        case BLOCK_BC5:
+          memset(block, 0, sizeof(block));
+          for (int p = 0; p < 16; ++p)
+            block[p][3] = 255;
+          decode_bc4(src, 0, block);
+          decode_bc4(src + 8, 1, block);
+          break;
+        case BLOCK_BC7: decode_bc7(src, block); break;
+      }
+      store_block(out, bx, by, block);
+    }
+  return out;
+}
+
+/****************** files *******************/
+static const char DDS_MAGIC[4] = {'D', 'D', 'S', ' '};
+static const uint8_t KTX2_MAGIC[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0',
+                                       0xbb, '\r', '\n', 0x1a, '\n'};
+
+// DDS header flags and fields, in 32-bit words after the magic
+static const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4;
+static const uint32_t DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000;
+static const uint32_t DDSD_LINEARSIZE = 0x80000;
+static const uint32_t DDPF_FOURCC = 0x4;
+static const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000;
+static const uint32_t DDSCAPS_MIPMAP = 0x400000, DDSCAPS2_CUBEMAP = 0x200;
+static const size_t DDS_HEADER_WORDS = 31;
+static const uint32_t DX10_TEXTURE2D = 3;
+
+// DXGI_FORMAT and VkFormat values of the formats we know
+static const uint32_t DXGI_BC1_UNORM = 71, DXGI_BC1_SRGB = 72;
+static const uint32_t DXGI_BC3_UNORM = 77, DXGI_BC3_SRGB = 78;
+static const uint32_t DXGI_BC5_UNORM = 83;
+static const uint32_t DXGI_BC7_UNORM = 98, DXGI_BC7_SRGB = 99;
+static const uint32_t VK_BC1_RGB_UNORM = 131, VK_BC1_RGBA_SRGB = 134;
+static const uint32_t VK_BC3_UNORM = 137, VK_BC3_SRGB = 138;
+static const uint32_t VK_BC5_UNORM = 141;
+static const uint32_t VK_BC7_UNORM = 145, VK_BC7_SRGB = 146;
+
+static const int MAX_TEXTURE_SIZE = 1 << 14;
+
+static uint32_t
+fourcc(const char a, const char b, const char c, const char d) {
+  return static_cast<uint32_t>(static_cast<uint8_t>(a)) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(b)) << 8) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(c)) << 16) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(d)) << 24);
+}
+
+template<typename T> static T
+read_le(const asset_data &file, const size_t offset, const string &filename) {
+  if (offset + sizeof(T) > file.size)
+    throw runtime_error("truncated texture file: " + filename);
+  T v = 0;
+  for (size_t i = 0; i < sizeof(T); ++i)
+    v |= static_cast<T>(file.data[offset + i]) << (8*i);
+  return v;
+}
+
+static void
+check_size(const int w, const int h, const size_t levels, const string &filename) {
+  if (w <= 0 || h <= 0 || w > MAX_TEXTURE_SIZE || h > MAX_TEXTURE_SIZE)
+    throw runtime_error("bad texture size in " + filename);
+  size_t full_chain = 1;
+  while ((std::max(w, h) >> full_chain) > 0)
+    ++full_chain;
+  if (levels == 0 || levels > full_chain)
+    throw runtime_error("bad mip level count in " + filename);
+}
+
+// copies `levels` tightly packed levels starting at offset
+static void
+read_levels(const asset_data &file, size_t offset, const size_t levels,
+            compressed_image &img, const string &filename) {
+  for (size_t level = 0; level < levels; ++level) {
+    const size_t size = compressed_size(img.format, img.level_width(level),
+                                        img.level_height(level));
+    if (offset + size > file.size)
+      throw runtime_error("truncated texture file: " + filename);
+    img.levels.push_back(vector<uint8_t>(file.data + offset,
+                                         file.data + offset + size));
+    offset += size;
+  }
+}
+
+static compressed_image
+parse_dds(const asset_data &file, const string &filename) {
+  uint32_t header[DDS_HEADER_WORDS];
+  for (size_t i = 0; i < DDS_HEADER_WORDS; ++i)
+    header[i] = read_le<uint32_t>(file, 4 + 4*i, filename);
+  if (header[0] != 4*DDS_HEADER_WORDS || header[18] != 32)
+    throw runtime_error("bad DDS header in " + filename);
+  if ((header[27] & DDSCAPS2_CUBEMAP) || header[5] > 1)
+    throw runtime_error("only 2D DDS textures are supported: " + filename);
+
+  compressed_image img;
+  img.w = static_cast<int>(header[3]);
+  img.h = static_cast<int>(header[2]);
+  size_t offset = 4 + 4*DDS_HEADER_WORDS;
+  const uint32_t code = (header[19] & DDPF_FOURCC) ? header[20] : 0;
+  if (code == fourcc('D', 'X', 'T', '1'))
+    img.format = BLOCK_BC1;
+  else if (code == fourcc('D', 'X', 'T', '5'))
+    img.format = BLOCK_BC3;
+  else if (code == fourcc('A', 'T', 'I', '2') || code == fourcc('B', 'C', '5', 'U'))
+    img.format = BLOCK_BC5;
+  else if (code == fourcc('D', 'X', '1', '0')) {
+    const uint32_t dxgi = read_le<uint32_t>(file, offset, filename);
+    if (read_le<uint32_t>(file, offset + 4, filename) != DX10_TEXTURE2D ||
+        read_le<uint32_t>(file, offset + 12, filename) > 1)
+      throw runtime_error("only single 2D DDS textures are supported: " + filename);
+    offset += 20;
+    if (dxgi == DXGI_BC1_UNORM || dxgi == DXGI_BC1_SRGB)
+      img.format = BLOCK_BC1;
+    else if (dxgi == DXGI_BC3_UNORM || dxgi == DXGI_BC3_SRGB)
+      img.format = BLOCK_BC3;
+    else if (dxgi == DXGI_BC5_UNORM)
+      img.format = BLOCK_BC5;
+    else if (dxgi == DXGI_BC7_UNORM || dxgi == DXGI_BC7_SRGB)
+      img.format = BLOCK_BC7;
+    else throw runtime_error("unsupported DXGI format " + to_string(dxgi) +
+                             " in " + filename);
+  }
+  else throw runtime_error("unsupported DDS pixel format in " + filename);
+
+  const size_t levels = (header[1] & DDSD_MIPMAPCOUNT) ?
+                        std::max<uint32_t>(header[6], 1) : 1;
+  check_size(img.w, img.h, levels, filename);
+  read_levels(file, offset, levels, img, filename);
+  return img;
+}
+
+static compressed_image
+parse_ktx2(const asset_data &file, const string &filename) {
+  const uint32_t vk_format = read_le<uint32_t>(file, 12, filename);
+  compressed_image img;
+  img.w = static_cast<int>(read_le<uint32_t>(file, 20, filename));
+  img.h = static_cast<int>(read_le<uint32_t>(file, 24, filename));
+  const uint32_t depth = read_le<uint32_t>(file, 28, filename);
+  const uint32_t layers = read_le<uint32_t>(file, 32, filename);
+  const uint32_t faces = read_le<uint32_t>(file, 36, filename);
+  const size_t levels = std::max<uint32_t>(read_le<uint32_t>(file, 40, filename), 1);
+  if (depth > 1 || layers > 1 || faces != 1)
+    throw runtime_error("only 2D KTX2 textures are supported: " + filename);
+  if (read_le<uint32_t>(file, 44, filename) != 0)
+    throw runtime_error("supercompressed KTX2 is not supported: " + filename);
+
+  if (vk_format >= VK_BC1_RGB_UNORM && vk_format <= VK_BC1_RGBA_SRGB)
+    img.format = BLOCK_BC1;
+  else if (vk_format == VK_BC3_UNORM || vk_format == VK_BC3_SRGB)
+    img.format = BLOCK_BC3;
+  else if (vk_format == VK_BC5_UNORM)
+    img.format = BLOCK_BC5;
+  else if (vk_format == VK_BC7_UNORM || vk_format == VK_BC7_SRGB)
+    img.format = BLOCK_BC7;
+  else throw runtime_error("unsupported KTX2 format " + to_string(vk_format) +
+                           " in " + filename);
+  check_size(img.w, img.h, levels, filename);
+
+  // the level index follows the 80 byte header, level 0 first
+  for (size_t level = 0; level < levels; ++level) {
+    const uint64_t offset = read_le<uint64_t>(file, 80 + 24*level, filename);
+    const uint64_t length = read_le<uint64_t>(file, 88 + 24*level, filename);
+    const size_t size = compressed_size(img.format, img.level_width(level),
+                                        img.level_height(level));
+    if (length != size || offset > file.size || size > file.size - offset)
+      throw runtime_error("bad KTX2 level " + to_string(level) + " in " + filename);
+    img.levels.push_back(vector<uint8_t>(file.data + offset,
+                                         file.data + offset + size));
+  }
+  return img;
+}
+
+compressed_image
+parse_compressed_image(const uint8_t *data, const size_t size,
+                       const string &filename) {
+  asset_data file;
+  file.data = data;
+  file.size = size;
+  if (size >= sizeof(DDS_MAGIC) && memcmp(data, DDS_MAGIC, sizeof(DDS_MAGIC)) == 0)
+    return parse_dds(file, filename);
+  if (size >= sizeof(KTX2_MAGIC) && memcmp(data, KTX2_MAGIC, sizeof(KTX2_MAGIC)) == 0)
+    return parse_ktx2(file, filename);
+  throw runtime_error("not a DDS or KTX2 file: " + filename);
+}
+
+compressed_image
+load_compressed_image(const string &filename) {
+  const asset_data file = load_asset(filename);
+  return parse_compressed_image(file.data, file.size, filename);
+}
+
+bool
+is_compressed_image(const uint8_t *data, const size_t size) {
+  return (size >= sizeof(DDS_MAGIC) &&
+          memcmp(data, DDS_MAGIC, sizeof(DDS_MAGIC)) == 0) ||
+         (size >= sizeof(KTX2_MAGIC) &&
+          memcmp(data, KTX2_MAGIC, sizeof(KTX2_MAGIC)) == 0);
+}
+
+static void
+put_u32(ofstream &out, const uint32_t v) {
+  const char bytes[4] = {static_cast<char>(v), static_cast<char>(v >> 8),
+                         static_cast<char>(v >> 16), static_cast<char>(v >> 24)};
+  out.write(bytes, 4);
+}
+
+void
+write_dds(const string &filename, const compressed_image &img) {
+  if (img.levels.empty())
+    throw runtime_error("no levels to write to " + filename);
+  ofstream out(filename, std::ios::binary);
+  if (!out)
+    throw runtime_error("cannot write texture " + filename);
+
+  const bool mips = img.levels.size() > 1;
+  uint32_t header[DDS_HEADER_WORDS] = {};
+  header[0] = 4*DDS_HEADER_WORDS;
+  header[1] = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT |
+              DDSD_LINEARSIZE | (mips ? DDSD_MIPMAPCOUNT : 0);
+  header[2] = img.h;
+  header[3] = img.w;
+  header[4] = img.levels[0].size();
+  header[6] = img.levels.size();
+  header[18] = 32;
+  header[19] = DDPF_FOURCC;
+  switch (img.format) {
+    case BLOCK_BC1: header[20] = fourcc('D', 'X', 'T', '1'); break;
+    case BLOCK_BC3: header[20] = fourcc('D', 'X', 'T', '5'); break;
+    case BLOCK_BC5: header[20] = fourcc('A', 'T', 'I', '2'); break;
+    case BLOCK_BC7: header[20] = fourcc('D', 'X', '1', '0'); break;
+  }
+  header[26] = DDSCAPS_TEXTURE | (mips ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+  out.write(DDS_MAGIC, sizeof(DDS_MAGIC));
+  for (const uint32_t word : header)
+    put_u32(out, word);
+  if (img.format == BLOCK_BC7) {
+    put_u32(out, DXGI_BC7_UNORM);
+    put_u32(out, DX10_TEXTURE2D);
+    put_u32(out, 0);  // misc flags
+    put_u32(out, 1);  // array size
+    put_u32(out, 0);  // alpha mode unknown
+  }
+  for (const vector<uint8_t> &level : img.levels)
+    out.write(reinterpret_cast<const char *>(level.data()), level.size());
+  if (!out)
+    throw runtime_error("failed writing texture " + filename);
+}
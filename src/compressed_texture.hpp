@@ -0,0 +1,73 @@
+#ifndef COMPRESSED_TEXTURE_HPP
+#define COMPRESSED_TEXTURE_HPP
+
+#include "glad.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "texture.hpp"
+
+class job_system;
+
+// S3TC is an extension that glad was generated without
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// 4x4 block formats
+enum block_format {
+  BLOCK_BC1,  // RGB, 1-bit alpha, 8 bytes per block
+  BLOCK_BC3,  // BC1 color plus interpolated alpha, 16 bytes
+  BLOCK_BC5,  // two channels (RG), e.g. normal maps, 16 bytes
+  BLOCK_BC7   // RGBA, higher quality, 16 bytes
+};
+
+const char *block_format_name(const block_format f);
+size_t block_bytes(const block_format f);
+GLenum block_gl_format(const block_format f);
+
+// Block compressed mip chain, level 0 first. Rows are bottom first like
+// rgba_image, so images from other tools have to be encoded flipped.
+struct compressed_image {
+  block_format format;
+  int w;
+  int h;
+  std::vector<std::vector<uint8_t>> levels;
+
+  compressed_image() : format(BLOCK_BC1), w(0), h(0) {}
+
+  int level_width(const size_t level) const;
+  int level_height(const size_t level) const;
+};
+
+// bytes of a w x h level, whole blocks
+size_t compressed_size(const block_format f, const int w, const int h);
+
+// DDS (legacy DXT1/DXT5/ATI2 or DX10 header) or KTX2 without
+// supercompression, told apart by their magic; files through load_asset
+compressed_image load_compressed_image(const std::string &filename);
+compressed_image parse_compressed_image(const uint8_t *data, const size_t size,
+                                       const std::string &filename);
+bool is_compressed_image(const uint8_t *data, const size_t size);
+
+// writes DDS: BC1, BC3 and BC5 with legacy FourCCs, BC7 with DX10
+void write_dds(const std::string &filename, const compressed_image &img);
+
+// encodes the image and its mips (build_mips), block rows spread over
+// the workers when jobs is given
+compressed_image compress_image(const rgba_image &img,
+                                const std::vector<rgba_image> &mips,
+                                const block_format f,
+                                job_system *jobs = nullptr);
+
+// CPU decoding for contexts without the format. BC7 is decoded for its
+// single subset modes (4, 5 and 6, which compress_image writes); other
+// modes throw.
+rgba_image decompress_level(const compressed_image &img, const size_t level);
+
+#endif
@@ -0,0 +1,245 @@
+#include "ecs.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+using std::vector;
+using std::runtime_error;
+using std::mutex;
+using std::lock_guard;
+using std::unique_ptr;
+
+struct component_info {
+  size_t size;
+  size_t align;
+};
+
+static mutex registry_mutex;
+static vector<component_info> registry;
+
+component_id
+register_component(const size_t size, const size_t align) {
+  lock_guard<mutex> lock(registry_mutex);
+  if (registry.size() == MAX_COMPONENTS)
+    throw runtime_error("too many component types");
+  component_info info;
+  info.size = size;
+  info.align = align;
+  registry.push_back(info);
+  return static_cast<component_id>(registry.size() - 1);
+}
+
+static component_info
+component_lookup(const component_id id) {
+  lock_guard<mutex> lock(registry_mutex);
+  return registry[id];
+}
+
+static inline size_t
+align_up(const size_t x, const size_t a) {
+  return (x + a - 1)/a*a;
+}
+
+// every column starts on its own cache line, which also keeps them
+// aligned for SIMD loads
+static const size_t COLUMN_ALIGN = 64;
+
+archetype::archetype(const uint64_t _mask) : mask(_mask), capacity(0) {
+  std::fill(column_of, column_of + MAX_COMPONENTS, -1);
+
+  vector<component_info> infos;
+  size_t row_bytes = sizeof(entity);
+  for (component_id id = 0; id < MAX_COMPONENTS; ++id) {
+    if (!(mask & (1ull << id)))
+      continue;
+    column_of[id] = static_cast<int>(components.size());
+    components.push_back(id);
+    infos.push_back(component_lookup(id));
+    if (infos.back().align > COLUMN_ALIGN)
+      throw runtime_error("component alignment above cache line size");
+    sizes.push_back(infos.back().size);
+    row_bytes += infos.back().size;
+  }
+
+  // largest row count whose aligned columns still fit in a chunk
+  const size_t padding = COLUMN_ALIGN*(components.size() + 1);
+  capacity = static_cast<uint32_t>((CHUNK_BYTES - padding)/row_bytes);
+  if (capacity == 0)
+    throw runtime_error("components too large for an ecs chunk");
+
+  size_t offset = align_up(capacity*sizeof(entity), COLUMN_ALIGN);
+  for (const component_info &info : infos) {
+    offsets.push_back(offset);
+    offset = align_up(offset + capacity*info.size, COLUMN_ALIGN);
+  }
+}
+
+archetype::~archetype() {
+  for (chunk &c : chunks)
+    std::free(c.data);
+}
+
+size_t
+archetype::size() const {
+  size_t total = 0;
+  for (const chunk &c : chunks)
+    total += c.count;
+  return total;
+}
+
+archetype &
+world::find_archetype(const uint64_t mask) {
+  auto it = by_mask.find(mask);
+  if (it != by_mask.end())
+    return *it->second;
+
+  archetypes.push_back(unique_ptr<archetype>(new archetype(mask)));
+  archetype *a = archetypes.back().get();
+  by_mask[mask] = a;
+  return *a;
+}
+
+entity
+world::allocate_entity() {
+  entity e;
+  if (!free_indices.empty()) {
+    e.index = free_indices.back();
+    free_indices.pop_back();
+  }
+  else {
+    e.index = static_cast<uint32_t>(records.size());
+    record r;
+    r.arch = nullptr;
+    r.chunk_index = 0;
+    r.row = 0;
+    r.generation = 0;
+    records.push_back(r);
+  }
+  e.generation = records[e.index].generation;
+  ++alive_count;
+  return e;
+}
+
+const world::record *
+world::lookup(const entity e) const {
+  if (e.index >= records.size())
+    return nullptr;
+  const record &r = records[e.index];
+  if (r.generation != e.generation || r.arch == nullptr)
+    return nullptr;
+  return &r;
+}
+
+bool
+world::alive(const entity e) const {
+  return lookup(e) != nullptr;
+}
+
+// appends a row for e at the end of the archetype, contents undefined
+void
+world::insert_row(archetype &arch, const entity e) {
+  if (arch.chunks.empty() || arch.chunks.back().count == arch.capacity) {
+    chunk c;
+    c.data = static_cast<unsigned char*>(std::aligned_alloc(COLUMN_ALIGN, CHUNK_BYTES));
+    if (!c.data)
+      throw runtime_error("out of memory allocating ecs chunk");
+    c.count = 0;
+    arch.chunks.push_back(c);
+  }
+
+  chunk &c = arch.chunks.back();
+  record &r = records[e.index];
+  r.arch = &arch;
+  r.chunk_index = static_cast<uint32_t>(arch.chunks.size() - 1);
+  r.row = c.count++;
+  arch.entities(c)[r.row] = e;
+}
+
+// fills the hole left by e with the last row of its archetype, so chunks
+// stay densely packed and iteration never has to skip dead rows
+void
+world::erase_row(const entity e) {
+  record &r = records[e.index];
+  archetype &arch = *r.arch;
+  chunk &last = arch.chunks.back();
+  const uint32_t last_row = last.count - 1;
+  chunk &c = arch.chunks[r.chunk_index];
+
+  if (&c != &last || r.row != last_row) {
+    const entity moved = arch.entities(last)[last_row];
+    arch.entities(c)[r.row] = moved;
+    for (size_t i = 0; i < arch.components.size(); ++i) {
+      const size_t sz = arch.sizes[i];
+      if (sz == 0)
+        continue;
+      std::memcpy(c.data + arch.offsets[i] + r.row*sz,
+                  last.data + arch.offsets[i] + last_row*sz, sz);
+    }
+    records[moved.index].chunk_index = r.chunk_index;
+    records[moved.index].row = r.row;
+  }
+
+  if (--last.count == 0) {
+    std::free(last.data);
+    arch.chunks.pop_back();
+  }
+  r.arch = nullptr;
+}
+
+void
+world::move_entity(const entity e, archetype &to) {
+  record &r = records[e.index];
+  archetype &from = *r.arch;
+  const chunk &src = from.chunks[r.chunk_index];
+  const uint32_t src_row = r.row;
+
+  // copy the shared components before the old row gets overwritten
+  insert_row(to, e);
+  const chunk &dst = to.chunks[r.chunk_index];
+  for (size_t i = 0; i < from.components.size(); ++i) {
+    const component_id id = from.components[i];
+    const size_t sz = from.sizes[i];
+    if (sz == 0 || to.column_of[id] < 0)
+      continue;
+    std::memcpy(static_cast<unsigned char*>(to.column(dst, id)) + r.row*sz,
+                src.data + from.offsets[i] + src_row*sz, sz);
+  }
+
+  // erase_row works on the record, so point it back at the old row
+  const record moved = r;
+  r.arch = &from;
+  r.chunk_index = static_cast<uint32_t>(&src - from.chunks.data());
+  r.row = src_row;
+  erase_row(e);
+  records[e.index] = moved;
+}
+
+void
+world::destroy(const entity e) {
+  if (!lookup(e))
+    return;
+  erase_row(e);
+  ++records[e.index].generation;
+  free_indices.push_back(e.index);
+  --alive_count;
+}
+
+void
+world::matching_chunks(const uint64_t mask, vector<chunk_ref> &out) {
+  out.clear();
+  for (const unique_ptr<archetype> &a : archetypes) {
+    if ((a->mask & mask) != mask)
+      continue;
+    for (size_t i = 0; i < a->chunks.size(); ++i) {
+      if (a->chunks[i].count == 0)
+        continue;
+      chunk_ref ref;
+      ref.arch = a.get();
+      ref.chunk_index = i;
+      out.push_back(ref);
+    }
+  }
+}
@@ -0,0 +1,255 @@
+#ifndef ECS_HPP
+#define ECS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "job_system.hpp"
+
+// Archetype based entity-component-system. Entities with the same set of
+// components live in the same archetype, whose storage is split in
+// fixed-size chunks. Inside a chunk every component type has its own
+// contiguous, 64-byte aligned array (structure of arrays), so a query
+// touching transform and velocity streams through exactly those two
+// arrays and nothing else.
+//
+// Components are plain data: they are moved around with memcpy and never
+// have their constructors or destructors run by the storage.
+
+typedef uint32_t component_id;
+static const size_t MAX_COMPONENTS = 64;
+static const size_t CHUNK_BYTES = 16*1024;
+
+component_id
+register_component(const size_t size, const size_t align);
+
+template<typename T>
+component_id
+component_type() {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "components are moved with memcpy");
+  static const component_id id =
+    register_component(std::is_empty<T>::value ? 0 : sizeof(T), alignof(T));
+  return id;
+}
+
+template<typename... Ts>
+uint64_t
+component_mask() {
+  uint64_t mask = 0;
+  const component_id ids[] = {component_type<Ts>()..., 0};
+  for (size_t i = 0; i < sizeof...(Ts); ++i)
+    mask |= (1ull << ids[i]);
+  return mask;
+}
+
+struct entity {
+  uint32_t index;
+  uint32_t generation;
+
+  entity() : index(UINT32_MAX), generation(0) {}
+  bool operator==(const entity &o) const {
+    return index == o.index && generation == o.generation;
+  }
+  bool operator!=(const entity &o) const { return !(*this == o); }
+};
+
+struct chunk {
+  unsigned char *data;
+  uint32_t count;
+};
+
+struct archetype {
+  uint64_t mask;
+  std::vector<component_id> components;  // sorted by id
+  std::vector<size_t> sizes;             // bytes per element of each column
+  std::vector<size_t> offsets;           // column start inside a chunk
+  int column_of[MAX_COMPONENTS];         // index into components, or -1
+  uint32_t capacity;                     // rows per chunk
+  std::vector<chunk> chunks;
+
+  explicit archetype(const uint64_t _mask);
+  ~archetype();
+
+  entity *entities(const chunk &c) const {
+    return reinterpret_cast<entity*>(c.data);
+  }
+
+  void *column(const chunk &c, const component_id id) const {
+    return c.data + offsets[column_of[id]];
+  }
+
+  template<typename T> T *column(const chunk &c) const {
+    return static_cast<T*>(column(c, component_type<T>()));
+  }
+
+  size_t size() const;
+};
+
+class world {
+public:
+  world() : alive_count(0) {}
+
+  world(const world &) = delete;
+  world &operator=(const world &) = delete;
+
+  template<typename... Ts> entity create(const Ts &...values);
+  void destroy(const entity e);
+  bool alive(const entity e) const;
+  size_t size() const { return alive_count; }
+
+  // nullptr if the entity does not have the component
+  template<typename T> T *get(const entity e);
+  template<typename T> bool has(const entity e) const;
+  template<typename T> void add(const entity e, const T &value);
+  template<typename T> void remove(const entity e);
+
+  // fn(n, entities, Ts*...) once per chunk holding at least Ts
+  template<typename... Ts, typename F> void each_chunk(F &&fn);
+  // fn(Ts&...) once per entity holding at least Ts
+  template<typename... Ts, typename F> void each(F &&fn);
+  // same as above, with chunks spread over the job system
+  template<typename... Ts, typename F> void par_each_chunk(job_system &jobs, F &&fn);
+  template<typename... Ts, typename F> void par_each(job_system &jobs, F &&fn);
+
+private:
+  struct record {
+    archetype *arch;
+    uint32_t chunk_index;
+    uint32_t row;
+    uint32_t generation;
+  };
+
+  struct chunk_ref {
+    archetype *arch;
+    size_t chunk_index;
+  };
+
+  archetype &find_archetype(const uint64_t mask);
+  entity allocate_entity();
+  void insert_row(archetype &arch, const entity e);
+  void erase_row(const entity e);
+  void move_entity(const entity e, archetype &to);
+  void matching_chunks(const uint64_t mask, std::vector<chunk_ref> &out);
+  const record *lookup(const entity e) const;
+
+  template<typename T> void store(const entity e, const T &value);
+
+  std::vector<record> records;
+  std::vector<uint32_t> free_indices;
+  std::vector<std::unique_ptr<archetype> > archetypes;
+  std::unordered_map<uint64_t, archetype*> by_mask;
+  size_t alive_count;
+};
+
+/********************** implementation ***********************/
+
+template<typename T>
+void
+world::store(const entity e, const T &value) {
+  if (std::is_empty<T>::value)
+    return;
+  const record &r = records[e.index];
+  const chunk &c = r.arch->chunks[r.chunk_index];
+  r.arch->column<T>(c)[r.row] = value;
+}
+
+template<typename... Ts>
+entity
+world::create(const Ts &...values) {
+  const entity e = allocate_entity();
+  insert_row(find_archetype(component_mask<Ts...>()), e);
+  const int expand[] = {(store(e, values), 0)..., 0};
+  (void)expand;
+  return e;
+}
+
+template<typename T>
+T *
+world::get(const entity e) {
+  const record *r = lookup(e);
+  const component_id id = component_type<T>();
+  if (!r || r->arch->column_of[id] < 0)
+    return nullptr;
+  const chunk &c = r->arch->chunks[r->chunk_index];
+  return r->arch->column<T>(c) + r->row;
+}
+
+template<typename T>
+bool
+world::has(const entity e) const {
+  const record *r = lookup(e);
+  return r && r->arch->column_of[component_type<T>()] >= 0;
+}
+
+template<typename T>
+void
+world::add(const entity e, const T &value) {
+  const record *r = lookup(e);
+  if (!r)
+    return;
+  const uint64_t mask = r->arch->mask | component_mask<T>();
+  if (mask != r->arch->mask)
+    move_entity(e, find_archetype(mask));
+  store(e, value);
+}
+
+template<typename T>
+void
+world::remove(const entity e) {
+  const record *r = lookup(e);
+  if (!r)
+    return;
+  const uint64_t mask = r->arch->mask & ~component_mask<T>();
+  if (mask != r->arch->mask)
+    move_entity(e, find_archetype(mask));
+}
+
+template<typename... Ts, typename F>
+void
+world::each_chunk(F &&fn) {
+  const uint64_t mask = component_mask<Ts...>();
+  for (const std::unique_ptr<archetype> &a : archetypes) {
+    if ((a->mask & mask) != mask)
+      continue;
+    for (const chunk &c : a->chunks)
+      if (c.count > 0)
+        fn(static_cast<size_t>(c.count), a->entities(c), a->column<Ts>(c)...);
+  }
+}
+
+template<typename... Ts, typename F>
+void
+world::each(F &&fn) {
+  each_chunk<Ts...>([&fn](const size_t n, const entity *, Ts *...cols) {
+    for (size_t i = 0; i < n; ++i)
+      fn(cols[i]...);
+  });
+}
+
+template<typename... Ts, typename F>
+void
+world::par_each_chunk(job_system &jobs, F &&fn) {
+  std::vector<chunk_ref> refs;
+  matching_chunks(component_mask<Ts...>(), refs);
+  jobs.parallel_for(refs.size(), [&refs, &fn](const size_t i) {
+    const archetype *a = refs[i].arch;
+    const chunk &c = a->chunks[refs[i].chunk_index];
+    fn(static_cast<size_t>(c.count), a->entities(c), a->template column<Ts>(c)...);
+  });
+}
+
+template<typename... Ts, typename F>
+void
+world::par_each(job_system &jobs, F &&fn) {
+  par_each_chunk<Ts...>(jobs, [&fn](const size_t n, const entity *, Ts *...cols) {
+    for (size_t i = 0; i < n; ++i)
+      fn(cols[i]...);
+  });
+}
+
+#endif
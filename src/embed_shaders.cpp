@@ -0,0 +1,171 @@
+// Shader embedder: preprocesses shaders at build time and writes them
+// as constexpr data the game compiles from (use_embedded_shaders), so
+// startup reads no shader file and a broken #include fails the build.
+//
+//   src/embed_shaders [--validate CMD] out.cpp shader...
+//
+// Shaders are named by their paths as given, which is how the renderer
+// asks for them, so run it from the repository root (make -C src does).
+// With --validate, every variant of every shader, one per combination
+// of shader features, is checked by running `CMD -S stage -DFEATURE...
+// file`, e.g. glslangValidator; the stage is vert or frag from "vertex"
+// or "fragment" in the shader's name.
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "shader.hpp"
+
+using std::string;
+using std::vector;
+using std::ofstream;
+using std::cerr;
+using std::endl;
+using std::runtime_error;
+using std::to_string;
+
+// text as a C++ string literal, one line of source per line of output
+static string
+literal(const string &text) {
+  string out = "\"";
+  for (size_t i = 0; i < text.size(); ++i) {
+    const unsigned char c = text[i];
+    if (c == '\n')
+      out += (i + 1 < text.size()) ? "\\n\"\n  \"" : "\\n";
+    else if (c == '"' || c == '\\')
+      out += string("\\") + static_cast<char>(c);
+    else if (c == '?')
+      out += "\\?";  // no trigraphs
+    else if (c < 0x20 || c >= 0x7f) {
+      // octal, as a hex escape would swallow the digits after it
+      out += "\\";
+      out += static_cast<char>('0' + (c >> 6));
+      out += static_cast<char>('0' + ((c >> 3) & 7));
+      out += static_cast<char>('0' + (c & 7));
+    }
+    else out += static_cast<char>(c);
+  }
+  return out + "\"";
+}
+
+static void
+write_embedded(const string &out_file, const vector<string> &names,
+               const vector<shader_source> &sources) {
+  // renamed into place, so make never sees half a file
+  const string tmp_file = out_file + ".tmp";
+  ofstream out(tmp_file);
+  if (!out)
+    throw runtime_error("cannot write " + tmp_file);
+  out << "// generated by embed_shaders from the files it names, do not edit\n"
+      << "#include \"shader.hpp\"\n\n";
+  for (size_t i = 0; i < sources.size(); ++i) {
+    out << "static constexpr char text_" << i << "[] =\n  "
+        << literal(sources[i].text) << ";\n";
+    out << "static constexpr const char *files_" << i << "[] = {";
+    for (size_t f = 0; f < sources[i].files.size(); ++f)
+      out << (f ? ", " : "") << literal(sources[i].files[f]);
+    out << "};\n\n";
+  }
+  out << "extern constexpr embedded_shader EMBEDDED_SHADERS[] = {\n";
+  for (size_t i = 0; i < sources.size(); ++i)
+    out << "  {" << literal(names[i]) << ", text_" << i << ", sizeof(text_"
+        << i << ") - 1, files_" << i << ", " << sources[i].files.size() << "},\n";
+  out << "};\n"
+      << "extern constexpr size_t EMBEDDED_SHADER_COUNT = " << sources.size()
+      << ";\n";
+  out.close();
+  if (!out || rename(tmp_file.c_str(), out_file.c_str()) != 0)
+    throw runtime_error("failed writing " + out_file);
+}
+
+static string
+stage_of(const string &name) {
+  const string base = name.substr(name.rfind('/') + 1);
+  if (base.find("vertex") != string::npos)
+    return "vert";
+  if (base.find("fragment") != string::npos)
+    return "frag";
+  throw runtime_error("no stage in the name of " + name +
+                      ", want vertex or fragment in it");
+}
+
+// every variant through the validator, its output shown when it fails
+static void
+validate(const string &command, const string &name, const shader_source &src) {
+  char path[] = "/tmp/embed_shaders_XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0)
+    throw runtime_error("cannot create a temporary file");
+  close(fd);
+  {
+    ofstream tmp(path);
+    tmp << src.text;
+  }
+
+  const vector<string> &features = shader_feature_names();
+  size_t failed = 0;
+  for (uint32_t key = 0; key < (1u << features.size()); ++key) {
+    string cmd = command + " -S " + stage_of(name);
+    for (size_t i = 0; i < features.size(); ++i)
+      if (key & (1u << i))
+        cmd += " -D" + features[i];
+    cmd += string(" ") + path + " > " + path + ".log 2>&1";
+    if (system(cmd.c_str()) == 0)
+      continue;
+    ++failed;
+    cerr << name << ", variant " << key << " failed validation:" << endl;
+    std::ifstream log(string(path) + ".log");
+    cerr << log.rdbuf() << "source strings:" << endl;
+    for (size_t i = 0; i < src.files.size(); ++i)
+      cerr << "  " << i << ": " << src.files[i] << endl;
+  }
+  unlink(path);
+  unlink((string(path) + ".log").c_str());
+  if (failed > 0)
+    throw runtime_error(name + ": " + to_string(failed) + " variant(s) invalid");
+}
+
+int
+main(int argc, const char **argv) {
+  try {
+    string validator, out_file;
+    vector<string> names;
+    for (int i = 1; i < argc; ++i) {
+      const string arg = argv[i];
+      if (arg == "--validate" && i + 1 < argc)
+        validator = argv[++i];
+      else if (arg.compare(0, 2, "--") == 0)
+        throw runtime_error("unknown argument: " + arg);
+      else if (out_file.empty())
+        out_file = arg;
+      else names.push_back(arg);
+    }
+    if (out_file.empty() || names.empty())
+      throw runtime_error("usage: embed_shaders [--validate CMD] out.cpp shader...");
+
+    vector<shader_source> sources;
+    for (const string &name : names) {
+      sources.push_back(preprocess_shader(name));
+      if (!validator.empty())
+        validate(validator, name, sources.back());
+    }
+    write_embedded(out_file, names, sources);
+
+    size_t bytes = 0;
+    for (const shader_source &s : sources)
+      bytes += s.text.size();
+    cerr << out_file << ": " << names.size() << " shader(s), " << bytes
+         << " bytes" << (validator.empty() ? ", not validated" : "") << endl;
+  }
+  catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include "fixed_timestep.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+using std::runtime_error;
+
+double
+clock_seconds() {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  static const steady_clock::time_point start = steady_clock::now();
+  return duration<double>(steady_clock::now() - start).count();
+}
+
+fixed_timestep::fixed_timestep(const double tick_hz,
+                               const size_t max_ticks_per_frame) :
+  dt(0.0), max_ticks(max_ticks_per_frame), max_frame_time(0.25),
+  accumulator(0.0), tick_count(0), dropped_ticks(0) {
+  if (tick_hz <= 0.0)
+    throw runtime_error("tick rate must be positive");
+  if (max_ticks == 0)
+    throw runtime_error("at least one tick per frame must be allowed");
+  dt = 1.0/tick_hz;
+}
+
+size_t
+fixed_timestep::advance(double frame_time) {
+  if (frame_time < 0.0) frame_time = 0.0;
+  if (frame_time > max_frame_time) frame_time = max_frame_time;
+  accumulator += frame_time;
+
+  size_t ticks = static_cast<size_t>(accumulator/dt);
+
+  // under load we would never catch up, so drop the surplus time instead
+  // of letting the simulation spiral
+  if (ticks > max_ticks) {
+    dropped_ticks += ticks - max_ticks;
+    accumulator -= (ticks - max_ticks)*dt;
+    ticks = max_ticks;
+  }
+
+  accumulator -= ticks*dt;
+  if (accumulator < 0.0) accumulator = 0.0;
+  tick_count += ticks;
+  return ticks;
+}
@@ -0,0 +1,33 @@
+#ifndef FIXED_TIMESTEP_HPP
+#define FIXED_TIMESTEP_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// monotonic wall clock in seconds, independent of GLFW so it can be
+// used from any thread
+double
+clock_seconds();
+
+// Hands out simulation ticks of constant length from variable frame
+// times. Leftover time stays in the accumulator and is exposed as
+// alpha() so the renderer can interpolate between the previous and the
+// current simulation state.
+struct fixed_timestep {
+  double dt;               // seconds per tick
+  size_t max_ticks;        // catch-up limit per frame
+  double max_frame_time;   // longer frames are clamped (debugger, hitch)
+  double accumulator;
+  uint64_t tick_count;
+  uint64_t dropped_ticks;  // ticks discarded by the catch-up limit
+
+  fixed_timestep(const double tick_hz, const size_t max_ticks_per_frame);
+
+  // adds the elapsed frame time and returns how many ticks to run now
+  size_t advance(double frame_time);
+
+  // position of the rendered frame between the last two ticks, in [0, 1)
+  double alpha() const { return accumulator/dt; }
+};
+
+#endif
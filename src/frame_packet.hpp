@@ -0,0 +1,176 @@
+#ifndef FRAME_PACKET_HPP
+#define FRAME_PACKET_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_emitter.hpp"
+
+enum mesh_id : uint32_t {
+  MESH_SQUARE = 0
+};
+
+struct draw_item {
+  uint32_t mesh;
+  uint32_t matrix;    // index into the world matrices
+  uint32_t material;  // index into the renderer's materials
+  glm::vec4 uv_rect;  // (offset, scale) of the image in the material's
+                      // textures, e.g. an atlas region
+};
+
+// per-instance vertex data of the sprite pass, 48 bytes
+struct sprite_instance {
+  glm::vec2 position;  // center
+  glm::vec2 size;
+  glm::vec4 uv_rect;   // (offset, scale) in the texture
+  float rotation;      // radians, counterclockwise about the center
+  uint32_t color;      // RGBA8 tint, red in the low byte
+  uint32_t layer;      // of the texture array
+  uint32_t pad;
+};
+
+// instances first to first + count sample the texture array of pool
+struct sprite_run {
+  uint32_t pool;
+  uint32_t first;
+  uint32_t count;
+};
+
+// The 2D pass of a frame, drawn over the scene without depth testing
+// and blended in instance order; built by sprite_batch.
+struct sprite_list {
+  glm::mat4 transform;  // sprite plane to clip space
+  std::vector<sprite_instance> instances;
+  std::vector<sprite_run> runs;
+
+  sprite_list() : transform(1.f) {}
+
+  void clear() {
+    instances.clear();
+    runs.clear();
+  }
+};
+
+// The particle pass of a frame: count round quads, centered on x and
+// y, of the given sizes and colors (RGBA8, red in the low byte). One
+// array per attribute, the way the particle update writes them; the
+// arrays may be longer than count.
+struct particle_list {
+  glm::mat4 transform;  // particle plane to clip space
+  size_t count;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> size;
+  std::vector<uint32_t> color;
+
+  particle_list() : transform(1.f), count(0) {}
+
+  void clear() { count = 0; }
+};
+
+// A string of the text pass, its UTF-8 bytes in the packet's text_chars.
+// Drawn over the sprites in window pixels, y down from the top-left.
+struct text_item {
+  uint32_t first;
+  uint32_t count;
+  glm::vec2 position;  // top-left of the first line
+  float size;          // pixels per em
+  uint32_t color;      // RGBA8, red in the low byte
+};
+
+// A light of the deferred lighting pass, fading out to nothing at its
+// radius; laid out as the two vec4 instance attributes of
+// shaders/light_vertex.shader.
+struct point_light {
+  glm::vec3 position;
+  float radius;
+  glm::vec3 color;
+  float intensity;
+};
+
+// per-frame uniform block, laid out like the std140 frame_data block in
+// the shaders so it can be copied as is
+struct frame_uniforms {
+  glm::mat4 view;
+  glm::mat4 proj;
+  glm::mat4 view_proj;
+  glm::vec4 camera_pos;  // w unused
+  glm::vec4 time;        // seconds, frame dt, frame number, unused
+
+  frame_uniforms() : view(1.f), proj(1.f), view_proj(1.f),
+                     camera_pos(0.f), time(0.f) {}
+};
+
+// Everything the render thread needs to draw one frame. The game thread
+// fills a packet, submits it and never touches it again until the render
+// thread has let go of it, so nothing in here is shared mutable state.
+struct frame_packet {
+  uint64_t frame;
+  int fb_width;
+  int fb_height;
+  glm::vec4 clear_color;
+  frame_uniforms uniforms;
+  std::vector<draw_item> draws;
+
+  // lighting of the draws, ignored by the forward (unlit) renderer; the
+  // ambient light defaults to 1, which draws the scene as it is
+  std::vector<point_light> lights;
+  glm::vec3 ambient_light;
+
+  // World matrices live on the GPU across frames. Each packet carries
+  // only the ones that changed, starting at matrix_first, and the total
+  // count. Packets are never skipped, so these deltas add up.
+  uint32_t matrix_count;
+  uint32_t matrix_first;
+  std::vector<glm::mat4> matrices;
+
+  sprite_list sprites;
+  particle_list particles;
+
+  // emission and forces of the GPU particles, whose state never leaves
+  // the GPU; inactive unless set every frame
+  particle_emitter gpu_emitter;
+  particle_forces gpu_forces;
+
+  // strings are laid out by the render thread, which has the glyphs
+  std::string text_chars;
+  std::vector<text_item> texts;
+
+  frame_packet() : frame(0), fb_width(0), fb_height(0),
+                   clear_color(0.f), ambient_light(1.f),
+                   matrix_count(0), matrix_first(0) {
+    gpu_emitter.active = false;
+  }
+
+  // keeps the allocations so steady state frames do not hit the heap
+  void reset() {
+    draws.clear();
+    lights.clear();
+    ambient_light = glm::vec3(1.f);
+    matrices.clear();
+    matrix_first = 0;
+    sprites.clear();
+    particles.clear();
+    gpu_emitter.active = false;
+    text_chars.clear();
+    texts.clear();
+  }
+
+  void add_text(const char *text, const glm::vec2 position, const float size,
+                const uint32_t color) {
+    text_item t;
+    t.first = static_cast<uint32_t>(text_chars.size());
+    t.count = static_cast<uint32_t>(strlen(text));
+    t.position = position;
+    t.size = size;
+    t.color = color;
+    text_chars.append(text, t.count);
+    texts.push_back(t);
+  }
+};
+
+#endif
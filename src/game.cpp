@@ -2,173 +2,237 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <string>
-#include <cstring>
+#include <memory>
 #include <sstream>
-#include <fstream>
-#include <vector>
+#include <iomanip>
 
 #include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
 
-#include "stb_image_wrapper.h"
+#include "fixed_timestep.hpp"
+#include "game_state.hpp"
+#include "profiler.hpp"
+#include "gl_stats.hpp"
+#include "trace_export.hpp"
+#include "replay.hpp"
+#include "render_thread.hpp"
+#include "asset_pack.hpp"
+#include "texture_cache.hpp"
 
-using std::vector;
 using std::runtime_error;
 using std::string;
-using std::cout;
 using std::cerr;
+using std::cout;
 using std::endl;
-using std::ifstream;
+using std::stod;
+using std::stoul;
+using std::unique_ptr;
 using std::ostringstream;
-using std::to_string;
-
-struct tex_image {
-  int w;
-  int h;
-  int nch;
-  GLuint rgb;
-  GLuint num;
-  unsigned int texture;
-  unsigned char *data;
-
-  tex_image() : w(0), h(0), nch(0), data(nullptr) {}
-
-
-  static void minimap_setup() {
-    // repeat pattern if overflows in S and T coordinates
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    // minimap
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  }
-
-  void load(const string filename, const GLuint _rgb, const GLuint _num) {
-    rgb = _rgb;
-    num = _num;
-
-    // setup
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    minimap_setup();
-
-    // load image data
-    stbi_set_flip_vertically_on_load(true);
-    data = stbi_load(filename.c_str(), &w, &h, &nch, 0);
-    if (!data) {
-      throw runtime_error("attempted to load non-existant image file: " + filename);
-    }
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, rgb, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-  }
-
-  inline void bind() {
-    glActiveTexture(num);
-    glBindTexture(GL_TEXTURE_2D, texture);
-  }
-
-  void unload() {
-    stbi_image_free(data);
-  }
-};
+using std::vector;
 
-// resize window on drag
-void
-framebuffer_size_callback(GLFWwindow *window, const int w, const int h) {
-  glViewport(0, 0, w, h);
-}
+static const size_t SCREEN_WIDTH = 1024;
+static const size_t SCREEN_HEIGHT = 768;
 
-void
+input_state
 process_input(GLFWwindow *window) {
   if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     glfwSetWindowShouldClose(window, GL_TRUE);
-}
 
-void
-read_file_to_string(const string &fn, const size_t array_size, char *str) {
-  ostringstream oss;
-  ifstream in(fn);
-  if (!in.good())
-    throw runtime_error("cannot open file " + fn);
+  input_state in;
+  if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) in.keys |= INPUT_LEFT;
+  if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) in.keys |= INPUT_RIGHT;
+  if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) in.keys |= INPUT_UP;
+  if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) in.keys |= INPUT_DOWN;
+  return in;
+}
 
-  oss << in.rdbuf();
+// true on the frame a key goes down
+static bool
+key_pressed(GLFWwindow *window, const int key, bool &was_down) {
+  const bool down = glfwGetKey(window, key) == GLFW_PRESS;
+  const bool pressed = down && !was_down;
+  was_down = down;
+  return pressed;
+}
 
-  if (oss.str().size() > array_size)
-    throw runtime_error("file size exceeds " + to_string(array_size) + ": " + fn);
+struct game_options {
+  bool wireframe;
+  double tick_hz;            // simulation ticks per second
+  size_t max_catchup_ticks;  // ticks allowed per frame before dropping time
+  bool profile;              // frame statistics in the title and at exit
+  bool gl_stats;             // GL call counters, toggled with F2
+  string trace_file;         // capture written here, chrome json or perfetto
+  uint64_t trace_start;      // first captured frame
+  uint64_t trace_frames;     // number of captured frames
+  string record_file;        // input log written here
+  string replay_file;        // input log played back instead of the keyboard
+  bool headless;             // replay without a window, simulation only
+  mip_options mips;          // filtering of texture mip chains
+  size_t texture_budget;     // bytes of streamed texture levels
+  vector<string> asset_packs; // mounted in order, later ones win
+  string texture_cache;      // decoded textures kept here, empty for none
+  bool shaders_from_disk;    // shader files instead of the embedded build
+  string font_file;          // of the stats overlay, empty for none
+  bool forward;              // unlit single pass instead of deferred lighting
+
+  game_options() : wireframe(false), tick_hz(60.0), max_catchup_ticks(5),
+                   profile(false), gl_stats(false), trace_start(60),
+                   trace_frames(120), headless(false),
+                   texture_budget(texture_stream_options().budget_bytes),
+                   texture_cache(".texture_cache"), shaders_from_disk(false),
+                   font_file("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"),
+                   forward(false) {}
+};
 
-  strcpy(str, oss.str().c_str());
+static void
+save_trace(const string &path) {
+  const profile_capture capture = profile_capture_take();
+  if (capture.events.empty()) {
+    cerr << "trace: no frames captured" << endl;
+    return;
+  }
+  write_trace(path, capture);
+  cerr << "wrote frames " << capture.first_frame << "-"
+       << capture.first_frame + capture.frame_count - 1 << " to " << path << endl;
 }
 
-enum shader_type {TYPE_VERTEX_SHADER, TYPE_FRAGMENT_SHADER};
-template<const shader_type type>
-GLuint
-compile_shader() {
-  // init shader
-  static const size_t MAX_FILE_SIZE = 65536;
-  GLchar *shader_source = (char*)malloc(MAX_FILE_SIZE*sizeof(char));
-
-  GLuint shader;
-  if (type == TYPE_VERTEX_SHADER) {
-    read_file_to_string("shaders/vertex.shader", MAX_FILE_SIZE, shader_source);
-    shader = glCreateShader(GL_VERTEX_SHADER);
-  }
-  else {
-    read_file_to_string("shaders/fragment.shader", MAX_FILE_SIZE, shader_source);
-    shader = glCreateShader(GL_FRAGMENT_SHADER);
+static game_options
+parse_options(const int argc, const char **argv) {
+  game_options opts;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    const bool has_value = (i + 1 < argc);
+    if (arg == "wireframe")
+      opts.wireframe = true;
+    else if (arg == "--tick-hz" && has_value)
+      opts.tick_hz = stod(argv[++i]);
+    else if (arg == "--max-catchup" && has_value)
+      opts.max_catchup_ticks = stoul(argv[++i]);
+    else if (arg == "--profile")
+      opts.profile = true;
+    else if (arg == "--gl-stats")
+      opts.gl_stats = true;
+    else if (arg == "--trace" && has_value)
+      opts.trace_file = argv[++i];
+    else if (arg == "--trace-start" && has_value)
+      opts.trace_start = stoul(argv[++i]);
+    else if (arg == "--trace-frames" && has_value)
+      opts.trace_frames = stoul(argv[++i]);
+    else if (arg == "--record" && has_value)
+      opts.record_file = argv[++i];
+    else if (arg == "--replay" && has_value)
+      opts.replay_file = argv[++i];
+    else if (arg == "--headless")
+      opts.headless = true;
+    else if (arg == "--mip-filter" && has_value) {
+      const string filter = argv[++i];
+      if (filter != "box" && filter != "kaiser")
+        throw runtime_error("unknown mip filter: " + filter);
+      opts.mips.filter = (filter == "kaiser") ? MIP_KAISER : MIP_BOX;
+    }
+    else if (arg == "--srgb-mips")
+      opts.mips.srgb = true;
+    else if (arg == "--texture-budget" && has_value)
+      opts.texture_budget = stoul(argv[++i]) << 20;
+    else if (arg == "--assets" && has_value)
+      opts.asset_packs.push_back(argv[++i]);
+    else if (arg == "--texture-cache" && has_value)
+      opts.texture_cache = argv[++i];
+    else if (arg == "--no-texture-cache")
+      opts.texture_cache.clear();
+    else if (arg == "--shaders-from-disk")
+      opts.shaders_from_disk = true;
+    else if (arg == "--font" && has_value)
+      opts.font_file = argv[++i];
+    else if (arg == "--no-font")
+      opts.font_file.clear();
+    else if (arg == "--forward")
+      opts.forward = true;
+    else
+      throw runtime_error("unknown argument: " + arg);
   }
+  // a capture needs the profiler running, and counters make it useful
+  if (!opts.trace_file.empty())
+    opts.profile = opts.gl_stats = true;
+  if (!opts.record_file.empty() && !opts.replay_file.empty())
+    throw runtime_error("--record and --replay are exclusive");
+  if (opts.headless && opts.replay_file.empty())
+    throw runtime_error("--headless needs --replay");
+  return opts;
+}
 
-  glShaderSource(shader, 1, &shader_source, NULL);
-  glCompileShader(shader);
-
-  // check if init was OK
-  int success;
-  char info_log[512];
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    const bool vtx = (type == TYPE_VERTEX_SHADER);
-    glGetShaderInfoLog(shader, 512, NULL, info_log);
-    cerr << "problem with " << (vtx ? "vertex" : "fragment")
-         << " shader: " << info_log;
-    return 0;
+// frame time report of a replay; false if it stopped before the end of
+// the log or the simulation did not end in the recorded state
+static bool
+report_replay(const input_log &log, const size_t replayed, game_state &state,
+              const vector<double> &frame_times) {
+  frame_time_report(frame_times).print(cout);
+  if (replayed < log.frames.size()) {
+    cerr << "replay stopped after " << replayed << " of "
+         << log.frames.size() << " frames" << endl;
+    return false;
+  }
+  if (!log.has_checksum) {
+    cerr << "recording was cut short, state not checked" << endl;
+    return true;
   }
-  return shader;
+  const bool match = state.checksum() == log.checksum;
+  cout << (match ? "state matches the recording" :
+                   "state DIFFERS from the recording") << endl;
+  return match;
 }
 
-static GLuint
-init_shaders() {
-  GLuint vertex_shader = compile_shader<TYPE_VERTEX_SHADER>();
-  GLuint fragment_shader = compile_shader<TYPE_FRAGMENT_SHADER>();
-
-  if (vertex_shader == 0 || fragment_shader == 0)
-    return GL_FALSE;
-
-  GLuint shader_program = glCreateProgram();
-
-  glAttachShader(shader_program, vertex_shader);
-  glAttachShader(shader_program, fragment_shader);
-  glLinkProgram(shader_program);
-
-  // check if init was OK
-  int success;
-  char info_log[512];
-  glGetShaderiv(shader_program, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(shader_program, 512, NULL, info_log);
-    cerr << "problem with linking shader to program: " << info_log << endl;
-    return 0;
+// Replays a log as fast as possible without a window or GL: only the
+// game thread work (simulation and frame building) is timed.
+static int
+run_headless_replay(const game_options &opts, const input_log &log) {
+  job_system jobs;
+  game_state state(jobs);
+  state.add_demo_effects();
+  fixed_timestep timestep(log.tick_hz, log.max_catchup_ticks);
+  frame_packet packet;
+  packet.fb_width = SCREEN_WIDTH;
+  packet.fb_height = SCREEN_HEIGHT;
+
+  vector<double> frame_times;
+  frame_times.reserve(log.frames.size());
+  double elapsed = 0.0;  // replayed time, drives effects and lights
+  for (size_t frame = 0; frame < log.frames.size(); ++frame) {
+    profile_set_frame(frame);
+    PROFILE_SCOPE("frame");
+    const double start = clock_seconds();
+
+    const input_frame &f = log.frames[frame];
+    const size_t ticks = timestep.advance(f.frame_time);
+    {
+      PROFILE_SCOPE("simulate");
+      for (size_t i = 0; i < ticks; ++i)
+        state.step(f.in, timestep.dt);
+    }
+    elapsed += f.frame_time;
+    packet.reset();
+    packet.frame = frame;
+    packet.uniforms.time = glm::vec4(elapsed, f.frame_time, frame, 0.f);
+    state.build_frame(static_cast<float>(timestep.alpha()), true, packet);
+    frame_times.push_back(clock_seconds() - start);
+
+    if (opts.profile) {
+      profile_collect(frame);
+      if (profile_capture_ready())
+        save_trace(opts.trace_file);
+    }
   }
 
-  glDeleteShader(vertex_shader);
-  glDeleteShader(fragment_shader);
-
-  return shader_program;
+  if (opts.profile) {
+    profile_collect(log.frames.size() + 1000);
+    profile_print(cerr);
+  }
+  return report_replay(log, log.frames.size(), state, frame_times) ?
+    EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-inline void
-glClearColor255(const int r, const int g, const int b, const int a) {
-  glClearColor(
+inline glm::vec4
+rgba255(const int r, const int g, const int b, const int a) {
+  return glm::vec4(
       static_cast<float>(r)/255.0,
       static_cast<float>(g)/255.0,
       static_cast<float>(b)/255.0,
@@ -176,51 +240,75 @@ glClearColor255(const int r, const int g, const int b, const int a) {
   );
 }
 
-inline void
-init_vertex_buffer(GLuint &vertex_array_object,
-                   GLuint &vertex_buffer_object,
-                   GLuint &element_buffer_object) {
-  // generate
-  glGenVertexArrays(1, &vertex_array_object);
-  glGenBuffers(1, &vertex_buffer_object);
-  glGenBuffers(1, &element_buffer_object);
-
-  // bind
-  glBindVertexArray(vertex_array_object);
-  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_object);
+// summary of the frame profiler and GL counters, one item per line
+static vector<string>
+stats_lines() {
+  vector<string> lines;
+  ostringstream oss;
+  oss << std::fixed << std::setprecision(2);
+  if (gl_stats_requested()) {
+    const gl_frame_stats gl = gl_stats_last_frame();
+    oss << "GL " << gl.calls << " calls " << gl.draws << " draws "
+        << gl.triangles << " tris " << gl.upload_bytes/1024 << " KiB";
+    lines.push_back(oss.str());
+  }
+  for (const scope_stats &s : profile_stats()) {
+    if ((s.track == "game" && s.name == "frame") ||
+        (s.track == "GPU" && (s.name == "scene" || s.name == "text")) ||
+        (s.track == "render" && s.name == "draw_text")) {
+      oss.str("");
+      oss << s.track << " " << s.name << " " << s.mean_ms
+          << " ms (p99 " << s.p99_ms << ")";
+      lines.push_back(oss.str());
+    }
+  }
+  return lines;
 }
 
-void
-load_vertices(const vector<float> &vertices,
-              const vector<uint32_t> &indices) {
-  glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(float), vertices.data(), GL_STATIC_DRAW);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+static string
+stats_title(const string &game_name, const vector<string> &lines) {
+  string title = game_name;
+  for (const string &l : lines)
+    title += " | " + l;
+  return title;
 }
 
-inline void
-postprocess_vertex_buffer() {
-  // coordinates attribute (location = 0 on vertex.shader)
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*) 0);
-  glEnableVertexAttribArray(0);
-
-  // color attribute (location = 1 on vertex.shader)
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*) (6*sizeof(float)));
-  glEnableVertexAttribArray(1);
-
-  // texture coord attribute
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*) (6*sizeof(float)));
-  glEnableVertexAttribArray(2);
+static string
+stats_overlay(const vector<string> &lines) {
+  string text;
+  for (const string &l : lines)
+    text += l + "\n";
+  return text;
 }
 
-
 int
 main(int argc, const char **argv) {
-  static const size_t SCREEN_WIDTH = 1024;
-  static const size_t SCREEN_HEIGHT = 768;
   static const string GAME_NAME = "First Game";
 
-  const bool wireframe_mode = (argc > 1 && strcmp(argv[1], "wireframe") == 0);
+  game_options opts = parse_options(argc, argv);
+  profile_enable(opts.profile);
+  profile_set_thread_name("game");
+  gl_stats_request(opts.gl_stats);
+  if (!opts.trace_file.empty())
+    profile_capture_start(opts.trace_start, opts.trace_frames);
+  for (const string &pack : opts.asset_packs)
+    mount_asset_pack(pack);
+  set_texture_cache(opts.texture_cache);
+
+  // a replay brings its own timestep settings
+  input_log log;
+  if (!opts.replay_file.empty()) {
+    log = read_input_log(opts.replay_file);
+    opts.tick_hz = log.tick_hz;
+    opts.max_catchup_ticks = log.max_catchup_ticks;
+    if (opts.headless)
+      return run_headless_replay(opts, log);
+  }
+  unique_ptr<input_recorder> recorder;
+  if (!opts.record_file.empty())
+    recorder.reset(new input_recorder(opts.record_file, opts.tick_hz,
+                                      opts.max_catchup_ticks));
+
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -237,99 +325,123 @@ main(int argc, const char **argv) {
     throw runtime_error("Failed to initialize window with GLFW!");
   }
 
-  // bind resizing to drag operation
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwMakeContextCurrent(window);
-
-  // init GLAD
-  if (!gladLoadGLLoader((GLADloadproc)(glfwGetProcAddress))) {
-    glfwTerminate();
-    throw runtime_error("Failed to initialize GLAD!");
+  // the render thread takes over the GL context from here on; the
+  // workers build texture mips and stream textures for it
+  job_system jobs;
+  renderer_options ropts;
+  ropts.wireframe = opts.wireframe;
+  ropts.mips = opts.mips;
+  ropts.jobs = &jobs;
+  ropts.streaming.budget_bytes = opts.texture_budget;
+  ropts.shaders_from_disk = opts.shaders_from_disk;
+  ropts.text.font_file = opts.font_file;
+  ropts.deferred = !opts.forward;
+  unique_ptr<render_thread> rt;
+  try {
+    rt.reset(new render_thread(window, ropts));
   }
-
-  // shader program
-  GLuint shader_program = init_shaders();
-  if (!shader_program) {
+  catch (...) {
     glfwTerminate();
-    throw runtime_error("Failed to compile shaders!");
+    throw;
   }
 
-  GLuint vertex_array_object = 0;
-  GLuint vertex_buffer_object = 0;
-  GLuint element_buffer_object = 0;
-  init_vertex_buffer(vertex_array_object,
-                     vertex_buffer_object,
-                     element_buffer_object);
+  // simulation runs in fixed ticks, rendering as fast as frames come
+  game_state state(jobs);
+  state.add_demo_effects();
+  fixed_timestep timestep(opts.tick_hz, opts.max_catchup_ticks);
+  const double start_time = clock_seconds();
+  double last_time = start_time;
+  uint64_t frame = 0;
+  double last_title_time = start_time;
+  bool title_has_stats = false;
+  string overlay;  // the stats again, drawn over the game
+  bool f2_down = false;
+  const bool replaying = !opts.replay_file.empty();
+  vector<double> frame_times;
 
-  if (vertex_array_object == 0 ||
-      vertex_buffer_object == 0 ||
-      element_buffer_object == 0) {
-    glfwTerminate();
-    throw runtime_error("Failed to init vertex buffer");
-  }
-
-  tex_image tx_container;
-  tex_image tx_face;
-  tx_container.load("container.jpg", GL_RGB, GL_TEXTURE0);
-  tx_face.load("awesomeface.png", GL_RGBA, GL_TEXTURE1);
-
-  // triangle
-  vector<float> square = {
-    -0.5f, -0.5f, 0.f, 0.5f, 0.5f, 0.5f, 0.f, 0.f,
-     0.5f, -0.5f, 0.f, 0.5f, 0.5f, 0.5f, 1.f, 0.f,
-    -0.5f,  0.5f, 0.f, 0.5f, 0.5f, 0.5f, 0.f, 1.f,
-     0.5f,  0.5f, 0.f, 0.5f, 0.5f, 0.5f, 1.f, 1.f
-  };
+  while (!glfwWindowShouldClose(window)) {
+    if (replaying && frame == log.frames.size())
+      break;
+    profile_set_frame(frame);
+    PROFILE_SCOPE("frame");
+
+    // inputs, from the keyboard or the log being replayed
+    input_state in = process_input(window);
+    if (key_pressed(window, GLFW_KEY_F2, f2_down))
+      gl_stats_request(!gl_stats_requested());
+
+    // simulate
+    const double now = clock_seconds();
+    double frame_time = now - last_time;
+    if (replaying) {
+      frame_times.push_back(frame_time);
+      in = log.frames[frame].in;
+      frame_time = log.frames[frame].frame_time;
+    }
+    else if (recorder)
+      frame_time = recorder->record(in, frame_time);
+    const size_t ticks = timestep.advance(frame_time);
+    last_time = now;
+    {
+      PROFILE_SCOPE("simulate");
+      for (size_t i = 0; i < ticks; ++i)
+        state.step(in, timestep.dt);
+    }
 
-  vector<uint32_t> square_indices = {
-    0, 1, 2,
-    1, 2, 3
-  };
+    // build the frame for the render thread, which is still busy
+    // drawing the previous one
+    frame_packet &packet = rt->begin_frame();
+    packet.frame = frame++;
+    glfwGetFramebufferSize(window, &packet.fb_width, &packet.fb_height);
+    packet.clear_color = rgba255(42, 94, 140, 255);
+    packet.uniforms.time = glm::vec4(now - start_time, frame_time, packet.frame, 0.f);
 
-  load_vertices(square, square_indices);
-  postprocess_vertex_buffer();
+    state.build_frame(static_cast<float>(timestep.alpha()),
+                      rt->caps().reversed_z, packet);
+    if (!overlay.empty())
+      packet.add_text(overlay.c_str(), glm::vec2(8.f), 16.f, 0xffffffffu);
+    rt->submit();
 
+    // post
+    glfwPollEvents();
 
-  if (wireframe_mode) {
-    cerr << "running in wireframe mode" << endl;
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    if (opts.profile) {
+      profile_collect(frame);
+      if (profile_capture_ready())
+        save_trace(opts.trace_file);
+    }
+    const bool show_stats = opts.profile || gl_stats_requested();
+    if ((show_stats || title_has_stats) && now - last_title_time >= 1.0) {
+      const vector<string> lines = stats_lines();
+      glfwSetWindowTitle(window, stats_title(GAME_NAME, lines).c_str());
+      overlay = show_stats ? stats_overlay(lines) : string();
+      last_title_time = now;
+      title_has_stats = show_stats;
+    }
   }
 
-  glUseProgram(shader_program);
-  glUniform1i(glGetUniformLocation(shader_program, "texture1"), 0);
-  glUniform1i(glGetUniformLocation(shader_program, "texture2"), 1);
+  rt.reset();
 
-  while (!glfwWindowShouldClose(window)) {
-    // inputs
-    process_input(window);
-
-    // render
-    glClearColor255(42, 94, 140, 255);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    // texture
-    tx_container.bind();
-    tx_face.bind();
-
-    // draw
-    glBindVertexArray(vertex_array_object);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-    // post
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+  if (opts.profile) {
+    profile_collect(frame + 1000);
+    // window closed mid capture: keep what was recorded
+    if (profile_capture_ready())
+      save_trace(opts.trace_file);
+    profile_print(cerr);
   }
+  gl_stats_print(cerr);
+
+  int status = EXIT_SUCCESS;
+  if (recorder)
+    recorder->finish(state.checksum());
+  if (replaying && !report_replay(log, frame, state, frame_times))
+    status = EXIT_FAILURE;
 
-  // free textures
-  tx_container.unload();
-  tx_face.unload();
+  if (timestep.dropped_ticks > 0)
+    cerr << "dropped " << timestep.dropped_ticks << " simulation ticks" << endl;
 
-  glDeleteVertexArrays(1, &vertex_array_object);
-  glDeleteBuffers(1, &vertex_buffer_object);
-  glDeleteBuffers(1, &element_buffer_object);
-  glDeleteProgram(shader_program);
   glfwTerminate();
   std::cerr << "Bye!" << endl;
-  return EXIT_SUCCESS;
+  return status;
 }
 
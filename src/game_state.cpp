@@ -0,0 +1,258 @@
+#include "game_state.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "components.hpp"
+#include "profiler.hpp"
+
+using std::vector;
+
+static const float SQUARE_ACCEL = 4.0f;     // units per second^2
+static const float SQUARE_DRAG = 3.0f;      // velocity decay per second
+static const float SQUARE_SPIN = 0.75f;     // radians per second
+static const float SQUARE_BOUND = 0.75f;    // keep it inside clip space
+static const float MOON_DISTANCE = 0.7f;    // relative to the square
+static const float MOON_SCALE = 0.35f;
+static const float MOON_SPIN = 2.0f;
+static const float MOON_LIFT = 0.05f;       // in front of the square
+static const size_t EFFECT_PARTICLES = 1 << 14;
+static const size_t LIGHTS = 200;
+static const float LIGHT_RADIUS = 0.35f;
+static const float LIGHT_HEIGHT = 0.15f;    // above the squares
+
+game_state::game_state(job_system &_jobs)
+  : jobs(&_jobs), effects(EFFECT_PARTICLES), trail(NO_EMITTER) {
+  transform t;
+  t.pos = glm::vec3(0.f);
+  t.angle = 0.f;
+
+  prev_transform pt;
+  pt.pos = t.pos;
+  pt.angle = t.angle;
+
+  velocity v;
+  v.linear = glm::vec3(0.f);
+  v.angular = SQUARE_SPIN;
+
+  renderable r;
+  r.mesh = MESH_SQUARE;
+  r.material = 0;
+  r.uv_rect = glm::vec4(0.f, 0.f, 1.f, 1.f);
+
+  scene_node sn;
+  sn.node = scene.create();
+  player = entities.create(t, pt, v, r, sn, player_control());
+
+  // a smaller square riding on the player, its transform is local to it
+  t.pos = pt.pos = glm::vec3(MOON_DISTANCE, 0.f, MOON_LIFT);
+  v.angular = MOON_SPIN;
+  sn.node = scene.create(sn.node);
+  scene.set_scale(sn.node, glm::vec3(MOON_SCALE));
+  entities.create(t, pt, v, r, sn);
+  dust.active = false;
+  ambient = glm::vec3(1.f);  // unlit, as drawn forward
+}
+
+void
+game_state::add_demo_effects() {
+  // sparks trailing the player, drifting down as they fade
+  particle_emitter sparks;
+  sparks.radius = 0.15f;
+  sparks.spread = 0.2f;
+  sparks.rate = 600.f;
+  sparks.lifetime = 0.8f;
+  sparks.lifetime_jitter = 0.4f;
+  sparks.start_size = 0.06f;
+  sparks.end_size = 0.01f;
+  sparks.start_color = 0xc040c0ffu;
+  sparks.end_color = 0x002080ffu;
+  trail = effects.add_emitter(sparks);
+  effects.forces.gravity = glm::vec2(0.f, -0.4f);
+  effects.forces.drag = 1.f;
+
+  // faint dust all over the screen, too much of it for the CPU path
+  dust.active = true;
+  dust.radius = 2.f;
+  dust.spread = 0.05f;
+  dust.velocity = glm::vec2(0.f, 0.03f);
+  dust.rate = 20000.f;
+  dust.lifetime = 3.f;
+  dust.lifetime_jitter = 0.5f;
+  dust.start_size = 0.01f;
+  dust.end_size = 0.004f;
+  dust.start_color = 0x40ffe0c0u;
+  dust.end_color = 0x00ffc080u;
+  dust_forces.drag = 0.5f;
+
+  // colored lights circling over the squares
+  ambient = glm::vec3(0.3f);
+  add_lights(LIGHTS, glm::vec2(1.3f, 1.f), LIGHT_RADIUS);
+}
+
+static float
+random01(uint32_t &s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return (s >> 8)*(1.f/16777216.f);
+}
+
+void
+game_state::add_lights(const size_t n, const glm::vec2 half_extent,
+                       const float radius) {
+  uint32_t seed = 0x2545f491u + 0x9e3779b9u*static_cast<uint32_t>(lights.size());
+  for (size_t i = 0; i < n; ++i) {
+    orbit_light l;
+    l.center = glm::vec2((2.f*random01(seed) - 1.f)*half_extent.x,
+                         (2.f*random01(seed) - 1.f)*half_extent.y);
+    l.orbit = 0.1f + 0.3f*random01(seed);
+    l.speed = (random01(seed) < 0.5f ? -1.f : 1.f)*(0.3f + random01(seed));
+    l.phase = 6.2831853f*random01(seed);
+    // a saturated hue
+    const float hue = 6.f*random01(seed);
+    l.light.color = glm::clamp(glm::vec3(std::fabs(hue - 3.f) - 1.f,
+                                         2.f - std::fabs(hue - 2.f),
+                                         2.f - std::fabs(hue - 4.f)), 0.f, 1.f);
+    l.light.position = glm::vec3(l.center, LIGHT_HEIGHT);
+    l.light.radius = radius;
+    l.light.intensity = 1.5f;
+    lights.push_back(l);
+  }
+}
+
+void
+game_state::step(const input_state &in, const double dt) {
+  PROFILE_SCOPE("step");
+  const float h = static_cast<float>(dt);
+
+  // remember where everything was for interpolation
+  entities.par_each_chunk<transform, prev_transform>(*jobs,
+    [](const size_t n, const entity *, transform *t, prev_transform *pt) {
+      for (size_t i = 0; i < n; ++i) {
+        pt[i].pos = t[i].pos;
+        pt[i].angle = t[i].angle;
+      }
+    });
+
+  // steering
+  glm::vec3 accel(0.f);
+  if (in.held(INPUT_LEFT)) accel.x -= SQUARE_ACCEL;
+  if (in.held(INPUT_RIGHT)) accel.x += SQUARE_ACCEL;
+  if (in.held(INPUT_DOWN)) accel.y -= SQUARE_ACCEL;
+  if (in.held(INPUT_UP)) accel.y += SQUARE_ACCEL;
+
+  const float drag = glm::clamp(SQUARE_DRAG*h, 0.f, 1.f);
+  entities.each<player_control, velocity>(
+    [&accel, h, drag](player_control &, velocity &v) {
+      v.linear += accel*h;
+      v.linear -= v.linear*drag;
+    });
+
+  // semi-implicit euler, stable enough at fixed dt
+  entities.par_each_chunk<transform, velocity>(*jobs,
+    [h](const size_t n, const entity *, transform *t, velocity *v) {
+      for (size_t i = 0; i < n; ++i) {
+        t[i].pos += v[i].linear*h;
+        t[i].angle += v[i].angular*h;
+      }
+    });
+
+  entities.each<player_control, transform>(
+    [](player_control &, transform &t) {
+      t.pos = glm::clamp(t.pos, -SQUARE_BOUND, SQUARE_BOUND);
+    });
+}
+
+static void
+fnv1a(uint64_t &h, const void *data, const size_t bytes) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < bytes; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ull;
+  }
+}
+
+uint64_t
+game_state::checksum() {
+  uint64_t h = 0xcbf29ce484222325ull;
+  entities.each_chunk<transform, velocity>(
+    [&h](const size_t n, const entity *, transform *t, velocity *v) {
+      fnv1a(h, t, n*sizeof(transform));
+      fnv1a(h, v, n*sizeof(velocity));
+    });
+  return h;
+}
+
+void
+game_state::build_frame(const float alpha, const bool reversed_z,
+                         frame_packet &packet) {
+  PROFILE_SCOPE("build_frame");
+  const float aspect = (packet.fb_height > 0) ?
+    static_cast<float>(packet.fb_width)/packet.fb_height : 1.f;
+  frame_uniforms &u = packet.uniforms;
+  u.view = cam.view();
+  u.proj = cam.projection(aspect, reversed_z);
+  u.view_proj = u.proj*u.view;
+  u.camera_pos = glm::vec4(cam.position, 1.f);
+
+  // only touch nodes that actually moved, so resting subtrees keep their
+  // world matrices and are not sent to the GPU again
+  entities.each<transform, prev_transform, scene_node>(
+    [this, alpha](transform &t, prev_transform &pt, scene_node &sn) {
+      const glm::vec3 pos = glm::mix(pt.pos, t.pos, alpha);
+      const float angle = glm::mix(pt.angle, t.angle, alpha);
+      const glm::quat rot = glm::angleAxis(angle, glm::vec3(0.f, 0.f, 1.f));
+
+      if (pos != scene.position(sn.node))
+        scene.set_position(sn.node, pos);
+      const glm::quat &old = scene.rotation(sn.node);
+      if (rot.x != old.x || rot.y != old.y || rot.z != old.z || rot.w != old.w)
+        scene.set_rotation(sn.node, rot);
+    });
+  scene.update();
+
+  // effects start where the player is drawn
+  const transform &t = *entities.get<transform>(player);
+  const prev_transform &pt = *entities.get<prev_transform>(player);
+  const glm::vec3 at = glm::mix(pt.pos, t.pos, alpha);
+  if (trail != NO_EMITTER)
+    effects.emitter(trail).position = glm::vec2(at.x, at.y);
+  effects.update(u.time.y, packet.particles, jobs);
+  packet.particles.transform = u.view_proj;
+  packet.gpu_emitter = dust;
+  packet.gpu_forces = dust_forces;
+
+  const float seconds = u.time.x;
+  for (const orbit_light &l : lights) {
+    point_light p = l.light;
+    const float angle = l.phase + l.speed*seconds;
+    p.position.x = l.center.x + l.orbit*std::cos(angle);
+    p.position.y = l.center.y + l.orbit*std::sin(angle);
+    packet.lights.push_back(p);
+  }
+  packet.ambient_light = ambient;
+
+  const vector<glm::mat4> &worlds = scene.world_matrices();
+  packet.matrix_count = static_cast<uint32_t>(worlds.size());
+  packet.matrix_first = static_cast<uint32_t>(scene.changed_first());
+  packet.matrices.assign(worlds.begin() + scene.changed_first(),
+                         worlds.begin() + scene.changed_last());
+
+  entities.each<renderable, scene_node>(
+    [this, &packet](renderable &r, scene_node &sn) {
+      draw_item d;
+      d.mesh = r.mesh;
+      d.matrix = scene.slot(sn.node);
+      d.material = r.material;
+      d.uv_rect = r.uv_rect;
+      packet.draws.push_back(d);
+    });
+
+  // runs of one material become one instanced draw
+  std::stable_sort(packet.draws.begin(), packet.draws.end(),
+    [](const draw_item &a, const draw_item &b) {
+      return a.material != b.material ? a.material < b.material :
+                                        a.mesh < b.mesh;
+    });
+}
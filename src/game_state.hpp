@@ -0,0 +1,83 @@
+#ifndef GAME_STATE_HPP
+#define GAME_STATE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "camera.hpp"
+#include "ecs.hpp"
+#include "frame_packet.hpp"
+#include "particles.hpp"
+#include "scene_graph.hpp"
+
+enum input_key : uint32_t {
+  INPUT_LEFT  = 1u << 0,
+  INPUT_RIGHT = 1u << 1,
+  INPUT_UP    = 1u << 2,
+  INPUT_DOWN  = 1u << 3
+};
+
+// keys held during a frame, sampled once and applied to every tick of
+// that frame
+struct input_state {
+  uint32_t keys;
+
+  input_state() : keys(0) {}
+  bool held(const input_key k) const { return (keys & k) != 0; }
+};
+
+// a point light going round a circle over the scene
+struct orbit_light {
+  point_light light;  // position.z is kept, x and y go round
+  glm::vec2 center;
+  float orbit;        // radius of the circle
+  float speed;        // radians per second
+  float phase;
+};
+
+static const uint32_t NO_EMITTER = ~0u;
+
+// Everything the simulation owns. It only advances in fixed ticks and
+// keeps the previous tick around so frames can be interpolated.
+struct game_state {
+  world entities;
+  scene_graph scene;
+  camera cam;
+  entity player;
+  job_system *jobs;
+  particle_system effects;  // cosmetic, left out of the checksum
+  uint32_t trail;           // emitter following the player, if any
+  particle_emitter dust;    // GPU particles, sent every frame, off at first
+  particle_forces dust_forces;
+  std::vector<orbit_light> lights;  // cosmetic as well
+  glm::vec3 ambient;
+
+  // the player and its moon, without effects
+  explicit game_state(job_system &_jobs);
+
+  // the game's own effects, left out of benchmark scenes so each one
+  // only pays for what it measures
+  void add_demo_effects();
+
+  // n lights of the given radius and random colors, circling over
+  // random points within half_extent of the origin
+  void add_lights(const size_t n, const glm::vec2 half_extent,
+                  const float radius);
+
+  void step(const input_state &in, const double dt);
+
+  // hash of the simulated state (transforms and velocities), equal for
+  // equal runs; used to check that a replay matches its recording
+  uint64_t checksum();
+
+  // blends every renderable between the last two ticks and adds its
+  // draw and changed world matrices to the packet, plus the camera;
+  // effects advance by the packet's frame time (uniforms.time.y) and
+  // lights go round by its clock (uniforms.time.x)
+  void build_frame(const float alpha, const bool reversed_z,
+                   frame_packet &packet);
+};
+
+#endif
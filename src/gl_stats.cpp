@@ -0,0 +1,437 @@
+#include "gl_stats.hpp"
+
+#include "glad.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <vector>
+
+#include "profiler.hpp"
+
+using std::atomic;
+using std::vector;
+using std::pair;
+using std::ostream;
+using std::endl;
+using std::setw;
+
+enum gl_call_kind {
+  GL_CALL_OTHER,
+  GL_CALL_STATE,   // binds and pipeline state
+  GL_CALL_DRAW,
+  GL_CALL_UPLOAD   // data copied from client memory
+};
+
+// entry points that get counted; anything not listed runs uncounted
+#define GL_STATS_ENTRIES(X) \
+  X(glDrawArrays, GL_CALL_DRAW) \
+  X(glDrawElements, GL_CALL_DRAW) \
+  X(glDrawArraysInstanced, GL_CALL_DRAW) \
+  X(glDrawElementsInstanced, GL_CALL_DRAW) \
+  X(glDrawElementsBaseVertex, GL_CALL_DRAW) \
+  X(glDrawElementsInstancedBaseVertex, GL_CALL_DRAW) \
+  X(glDrawRangeElements, GL_CALL_DRAW) \
+  X(glMultiDrawArraysIndirect, GL_CALL_DRAW) \
+  X(glMultiDrawElementsIndirect, GL_CALL_DRAW) \
+  X(glBlitFramebuffer, GL_CALL_OTHER) \
+  X(glClear, GL_CALL_OTHER) \
+  X(glBufferData, GL_CALL_UPLOAD) \
+  X(glBufferSubData, GL_CALL_UPLOAD) \
+  X(glNamedBufferData, GL_CALL_UPLOAD) \
+  X(glNamedBufferSubData, GL_CALL_UPLOAD) \
+  X(glTexImage2D, GL_CALL_UPLOAD) \
+  X(glTexImage3D, GL_CALL_UPLOAD) \
+  X(glTexSubImage2D, GL_CALL_UPLOAD) \
+  X(glTexSubImage3D, GL_CALL_UPLOAD) \
+  X(glCompressedTexImage2D, GL_CALL_UPLOAD) \
+  X(glCompressedTexImage3D, GL_CALL_UPLOAD) \
+  X(glCompressedTexSubImage2D, GL_CALL_UPLOAD) \
+  X(glCompressedTexSubImage3D, GL_CALL_UPLOAD) \
+  X(glMapBufferRange, GL_CALL_OTHER) \
+  X(glUnmapBuffer, GL_CALL_OTHER) \
+  X(glFlushMappedBufferRange, GL_CALL_OTHER) \
+  X(glCopyBufferSubData, GL_CALL_OTHER) \
+  X(glUseProgram, GL_CALL_STATE) \
+  X(glBindVertexArray, GL_CALL_STATE) \
+  X(glBindBuffer, GL_CALL_STATE) \
+  X(glBindBufferBase, GL_CALL_STATE) \
+  X(glBindBufferRange, GL_CALL_STATE) \
+  X(glBindTexture, GL_CALL_STATE) \
+  X(glActiveTexture, GL_CALL_STATE) \
+  X(glBindSampler, GL_CALL_STATE) \
+  X(glBindFramebuffer, GL_CALL_STATE) \
+  X(glBindRenderbuffer, GL_CALL_STATE) \
+  X(glTexBuffer, GL_CALL_STATE) \
+  X(glEnable, GL_CALL_STATE) \
+  X(glDisable, GL_CALL_STATE) \
+  X(glBlendFunc, GL_CALL_STATE) \
+  X(glBlendFuncSeparate, GL_CALL_STATE) \
+  X(glBlendEquation, GL_CALL_STATE) \
+  X(glDepthFunc, GL_CALL_STATE) \
+  X(glDepthMask, GL_CALL_STATE) \
+  X(glColorMask, GL_CALL_STATE) \
+  X(glCullFace, GL_CALL_STATE) \
+  X(glPolygonMode, GL_CALL_STATE) \
+  X(glViewport, GL_CALL_STATE) \
+  X(glScissor, GL_CALL_STATE) \
+  X(glDrawBuffers, GL_CALL_STATE) \
+  X(glVertexAttribPointer, GL_CALL_STATE) \
+  X(glVertexAttribIPointer, GL_CALL_STATE) \
+  X(glVertexAttribDivisor, GL_CALL_STATE) \
+  X(glEnableVertexAttribArray, GL_CALL_STATE) \
+  X(glDisableVertexAttribArray, GL_CALL_STATE) \
+  X(glBeginTransformFeedback, GL_CALL_STATE) \
+  X(glEndTransformFeedback, GL_CALL_STATE) \
+  X(glUniform1i, GL_CALL_OTHER) \
+  X(glUniform1f, GL_CALL_OTHER) \
+  X(glUniform2f, GL_CALL_OTHER) \
+  X(glUniform3f, GL_CALL_OTHER) \
+  X(glUniform4f, GL_CALL_OTHER) \
+  X(glUniform4fv, GL_CALL_OTHER) \
+  X(glUniformMatrix4fv, GL_CALL_OTHER) \
+  X(glClearColor, GL_CALL_OTHER) \
+  X(glClearDepth, GL_CALL_OTHER) \
+  X(glTexParameteri, GL_CALL_OTHER) \
+  X(glGenerateMipmap, GL_CALL_OTHER) \
+  X(glBeginQuery, GL_CALL_OTHER) \
+  X(glEndQuery, GL_CALL_OTHER) \
+  X(glQueryCounter, GL_CALL_OTHER) \
+  X(glGetQueryObjectiv, GL_CALL_OTHER) \
+  X(glGetQueryObjectui64v, GL_CALL_OTHER) \
+  X(glGetInteger64v, GL_CALL_OTHER) \
+  X(glGetIntegerv, GL_CALL_OTHER) \
+  X(glGetError, GL_CALL_OTHER) \
+  X(glFenceSync, GL_CALL_OTHER) \
+  X(glClientWaitSync, GL_CALL_OTHER) \
+  X(glDeleteSync, GL_CALL_OTHER) \
+  X(glFlush, GL_CALL_OTHER) \
+  X(glFinish, GL_CALL_OTHER)
+
+#define GL_STATS_ID(name, kind) GL_ID_##name,
+enum gl_entry_id {
+  GL_STATS_ENTRIES(GL_STATS_ID)
+  GL_ENTRY_COUNT
+};
+#undef GL_STATS_ID
+
+#define GL_STATS_NAME(name, kind) #name,
+static const char *const entry_names[GL_ENTRY_COUNT] = {
+  GL_STATS_ENTRIES(GL_STATS_NAME)
+};
+#undef GL_STATS_NAME
+
+#define GL_STATS_KIND(name, kind) kind,
+static const gl_call_kind entry_kinds[GL_ENTRY_COUNT] = {
+  GL_STATS_ENTRIES(GL_STATS_KIND)
+};
+#undef GL_STATS_KIND
+
+// render thread only, apart from the published last frame
+typedef void (APIENTRYP gl_proc)();
+static gl_proc originals[GL_ENTRY_COUNT];
+static uint64_t frame_calls[GL_ENTRY_COUNT];
+static uint64_t total_calls[GL_ENTRY_COUNT];
+static uint64_t counted_frames = 0;
+static uint64_t frame_triangles = 0;
+static uint64_t frame_upload_bytes = 0;
+static bool installed = false;
+
+static atomic<bool> requested(false);
+static atomic<uint64_t> last_calls(0);
+static atomic<uint64_t> last_draws(0);
+static atomic<uint64_t> last_triangles(0);
+static atomic<uint64_t> last_state_changes(0);
+static atomic<uint64_t> last_upload_bytes(0);
+
+/****************** size helpers *******************/
+static uint64_t
+triangles(const GLenum mode, const GLsizei count) {
+  if (count < 3)
+    return 0;
+  switch (mode) {
+    case GL_TRIANGLES: return count/3;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN: return count - 2;
+    default: return 0;
+  }
+}
+
+static uint64_t
+components(const GLenum format) {
+  switch (format) {
+    case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT:
+    case GL_STENCIL_INDEX: return 1;
+    case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL: return 2;
+    case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: return 3;
+    default: return 4;
+  }
+}
+
+// bytes per pixel of client data in format/type
+static uint64_t
+pixel_bytes(const GLenum format, const GLenum type) {
+  switch (type) {
+    case GL_UNSIGNED_BYTE: case GL_BYTE: return components(format);
+    case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+      return 2*components(format);
+    case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+      return 4*components(format);
+    case GL_UNSIGNED_BYTE_3_3_2: case GL_UNSIGNED_BYTE_2_3_3_REV: return 1;
+    case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_5_6_5_REV:
+    case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+    case GL_UNSIGNED_SHORT_5_5_5_1: case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+      return 2;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV: return 8;
+    default: return 4;  // the remaining packed 32 bit types
+  }
+}
+
+static uint64_t
+image_bytes(const GLsizei w, const GLsizei h, const GLsizei d,
+            const GLenum format, const GLenum type, const void *pixels) {
+  // pixels may be an offset into a bound unpack buffer; counted anyway,
+  // the copy still happens, just not from client memory
+  if (pixels == NULL || w <= 0 || h <= 0 || d <= 0)
+    return 0;
+  return static_cast<uint64_t>(w)*h*d*pixel_bytes(format, type);
+}
+
+/****************** per entry hooks *******************/
+template <int ID> struct entry_tag {};
+
+// entries without anything beyond the call count
+template <int ID, typename... A>
+inline void on_call(entry_tag<ID>, A...) {}
+
+inline void
+on_call(entry_tag<GL_ID_glDrawArrays>, GLenum mode, GLint, GLsizei count) {
+  frame_triangles += triangles(mode, count);
+}
+
+inline void
+on_call(entry_tag<GL_ID_glDrawElements>, GLenum mode, GLsizei count,
+        GLenum, const void *) {
+  frame_triangles += triangles(mode, count);
+}
+
+inline void
+on_call(entry_tag<GL_ID_glDrawArraysInstanced>, GLenum mode, GLint,
+        GLsizei count, GLsizei instances) {
+  frame_triangles += triangles(mode, count)*instances;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glDrawElementsInstanced>, GLenum mode, GLsizei count,
+        GLenum, const void *, GLsizei instances) {
+  frame_triangles += triangles(mode, count)*instances;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glDrawElementsBaseVertex>, GLenum mode,
+        GLsizei count, GLenum, const void *, GLint) {
+  frame_triangles += triangles(mode, count);
+}
+
+inline void
+on_call(entry_tag<GL_ID_glDrawElementsInstancedBaseVertex>, GLenum mode,
+        GLsizei count, GLenum, const void *, GLsizei instances, GLint) {
+  frame_triangles += triangles(mode, count)*instances;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glDrawRangeElements>, GLenum mode, GLuint, GLuint,
+        GLsizei count, GLenum, const void *) {
+  frame_triangles += triangles(mode, count);
+}
+
+inline void
+on_call(entry_tag<GL_ID_glBufferData>, GLenum, GLsizeiptr size,
+        const void *data, GLenum) {
+  if (data != NULL) frame_upload_bytes += size;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glBufferSubData>, GLenum, GLintptr, GLsizeiptr size,
+        const void *) {
+  frame_upload_bytes += size;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glNamedBufferData>, GLuint, GLsizeiptr size,
+        const void *data, GLenum) {
+  if (data != NULL) frame_upload_bytes += size;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glNamedBufferSubData>, GLuint, GLintptr,
+        GLsizeiptr size, const void *) {
+  frame_upload_bytes += size;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glTexImage2D>, GLenum, GLint, GLint, GLsizei w,
+        GLsizei h, GLint, GLenum format, GLenum type, const void *pixels) {
+  frame_upload_bytes += image_bytes(w, h, 1, format, type, pixels);
+}
+
+inline void
+on_call(entry_tag<GL_ID_glTexImage3D>, GLenum, GLint, GLint, GLsizei w,
+        GLsizei h, GLsizei d, GLint, GLenum format, GLenum type,
+        const void *pixels) {
+  frame_upload_bytes += image_bytes(w, h, d, format, type, pixels);
+}
+
+inline void
+on_call(entry_tag<GL_ID_glTexSubImage2D>, GLenum, GLint, GLint, GLint,
+        GLsizei w, GLsizei h, GLenum format, GLenum type, const void *pixels) {
+  frame_upload_bytes += image_bytes(w, h, 1, format, type, pixels);
+}
+
+inline void
+on_call(entry_tag<GL_ID_glTexSubImage3D>, GLenum, GLint, GLint, GLint, GLint,
+        GLsizei w, GLsizei h, GLsizei d, GLenum format, GLenum type,
+        const void *pixels) {
+  frame_upload_bytes += image_bytes(w, h, d, format, type, pixels);
+}
+
+inline void
+on_call(entry_tag<GL_ID_glCompressedTexImage2D>, GLenum, GLint, GLenum,
+        GLsizei, GLsizei, GLint, GLsizei size, const void *data) {
+  if (data != NULL) frame_upload_bytes += size;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glCompressedTexImage3D>, GLenum, GLint, GLenum,
+        GLsizei, GLsizei, GLsizei, GLint, GLsizei size, const void *data) {
+  if (data != NULL) frame_upload_bytes += size;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glCompressedTexSubImage2D>, GLenum, GLint, GLint,
+        GLint, GLsizei, GLsizei, GLenum, GLsizei size, const void *) {
+  frame_upload_bytes += size;
+}
+
+inline void
+on_call(entry_tag<GL_ID_glCompressedTexSubImage3D>, GLenum, GLint, GLint,
+        GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLsizei size,
+        const void *) {
+  frame_upload_bytes += size;
+}
+
+// stands in for one entry point: counts, runs the hook, forwards
+template <int ID, typename F> struct counted;
+
+template <int ID, typename R, typename... A>
+struct counted<ID, R (APIENTRYP)(A...)> {
+  static R APIENTRY call(A... args) {
+    ++frame_calls[ID];
+    on_call(entry_tag<ID>(), args...);
+    return reinterpret_cast<R (APIENTRYP)(A...)>(originals[ID])(args...);
+  }
+};
+
+/****************** install *******************/
+static void
+install() {
+#define GL_STATS_INSTALL(name, kind) \
+  originals[GL_ID_##name] = reinterpret_cast<gl_proc>(glad_##name); \
+  if (glad_##name != NULL) \
+    glad_##name = &counted<GL_ID_##name, decltype(glad_##name)>::call;
+  GL_STATS_ENTRIES(GL_STATS_INSTALL)
+#undef GL_STATS_INSTALL
+  installed = true;
+}
+
+static void
+uninstall() {
+#define GL_STATS_UNINSTALL(name, kind) \
+  glad_##name = reinterpret_cast<decltype(glad_##name)>(originals[GL_ID_##name]);
+  GL_STATS_ENTRIES(GL_STATS_UNINSTALL)
+#undef GL_STATS_UNINSTALL
+  installed = false;
+}
+
+/****************** public *******************/
+void
+gl_stats_request(const bool on) {
+  requested.store(on, std::memory_order_relaxed);
+}
+
+bool
+gl_stats_requested() {
+  return requested.load(std::memory_order_relaxed);
+}
+
+void
+gl_stats_frame() {
+  if (installed) {
+    gl_frame_stats s;
+    for (size_t i = 0; i < GL_ENTRY_COUNT; ++i) {
+      const uint64_t n = frame_calls[i];
+      s.calls += n;
+      if (entry_kinds[i] == GL_CALL_DRAW) s.draws += n;
+      if (entry_kinds[i] == GL_CALL_STATE) s.state_changes += n;
+      total_calls[i] += n;
+      frame_calls[i] = 0;
+    }
+    s.triangles = frame_triangles;
+    s.upload_bytes = frame_upload_bytes;
+    frame_triangles = frame_upload_bytes = 0;
+    ++counted_frames;
+
+    last_calls.store(s.calls, std::memory_order_relaxed);
+    last_draws.store(s.draws, std::memory_order_relaxed);
+    last_triangles.store(s.triangles, std::memory_order_relaxed);
+    last_state_changes.store(s.state_changes, std::memory_order_relaxed);
+    last_upload_bytes.store(s.upload_bytes, std::memory_order_relaxed);
+
+    profile_counter("gl_calls", s.calls);
+    profile_counter("draw_calls", s.draws);
+    profile_counter("triangles", s.triangles);
+    profile_counter("state_changes", s.state_changes);
+    profile_counter("uploaded_bytes", s.upload_bytes);
+  }
+
+  const bool want = gl_stats_requested();
+  if (want && !installed)
+    install();
+  else if (!want && installed)
+    uninstall();
+}
+
+void
+gl_stats_shutdown() {
+  if (installed)
+    uninstall();
+}
+
+gl_frame_stats
+gl_stats_last_frame() {
+  gl_frame_stats s;
+  s.calls = last_calls.load(std::memory_order_relaxed);
+  s.draws = last_draws.load(std::memory_order_relaxed);
+  s.triangles = last_triangles.load(std::memory_order_relaxed);
+  s.state_changes = last_state_changes.load(std::memory_order_relaxed);
+  s.upload_bytes = last_upload_bytes.load(std::memory_order_relaxed);
+  return s;
+}
+
+void
+gl_stats_print(ostream &os) {
+  if (counted_frames == 0)
+    return;
+
+  vector<pair<uint64_t, size_t> > order;
+  for (size_t i = 0; i < GL_ENTRY_COUNT; ++i)
+    if (total_calls[i] > 0)
+      order.push_back(pair<uint64_t, size_t>(total_calls[i], i));
+  std::sort(order.rbegin(), order.rend());
+
+  os << "GL calls per frame over " << counted_frames << " frames" << endl;
+  os << std::fixed << std::setprecision(2);
+  for (const pair<uint64_t, size_t> &p : order)
+    os << "  " << std::left << setw(36) << entry_names[p.second] << std::right
+       << setw(10) << static_cast<double>(p.first)/counted_frames << endl;
+}
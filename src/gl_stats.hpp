@@ -0,0 +1,40 @@
+#ifndef GL_STATS_HPP
+#define GL_STATS_HPP
+
+#include <cstdint>
+#include <ostream>
+
+// Per-frame GL call counters. While on, glad's function pointers for the
+// entry points listed in gl_stats.cpp are replaced by wrappers that count
+// calls, draws, triangles, state changes and bytes handed to the driver;
+// while off the original pointers are back in place, so the cost is zero.
+
+struct gl_frame_stats {
+  uint64_t calls;
+  uint64_t draws;
+  uint64_t triangles;
+  uint64_t state_changes;
+  uint64_t upload_bytes;
+
+  gl_frame_stats() : calls(0), draws(0), triangles(0), state_changes(0),
+                     upload_bytes(0) {}
+};
+
+// any thread; takes effect at the next frame boundary on the render thread
+void gl_stats_request(const bool on);
+bool gl_stats_requested();
+
+// render thread, once per frame after the swap: publishes the frame's
+// counts (also as profiler counters), then applies a pending toggle
+void gl_stats_frame();
+// render thread, before the context goes away: restores glad's pointers
+void gl_stats_shutdown();
+
+// counts of the last finished frame; any thread
+gl_frame_stats gl_stats_last_frame();
+
+// calls per frame by entry point over every counted frame. Only call
+// once the render thread is done.
+void gl_stats_print(std::ostream &os);
+
+#endif
@@ -0,0 +1,165 @@
+#include "gpu_particles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "profiler.hpp"
+#include "renderer.hpp"
+
+using std::vector;
+using std::runtime_error;
+
+// position and velocity, then seconds left and 1/lifetime
+static const size_t SLOT_BYTES = 6*sizeof(float);
+
+static glm::vec4
+unpack_color(const uint32_t c) {
+  return glm::vec4(c & 0xff, (c >> 8) & 0xff, (c >> 16) & 0xff, c >> 24)/255.f;
+}
+
+static void
+bind_blocks(const GLuint program) {
+  const GLuint frame_block = glGetUniformBlockIndex(program, "frame_data");
+  if (frame_block != GL_INVALID_INDEX)
+    glUniformBlockBinding(program, frame_block, UBO_FRAME);
+  const GLuint particle_block = glGetUniformBlockIndex(program, "particle_data");
+  if (particle_block != GL_INVALID_INDEX)
+    glUniformBlockBinding(program, particle_block, UBO_PARTICLES);
+}
+
+static void
+point_attributes(const GLuint divisor) {
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, SLOT_BYTES, (void*) 0);
+  glVertexAttribDivisor(0, divisor);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, SLOT_BYTES,
+                        (void*) (4*sizeof(float)));
+  glVertexAttribDivisor(1, divisor);
+}
+
+void
+gpu_particles::init(const size_t capacity) {
+  update_shaders.init_feedback("shaders/gpu_particle_update_vertex.shader",
+                               {"state", "life"}, bind_blocks);
+  draw_shaders.init("shaders/gpu_particle_vertex.shader",
+                    "shaders/particle_fragment.shader", bind_blocks);
+  glGenBuffers(1, &uniform_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(gpu_particle_uniforms), NULL,
+               GL_DYNAMIC_DRAW);
+  glGenBuffers(2, buffers);
+  glGenVertexArrays(2, update_vaos);
+  glGenVertexArrays(2, draw_vaos);
+  resize(capacity);
+  // compile errors show at startup
+  update_shaders.program(0);
+  draw_shaders.program(0);
+}
+
+void
+gpu_particles::resize(const size_t capacity) {
+  if (capacity == 0 || capacity > 0xffffffffu/2)
+    throw runtime_error("bad GPU particle capacity");
+  slots = capacity;
+  current = 0;
+  next_slot = 0;
+  credit = 0.f;
+  // zeros are dead particles, nothing to draw until they are spawned
+  const vector<float> dead(slots*SLOT_BYTES/sizeof(float), 0.f);
+  for (int i = 0; i < 2; ++i) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+    glBufferData(GL_ARRAY_BUFFER, slots*SLOT_BYTES, dead.data(), GL_DYNAMIC_COPY);
+    glBindVertexArray(update_vaos[i]);
+    point_attributes(0);
+    glBindVertexArray(draw_vaos[i]);
+    point_attributes(1);
+  }
+  glBindVertexArray(0);
+  idle_time = max_lifetime = 0.f;
+}
+
+void
+gpu_particles::update(const particle_emitter &e, const particle_forces &f,
+                      const float dt) {
+  uint32_t emit = 0;
+  if (e.active) {
+    credit += e.rate*dt;
+    const float whole = std::floor(credit);
+    emit = static_cast<uint32_t>(std::min(whole, static_cast<float>(slots)));
+    credit -= whole;
+    max_lifetime = std::max(max_lifetime, e.lifetime*(1.f + e.lifetime_jitter));
+  }
+  else
+    credit = 0.f;
+  idle_time = (emit > 0) ? 0.f : idle_time + dt;
+  if (idle())
+    return;
+
+  PROFILE_SCOPE("update_gpu_particles");
+  seed = seed*1664525u + 1013904223u;
+  gpu_particle_uniforms &u = uniforms;
+  u.emitter = glm::vec4(e.position.x, e.position.y, e.radius, e.spread);
+  u.motion = glm::vec4(e.velocity.x, e.velocity.y, f.gravity.x, f.gravity.y);
+  u.life_params = glm::vec4(e.lifetime, e.lifetime_jitter, f.drag, 0.f);
+  u.sizes = glm::vec4(e.start_size, e.end_size, 0.f, 0.f);
+  u.start_color = unpack_color(e.start_color);
+  u.end_color = unpack_color(e.end_color);
+  u.emission[0] = next_slot;
+  u.emission[1] = emit;
+  u.emission[2] = static_cast<uint32_t>(slots);
+  u.emission[3] = seed;
+  next_slot = static_cast<uint32_t>((next_slot + emit) % slots);
+  glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(u), &u);
+  glBindBufferBase(GL_UNIFORM_BUFFER, UBO_PARTICLES, uniform_buffer);
+
+  // every slot from one buffer into the other, nothing rasterized
+  glUseProgram(update_shaders.program(0));
+  glEnable(GL_RASTERIZER_DISCARD);
+  glBindVertexArray(update_vaos[current]);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1 - current]);
+  glBeginTransformFeedback(GL_POINTS);
+  glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(slots));
+  glEndTransformFeedback();
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+  glDisable(GL_RASTERIZER_DISCARD);
+  glBindVertexArray(0);
+  current = 1 - current;
+}
+
+void
+gpu_particles::draw(const uint32_t features) {
+  if (idle())
+    return;
+  PROFILE_SCOPE("draw_gpu_particles");
+  // dead slots are drawn too, collapsed to nothing by the vertex shader
+  glBindBufferBase(GL_UNIFORM_BUFFER, UBO_PARTICLES, uniform_buffer);
+  glUseProgram(draw_shaders.program(features));
+  glBindVertexArray(draw_vaos[current]);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(slots));
+  glDisable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+  glBindVertexArray(0);
+}
+
+void
+gpu_particles::destroy() {
+  update_shaders.destroy();
+  draw_shaders.destroy();
+  glDeleteBuffers(1, &uniform_buffer);
+  glDeleteBuffers(2, buffers);
+  glDeleteVertexArrays(2, update_vaos);
+  glDeleteVertexArrays(2, draw_vaos);
+  uniform_buffer = 0;
+  buffers[0] = buffers[1] = 0;
+  update_vaos[0] = update_vaos[1] = 0;
+  draw_vaos[0] = draw_vaos[1] = 0;
+  slots = 0;
+}
@@ -0,0 +1,71 @@
+#ifndef GPU_PARTICLES_HPP
+#define GPU_PARTICLES_HPP
+
+#include "glad.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "particle_emitter.hpp"
+#include "shader.hpp"
+
+// the particle_data block of shaders/common/particle_data.glsl, std140
+struct gpu_particle_uniforms {
+  glm::vec4 emitter;      // position, radius, spread
+  glm::vec4 motion;       // initial velocity, gravity
+  glm::vec4 life_params;  // lifetime, jitter, drag, unused
+  glm::vec4 sizes;        // start and end size
+  glm::vec4 start_color;
+  glm::vec4 end_color;
+  uint32_t emission[4];   // first slot, slots, capacity, seed
+};
+
+// Particles that live on the GPU only. Two buffers of fixed slots take
+// turns: a vertex shader reads every slot of one and transform feedback
+// writes its next state to the other, with the rasterizer off, then the
+// same buffer is drawn as instances. The CPU sends the emitter and
+// forces (a few hundred bytes) and how many dead slots to spawn into, so
+// a frame costs the same on the CPU whatever the number of particles.
+// Emission walks the slots as a ring; while the slots it reaches are
+// still alive it emits less than asked. All methods on the GL thread.
+class gpu_particles {
+public:
+  gpu_particles() : uniform_buffer(0), current(0), slots(0), next_slot(0),
+                    credit(0.f), idle_time(0.f), max_lifetime(0.f), seed(0) {
+    buffers[0] = buffers[1] = 0;
+    update_vaos[0] = update_vaos[1] = 0;
+    draw_vaos[0] = draw_vaos[1] = 0;
+  }
+
+  void init(const size_t capacity);
+  // all slots dead, in buffers of the new size
+  void resize(const size_t capacity);
+  // advances the particles by dt, spawning from e if it is active
+  void update(const particle_emitter &e, const particle_forces &f, const float dt);
+  // additively blended over the bound framebuffer, no depth test
+  void draw(const uint32_t features);
+  // nothing emitted for longer than anything lives, nothing to do
+  bool idle() const { return idle_time > max_lifetime; }
+  size_t capacity() const { return slots; }
+  void destroy();
+
+private:
+  shader_cache update_shaders;  // vertex only, captured by transform feedback
+  shader_cache draw_shaders;
+  GLuint buffers[2];            // per slot: position, velocity, life left, 1/lifetime
+  GLuint update_vaos[2];        // reading buffers[i] per vertex
+  GLuint draw_vaos[2];          // reading buffers[i] per instance
+  GLuint uniform_buffer;
+  int current;                  // buffer holding the latest state
+  size_t slots;
+  uint32_t next_slot;           // where emission goes on from
+  float credit;                 // fractional particles owed
+  float idle_time;              // seconds since anything was emitted
+  float max_lifetime;           // longest a particle emitted so far can live
+  uint32_t seed;
+  gpu_particle_uniforms uniforms;
+};
+
+#endif
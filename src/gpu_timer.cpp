@@ -0,0 +1,96 @@
+#include "gpu_timer.hpp"
+
+#include "profiler.hpp"
+
+// the two clocks drift apart slowly, resample the offset now and then
+static const uint64_t CALIBRATION_INTERVAL = 120;
+
+void
+gpu_timer_pool::init() {
+  for (frame_slot &slot : slots) {
+    slot.frame = 0;
+    slot.used = 0;
+    glGenQueries(MAX_QUERIES, slot.queries);
+    glGenQueries(MAX_QUERIES, slot.stamps);
+  }
+  track = profile_track("GPU");
+}
+
+void
+gpu_timer_pool::destroy() {
+  for (frame_slot &slot : slots) {
+    glDeleteQueries(MAX_QUERIES, slot.queries);
+    glDeleteQueries(MAX_QUERIES, slot.stamps);
+  }
+  current = nullptr;
+}
+
+void
+gpu_timer_pool::read_back(frame_slot &slot) {
+  for (size_t i = 0; i < slot.used; ++i) {
+    GLint available = 0;
+    glGetQueryObjectiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      ++dropped;
+      continue;
+    }
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &ns);
+
+    // the timestamp was issued before the elapsed query, so it is done
+    // too; without a calibration fall back to where the CPU issued it
+    uint64_t begin = slot.cpu_begin_ns[i];
+    if (calibrated) {
+      GLuint64 stamp = 0;
+      glGetQueryObjectui64v(slot.stamps[i], GL_QUERY_RESULT, &stamp);
+      begin = static_cast<uint64_t>(static_cast<int64_t>(stamp) + gpu_to_cpu_ns);
+    }
+    profile_record(track, slot.names[i], slot.frame, begin, begin + ns);
+  }
+  slot.used = 0;
+}
+
+void
+gpu_timer_pool::calibrate(const uint64_t frame) {
+  GLint64 gpu_ns = 0;
+  const uint64_t before = profile_now_ns();
+  glGetInteger64v(GL_TIMESTAMP, &gpu_ns);
+  const uint64_t after = profile_now_ns();
+  gpu_to_cpu_ns = static_cast<int64_t>((before + after)/2) - gpu_ns;
+  calibrated_frame = frame;
+  calibrated = true;
+}
+
+void
+gpu_timer_pool::begin_frame(const uint64_t frame) {
+  if (profile_enabled() &&
+      (!calibrated || frame - calibrated_frame >= CALIBRATION_INTERVAL))
+    calibrate(frame);
+
+  current = &slots[frame % FRAMES_IN_FLIGHT];
+  read_back(*current);
+  current->frame = frame;
+}
+
+void
+gpu_timer_pool::begin(const char *name) {
+  if (depth++ > 0)
+    return;
+  if (!current || current->used == MAX_QUERIES || !profile_enabled())
+    return;
+  const size_t i = current->used;
+  current->names[i] = name;
+  current->cpu_begin_ns[i] = profile_now_ns();
+  glQueryCounter(current->stamps[i], GL_TIMESTAMP);
+  glBeginQuery(GL_TIME_ELAPSED, current->queries[i]);
+  open = true;
+}
+
+void
+gpu_timer_pool::end() {
+  if (depth == 0 || --depth > 0 || !open)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+  ++current->used;
+  open = false;
+}
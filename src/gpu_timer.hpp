@@ -0,0 +1,74 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include "glad.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Pool of GL_TIME_ELAPSED queries, one set per frame in flight. Results
+// are read back FRAMES_IN_FLIGHT frames later, when the GPU has long
+// finished them, and handed to the profiler on its "GPU" track. A result
+// that is still not available then is dropped rather than waited for.
+//
+// Each scope also gets a GL_TIMESTAMP query at its start. GPU time is
+// mapped onto the CPU clock with an offset sampled periodically through
+// glGetInteger64v(GL_TIMESTAMP), so captures show GPU work where it
+// actually ran relative to the CPU threads.
+//
+// GL_TIME_ELAPSED queries cannot nest, so GPU scopes are flat: a scope
+// opened inside another one is not timed on its own.
+class gpu_timer_pool {
+public:
+  static const size_t FRAMES_IN_FLIGHT = 4;
+  static const size_t MAX_QUERIES = 32;
+
+  gpu_timer_pool() : current(nullptr), depth(0), open(false), track(0),
+                     dropped(0), gpu_to_cpu_ns(0), calibrated_frame(0),
+                     calibrated(false) {}
+
+  void init();
+  void destroy();
+
+  // collects the results of the frame that last used this slot
+  void begin_frame(const uint64_t frame);
+
+  void begin(const char *name);
+  void end();
+
+  uint64_t dropped_results() const { return dropped; }
+
+private:
+  struct frame_slot {
+    uint64_t frame;
+    size_t used;
+    GLuint queries[MAX_QUERIES];
+    GLuint stamps[MAX_QUERIES];
+    const char *names[MAX_QUERIES];
+    uint64_t cpu_begin_ns[MAX_QUERIES];
+  };
+
+  void read_back(frame_slot &slot);
+  void calibrate(const uint64_t frame);
+
+  frame_slot slots[FRAMES_IN_FLIGHT];
+  frame_slot *current;
+  int depth;
+  bool open;
+  uint32_t track;
+  uint64_t dropped;
+  int64_t gpu_to_cpu_ns;
+  uint64_t calibrated_frame;
+  bool calibrated;
+};
+
+// times the enclosing block
+struct gpu_scope {
+  gpu_timer_pool &pool;
+  gpu_scope(gpu_timer_pool &_pool, const char *name) : pool(_pool) {
+    pool.begin(name);
+  }
+  ~gpu_scope() { pool.end(); }
+};
+
+#endif
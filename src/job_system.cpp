@@ -0,0 +1,120 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "profiler.hpp"
+
+using std::function;
+using std::unique_lock;
+using std::mutex;
+using std::shared_ptr;
+using std::make_shared;
+using std::atomic;
+
+job_system::job_system(size_t num_threads) : quit(false) {
+  if (num_threads == 0) {
+    const size_t hw = std::thread::hardware_concurrency();
+    num_threads = (hw > 1) ? hw - 1 : 0;
+  }
+  for (size_t i = 0; i < num_threads; ++i)
+    workers.push_back(std::thread(&job_system::worker_loop, this));
+}
+
+job_system::~job_system() {
+  {
+    unique_lock<mutex> lock(mtx);
+    quit = true;
+  }
+  cv.notify_all();
+  for (std::thread &t : workers)
+    t.join();
+}
+
+void
+job_system::submit(function<void()> task) {
+  if (workers.empty()) {
+    task();
+    return;
+  }
+  const uint64_t frame = profile_frame();
+  {
+    unique_lock<mutex> lock(mtx);
+    tasks.push_back(queued_task{std::move(task), frame});
+  }
+  cv.notify_one();
+}
+
+void
+job_system::worker_loop() {
+  profile_set_thread_name("worker");
+  for (;;) {
+    queued_task task;
+    {
+      unique_lock<mutex> lock(mtx);
+      cv.wait(lock, [this] { return quit || !tasks.empty(); });
+      if (tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    profile_set_frame(task.frame);
+    task.run();
+  }
+}
+
+// shared by the caller and the helpers it queued; helpers that only get
+// to run after the loop finished must still find it alive
+struct parallel_batch {
+  atomic<size_t> next;
+  atomic<size_t> done;
+  size_t count;
+  const function<void(size_t)> *fn;
+  mutex mtx;
+  std::condition_variable cv;
+
+  void run() {
+    size_t finished = 0;
+    for (size_t i = next++; i < count; i = next++) {
+      (*fn)(i);
+      ++finished;
+    }
+    if (finished > 0 && (done += finished) == count) {
+      unique_lock<mutex> lock(mtx);
+      cv.notify_all();
+    }
+  }
+};
+
+void
+job_system::parallel_for(const size_t count, const function<void(size_t)> &fn) {
+  if (count == 0)
+    return;
+  if (count == 1 || workers.empty()) {
+    for (size_t i = 0; i < count; ++i)
+      fn(i);
+    return;
+  }
+
+  shared_ptr<parallel_batch> batch = make_shared<parallel_batch>();
+  batch->next = 0;
+  batch->done = 0;
+  batch->count = count;
+  batch->fn = &fn;
+
+  const size_t helpers = std::min(workers.size(), count - 1);
+  const uint64_t frame = profile_frame();
+  {
+    unique_lock<mutex> lock(mtx);
+    for (size_t i = 0; i < helpers; ++i)
+      tasks.push_back(queued_task{[batch] { batch->run(); }, frame});
+  }
+  if (helpers == 1) cv.notify_one();
+  else cv.notify_all();
+
+  batch->run();
+
+  unique_lock<mutex> lock(batch->mtx);
+  batch->cv.wait(lock, [&batch] { return batch->done == batch->count; });
+}
@@ -0,0 +1,52 @@
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed pool of worker threads shared by everything that wants to
+// spread work over the cores (entity updates, image processing, asset
+// decoding). The thread calling parallel_for() always helps, so nested
+// or concurrent calls cannot deadlock on a busy pool.
+class job_system {
+public:
+  // 0 threads means one per hardware thread, minus the caller
+  explicit job_system(size_t num_threads = 0);
+  ~job_system();
+
+  job_system(const job_system &) = delete;
+  job_system &operator=(const job_system &) = delete;
+
+  // workers plus the calling thread
+  size_t concurrency() const { return workers.size() + 1; }
+
+  // runs fn(i) for every i in [0, count) and returns once all are done
+  void parallel_for(const size_t count, const std::function<void(size_t)> &fn);
+
+  // queues a task to run on some worker, without waiting for it
+  void submit(std::function<void()> task);
+
+private:
+  // a task and the profiler frame of the thread that queued it, so the
+  // worker's scopes count towards that frame
+  struct queued_task {
+    std::function<void()> run;
+    uint64_t frame;
+  };
+
+  void worker_loop();
+
+  std::vector<std::thread> workers;
+  std::deque<queued_task> tasks;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool quit;
+};
+
+#endif
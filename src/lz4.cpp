@@ -0,0 +1,156 @@
+#include "lz4.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using std::vector;
+using std::runtime_error;
+
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5;  // the block always ends in literals
+static const size_t MATCH_LIMIT = 12;   // no match starts in the last 12 bytes
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 16;
+
+static uint32_t
+read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t
+hash4(const uint32_t v) {
+  return (v*2654435761u) >> (32 - HASH_BITS);
+}
+
+size_t
+lz4_compress_bound(const size_t n) {
+  return n + n/255 + 16;
+}
+
+// a length past the 15 of its token nibble
+static void
+put_length(vector<uint8_t> &out, size_t len) {
+  for (; len >= 255; len -= 255)
+    out.push_back(255);
+  out.push_back(static_cast<uint8_t>(len));
+}
+
+// one sequence: literals, then a match unless it is the last one
+static void
+put_sequence(vector<uint8_t> &out, const uint8_t *literals, const size_t lit_len,
+             const size_t offset, const size_t match_len) {
+  const size_t match_code = match_len ? match_len - MIN_MATCH : 0;
+  out.push_back(static_cast<uint8_t>((std::min<size_t>(lit_len, 15) << 4) |
+                                     std::min<size_t>(match_code, 15)));
+  if (lit_len >= 15)
+    put_length(out, lit_len - 15);
+  out.insert(out.end(), literals, literals + lit_len);
+  if (match_len == 0)
+    return;
+  out.push_back(static_cast<uint8_t>(offset));
+  out.push_back(static_cast<uint8_t>(offset >> 8));
+  if (match_code >= 15)
+    put_length(out, match_code - 15);
+}
+
+vector<uint8_t>
+lz4_compress(const uint8_t *src, const size_t size) {
+  vector<uint8_t> out;
+  out.reserve(lz4_compress_bound(size));
+  size_t anchor = 0;
+  if (size > MATCH_LIMIT) {
+    // last position seen for each hash of 4 bytes
+    vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+    const size_t last_start = size - MATCH_LIMIT;
+    const size_t last_end = size - LAST_LITERALS;
+    size_t pos = 0;
+    while (pos < last_start) {
+      const uint32_t seq = read32(src + pos);
+      const uint32_t h = hash4(seq);
+      const size_t candidate = table[h];
+      table[h] = static_cast<uint32_t>(pos);
+      if (candidate >= pos || pos - candidate > MAX_OFFSET ||
+          read32(src + candidate) != seq) {
+        ++pos;
+        continue;
+      }
+
+      // longest match forwards, then back over pending literals
+      size_t len = MIN_MATCH;
+      while (pos + len < last_end && src[candidate + len] == src[pos + len])
+        ++len;
+      size_t start = pos, from = candidate;
+      while (start > anchor && from > 0 && src[start - 1] == src[from - 1]) {
+        --start;
+        --from;
+        ++len;
+      }
+      put_sequence(out, src + anchor, start - anchor, start - from, len);
+      pos = anchor = start + len;
+      if (pos - 2 < last_start)
+        table[hash4(read32(src + pos - 2))] = static_cast<uint32_t>(pos - 2);
+    }
+  }
+  put_sequence(out, src + anchor, size - anchor, 0, 0);
+  return out;
+}
+
+static size_t
+read_length(const uint8_t *src, const size_t src_size, size_t &ip) {
+  size_t len = 0;
+  uint8_t b;
+  do {
+    if (ip >= src_size)
+      throw runtime_error("truncated LZ4 block");
+    b = src[ip++];
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+void
+lz4_decompress(const uint8_t *src, const size_t src_size,
+               uint8_t *dst, const size_t dst_size) {
+  size_t ip = 0, op = 0;
+  for (;;) {
+    if (ip >= src_size)
+      throw runtime_error("truncated LZ4 block");
+    const uint8_t token = src[ip++];
+
+    size_t lit_len = token >> 4;
+    if (lit_len == 15)
+      lit_len += read_length(src, src_size, ip);
+    if (lit_len > src_size - ip || lit_len > dst_size - op)
+      throw runtime_error("LZ4 literals out of bounds");
+    if (lit_len > 0)
+      memcpy(dst + op, src + ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == src_size)
+      break;  // the last sequence has no match
+
+    if (src_size - ip < 2)
+      throw runtime_error("truncated LZ4 block");
+    const size_t offset = src[ip] | (static_cast<size_t>(src[ip + 1]) << 8);
+    ip += 2;
+    size_t len = token & 15;
+    if (len == 15)
+      len += read_length(src, src_size, ip);
+    len += MIN_MATCH;
+    if (offset == 0 || offset > op || len > dst_size - op)
+      throw runtime_error("LZ4 match out of bounds");
+
+    // matches may overlap what they write, e.g. runs of one byte
+    const uint8_t *match = dst + op - offset;
+    if (offset >= len)
+      memcpy(dst + op, match, len);
+    else for (size_t i = 0; i < len; ++i)
+      dst[op + i] = match[i];
+    op += len;
+  }
+  if (op != dst_size)
+    throw runtime_error("LZ4 block has the wrong decompressed size");
+}
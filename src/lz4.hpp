@@ -0,0 +1,21 @@
+#ifndef LZ4_HPP
+#define LZ4_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LZ4 block format (no frame header): a greedy single-pass compressor,
+// fast to decode, for asset pack entries
+
+// worst case compressed size of n bytes
+size_t lz4_compress_bound(const size_t n);
+
+std::vector<uint8_t> lz4_compress(const uint8_t *src, const size_t size);
+
+// dst_size is the exact decompressed size; throws on malformed input
+// instead of reading or writing out of bounds
+void lz4_decompress(const uint8_t *src, const size_t src_size,
+                    uint8_t *dst, const size_t dst_size);
+
+#endif
@@ -0,0 +1,66 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::runtime_error;
+
+mapped_file::mapped_file(const string &filename) : bytes(nullptr), length(0),
+                                                   is_mapped(false) {
+  const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw runtime_error("cannot open file " + filename + ": " + strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw runtime_error("cannot stat file " + filename);
+  }
+  length = static_cast<size_t>(st.st_size);
+
+  if (length >= MAP_THRESHOLD) {
+    void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      close(fd);
+      bytes = static_cast<uint8_t *>(map);
+      is_mapped = true;
+      return;
+    }
+    // not mappable (e.g. a pipe), read it instead
+  }
+
+  // one byte more so that empty files still get a buffer
+  const size_t capacity = (length + ALIGNMENT) & ~(ALIGNMENT - 1);
+  bytes = static_cast<uint8_t *>(aligned_alloc(ALIGNMENT, capacity));
+  if (bytes == nullptr) {
+    close(fd);
+    throw runtime_error("out of memory reading " + filename);
+  }
+  // one read() unless the kernel hands out less
+  size_t done = 0;
+  while (done < length) {
+    const ssize_t n = read(fd, bytes + done, length - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      close(fd);
+      free(bytes);
+      throw runtime_error("failed reading file " + filename);
+    }
+    done += static_cast<size_t>(n);
+  }
+  close(fd);
+}
+
+mapped_file::~mapped_file() {
+  if (is_mapped)
+    munmap(bytes, length);
+  else free(bytes);
+}
@@ -0,0 +1,34 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file in memory, read only. Files of MAP_THRESHOLD bytes and
+// more are mapped, smaller ones are read with a single read() into a
+// buffer of their size, where a mapping would cost more than the copy.
+// Either way the data is 64 byte aligned and is not copied again.
+class mapped_file {
+public:
+  static const size_t MAP_THRESHOLD = 64 << 10;
+  static const size_t ALIGNMENT = 64;
+
+  // throws when the file cannot be opened or read
+  explicit mapped_file(const std::string &filename);
+  ~mapped_file();
+
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  const uint8_t *data() const { return bytes; }
+  size_t size() const { return length; }
+  bool mapped() const { return is_mapped; }
+
+private:
+  uint8_t *bytes;
+  size_t length;
+  bool is_mapped;
+};
+
+#endif
@@ -0,0 +1,448 @@
+#include "mipmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIP_X86 1
+#endif
+
+#include "job_system.hpp"
+
+using std::vector;
+
+static const float KAISER_RADIUS = 3.f;  // in destination pixels
+static const float KAISER_ALPHA = 4.f;
+static const size_t PARALLEL_PIXELS = 1 << 16;  // smaller levels stay serial
+static const int LINEAR_TO_SRGB_SIZE = 1 << 14;
+
+/****************** dispatch *******************/
+static mip_simd
+detect_simd() {
+#ifdef MIP_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return MIP_SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return MIP_SIMD_SSE2;
+#endif
+  return MIP_SIMD_SCALAR;
+}
+
+static mip_simd
+resolve(const mip_simd requested) {
+  static const mip_simd best = detect_simd();
+  // never more than the CPU has
+  return (requested == MIP_SIMD_AUTO || requested > best) ? best : requested;
+}
+
+const char *
+mip_simd_name(const mip_simd simd) {
+  switch (resolve(simd)) {
+    case MIP_SIMD_AVX2: return "avx2";
+    case MIP_SIMD_SSE2: return "sse2";
+    default: return "scalar";
+  }
+}
+
+// fn(first, last) over bands of rows, on the workers if it is worth it
+template<typename F> static void
+for_row_bands(job_system *jobs, const int rows, const size_t row_pixels,
+              const F &fn) {
+  if (jobs == nullptr || jobs->concurrency() == 1 ||
+      rows*row_pixels < PARALLEL_PIXELS || rows < 2) {
+    fn(0, rows);
+    return;
+  }
+  const int bands = static_cast<int>(std::min<size_t>(4*jobs->concurrency(), rows));
+  jobs->parallel_for(bands, [&](size_t band) {
+    fn(static_cast<int>(band*rows/bands), static_cast<int>((band + 1)*rows/bands));
+  });
+}
+
+/****************** sRGB *******************/
+struct srgb_tables {
+  float to_linear[256];
+  uint8_t to_srgb[LINEAR_TO_SRGB_SIZE + 1];
+
+  srgb_tables() {
+    for (int i = 0; i < 256; ++i) {
+      const float c = i/255.f;
+      to_linear[i] = (c <= 0.04045f) ? c/12.92f : std::pow((c + 0.055f)/1.055f, 2.4f);
+    }
+    for (int i = 0; i <= LINEAR_TO_SRGB_SIZE; ++i) {
+      const float l = static_cast<float>(i)/LINEAR_TO_SRGB_SIZE;
+      const float c = (l <= 0.0031308f) ? 12.92f*l : 1.055f*std::pow(l, 1.f/2.4f) - 0.055f;
+      to_srgb[i] = static_cast<uint8_t>(std::min(std::max(c*255.f + 0.5f, 0.f), 255.f));
+    }
+  }
+};
+
+static const srgb_tables &
+srgb() {
+  static const srgb_tables tables;
+  return tables;
+}
+
+/****************** float images *******************/
+// linear RGBA, 4 floats per pixel
+struct float_image {
+  int w;
+  int h;
+  vector<float> px;
+};
+
+static float_image
+to_float(const rgba_image &img, const bool is_srgb, job_system *jobs) {
+  float_image out;
+  out.w = img.w;
+  out.h = img.h;
+  out.px.resize(4*static_cast<size_t>(img.w)*img.h);
+  const float *lut = srgb().to_linear;
+  for_row_bands(jobs, img.h, img.w, [&](int first, int last) {
+    const size_t begin = 4*static_cast<size_t>(first)*img.w;
+    const size_t end = 4*static_cast<size_t>(last)*img.w;
+    for (size_t i = begin; i < end; i += 4) {
+      for (int c = 0; c < 3; ++c)
+        out.px[i + c] = is_srgb ? lut[img.pixels[i + c]] : img.pixels[i + c]/255.f;
+      out.px[i + 3] = img.pixels[i + 3]/255.f;
+    }
+  });
+  return out;
+}
+
+static uint8_t
+to_unorm8(const float v) {
+  return static_cast<uint8_t>(std::min(std::max(v*255.f + 0.5f, 0.f), 255.f));
+}
+
+static rgba_image
+to_rgba8(const float_image &img, const bool is_srgb, job_system *jobs) {
+  rgba_image out;
+  out.w = img.w;
+  out.h = img.h;
+  out.pixels.resize(4*static_cast<size_t>(img.w)*img.h);
+  const uint8_t *lut = srgb().to_srgb;
+  for_row_bands(jobs, img.h, img.w, [&](int first, int last) {
+    const size_t begin = 4*static_cast<size_t>(first)*img.w;
+    const size_t end = 4*static_cast<size_t>(last)*img.w;
+    for (size_t i = begin; i < end; i += 4) {
+      for (int c = 0; c < 3; ++c) {
+        const float v = std::min(std::max(img.px[i + c], 0.f), 1.f);
+        out.pixels[i + c] = is_srgb ?
+          lut[static_cast<int>(v*LINEAR_TO_SRGB_SIZE + 0.5f)] : to_unorm8(v);
+      }
+      out.pixels[i + 3] = to_unorm8(img.px[i + 3]);
+    }
+  });
+  return out;
+}
+
+/****************** filter taps *******************/
+// the source pixels each destination pixel reads and their weights,
+// normalized; indices past the edges are clamped
+struct filter_taps {
+  vector<int> first;   // per destination pixel, into index and weight
+  vector<int> count;
+  vector<int> index;
+  vector<float> weight;
+};
+
+static double
+bessel_i0(const double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 32; ++k) {
+    term *= (x/(2*k))*(x/(2*k));
+    sum += term;
+  }
+  return sum;
+}
+
+static double
+kaiser(const double x) {
+  const double t = x/KAISER_RADIUS;
+  if (std::fabs(t) >= 1.0)
+    return 0.0;
+  const double sinc = (x == 0.0) ? 1.0 : std::sin(M_PI*x)/(M_PI*x);
+  return sinc*bessel_i0(KAISER_ALPHA*std::sqrt(1.0 - t*t))/bessel_i0(KAISER_ALPHA);
+}
+
+static filter_taps
+make_taps(const int src, const int dst, const mip_filter filter) {
+  filter_taps taps;
+  const double scale = static_cast<double>(src)/dst;
+  for (int i = 0; i < dst; ++i) {
+    const double center = (i + 0.5)*scale;
+    const double reach = (filter == MIP_BOX) ? scale/2 : KAISER_RADIUS*scale;
+    const int lo = static_cast<int>(std::floor(center - reach));
+    const int hi = static_cast<int>(std::ceil(center + reach));
+
+    taps.first.push_back(static_cast<int>(taps.index.size()));
+    double total = 0.0;
+    for (int j = lo; j < hi; ++j) {
+      double w;
+      if (filter == MIP_BOX)  // how much of the pixel the footprint covers
+        w = std::min<double>(center + reach, j + 1) - std::max<double>(center - reach, j);
+      else w = kaiser((j + 0.5 - center)/scale);
+      if (w == 0.0 || (filter == MIP_BOX && w < 0.0))
+        continue;
+      taps.index.push_back(std::min(std::max(j, 0), src - 1));
+      taps.weight.push_back(static_cast<float>(w));
+      total += w;
+    }
+    taps.count.push_back(static_cast<int>(taps.index.size()) - taps.first.back());
+    for (size_t k = taps.first.back(); k < taps.index.size(); ++k)
+      taps.weight[k] = static_cast<float>(taps.weight[k]/total);
+  }
+  return taps;
+}
+
+/****************** kernels *******************/
+// y += a*x over n floats
+static void
+axpy_scalar(float *y, const float *x, const float a, const size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    y[i] += a*x[i];
+}
+
+// out[x] = sum of weight*row[index] per destination pixel, RGBA at once
+static void
+horizontal_scalar(float *out, const float *row, const filter_taps &taps) {
+  for (size_t x = 0; x < taps.first.size(); ++x) {
+    float acc[4] = {0.f, 0.f, 0.f, 0.f};
+    for (int k = taps.first[x]; k < taps.first[x] + taps.count[x]; ++k)
+      for (int c = 0; c < 4; ++c)
+        acc[c] += taps.weight[k]*row[4*taps.index[k] + c];
+    memcpy(out + 4*x, acc, sizeof(acc));
+  }
+}
+
+// 2x2 average of rows a and b into out, for n destination pixels
+static void
+box2_scalar(uint8_t *out, const uint8_t *a, const uint8_t *b, const int n) {
+  for (int x = 0; x < n; ++x)
+    for (int c = 0; c < 4; ++c)
+      out[4*x + c] = static_cast<uint8_t>(
+        (a[8*x + c] + a[8*x + 4 + c] + b[8*x + c] + b[8*x + 4 + c] + 2) >> 2);
+}
+
+#ifdef MIP_X86
+static void
+axpy_sse2(float *y, const float *x, const float a, const size_t n) {
+  const __m128 va = _mm_set1_ps(a);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i),
+                                    _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+  axpy_scalar(y + i, x + i, a, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+axpy_avx2(float *y, const float *x, const float a, const size_t n) {
+  const __m256 va = _mm256_set1_ps(a);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i),
+                                          _mm256_mul_ps(va, _mm256_loadu_ps(x + i))));
+  axpy_sse2(y + i, x + i, a, n - i);
+}
+
+// one pixel is one register
+static void
+horizontal_sse2(float *out, const float *row, const filter_taps &taps) {
+  for (size_t x = 0; x < taps.first.size(); ++x) {
+    __m128 acc = _mm_setzero_ps();
+    for (int k = taps.first[x]; k < taps.first[x] + taps.count[x]; ++k)
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(taps.weight[k]),
+                                       _mm_loadu_ps(row + 4*taps.index[k])));
+    _mm_storeu_ps(out + 4*x, acc);
+  }
+}
+
+// two destination pixels per register when they have as many taps,
+// which they do everywhere but near the edges
+__attribute__((target("avx2"))) static void
+horizontal_avx2(float *out, const float *row, const filter_taps &taps) {
+  const size_t n = taps.first.size();
+  for (size_t x = 0; x < n; ) {
+    const int a = taps.first[x];
+    if (x + 1 < n && taps.count[x] == taps.count[x + 1]) {
+      const int b = taps.first[x + 1];
+      __m256 acc = _mm256_setzero_ps();
+      for (int t = 0; t < taps.count[x]; ++t) {
+        const __m256 w = _mm256_set_m128(_mm_set1_ps(taps.weight[b + t]),
+                                         _mm_set1_ps(taps.weight[a + t]));
+        const __m256 p = _mm256_set_m128(_mm_loadu_ps(row + 4*taps.index[b + t]),
+                                         _mm_loadu_ps(row + 4*taps.index[a + t]));
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(w, p));
+      }
+      _mm256_storeu_ps(out + 4*x, acc);
+      x += 2;
+    }
+    else {
+      __m128 acc = _mm_setzero_ps();
+      for (int t = a; t < a + taps.count[x]; ++t)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(taps.weight[t]),
+                                         _mm_loadu_ps(row + 4*taps.index[t])));
+      _mm_storeu_ps(out + 4*x, acc);
+      x += 1;
+    }
+  }
+}
+
+// 16-bit sums of each 2x2, 4 destination pixels per iteration
+static void
+box2_sse2(uint8_t *out, const uint8_t *a, const uint8_t *b, const int n) {
+  const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+  int x = 0;
+  for (; x + 4 <= n; x += 4) {
+    __m128i half[2];
+    for (int i = 0; i < 2; ++i) {
+      const __m128i ra = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + 8*x + 16*i));
+      const __m128i rb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + 8*x + 16*i));
+      // vertical pairs, pixels 0,1 and 2,3 of the four
+      const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(ra, zero), _mm_unpacklo_epi8(rb, zero));
+      const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(ra, zero), _mm_unpackhi_epi8(rb, zero));
+      // then horizontal pairs
+      const __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+      half[i] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4*x),
+                     _mm_packus_epi16(half[0], half[1]));
+  }
+  box2_scalar(out + 4*x, a + 8*x, b + 8*x, n - x);
+}
+
+// as box2_sse2 per 128-bit lane, 8 destination pixels per iteration
+__attribute__((target("avx2"))) static void
+box2_avx2(uint8_t *out, const uint8_t *a, const uint8_t *b, const int n) {
+  const __m256i zero = _mm256_setzero_si256(), two = _mm256_set1_epi16(2);
+  int x = 0;
+  for (; x + 8 <= n; x += 8) {
+    __m256i half[2];
+    for (int i = 0; i < 2; ++i) {
+      const __m256i ra = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + 8*x + 32*i));
+      const __m256i rb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + 8*x + 32*i));
+      const __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(ra, zero), _mm256_unpacklo_epi8(rb, zero));
+      const __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(ra, zero), _mm256_unpackhi_epi8(rb, zero));
+      const __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+      half[i] = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+    }
+    // packing works per lane, leaving 64-bit pairs to put back in order
+    const __m256i packed = _mm256_packus_epi16(half[0], half[1]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 4*x),
+                        _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  box2_sse2(out + 4*x, a + 8*x, b + 8*x, n - x);
+}
+#endif
+
+struct kernels {
+  void (*axpy)(float *, const float *, float, size_t);
+  void (*horizontal)(float *, const float *, const filter_taps &);
+  void (*box2)(uint8_t *, const uint8_t *, const uint8_t *, int);
+};
+
+static kernels
+kernels_for(const mip_simd requested) {
+  kernels k = {axpy_scalar, horizontal_scalar, box2_scalar};
+#ifdef MIP_X86
+  const mip_simd simd = resolve(requested);
+  if (simd >= MIP_SIMD_SSE2) {
+    k.axpy = axpy_sse2;
+    k.horizontal = horizontal_sse2;
+    k.box2 = box2_sse2;
+  }
+  if (simd >= MIP_SIMD_AVX2) {
+    k.axpy = axpy_avx2;
+    k.horizontal = horizontal_avx2;
+    k.box2 = box2_avx2;
+  }
+#else
+  (void) requested;
+#endif
+  return k;
+}
+
+/****************** resampling *******************/
+// separable: the rows under each destination row are blended first,
+// then that row is filtered horizontally
+static float_image
+resample(const float_image &src, const int dw, const int dh,
+         const mip_filter filter, const kernels &k, job_system *jobs) {
+  const filter_taps tx = make_taps(src.w, dw, filter);
+  const filter_taps ty = make_taps(src.h, dh, filter);
+  float_image dst;
+  dst.w = dw;
+  dst.h = dh;
+  dst.px.resize(4*static_cast<size_t>(dw)*dh);
+  const size_t row_floats = 4*static_cast<size_t>(src.w);
+
+  for_row_bands(jobs, dh, src.w, [&](int first, int last) {
+    vector<float> row(row_floats);
+    for (int y = first; y < last; ++y) {
+      std::fill(row.begin(), row.end(), 0.f);
+      for (int t = ty.first[y]; t < ty.first[y] + ty.count[y]; ++t)
+        k.axpy(row.data(), &src.px[ty.index[t]*row_floats], ty.weight[t], row_floats);
+      k.horizontal(&dst.px[4*static_cast<size_t>(y)*dw], row.data(), tx);
+    }
+  });
+  return dst;
+}
+
+// even sized, linear box filtering: exact integer averages
+static rgba_image
+box2(const rgba_image &img, const kernels &k, job_system *jobs) {
+  rgba_image out;
+  out.w = img.w/2;
+  out.h = img.h/2;
+  out.pixels.resize(4*static_cast<size_t>(out.w)*out.h);
+  for_row_bands(jobs, out.h, img.w, [&](int first, int last) {
+    for (int y = first; y < last; ++y)
+      k.box2(&out.pixels[4*static_cast<size_t>(y)*out.w],
+             &img.pixels[4*static_cast<size_t>(2*y)*img.w],
+             &img.pixels[4*static_cast<size_t>(2*y + 1)*img.w], out.w);
+  });
+  return out;
+}
+
+static bool
+integer_box(const rgba_image &img, const mip_options &opts) {
+  return opts.filter == MIP_BOX && !opts.srgb &&
+         img.w % 2 == 0 && img.h % 2 == 0;
+}
+
+rgba_image
+downsample_rgba(const rgba_image &img, const mip_options &opts,
+                job_system *jobs) {
+  const kernels k = kernels_for(opts.simd);
+  if (integer_box(img, opts))
+    return box2(img, k, jobs);
+  const float_image src = to_float(img, opts.srgb, jobs);
+  return to_rgba8(resample(src, std::max(img.w/2, 1), std::max(img.h/2, 1),
+                           opts.filter, k, jobs), opts.srgb, jobs);
+}
+
+vector<rgba_image>
+build_mips(const rgba_image &img, const mip_options &opts, job_system *jobs) {
+  vector<rgba_image> mips;
+  const kernels k = kernels_for(opts.simd);
+  if (opts.filter == MIP_BOX && !opts.srgb) {
+    while ((mips.empty() ? img : mips.back()).w > 1 ||
+           (mips.empty() ? img : mips.back()).h > 1)
+      mips.push_back(downsample_rgba(mips.empty() ? img : mips.back(), opts, jobs));
+    return mips;
+  }
+
+  // stays in linear float from level to level, rounding once per level
+  float_image level = to_float(img, opts.srgb, jobs);
+  while (level.w > 1 || level.h > 1) {
+    level = resample(level, std::max(level.w/2, 1), std::max(level.h/2, 1),
+                     opts.filter, k, jobs);
+    mips.push_back(to_rgba8(level, opts.srgb, jobs));
+  }
+  return mips;
+}
@@ -0,0 +1,46 @@
+#ifndef MIPMAP_HPP
+#define MIPMAP_HPP
+
+#include <vector>
+
+#include "texture.hpp"
+
+class job_system;
+
+enum mip_filter {
+  MIP_BOX,    // average of the pixels each output covers
+  MIP_KAISER  // Kaiser windowed sinc, sharper, may ring slightly
+};
+
+// instruction set of the filters; AUTO picks the best the CPU has
+enum mip_simd {
+  MIP_SIMD_AUTO,
+  MIP_SIMD_SCALAR,
+  MIP_SIMD_SSE2,
+  MIP_SIMD_AVX2
+};
+
+struct mip_options {
+  mip_filter filter;
+  bool srgb;      // RGB is sRGB encoded and is filtered in linear light
+  mip_simd simd;
+
+  mip_options() : filter(MIP_BOX), srgb(false), simd(MIP_SIMD_AUTO) {}
+};
+
+// Next mip level, half the size rounded down (at least 1). Odd sizes
+// are resampled so that every source pixel counts. With jobs, bands of
+// rows run on the workers.
+rgba_image downsample_rgba(const rgba_image &img,
+                           const mip_options &opts = mip_options(),
+                           job_system *jobs = nullptr);
+
+// levels 1 and down to 1x1, each from the one before
+std::vector<rgba_image> build_mips(const rgba_image &img,
+                                   const mip_options &opts = mip_options(),
+                                   job_system *jobs = nullptr);
+
+// what MIP_SIMD_AUTO resolves to on this CPU
+const char *mip_simd_name(const mip_simd simd = MIP_SIMD_AUTO);
+
+#endif
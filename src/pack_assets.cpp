@@ -0,0 +1,65 @@
+// Asset packer: stores files in one pack that the game maps instead of
+// opening them one by one (mount_asset_pack, game --assets).
+//
+//   src/pack_assets [--lz4] [--align N] out.pak file...
+//
+// Files are stored under their paths as given, which is how the game
+// asks for them, so run it from the repository root (make -C src assets).
+// --lz4 compresses the entries it shrinks; JPEG and PNG rarely shrink.
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "asset_pack.hpp"
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+using std::runtime_error;
+
+int
+main(int argc, const char **argv) {
+  try {
+    bool lz4 = false;
+    uint32_t alignment = 64;
+    string out_file;
+    vector<string> files;
+    for (int i = 1; i < argc; ++i) {
+      const string arg = argv[i];
+      if (arg == "--lz4")
+        lz4 = true;
+      else if (arg == "--align" && i + 1 < argc)
+        alignment = static_cast<uint32_t>(std::stoul(argv[++i]));
+      else if (arg.compare(0, 2, "--") == 0)
+        throw runtime_error("unknown argument: " + arg);
+      else if (out_file.empty())
+        out_file = arg;
+      else files.push_back(arg);
+    }
+    if (out_file.empty() || files.empty())
+      throw runtime_error("usage: pack_assets [--lz4] [--align N] out.pak file...");
+
+    write_asset_pack(out_file, files, lz4, alignment);
+
+    // read back through the same path the game uses
+    const asset_pack pack(out_file);
+    size_t stored = 0, size = 0;
+    for (const pack_entry &e : pack) {
+      stored += e.stored_size;
+      size += e.size;
+      cerr << pack.name(e) << ": " << e.size << " bytes"
+           << (e.compression == PACK_LZ4 ? ", lz4 " + std::to_string(e.stored_size) : "")
+           << endl;
+    }
+    cerr << out_file << ": " << files.size() << " file(s), " << size
+         << " bytes stored in " << stored << endl;
+  }
+  catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
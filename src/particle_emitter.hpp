@@ -0,0 +1,39 @@
+#ifndef PARTICLE_EMITTER_HPP
+#define PARTICLE_EMITTER_HPP
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// Spawns particles at a steady rate around a point. Particles of a
+// particle_system keep the start and end size and color of the emitter
+// they came from; GPU particles (gpu_particles.hpp) take them from the
+// emitter of the frame they are drawn in.
+struct particle_emitter {
+  glm::vec2 position;
+  float radius;          // spawned anywhere within it
+  glm::vec2 velocity;    // initial, plus up to spread in any direction
+  float spread;
+  float rate;            // particles per second, 0 for bursts only
+  float lifetime;        // seconds
+  float lifetime_jitter; // fraction of it, either way
+  float start_size, end_size;
+  uint32_t start_color, end_color;  // RGBA8, red in the low byte
+  bool active;
+
+  particle_emitter() : position(0.f), radius(0.f), velocity(0.f), spread(0.f),
+                       rate(0.f), lifetime(1.f), lifetime_jitter(0.f),
+                       start_size(0.05f), end_size(0.f),
+                       start_color(0xffffffffu), end_color(0x00ffffffu),
+                       active(true) {}
+};
+
+// acceleration on every particle, dv/dt = gravity - drag*v
+struct particle_forces {
+  glm::vec2 gravity;
+  float drag;
+
+  particle_forces() : gravity(0.f), drag(0.f) {}
+};
+
+#endif
@@ -0,0 +1,367 @@
+#include "particles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PARTICLE_X86 1
+#endif
+
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+using std::vector;
+using std::runtime_error;
+
+// particles per job, enough to outweigh scheduling
+static const size_t PARTICLE_CHUNK = 16384;
+static const float MIN_LIFETIME = 1e-3f;
+
+/****************** dispatch *******************/
+static particle_simd
+detect_simd() {
+#ifdef PARTICLE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return PARTICLE_SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return PARTICLE_SIMD_SSE2;
+#endif
+  return PARTICLE_SIMD_SCALAR;
+}
+
+static particle_simd
+resolve(const particle_simd requested) {
+  static const particle_simd best = detect_simd();
+  // never more than the CPU has
+  return (requested == PARTICLE_SIMD_AUTO || requested > best) ? best : requested;
+}
+
+const char *
+particle_simd_name(const particle_simd simd) {
+  switch (resolve(simd)) {
+    case PARTICLE_SIMD_AVX2: return "avx2";
+    case PARTICLE_SIMD_SSE2: return "sse2";
+    default: return "scalar";
+  }
+}
+
+/****************** kernels *******************/
+// the arrays a kernel reads and writes, and the step's constants
+struct particle_arrays {
+  float *x, *y, *vx, *vy, *life;
+  const float *inv_lifetime, *size0, *size1;
+  const uint32_t *color0, *color1;
+  float *out_x, *out_y, *out_size;
+  uint32_t *out_color;
+  float dt, gx, gy, drag;
+};
+
+// Particles first to last: semi-implicit Euler under gravity and drag,
+// aging, then size and color over life. Returns how many are dead.
+static uint32_t
+update_scalar(const particle_arrays &p, const size_t first, const size_t last) {
+  uint32_t dead = 0;
+  for (size_t i = first; i < last; ++i) {
+    p.vx[i] += (p.gx - p.drag*p.vx[i])*p.dt;
+    p.vy[i] += (p.gy - p.drag*p.vy[i])*p.dt;
+    p.x[i] += p.vx[i]*p.dt;
+    p.y[i] += p.vy[i]*p.dt;
+    p.life[i] -= p.dt;
+    const bool alive = p.life[i] > 0.f;
+    dead += !alive;
+
+    // fraction of the life gone, 0 to 1, and in 7 bits for the colors
+    const float t = std::min(std::max(1.f - p.life[i]*p.inv_lifetime[i], 0.f), 1.f);
+    const int t7 = static_cast<int>(t*128.f);
+    const float size = p.size0[i] + (p.size1[i] - p.size0[i])*t;
+    uint32_t color = 0;
+    for (int c = 0; c < 32; c += 8) {
+      const int a = (p.color0[i] >> c) & 0xff, b = (p.color1[i] >> c) & 0xff;
+      color |= static_cast<uint32_t>((a + (((b - a)*t7) >> 7)) & 0xff) << c;
+    }
+    p.out_x[i] = p.x[i];
+    p.out_y[i] = p.y[i];
+    p.out_size[i] = alive ? size : 0.f;
+    p.out_color[i] = color;
+  }
+  return dead;
+}
+
+#ifdef PARTICLE_X86
+// a + (b - a)*t7 >> 7 per byte: even and odd bytes in 16-bit lanes,
+// where the product of a difference and t7 (up to 128) still fits
+static inline __m128i
+lerp_rgba8_sse2(const __m128i a, const __m128i b, const __m128i t7) {
+  const __m128i m = _mm_set1_epi32(0x00ff00ff);
+  const __m128i t = _mm_or_si128(t7, _mm_slli_epi32(t7, 16));
+  const __m128i ae = _mm_and_si128(a, m), be = _mm_and_si128(b, m);
+  const __m128i ao = _mm_and_si128(_mm_srli_epi32(a, 8), m);
+  const __m128i bo = _mm_and_si128(_mm_srli_epi32(b, 8), m);
+  const __m128i e = _mm_add_epi16(ae, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(be, ae), t), 7));
+  const __m128i o = _mm_add_epi16(ao, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(bo, ao), t), 7));
+  return _mm_or_si128(_mm_and_si128(e, m), _mm_slli_epi32(_mm_and_si128(o, m), 8));
+}
+
+static uint32_t
+update_sse2(const particle_arrays &p, const size_t first, const size_t last) {
+  const __m128 dt = _mm_set1_ps(p.dt), drag = _mm_set1_ps(p.drag);
+  const __m128 gx = _mm_set1_ps(p.gx), gy = _mm_set1_ps(p.gy);
+  const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+  const __m128 scale7 = _mm_set1_ps(128.f);
+  uint32_t dead = 0;
+  size_t i = first;
+  for (; i + 4 <= last; i += 4) {
+    __m128 vx = _mm_loadu_ps(p.vx + i), vy = _mm_loadu_ps(p.vy + i);
+    vx = _mm_add_ps(vx, _mm_mul_ps(_mm_sub_ps(gx, _mm_mul_ps(drag, vx)), dt));
+    vy = _mm_add_ps(vy, _mm_mul_ps(_mm_sub_ps(gy, _mm_mul_ps(drag, vy)), dt));
+    const __m128 x = _mm_add_ps(_mm_loadu_ps(p.x + i), _mm_mul_ps(vx, dt));
+    const __m128 y = _mm_add_ps(_mm_loadu_ps(p.y + i), _mm_mul_ps(vy, dt));
+    const __m128 life = _mm_sub_ps(_mm_loadu_ps(p.life + i), dt);
+    _mm_storeu_ps(p.vx + i, vx);
+    _mm_storeu_ps(p.vy + i, vy);
+    _mm_storeu_ps(p.x + i, x);
+    _mm_storeu_ps(p.y + i, y);
+    _mm_storeu_ps(p.life + i, life);
+    const __m128 alive = _mm_cmpgt_ps(life, zero);
+    dead += 4 - __builtin_popcount(_mm_movemask_ps(alive));
+
+    __m128 t = _mm_sub_ps(one, _mm_mul_ps(life, _mm_loadu_ps(p.inv_lifetime + i)));
+    t = _mm_min_ps(_mm_max_ps(t, zero), one);
+    const __m128 s0 = _mm_loadu_ps(p.size0 + i);
+    const __m128 size = _mm_add_ps(s0, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p.size1 + i), s0), t));
+    const __m128i color = lerp_rgba8_sse2(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(p.color0 + i)),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(p.color1 + i)),
+      _mm_cvttps_epi32(_mm_mul_ps(t, scale7)));
+    _mm_storeu_ps(p.out_x + i, x);
+    _mm_storeu_ps(p.out_y + i, y);
+    _mm_storeu_ps(p.out_size + i, _mm_and_ps(alive, size));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p.out_color + i), color);
+  }
+  return dead + update_scalar(p, i, last);
+}
+
+// as the SSE2 one, 8 particles per iteration
+__attribute__((target("avx2"))) static inline __m256i
+lerp_rgba8_avx2(const __m256i a, const __m256i b, const __m256i t7) {
+  const __m256i m = _mm256_set1_epi32(0x00ff00ff);
+  const __m256i t = _mm256_or_si256(t7, _mm256_slli_epi32(t7, 16));
+  const __m256i ae = _mm256_and_si256(a, m), be = _mm256_and_si256(b, m);
+  const __m256i ao = _mm256_and_si256(_mm256_srli_epi32(a, 8), m);
+  const __m256i bo = _mm256_and_si256(_mm256_srli_epi32(b, 8), m);
+  const __m256i e = _mm256_add_epi16(ae, _mm256_srai_epi16(
+    _mm256_mullo_epi16(_mm256_sub_epi16(be, ae), t), 7));
+  const __m256i o = _mm256_add_epi16(ao, _mm256_srai_epi16(
+    _mm256_mullo_epi16(_mm256_sub_epi16(bo, ao), t), 7));
+  return _mm256_or_si256(_mm256_and_si256(e, m),
+                         _mm256_slli_epi32(_mm256_and_si256(o, m), 8));
+}
+
+__attribute__((target("avx2"))) static uint32_t
+update_avx2(const particle_arrays &p, const size_t first, const size_t last) {
+  const __m256 dt = _mm256_set1_ps(p.dt), drag = _mm256_set1_ps(p.drag);
+  const __m256 gx = _mm256_set1_ps(p.gx), gy = _mm256_set1_ps(p.gy);
+  const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+  const __m256 scale7 = _mm256_set1_ps(128.f);
+  uint32_t dead = 0;
+  size_t i = first;
+  for (; i + 8 <= last; i += 8) {
+    __m256 vx = _mm256_loadu_ps(p.vx + i), vy = _mm256_loadu_ps(p.vy + i);
+    vx = _mm256_add_ps(vx, _mm256_mul_ps(_mm256_sub_ps(gx, _mm256_mul_ps(drag, vx)), dt));
+    vy = _mm256_add_ps(vy, _mm256_mul_ps(_mm256_sub_ps(gy, _mm256_mul_ps(drag, vy)), dt));
+    const __m256 x = _mm256_add_ps(_mm256_loadu_ps(p.x + i), _mm256_mul_ps(vx, dt));
+    const __m256 y = _mm256_add_ps(_mm256_loadu_ps(p.y + i), _mm256_mul_ps(vy, dt));
+    const __m256 life = _mm256_sub_ps(_mm256_loadu_ps(p.life + i), dt);
+    _mm256_storeu_ps(p.vx + i, vx);
+    _mm256_storeu_ps(p.vy + i, vy);
+    _mm256_storeu_ps(p.x + i, x);
+    _mm256_storeu_ps(p.y + i, y);
+    _mm256_storeu_ps(p.life + i, life);
+    const __m256 alive = _mm256_cmp_ps(life, zero, _CMP_GT_OQ);
+    dead += 8 - __builtin_popcount(_mm256_movemask_ps(alive));
+
+    __m256 t = _mm256_sub_ps(one, _mm256_mul_ps(life, _mm256_loadu_ps(p.inv_lifetime + i)));
+    t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+    const __m256 s0 = _mm256_loadu_ps(p.size0 + i);
+    const __m256 size = _mm256_add_ps(s0, _mm256_mul_ps(
+      _mm256_sub_ps(_mm256_loadu_ps(p.size1 + i), s0), t));
+    const __m256i color = lerp_rgba8_avx2(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p.color0 + i)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p.color1 + i)),
+      _mm256_cvttps_epi32(_mm256_mul_ps(t, scale7)));
+    _mm256_storeu_ps(p.out_x + i, x);
+    _mm256_storeu_ps(p.out_y + i, y);
+    _mm256_storeu_ps(p.out_size + i, _mm256_and_ps(alive, size));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p.out_color + i), color);
+  }
+  return dead + update_sse2(p, i, last);
+}
+#endif
+
+typedef uint32_t (*update_kernel)(const particle_arrays &, size_t, size_t);
+
+static update_kernel
+kernel_for(const particle_simd requested) {
+#ifdef PARTICLE_X86
+  const particle_simd simd = resolve(requested);
+  if (simd >= PARTICLE_SIMD_AVX2)
+    return update_avx2;
+  if (simd >= PARTICLE_SIMD_SSE2)
+    return update_sse2;
+#else
+  (void) requested;
+#endif
+  return update_scalar;
+}
+
+/****************** particle_system *******************/
+static uint32_t
+xorshift(uint32_t &s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+// in [0, 1)
+static float
+random01(uint32_t &s) {
+  return (xorshift(s) & 0xffffff)/16777216.f;
+}
+
+particle_system::particle_system(const size_t capacity, const particle_simd _simd)
+  : x(capacity), y(capacity), vx(capacity), vy(capacity), life(capacity),
+    inv_lifetime(capacity), size0(capacity), size1(capacity),
+    color0(capacity), color1(capacity), count(0), simd(_simd),
+    seed(0x9e3779b9u) {}
+
+uint32_t
+particle_system::add_emitter(const particle_emitter &e) {
+  emitters.push_back(e);
+  emit_credit.push_back(0.f);
+  return static_cast<uint32_t>(emitters.size() - 1);
+}
+
+void
+particle_system::burst(const uint32_t id, const size_t n) {
+  if (id >= emitters.size())
+    throw runtime_error("no such particle emitter");
+  spawn(emitters[id], n);
+}
+
+void
+particle_system::spawn(const particle_emitter &e, const size_t wanted) {
+  const size_t n = std::min(wanted, capacity() - count);
+  for (size_t i = count; i < count + n; ++i) {
+    // a point of the unit disc, by rejection, for position and velocity
+    float dx, dy, ux, uy;
+    do {
+      dx = 2.f*random01(seed) - 1.f;
+      dy = 2.f*random01(seed) - 1.f;
+    } while (dx*dx + dy*dy > 1.f);
+    do {
+      ux = 2.f*random01(seed) - 1.f;
+      uy = 2.f*random01(seed) - 1.f;
+    } while (ux*ux + uy*uy > 1.f);
+    const float jitter = e.lifetime_jitter*(2.f*random01(seed) - 1.f);
+    const float lifetime = std::max(e.lifetime*(1.f + jitter), MIN_LIFETIME);
+
+    x[i] = e.position.x + e.radius*dx;
+    y[i] = e.position.y + e.radius*dy;
+    vx[i] = e.velocity.x + e.spread*ux;
+    vy[i] = e.velocity.y + e.spread*uy;
+    life[i] = lifetime;
+    inv_lifetime[i] = 1.f/lifetime;
+    size0[i] = e.start_size;
+    size1[i] = e.end_size;
+    color0[i] = e.start_color;
+    color1[i] = e.end_color;
+  }
+  count += n;
+}
+
+// swaps the last live particle into each dead one's place, looking only
+// at the chunks the last update found deaths in
+void
+particle_system::remove_dead() {
+  for (size_t c = 0; c < chunk_dead.size(); ++c) {
+    if (chunk_dead[c] == 0)
+      continue;
+    const size_t end = std::min(count, (c + 1)*PARTICLE_CHUNK);
+    for (size_t i = c*PARTICLE_CHUNK; i < end; ++i) {
+      while (i < count && life[i] <= 0.f) {
+        const size_t last = --count;
+        x[i] = x[last];
+        y[i] = y[last];
+        vx[i] = vx[last];
+        vy[i] = vy[last];
+        life[i] = life[last];
+        inv_lifetime[i] = inv_lifetime[last];
+        size0[i] = size0[last];
+        size1[i] = size1[last];
+        color0[i] = color0[last];
+        color1[i] = color1[last];
+      }
+    }
+  }
+  chunk_dead.clear();
+}
+
+void
+particle_system::update(const float dt, particle_list &out, job_system *jobs) {
+  PROFILE_SCOPE("particles");
+  remove_dead();
+  for (size_t e = 0; e < emitters.size(); ++e) {
+    if (!emitters[e].active || emitters[e].rate <= 0.f)
+      continue;
+    emit_credit[e] += emitters[e].rate*dt;
+    const float n = std::floor(emit_credit[e]);
+    emit_credit[e] -= n;
+    spawn(emitters[e], static_cast<size_t>(n));
+  }
+
+  // the list's arrays only ever grow, to the capacity, so a steady
+  // stream of particles does not hit the heap
+  if (out.x.size() < count) {
+    out.x.resize(capacity());
+    out.y.resize(capacity());
+    out.size.resize(capacity());
+    out.color.resize(capacity());
+  }
+  out.count = count;
+
+  particle_arrays p;
+  p.x = x.data();
+  p.y = y.data();
+  p.vx = vx.data();
+  p.vy = vy.data();
+  p.life = life.data();
+  p.inv_lifetime = inv_lifetime.data();
+  p.size0 = size0.data();
+  p.size1 = size1.data();
+  p.color0 = color0.data();
+  p.color1 = color1.data();
+  p.out_x = out.x.data();
+  p.out_y = out.y.data();
+  p.out_size = out.size.data();
+  p.out_color = out.color.data();
+  p.dt = dt;
+  p.gx = forces.gravity.x;
+  p.gy = forces.gravity.y;
+  p.drag = forces.drag;
+
+  const update_kernel kernel = kernel_for(simd);
+  const size_t chunks = (count + PARTICLE_CHUNK - 1)/PARTICLE_CHUNK;
+  chunk_dead.assign(chunks, 0);
+  const auto run = [this, &p, kernel](const size_t c) {
+    chunk_dead[c] = kernel(p, c*PARTICLE_CHUNK, std::min(count, (c + 1)*PARTICLE_CHUNK));
+  };
+  if (jobs != nullptr && chunks > 1)
+    jobs->parallel_for(chunks, run);
+  else
+    for (size_t c = 0; c < chunks; ++c)
+      run(c);
+}
@@ -0,0 +1,71 @@
+#ifndef PARTICLES_HPP
+#define PARTICLES_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frame_packet.hpp"
+#include "particle_emitter.hpp"
+
+class job_system;
+
+// instruction set of the update kernels; AUTO picks the best the CPU has
+enum particle_simd {
+  PARTICLE_SIMD_AUTO,
+  PARTICLE_SIMD_SCALAR,
+  PARTICLE_SIMD_SSE2,
+  PARTICLE_SIMD_AVX2
+};
+
+// Particles as structure of arrays, one array per field, so that the
+// update runs 4 (SSE2) or 8 (AVX2) of them per instruction: forces and
+// integration, aging, then size and color over life, written straight
+// into the particle_list the renderer draws. Sizes and colors are
+// blended in 7-bit fixed point, so every instruction set gives the same
+// instances. Dead particles are drawn at size 0 for the frame they die
+// in and swapped out at the start of the next update.
+class particle_system {
+public:
+  explicit particle_system(const size_t capacity,
+                           const particle_simd simd = PARTICLE_SIMD_AUTO);
+
+  // returns the emitter's id, for emitter() and burst()
+  uint32_t add_emitter(const particle_emitter &e);
+  particle_emitter &emitter(const uint32_t id) { return emitters[id]; }
+  // n particles from the emitter now, as many as there is room for
+  void burst(const uint32_t id, const size_t n);
+
+  // removes the dead, emits, advances everything by dt and replaces the
+  // instances of out; the update is split over the job system when given
+  void update(const float dt, particle_list &out, job_system *jobs = nullptr);
+
+  size_t size() const { return count; }
+  size_t capacity() const { return x.size(); }
+  particle_forces forces;
+
+private:
+  void spawn(const particle_emitter &e, const size_t n);
+  void remove_dead();
+
+  std::vector<particle_emitter> emitters;
+  std::vector<float> emit_credit;  // fractional particles owed per emitter
+
+  // the particles, count of each array's entries in use
+  std::vector<float> x, y, vx, vy;
+  std::vector<float> life;        // seconds left
+  std::vector<float> inv_lifetime;
+  std::vector<float> size0, size1;
+  std::vector<uint32_t> color0, color1;
+  size_t count;
+
+  std::vector<uint32_t> chunk_dead;  // per update chunk, from the last update
+  particle_simd simd;
+  uint32_t seed;
+};
+
+// what PARTICLE_SIMD_AUTO resolves to on this CPU
+const char *particle_simd_name(const particle_simd simd = PARTICLE_SIMD_AUTO);
+
+#endif
@@ -0,0 +1,373 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+
+#include "fixed_timestep.hpp"
+
+using std::vector;
+using std::string;
+using std::deque;
+using std::map;
+using std::mutex;
+using std::lock_guard;
+using std::atomic;
+using std::ostream;
+using std::endl;
+using std::setw;
+
+static const size_t RING_CAPACITY = 1 << 12;  // events, power of two
+static const size_t MAX_DEPTH = 64;
+static const uint64_t FRAME_LAG = 4;          // frames before a frame is final
+static const size_t WINDOW_FRAMES = 300;
+
+// One per thread that ever recorded a scope. Only the owner writes
+// events and head, only the collector advances tail.
+struct thread_buffer {
+  profile_event ring[RING_CAPACITY];
+  atomic<uint64_t> head;
+  atomic<uint64_t> tail;
+  atomic<uint64_t> dropped;
+  uint32_t track;
+
+  // owner only
+  uint64_t frame;
+  uint32_t depth;
+  const char *open_name[MAX_DEPTH];
+  uint64_t open_begin[MAX_DEPTH];
+
+  thread_buffer() : head(0), tail(0), dropped(0), track(0), frame(0), depth(0) {}
+
+  void push(const profile_event &e) {
+    const uint64_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= RING_CAPACITY) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    ring[h & (RING_CAPACITY - 1)] = e;
+    head.store(h + 1, std::memory_order_release);
+  }
+};
+
+static atomic<bool> enabled(false);
+static mutex registry_mutex;
+static vector<thread_buffer*> buffers;   // never freed, threads may exit
+static vector<string> tracks;
+static thread_local thread_buffer *local_buffer = nullptr;
+
+static uint32_t
+add_track(const string &name) {
+  tracks.push_back(name);
+  return static_cast<uint32_t>(tracks.size() - 1);
+}
+
+static thread_buffer &
+local() {
+  if (!local_buffer) {
+    thread_buffer *b = new thread_buffer();
+    lock_guard<mutex> lock(registry_mutex);
+    b->track = add_track("thread " + std::to_string(buffers.size()));
+    buffers.push_back(b);
+    local_buffer = b;
+  }
+  return *local_buffer;
+}
+
+void
+profile_enable(const bool on) {
+  enabled.store(on, std::memory_order_relaxed);
+}
+
+bool
+profile_enabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t
+profile_now_ns() {
+  return static_cast<uint64_t>(clock_seconds()*1e9);
+}
+
+void
+profile_set_thread_name(const char *name) {
+  thread_buffer &b = local();
+  lock_guard<mutex> lock(registry_mutex);
+  tracks[b.track] = name;
+}
+
+void
+profile_set_frame(const uint64_t frame) {
+  local().frame = frame;
+}
+
+uint64_t
+profile_frame() {
+  return local_buffer ? local_buffer->frame : 0;
+}
+
+void
+profile_begin(const char *name) {
+  thread_buffer &b = local();
+  if (b.depth < MAX_DEPTH) {
+    b.open_name[b.depth] = name;
+    b.open_begin[b.depth] = profile_now_ns();
+  }
+  ++b.depth;
+}
+
+void
+profile_end() {
+  thread_buffer &b = local();
+  if (b.depth == 0)
+    return;
+  --b.depth;
+  if (b.depth >= MAX_DEPTH)
+    return;
+
+  profile_event e;
+  e.name = b.open_name[b.depth];
+  e.frame = b.frame;
+  e.begin_ns = b.open_begin[b.depth];
+  e.end_ns = profile_now_ns();
+  e.value = 0;
+  e.depth = b.depth;
+  e.thread = b.track;
+  e.kind = PROFILE_SCOPE_EVENT;
+  b.push(e);
+}
+
+uint32_t
+profile_track(const char *name) {
+  lock_guard<mutex> lock(registry_mutex);
+  for (size_t i = 0; i < tracks.size(); ++i)
+    if (tracks[i] == name)
+      return static_cast<uint32_t>(i);
+  return add_track(name);
+}
+
+void
+profile_record(const uint32_t track, const char *name, const uint64_t frame,
+               const uint64_t begin_ns, const uint64_t end_ns) {
+  profile_event e;
+  e.name = name;
+  e.frame = frame;
+  e.begin_ns = begin_ns;
+  e.end_ns = end_ns;
+  e.value = 0;
+  e.depth = 0;
+  e.thread = track;
+  e.kind = PROFILE_SCOPE_EVENT;
+  local().push(e);
+}
+
+void
+profile_counter(const char *name, const int64_t value) {
+  if (!profile_enabled())
+    return;
+  thread_buffer &b = local();
+  profile_event e;
+  e.name = name;
+  e.frame = b.frame;
+  e.begin_ns = e.end_ns = profile_now_ns();
+  e.value = value;
+  e.depth = 0;
+  e.thread = b.track;
+  e.kind = PROFILE_COUNTER_EVENT;
+  b.push(e);
+}
+
+std::string
+profile_track_name(const uint32_t track) {
+  lock_guard<mutex> lock(registry_mutex);
+  return (track < tracks.size()) ? tracks[track] : string("?");
+}
+
+/***************** aggregation, game thread only *****************/
+
+struct frame_sample {
+  uint64_t ns;
+  uint32_t calls;
+
+  frame_sample() : ns(0), calls(0) {}
+};
+
+struct scope_accum {
+  map<uint64_t, frame_sample> pending;  // frames not final yet
+  deque<frame_sample> history;          // final frames, oldest first
+};
+
+// per track, per scope name; the same literal can live at different
+// addresses in different translation units, so names are compared as
+// strings, through a cache keyed by pointer
+static mutex stats_mutex;
+static map<uint32_t, map<string, scope_accum> > accums;
+static std::unordered_map<const char*, string> name_cache;
+
+static bool capture_active = false;
+static bool capture_done = false;
+static profile_capture capture;
+
+static const string &
+intern(const char *name) {
+  auto it = name_cache.find(name);
+  if (it == name_cache.end())
+    it = name_cache.emplace(name, string(name)).first;
+  return it->second;
+}
+
+void
+profile_collect(const uint64_t frame) {
+  vector<thread_buffer*> snapshot;
+  {
+    lock_guard<mutex> lock(registry_mutex);
+    snapshot = buffers;
+  }
+
+  lock_guard<mutex> lock(stats_mutex);
+  for (thread_buffer *b : snapshot) {
+    const uint64_t t = b->tail.load(std::memory_order_relaxed);
+    const uint64_t h = b->head.load(std::memory_order_acquire);
+    for (uint64_t i = t; i < h; ++i) {
+      const profile_event &e = b->ring[i & (RING_CAPACITY - 1)];
+      if (capture_active && e.frame >= capture.first_frame &&
+          e.frame < capture.first_frame + capture.frame_count)
+        capture.events.push_back(e);
+      if (e.kind != PROFILE_SCOPE_EVENT)
+        continue;
+      frame_sample &s = accums[e.thread][intern(e.name)].pending[e.frame];
+      s.ns += e.end_ns - e.begin_ns;
+      ++s.calls;
+    }
+    b->tail.store(h, std::memory_order_release);
+  }
+
+  if (frame < FRAME_LAG)
+    return;
+  const uint64_t final_before = frame - FRAME_LAG;
+
+  if (capture_active && final_before >= capture.first_frame + capture.frame_count) {
+    capture_active = false;
+    capture_done = true;
+  }
+  for (auto &track : accums) {
+    for (auto &kv : track.second) {
+      scope_accum &a = kv.second;
+      while (!a.pending.empty() && a.pending.begin()->first < final_before) {
+        a.history.push_back(a.pending.begin()->second);
+        a.pending.erase(a.pending.begin());
+      }
+      while (a.history.size() > WINDOW_FRAMES)
+        a.history.pop_front();
+    }
+  }
+}
+
+void
+profile_capture_start(const uint64_t first_frame, const uint64_t frame_count) {
+  lock_guard<mutex> lock(stats_mutex);
+  capture = profile_capture();
+  capture.first_frame = first_frame;
+  capture.frame_count = frame_count;
+  capture_active = true;
+  capture_done = false;
+}
+
+bool
+profile_capture_ready() {
+  lock_guard<mutex> lock(stats_mutex);
+  return capture_done;
+}
+
+profile_capture
+profile_capture_take() {
+  profile_capture out;
+  {
+    lock_guard<mutex> lock(stats_mutex);
+    out.first_frame = capture.first_frame;
+    out.frame_count = capture.frame_count;
+    out.events.swap(capture.events);
+    capture_done = false;
+  }
+  lock_guard<mutex> lock(registry_mutex);
+  out.tracks = tracks;
+  return out;
+}
+
+double
+profile_percentile(const vector<double> &sorted, const double p) {
+  if (sorted.empty())
+    return 0.0;
+  size_t rank = static_cast<size_t>(p*sorted.size() + 0.999999);
+  rank = std::max<size_t>(rank, 1);
+  return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+vector<scope_stats>
+profile_stats() {
+  vector<scope_stats> out;
+  lock_guard<mutex> lock(stats_mutex);
+  for (const auto &track : accums) {
+    for (const auto &kv : track.second) {
+      const deque<frame_sample> &h = kv.second.history;
+      if (h.empty())
+        continue;
+
+      vector<double> ms;
+      double sum = 0.0;
+      double calls = 0.0;
+      for (const frame_sample &s : h) {
+        ms.push_back(s.ns*1e-6);
+        sum += ms.back();
+        calls += s.calls;
+      }
+      std::sort(ms.begin(), ms.end());
+
+      scope_stats st;
+      st.name = kv.first;
+      st.track = profile_track_name(track.first);
+      st.mean_ms = sum/ms.size();
+      st.p50_ms = profile_percentile(ms, 0.50);
+      st.p99_ms = profile_percentile(ms, 0.99);
+      st.max_ms = ms.back();
+      st.calls_per_frame = calls/ms.size();
+      st.frames = ms.size();
+      out.push_back(st);
+    }
+  }
+
+  std::sort(out.begin(), out.end(), [](const scope_stats &a, const scope_stats &b) {
+    return (a.track != b.track) ? a.track < b.track : a.name < b.name;
+  });
+  return out;
+}
+
+void
+profile_print(ostream &os) {
+  const vector<scope_stats> stats = profile_stats();
+  uint64_t dropped = 0;
+  {
+    lock_guard<mutex> lock(registry_mutex);
+    for (const thread_buffer *b : buffers)
+      dropped += b->dropped.load(std::memory_order_relaxed);
+  }
+
+  os << std::fixed << std::setprecision(3)
+     << setw(10) << "track" << setw(20) << "scope"
+     << setw(10) << "mean ms" << setw(10) << "p50 ms"
+     << setw(10) << "p99 ms" << setw(10) << "max ms"
+     << setw(8) << "calls" << setw(8) << "frames" << endl;
+  for (const scope_stats &s : stats)
+    os << setw(10) << s.track << setw(20) << s.name
+       << setw(10) << s.mean_ms << setw(10) << s.p50_ms
+       << setw(10) << s.p99_ms << setw(10) << s.max_ms
+       << setw(8) << std::setprecision(1) << s.calls_per_frame
+       << setw(8) << s.frames << std::setprecision(3) << endl;
+  if (dropped > 0)
+    os << "dropped " << dropped << " profile events (ring buffer full)" << endl;
+  os.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,117 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Frame profiler. Code marks regions with PROFILE_SCOPE("name"); each
+// thread writes finished scopes into its own single-producer ring buffer
+// without taking locks, and the game thread drains all buffers once per
+// frame in profile_collect(). Durations are summed per scope and frame
+// and kept over a sliding window of frames for statistics.
+//
+// Scope names must be string literals (or otherwise live forever), only
+// the pointer is stored. Profiling is off until profile_enable(true);
+// disabled scopes cost a relaxed atomic load.
+
+enum profile_event_kind : uint8_t {
+  PROFILE_SCOPE_EVENT,
+  PROFILE_COUNTER_EVENT   // begin_ns == end_ns, value holds the sample
+};
+
+struct profile_event {
+  const char *name;
+  uint64_t frame;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+  int64_t value;
+  uint32_t depth;    // nesting level on its thread
+  uint32_t thread;   // track index, see profile_track_name()
+  uint8_t kind;
+};
+
+// every event of a range of frames, for offline inspection
+struct profile_capture {
+  uint64_t first_frame;
+  uint64_t frame_count;
+  std::vector<profile_event> events;
+  std::vector<std::string> tracks;   // indexed by profile_event::thread
+};
+
+struct scope_stats {
+  std::string name;
+  std::string track;
+  double mean_ms;
+  double p50_ms;
+  double p99_ms;
+  double max_ms;
+  double calls_per_frame;
+  size_t frames;     // frames in the window that ran this scope
+};
+
+void profile_enable(const bool on);
+bool profile_enabled();
+
+// nanoseconds on the same steady clock as clock_seconds()
+uint64_t profile_now_ns();
+
+// names the calling thread's track, shown in reports
+void profile_set_thread_name(const char *name);
+// frame number the calling thread is currently working on; the render
+// thread lags the game thread by one
+void profile_set_frame(const uint64_t frame);
+// the calling thread's frame, 0 if it never profiled; the job system
+// hands it on to the workers running the thread's jobs
+uint64_t profile_frame();
+
+void profile_begin(const char *name);
+void profile_end();
+
+// events timed by other means (GPU queries), recorded on a named track
+uint32_t profile_track(const char *name);
+void profile_record(const uint32_t track, const char *name,
+                    const uint64_t frame, const uint64_t begin_ns,
+                    const uint64_t end_ns);
+
+// a sample of a per-frame quantity (draw calls, bytes uploaded), shown as
+// a counter track in captures
+void profile_counter(const char *name, const int64_t value);
+
+// drains every thread buffer. Frames older than `frame` minus a few
+// frames of slack (GPU results arrive late) are folded into statistics.
+void profile_collect(const uint64_t frame);
+
+// keeps every event of frames [first_frame, first_frame + frame_count)
+// until profile_capture_take(); only one capture runs at a time
+void profile_capture_start(const uint64_t first_frame, const uint64_t frame_count);
+// true once all frames of the capture are final
+bool profile_capture_ready();
+profile_capture profile_capture_take();
+
+// nearest-rank percentile, p in [0, 1], of values sorted ascending; 0
+// when there are none. Shared by every report so their p99s agree.
+double profile_percentile(const std::vector<double> &sorted, const double p);
+
+std::vector<scope_stats> profile_stats();
+std::string profile_track_name(const uint32_t track);
+void profile_print(std::ostream &os);
+
+struct profile_scope {
+  const bool active;
+  explicit profile_scope(const char *name) : active(profile_enabled()) {
+    if (active) profile_begin(name);
+  }
+  ~profile_scope() {
+    if (active) profile_end();
+  }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+  profile_scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,136 @@
+#include "render_thread.hpp"
+
+#include "glad.h"
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+
+#include "profiler.hpp"
+#include "gl_stats.hpp"
+
+using std::runtime_error;
+using std::unique_lock;
+using std::mutex;
+
+render_thread::render_thread(GLFWwindow *_window,
+                             const renderer_options &opts) :
+  window(_window), write_index(0), ready_index(-1), read_index(-1),
+  started(false), quit(false) {
+  thread = std::thread(&render_thread::run, this, opts);
+
+  // wait for GL init so failures surface on the game thread right away
+  unique_lock<mutex> lock(mtx);
+  cv.wait(lock, [this] { return started || error; });
+  if (error) {
+    lock.unlock();
+    thread.join();
+    std::rethrow_exception(error);
+  }
+}
+
+render_thread::~render_thread() {
+  stop();
+}
+
+frame_packet &
+render_thread::begin_frame() {
+  unique_lock<mutex> lock(mtx);
+  // the render thread may still be drawing from this packet
+  PROFILE_SCOPE("wait_render");
+  cv.wait(lock, [this] { return read_index != write_index || error; });
+  rethrow_if_failed();
+
+  frame_packet &packet = packets[write_index];
+  packet.reset();
+  return packet;
+}
+
+void
+render_thread::submit() {
+  {
+    unique_lock<mutex> lock(mtx);
+    // the previous packet has to be picked up before publishing another
+    cv.wait(lock, [this] { return ready_index < 0 || error; });
+    rethrow_if_failed();
+    ready_index = write_index;
+    write_index ^= 1;
+  }
+  cv.notify_all();
+}
+
+void
+render_thread::stop() {
+  if (!thread.joinable())
+    return;
+  {
+    unique_lock<mutex> lock(mtx);
+    quit = true;
+  }
+  cv.notify_all();
+  thread.join();
+}
+
+void
+render_thread::rethrow_if_failed() {
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void
+render_thread::run(const renderer_options opts) {
+  profile_set_thread_name("render");
+  renderer r;
+  bool gl_loaded = false;
+  try {
+    glfwMakeContextCurrent(window);
+
+    // init GLAD
+    if (!gladLoadGLLoader((GLADloadproc)(glfwGetProcAddress)))
+      throw runtime_error("Failed to initialize GLAD!");
+    gl_loaded = true;
+    gl_stats_frame();
+
+    r.init(opts);
+    {
+      unique_lock<mutex> lock(mtx);
+      gl_caps = r.caps;
+      started = true;
+    }
+    cv.notify_all();
+
+    for (;;) {
+      int index;
+      {
+        unique_lock<mutex> lock(mtx);
+        read_index = -1;
+        cv.notify_all();
+        cv.wait(lock, [this] { return ready_index >= 0 || quit; });
+        if (ready_index < 0)
+          break;
+        read_index = index = ready_index;
+        ready_index = -1;
+      }
+      cv.notify_all();
+
+      profile_set_frame(packets[index].frame);
+      PROFILE_SCOPE("render");
+      r.draw(packets[index]);
+      {
+        PROFILE_SCOPE("swap");
+        glfwSwapBuffers(window);
+      }
+      gl_stats_frame();
+    }
+  }
+  catch (...) {
+    unique_lock<mutex> lock(mtx);
+    error = std::current_exception();
+    read_index = -1;
+  }
+  cv.notify_all();
+
+  if (gl_loaded)
+    r.destroy();
+  gl_stats_shutdown();
+  glfwMakeContextCurrent(NULL);
+}
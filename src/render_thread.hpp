@@ -0,0 +1,58 @@
+#ifndef RENDER_THREAD_HPP
+#define RENDER_THREAD_HPP
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "frame_packet.hpp"
+#include "renderer.hpp"
+
+struct GLFWwindow;
+
+// Runs the renderer on its own thread, which owns the GL context of the
+// window. The game thread fills one frame packet while the render thread
+// draws the other, so a frame costs max(simulation, rendering) instead
+// of their sum. The game thread is never more than one frame ahead.
+class render_thread {
+public:
+  // takes the window's GL context; it must not be current on the caller
+  render_thread(GLFWwindow *window, const renderer_options &opts);
+  ~render_thread();
+
+  render_thread(const render_thread &) = delete;
+  render_thread &operator=(const render_thread &) = delete;
+
+  // the packet the game thread may fill; valid until the next submit()
+  frame_packet &begin_frame();
+
+  // hands the packet to the render thread. Rethrows anything that went
+  // wrong on the render thread.
+  void submit();
+
+  // finishes the frame in flight and joins the thread
+  void stop();
+
+  // what the GL context turned out to support, fixed after construction
+  const renderer_caps &caps() const { return gl_caps; }
+
+private:
+  void run(const renderer_options opts);
+  void rethrow_if_failed();
+
+  GLFWwindow *window;
+  renderer_caps gl_caps;
+  frame_packet packets[2];
+  int write_index;   // owned by the game thread between begin and submit
+  int ready_index;   // submitted but not yet picked up, -1 if none
+  int read_index;    // being drawn by the render thread, -1 if idle
+  bool started;
+  bool quit;
+  std::exception_ptr error;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread thread;
+};
+
+#endif
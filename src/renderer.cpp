@@ -0,0 +1,787 @@
+#include "renderer.hpp"
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include "asset_pack.hpp"
+#include "profiler.hpp"
+#include "texture_cache.hpp"
+
+
+using std::vector;
+using std::runtime_error;
+using std::string;
+using std::cerr;
+using std::endl;
+using std::to_string;
+
+static bool
+has_extension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; ++i) {
+    const GLubyte *ext = glGetStringi(GL_EXTENSIONS, i);
+    if (ext != NULL && strcmp(reinterpret_cast<const char *>(ext), name) == 0)
+      return true;
+  }
+  return false;
+}
+
+inline void
+init_vertex_buffer(GLuint &vertex_array_object,
+                   GLuint &vertex_buffer_object,
+                   GLuint &element_buffer_object) {
+  // generate
+  glGenVertexArrays(1, &vertex_array_object);
+  glGenBuffers(1, &vertex_buffer_object);
+  glGenBuffers(1, &element_buffer_object);
+
+  // bind
+  glBindVertexArray(vertex_array_object);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_object);
+}
+
+void
+load_vertices(const vector<float> &vertices,
+              const vector<uint32_t> &indices) {
+  glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(float), vertices.data(), GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+}
+
+inline void
+postprocess_vertex_buffer() {
+  // coordinates attribute (location = 0 on vertex.shader)
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*) 0);
+  glEnableVertexAttribArray(0);
+
+  // color attribute (location = 1 on vertex.shader)
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*) (6*sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  // texture coord attribute
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void*) (6*sizeof(float)));
+  glEnableVertexAttribArray(2);
+}
+
+void
+renderer::init(const renderer_options &opts) {
+  mip_opts = opts.mips;
+  jobs = opts.jobs;
+
+  init_vertex_buffer(vertex_array_object,
+                     vertex_buffer_object,
+                     element_buffer_object);
+
+  if (vertex_array_object == 0 ||
+      vertex_buffer_object == 0 ||
+      element_buffer_object == 0)
+    throw runtime_error("Failed to init vertex buffer");
+
+  // triangle
+  vector<float> square = {
+    -0.5f, -0.5f, 0.f, 0.5f, 0.5f, 0.5f, 0.f, 0.f,
+     0.5f, -0.5f, 0.f, 0.5f, 0.5f, 0.5f, 1.f, 0.f,
+    -0.5f,  0.5f, 0.f, 0.5f, 0.5f, 0.5f, 0.f, 1.f,
+     0.5f,  0.5f, 0.f, 0.5f, 0.5f, 0.5f, 1.f, 1.f
+  };
+
+  vector<uint32_t> square_indices = {
+    0, 1, 2,
+    1, 2, 3
+  };
+
+  load_vertices(square, square_indices);
+  postprocess_vertex_buffer();
+
+  if (opts.wireframe) {
+    cerr << "running in wireframe mode" << endl;
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    shader_features |= SHADER_WIREFRAME;
+  }
+  // lines have no faces to light
+  deferred = opts.deferred && !opts.wireframe;
+
+  // variants are compiled as materials need them, each set up alike;
+  // sources are the ones make embedded unless asked to read the files
+  if (!opts.shaders_from_disk)
+    use_embedded_shaders(EMBEDDED_SHADERS, EMBEDDED_SHADER_COUNT);
+  shaders.init("shaders/vertex.shader", "shaders/fragment.shader",
+               [](const GLuint program) {
+    glUniform1i(glGetUniformLocation(program, "base_textures"), 0);
+    glUniform1i(glGetUniformLocation(program, "overlay_textures"), 1);
+    glUniform1i(glGetUniformLocation(program, "world_matrices"), 2);
+    const GLuint frame_block = glGetUniformBlockIndex(program, "frame_data");
+    if (frame_block != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, frame_block, UBO_FRAME);
+    const GLuint material_block = glGetUniformBlockIndex(program, "material_data");
+    if (material_block != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, material_block, UBO_MATERIALS);
+  });
+
+  // per draw matrix and material index and texture rectangle, one each;
+  // pointed at a batch's first instance before drawing it
+  glGenBuffers(1, &instance_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+  glEnableVertexAttribArray(3);
+  glVertexAttribDivisor(3, 1);
+  glEnableVertexAttribArray(4);
+  glVertexAttribDivisor(4, 1);
+
+  // per-frame uniforms: camera and time
+  glGenBuffers(1, &frame_ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_uniforms), NULL, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, UBO_FRAME, frame_ubo);
+
+  // texture layers of every material, filled in by add_material
+  glGenBuffers(1, &material_ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, material_ubo);
+  glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS*sizeof(GLint[4]), NULL, GL_STATIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, UBO_MATERIALS, material_ubo);
+
+  // reversed-Z needs depth in [0, 1] instead of GL's default [-1, 1],
+  // otherwise half of the float range is wasted around 0
+  caps.reversed_z = GLAD_GL_VERSION_4_5 && glClipControl != NULL;
+  if (caps.reversed_z)
+    glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(caps.reversed_z ? GL_GREATER : GL_LESS);
+  glClearDepth(caps.reversed_z ? 0.0 : 1.0);
+
+  // block compression, S3TC being an extension even in 4.6
+  caps.s3tc = has_extension("GL_EXT_texture_compression_s3tc");
+  caps.rgtc = GLAD_GL_VERSION_3_0 || has_extension("GL_ARB_texture_compression_rgtc");
+  caps.bptc = GLAD_GL_VERSION_4_2 || has_extension("GL_ARB_texture_compression_bptc");
+
+  gpu_timers.init();
+
+  // world matrices, four RGBA32F texels each
+  glGenBuffers(1, &matrix_buffer);
+  glGenTextures(1, &matrix_texture);
+
+  // streamed files keep the block formats the context samples
+  uint32_t gpu_formats = 0;
+  const block_format formats[] = {BLOCK_BC1, BLOCK_BC3, BLOCK_BC5, BLOCK_BC7};
+  for (const block_format f : formats)
+    if (caps.supports(f))
+      gpu_formats |= 1u << f;
+  streamer.init(&pools, opts.streaming, mip_opts, jobs, gpu_formats);
+
+  // sprites: no vertices, the corners come from gl_VertexID
+  sprite_shaders.init("shaders/sprite_vertex.shader",
+                      "shaders/sprite_fragment.shader",
+                      [](const GLuint program) {
+    glUniform1i(glGetUniformLocation(program, "sprite_textures"), 0);
+  });
+  glGenVertexArrays(1, &sprite_vao);
+  glGenBuffers(1, &sprite_buffer);
+  glBindVertexArray(sprite_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, sprite_buffer);
+  for (GLuint attrib = 0; attrib < 5; ++attrib) {
+    glEnableVertexAttribArray(attrib);
+    glVertexAttribDivisor(attrib, 1);
+  }
+
+  // particles: same, with an array per attribute
+  particle_shaders.init("shaders/particle_vertex.shader",
+                        "shaders/particle_fragment.shader",
+                        [](const GLuint) {});
+  glGenVertexArrays(1, &particle_vao);
+  glGenBuffers(1, &particle_buffer);
+  glBindVertexArray(particle_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
+  for (GLuint attrib = 0; attrib < 4; ++attrib) {
+    glEnableVertexAttribArray(attrib);
+    glVertexAttribDivisor(attrib, 1);
+  }
+  // lights: instanced rectangles over the G-buffer, corners from
+  // gl_VertexID as well
+  light_shaders.init("shaders/light_vertex.shader",
+                     "shaders/light_fragment.shader",
+                     [this](const GLuint program) {
+    glUniform1i(glGetUniformLocation(program, "gbuffer_albedo"), 0);
+    glUniform1i(glGetUniformLocation(program, "gbuffer_normal"), 1);
+    glUniform1i(glGetUniformLocation(program, "gbuffer_depth"), 2);
+    glUniform1i(glGetUniformLocation(program, "reversed_z"), caps.reversed_z);
+    const GLuint frame_block = glGetUniformBlockIndex(program, "frame_data");
+    if (frame_block != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, frame_block, UBO_FRAME);
+  });
+  glGenVertexArrays(1, &light_vao);
+  glGenBuffers(1, &light_buffer);
+  glBindVertexArray(light_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, light_buffer);
+  for (GLuint attrib = 0; attrib < 2; ++attrib) {
+    glEnableVertexAttribArray(attrib);
+    glVertexAttribDivisor(attrib, 1);
+  }
+
+  // GPU particles: state kept in buffers the GPU updates itself
+  gpu_effects.init(opts.gpu_particle_capacity);
+  glBindVertexArray(vertex_array_object);
+
+  // text is optional, the game runs on without a font
+  if (!opts.text.font_file.empty()) {
+    try {
+      text.init(&pools, jobs, opts.text);
+      sprite_shaders.program((shader_features & SHADER_WIREFRAME) | SHADER_SDF);
+    }
+    catch (const std::exception &e) {
+      cerr << "no text: " << e.what() << endl;
+      text.destroy();
+    }
+  }
+
+  const uint32_t container = stream_texture("container.jpg");
+  const uint32_t face = stream_texture("awesomeface.png");
+  add_streamed_material(container, face);
+  // compile errors show at startup, not at the first draw
+  shaders.program(materials[0].shader_key | (deferred ? SHADER_GBUFFER : 0));
+  if (deferred)
+    light_shaders.program(0);
+  sprite_shaders.program(shader_features & SHADER_WIREFRAME);
+  particle_shaders.program(shader_features & SHADER_WIREFRAME);
+}
+
+texture_ref
+renderer::add_texture(const rgba_image &img) {
+  return pools.add(img, build_mips(img, mip_opts, jobs));
+}
+
+texture_ref
+renderer::add_texture(const compressed_image &img) {
+  if (caps.supports(img.format))
+    return pools.add(img);
+  // decoded with whatever mips the file has
+  vector<rgba_image> mips;
+  for (size_t level = 1; level < img.levels.size(); ++level)
+    mips.push_back(decompress_level(img, level));
+  return pools.add(decompress_level(img, 0), mips);
+}
+
+texture_ref
+renderer::load_texture(const string &filename) {
+  const texture_file file = load_texture_file(filename, mip_opts, jobs);
+  if (!file.blocks.levels.empty())
+    return add_texture(file.blocks);
+  return pools.add(file.image, file.mips);
+}
+
+uint32_t
+renderer::stream_texture(const string &filename) {
+  return streamer.add(filename);
+}
+
+uint32_t
+renderer::add_material(const texture_ref &base, const texture_ref &overlay) {
+  if (materials.size() >= MAX_MATERIALS)
+    throw runtime_error("too many materials, the limit is " +
+                        to_string(MAX_MATERIALS));
+  material m;
+  m.base = base;
+  m.overlay = overlay;
+  m.shader_key = shader_features | SHADER_HAS_TEXTURE2;
+  materials.push_back(m);
+  write_material(static_cast<uint32_t>(materials.size() - 1));
+  return static_cast<uint32_t>(materials.size() - 1);
+}
+
+uint32_t
+renderer::add_material(const texture_ref &base) {
+  const uint32_t index = add_material(base, base);
+  materials[index].shader_key = shader_features;
+  return index;
+}
+
+uint32_t
+renderer::add_streamed_material(const uint32_t base, const uint32_t overlay) {
+  const uint32_t index = add_material(streamer.ref(base), streamer.ref(overlay));
+  materials[index].base_stream = base;
+  materials[index].overlay_stream = overlay;
+  return index;
+}
+
+void
+renderer::write_material(const uint32_t index) {
+  const material &m = materials[index];
+  // std140 ivec4 per material
+  const float roughness = std::min(std::max(m.roughness, 0.f), 1.f);
+  const GLint layers[4] = {static_cast<GLint>(m.base.layer),
+                           static_cast<GLint>(m.overlay.layer),
+                           static_cast<GLint>(roughness*255.f + 0.5f), 0};
+  glBindBuffer(GL_UNIFORM_BUFFER, material_ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, index*sizeof(layers), sizeof(layers), layers);
+}
+
+// Streaming feedback: the pixels each draw's unit square spans on screen
+// along its longer side, over the part of the texture it shows, go to
+// the streamer for both textures. Draws behind the camera do not count;
+// off screen ones do, they may be on screen soon.
+void
+renderer::request_texture_levels(const frame_packet &packet) {
+  if (streamer.size() == 0)
+    return;
+
+  const frame_uniforms &u = packet.uniforms;
+  const bool perspective = (u.proj[3][3] == 0.f);
+  const float pixels_per_unit = 0.5f*u.proj[1][1]*packet.fb_height;
+  for (const draw_item &d : packet.draws) {
+    const material &m = materials[d.material];
+    if (m.base_stream == NO_STREAM && m.overlay_stream == NO_STREAM)
+      continue;
+    const glm::mat4 &model = world_matrices[d.matrix];
+    const float size = std::max(glm::length(glm::vec3(model[0])),
+                                glm::length(glm::vec3(model[1])));
+    float pixels = size*pixels_per_unit;
+    if (perspective) {
+      const float depth = -(u.view*model[3]).z;
+      if (depth < -size)
+        continue;
+      pixels /= std::max(depth, 1e-3f);
+    }
+    const float pixels_per_uv =
+      pixels/std::max(std::min(d.uv_rect.z, d.uv_rect.w), 1e-6f);
+    if (m.base_stream != NO_STREAM)
+      streamer.request(m.base_stream, pixels_per_uv);
+    if (m.overlay_stream != NO_STREAM)
+      streamer.request(m.overlay_stream, pixels_per_uv);
+  }
+
+  moved_textures.clear();
+  streamer.update(moved_textures);
+  if (moved_textures.empty())
+    return;
+
+  // materials over textures that moved get their new layers
+  vector<bool> moved(streamer.size(), false);
+  for (const uint32_t id : moved_textures)
+    moved[id] = true;
+  for (uint32_t i = 0; i < materials.size(); ++i) {
+    material &m = materials[i];
+    const bool base = (m.base_stream != NO_STREAM && moved[m.base_stream]);
+    const bool overlay = (m.overlay_stream != NO_STREAM && moved[m.overlay_stream]);
+    if (base)
+      m.base = streamer.ref(m.base_stream);
+    if (overlay)
+      m.overlay = streamer.ref(m.overlay_stream);
+    if (base || overlay)
+      write_material(i);
+  }
+}
+
+void
+renderer::upload_matrices(const frame_packet &packet) {
+  static const size_t MATRIX_BYTES = sizeof(glm::mat4);
+  glBindBuffer(GL_TEXTURE_BUFFER, matrix_buffer);
+
+  // grow, keeping what was uploaded by earlier packets
+  if (packet.matrix_count > matrix_capacity) {
+    const size_t capacity = std::max<size_t>(packet.matrix_count, 2*matrix_capacity);
+    GLuint grown = 0;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity*MATRIX_BYTES, NULL, GL_DYNAMIC_DRAW);
+    if (matrix_capacity > 0)
+      glCopyBufferSubData(GL_TEXTURE_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                          matrix_capacity*MATRIX_BYTES);
+    glDeleteBuffers(1, &matrix_buffer);
+    matrix_buffer = grown;
+    matrix_capacity = capacity;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, matrix_buffer);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, matrix_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, matrix_buffer);
+  }
+
+  if (!packet.matrices.empty())
+    glBufferSubData(GL_TEXTURE_BUFFER, packet.matrix_first*MATRIX_BYTES,
+                    packet.matrices.size()*MATRIX_BYTES, packet.matrices.data());
+
+  world_matrices.resize(packet.matrix_count);
+  std::copy(packet.matrices.begin(), packet.matrices.end(),
+            world_matrices.begin() + packet.matrix_first);
+}
+
+void
+renderer::upload_instances(const frame_packet &packet) {
+  instances.resize(packet.draws.size());
+  for (size_t i = 0; i < packet.draws.size(); ++i) {
+    instances[i].matrix = static_cast<GLint>(packet.draws[i].matrix);
+    instances[i].material = static_cast<GLint>(packet.draws[i].material);
+    instances[i].uv_rect = packet.draws[i].uv_rect;
+  }
+  // orphaned every frame so the driver never waits on last frame's copy
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+  glBufferData(GL_ARRAY_BUFFER, instances.size()*sizeof(draw_instance),
+               instances.data(), GL_STREAM_DRAW);
+}
+
+// a render target read back texel by texel, no mips or filtering
+static void
+set_target_texture(const GLuint texture, const GLint internal_format,
+                   const GLenum format, const GLenum type,
+                   const int w, const int h) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, w, h, 0, format, type, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+void
+renderer::resize_targets(const int w, const int h) {
+  if (scene_fbo == 0) {
+    glGenFramebuffers(1, &scene_fbo);
+    glGenRenderbuffers(1, &scene_color);
+    glGenTextures(1, &scene_depth);
+  }
+
+  glBindRenderbuffer(GL_RENDERBUFFER, scene_color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+  set_target_texture(scene_depth, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT,
+                     GL_FLOAT, w, h);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, scene_color);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                         GL_TEXTURE_2D, scene_depth, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    throw runtime_error("scene framebuffer incomplete");
+  if (!deferred)
+    return;
+
+  if (gbuffer_fbo == 0) {
+    glGenFramebuffers(1, &gbuffer_fbo);
+    glGenFramebuffers(1, &light_fbo);
+    glGenTextures(1, &gbuffer_albedo);
+    glGenTextures(1, &gbuffer_normal);
+  }
+  set_target_texture(gbuffer_albedo, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h);
+  set_target_texture(gbuffer_normal, GL_RG16, GL_RG, GL_UNSIGNED_SHORT, w, h);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, gbuffer_fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                         GL_TEXTURE_2D, gbuffer_albedo, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                         GL_TEXTURE_2D, gbuffer_normal, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                         GL_TEXTURE_2D, scene_depth, 0);
+  const GLenum outputs[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, outputs);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    throw runtime_error("G-buffer incomplete");
+
+  glBindFramebuffer(GL_FRAMEBUFFER, light_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, scene_color);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    throw runtime_error("light framebuffer incomplete");
+}
+
+void
+renderer::draw(const frame_packet &packet) {
+  // minimized windows have no framebuffer to draw into
+  if (packet.fb_width <= 0 || packet.fb_height <= 0)
+    return;
+
+  // resize window on drag, reported by the game thread
+  if (packet.fb_width != viewport_w || packet.fb_height != viewport_h) {
+    viewport_w = packet.fb_width;
+    viewport_h = packet.fb_height;
+    resize_targets(viewport_w, viewport_h);
+    glViewport(0, 0, viewport_w, viewport_h);
+  }
+
+  PROFILE_SCOPE("draw");
+  gpu_timers.begin_frame(packet.frame);
+
+  {
+    gpu_scope timer(gpu_timers, "scene");
+    draw_scene(packet);
+  }
+  if (deferred) {
+    gpu_scope timer(gpu_timers, "lighting");
+    draw_lights(packet);
+  }
+  if (packet.particles.count > 0) {
+    gpu_scope timer(gpu_timers, "particles");
+    draw_particles(packet.particles);
+  }
+  if (packet.gpu_emitter.active || !gpu_effects.idle()) {
+    gpu_scope timer(gpu_timers, "gpu_particles");
+    gpu_effects.update(packet.gpu_emitter, packet.gpu_forces, packet.uniforms.time.y);
+    gpu_effects.draw(shader_features & SHADER_WIREFRAME);
+    glBindVertexArray(vertex_array_object);
+  }
+  if (!packet.sprites.runs.empty()) {
+    gpu_scope timer(gpu_timers, "sprites");
+    draw_sprites(packet.sprites);
+  }
+  if (!packet.texts.empty() && text.loaded()) {
+    gpu_scope timer(gpu_timers, "text");
+    draw_text(packet);
+  }
+
+  // present
+  gpu_scope timer(gpu_timers, "present");
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, viewport_w, viewport_h, 0, 0, viewport_w, viewport_h,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+void
+renderer::draw_scene(const frame_packet &packet) {
+  // render; deferred, the lighting pass writes every pixel of the scene
+  // color, so only depth is cleared
+  glBindFramebuffer(GL_FRAMEBUFFER, deferred ? gbuffer_fbo : scene_fbo);
+  const glm::vec4 &c = packet.clear_color;
+  glClearColor(c.x, c.y, c.z, c.w);
+  glClear(deferred ? GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  const uint32_t pass_features = deferred ? SHADER_GBUFFER : 0;
+
+  glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame_uniforms), &packet.uniforms);
+  upload_matrices(packet);
+  request_texture_levels(packet);
+
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_BUFFER, matrix_texture);
+
+  // one instanced draw per run of draws sharing mesh, texture arrays
+  // and shader variant; the shader picks each material's layers, so everything in
+  // the same pools (or one atlas) goes out in a single call
+  glBindVertexArray(vertex_array_object);
+  upload_instances(packet);
+  GLuint current_program = 0;
+  const size_t n = packet.draws.size();
+  for (size_t first = 0, last = 0; first < n; first = last) {
+    const draw_item &d = packet.draws[first];
+    const material &m = materials[d.material];
+    for (last = first + 1; last < n; ++last) {
+      const material &next = materials[packet.draws[last].material];
+      if (next.base.pool != m.base.pool ||
+          next.overlay.pool != m.overlay.pool ||
+          next.shader_key != m.shader_key ||
+          packet.draws[last].mesh != d.mesh)
+        break;
+    }
+
+    const GLuint program = shaders.program(m.shader_key | pass_features);
+    if (program != current_program) {
+      glUseProgram(program);
+      current_program = program;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pools.texture(m.base.pool));
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pools.texture(m.overlay.pool));
+
+    const size_t offset = first*sizeof(draw_instance);
+    glVertexAttribIPointer(3, 2, GL_INT, sizeof(draw_instance),
+                           (void*) offset);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(draw_instance),
+                          (void*) (offset + offsetof(draw_instance, uv_rect)));
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0,
+                            static_cast<GLsizei>(last - first));
+  }
+}
+
+void
+renderer::draw_sprites(const sprite_list &sprites, const uint32_t features) {
+  PROFILE_SCOPE("draw_sprites");
+  // orphaned every frame so the driver never waits on last frame's copy
+  glBindVertexArray(sprite_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, sprite_buffer);
+  glBufferData(GL_ARRAY_BUFFER, sprites.instances.size()*sizeof(sprite_instance),
+               sprites.instances.data(), GL_STREAM_DRAW);
+
+  const GLuint program =
+    sprite_shaders.program((shader_features & SHADER_WIREFRAME) | features);
+  glUseProgram(program);
+  glUniformMatrix4fv(glGetUniformLocation(program, "sprite_transform"), 1,
+                     GL_FALSE, &sprites.transform[0][0]);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glActiveTexture(GL_TEXTURE0);
+
+  // a run is one array; without base instance (GL 4.2) the attributes
+  // are pointed at its first instance instead
+  const GLsizei stride = sizeof(sprite_instance);
+  for (const sprite_run &run : sprites.runs) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pools.texture(run.pool));
+    const size_t offset = run.first*sizeof(sprite_instance);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*) (offset + offsetof(sprite_instance, position)));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*) (offset + offsetof(sprite_instance, uv_rect)));
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride,
+                          (void*) (offset + offsetof(sprite_instance, rotation)));
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                          (void*) (offset + offsetof(sprite_instance, color)));
+    glVertexAttribIPointer(4, 1, GL_INT, stride,
+                           (void*) (offset + offsetof(sprite_instance, layer)));
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(run.count));
+  }
+
+  glDisable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+  glBindVertexArray(vertex_array_object);
+}
+
+void
+renderer::draw_particles(const particle_list &particles) {
+  PROFILE_SCOPE("draw_particles");
+  // orphaned every frame, then filled with the arrays one after another
+  const size_t n = particles.count;
+  const size_t array = n*sizeof(float);
+  glBindVertexArray(particle_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
+  glBufferData(GL_ARRAY_BUFFER, 4*array, NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, array, particles.x.data());
+  glBufferSubData(GL_ARRAY_BUFFER, array, array, particles.y.data());
+  glBufferSubData(GL_ARRAY_BUFFER, 2*array, array, particles.size.data());
+  glBufferSubData(GL_ARRAY_BUFFER, 3*array, n*sizeof(uint32_t), particles.color.data());
+  glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, (void*) 0);
+  glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, (void*) array);
+  glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, (void*) (2*array));
+  glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (void*) (3*array));
+
+  const GLuint program = particle_shaders.program(shader_features & SHADER_WIREFRAME);
+  glUseProgram(program);
+  glUniformMatrix4fv(glGetUniformLocation(program, "particle_transform"), 1,
+                     GL_FALSE, &particles.transform[0][0]);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(n));
+  glDisable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+  glBindVertexArray(vertex_array_object);
+}
+
+void
+renderer::draw_lights(const frame_packet &packet) {
+  PROFILE_SCOPE("draw_lights");
+  // orphaned every frame, the ambient light first
+  point_light ambient;
+  ambient.position = glm::vec3(0.f);
+  ambient.radius = 0.f;
+  ambient.color = packet.ambient_light;
+  ambient.intensity = 1.f;
+  const size_t n = packet.lights.size();
+  glBindVertexArray(light_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, light_buffer);
+  glBufferData(GL_ARRAY_BUFFER, (n + 1)*sizeof(point_light), NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(point_light), &ambient);
+  glBufferSubData(GL_ARRAY_BUFFER, sizeof(point_light), n*sizeof(point_light),
+                  packet.lights.data());
+
+  glBindFramebuffer(GL_FRAMEBUFFER, light_fbo);
+  const GLuint program = light_shaders.program(0);
+  glUseProgram(program);
+  const glm::mat4 inv_view_proj = glm::inverse(packet.uniforms.view_proj);
+  glUniformMatrix4fv(glGetUniformLocation(program, "inv_view_proj"), 1,
+                     GL_FALSE, &inv_view_proj[0][0]);
+  glUniform3f(glGetUniformLocation(program, "background"),
+              packet.clear_color.x, packet.clear_color.y, packet.clear_color.z);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, gbuffer_albedo);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, gbuffer_normal);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, scene_depth);
+  glDisable(GL_DEPTH_TEST);
+
+  // the ambient light sets every pixel, the others add to it; without
+  // base instance (GL 4.2) the attributes are moved past the ambient one
+  const GLsizei stride = sizeof(point_light);
+  for (size_t first = 0; first < 2 && first <= n; ++first) {
+    const size_t offset = first*sizeof(point_light);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*) (offset + offsetof(point_light, position)));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*) (offset + offsetof(point_light, color)));
+    if (first == 1) {
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_ONE, GL_ONE);
+    }
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+                          static_cast<GLsizei>(first == 0 ? 1 : n));
+  }
+
+  glDisable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+  glActiveTexture(GL_TEXTURE0);
+  glBindFramebuffer(GL_FRAMEBUFFER, scene_fbo);
+  glBindVertexArray(vertex_array_object);
+}
+
+void
+renderer::draw_text(const frame_packet &packet) {
+  PROFILE_SCOPE("draw_text");
+  text.update();
+  text_batch.clear();
+  for (const text_item &t : packet.texts)
+    text.layout(&packet.text_chars[t.first], t.count, t.position, t.size,
+                t.color, text_batch);
+  if (text_batch.size() == 0)
+    return;  // glyphs still on their way
+  text_batch.build(text_sprites);
+
+  // window pixels, y down from the top-left
+  glm::mat4 &m = text_sprites.transform;
+  m = glm::mat4(1.f);
+  m[0][0] = 2.f/viewport_w;
+  m[1][1] = -2.f/viewport_h;
+  m[3][0] = -1.f;
+  m[3][1] = 1.f;
+  draw_sprites(text_sprites, SHADER_SDF);
+}
+
+void
+renderer::destroy() {
+  // free textures
+  text.destroy();
+  streamer.destroy();
+  pools.destroy();
+  materials.clear();
+
+  glDeleteVertexArrays(1, &vertex_array_object);
+  glDeleteBuffers(1, &vertex_buffer_object);
+  glDeleteBuffers(1, &element_buffer_object);
+  glDeleteBuffers(1, &matrix_buffer);
+  glDeleteTextures(1, &matrix_texture);
+  glDeleteBuffers(1, &instance_buffer);
+  glDeleteBuffers(1, &frame_ubo);
+  glDeleteBuffers(1, &material_ubo);
+  gpu_timers.destroy();
+  glDeleteFramebuffers(1, &scene_fbo);
+  glDeleteRenderbuffers(1, &scene_color);
+  glDeleteTextures(1, &scene_depth);
+  glDeleteFramebuffers(1, &gbuffer_fbo);
+  glDeleteFramebuffers(1, &light_fbo);
+  glDeleteTextures(1, &gbuffer_albedo);
+  glDeleteTextures(1, &gbuffer_normal);
+  light_shaders.destroy();
+  glDeleteVertexArrays(1, &light_vao);
+  glDeleteBuffers(1, &light_buffer);
+  shaders.destroy();
+  sprite_shaders.destroy();
+  glDeleteVertexArrays(1, &sprite_vao);
+  glDeleteBuffers(1, &sprite_buffer);
+  particle_shaders.destroy();
+  glDeleteVertexArrays(1, &particle_vao);
+  glDeleteBuffers(1, &particle_buffer);
+  gpu_effects.destroy();
+}
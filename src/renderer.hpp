@@ -0,0 +1,189 @@
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include "glad.h"
+
+#include <string>
+#include <vector>
+
+#include "compressed_texture.hpp"
+#include "frame_packet.hpp"
+#include "gpu_particles.hpp"
+#include "gpu_timer.hpp"
+#include "mipmap.hpp"
+#include "shader.hpp"
+#include "sprite_batch.hpp"
+#include "text.hpp"
+#include "texture.hpp"
+#include "texture_pool.hpp"
+#include "texture_stream.hpp"
+
+struct renderer_options {
+  bool wireframe;
+  mip_options mips;  // how mip chains of loaded images are filtered
+  job_system *jobs;  // builds mip chains, on the render thread if NULL
+  texture_stream_options streaming;  // VRAM budget of streamed textures
+  bool shaders_from_disk;  // read and preprocessed at init, not embedded
+  text_options text;       // no text drawn without a font
+  size_t gpu_particle_capacity;  // slots of the GPU particles
+  bool deferred;           // G-buffer and lighting pass, forward when false
+
+  renderer_options() : wireframe(false), jobs(nullptr),
+                       shaders_from_disk(false),
+                       gpu_particle_capacity(1 << 17), deferred(true) {}
+};
+
+// what the context supports, decided once at init
+struct renderer_caps {
+  bool reversed_z;  // glClipControl available, depth in [0, 1]
+  bool s3tc;        // BC1 and BC3
+  bool rgtc;        // BC5
+  bool bptc;        // BC7
+
+  renderer_caps() : reversed_z(false), s3tc(false), rgtc(false), bptc(false) {}
+
+  bool supports(const block_format f) const {
+    return (f == BLOCK_BC5) ? rgtc : (f == BLOCK_BC7) ? bptc : s3tc;
+  }
+};
+
+// uniform block binding points shared by all programs
+enum uniform_binding : GLuint {
+  UBO_FRAME = 0,
+  UBO_MATERIALS = 1,
+  UBO_PARTICLES = 2
+};
+
+// size of the material_data block in vertex.shader
+static const uint32_t MAX_MATERIALS = 1024;
+
+static const uint32_t NO_STREAM = ~0u;
+
+// Pooled textures sampled by a draw. Their arrays are bound to units 0
+// and 1 and the layers are looked up in the material block, so draws of
+// materials sharing both arrays and shader variant batch together.
+// Streamed textures are followed by id, their refs change as levels
+// come and go.
+struct material {
+  texture_ref base;
+  texture_ref overlay;  // same as base when there is none
+  uint32_t base_stream;
+  uint32_t overlay_stream;
+  uint32_t shader_key;  // shader_feature bits of the variant it draws with
+  float roughness;      // 0 to 1, of the deferred lighting
+
+  material() : base_stream(NO_STREAM), overlay_stream(NO_STREAM),
+               shader_key(0), roughness(0.6f) {}
+};
+
+// per-instance vertex data of a batched draw, attributes 3 and 4
+struct draw_instance {
+  GLint matrix;
+  GLint material;
+  GLint pad[2];
+  glm::vec4 uv_rect;
+};
+
+// Owns every GL object of the game. All methods must be called from the
+// thread that has the GL context current.
+struct renderer {
+  shader_cache shaders;   // variants of shaders/vertex and fragment.shader
+  uint32_t shader_features;  // added to every material's key, e.g. wireframe
+  shader_cache sprite_shaders;
+  GLuint sprite_vao;
+  GLuint sprite_buffer;      // sprite_instance per sprite, refilled every frame
+  shader_cache particle_shaders;
+  GLuint particle_vao;
+  GLuint particle_buffer;    // particle_list arrays back to back, every frame
+  gpu_particles gpu_effects; // emitted from the packet's gpu_emitter
+  text_renderer text;
+  sprite_batch text_batch;   // glyphs of the packet's texts
+  sprite_list text_sprites;
+  GLuint vertex_array_object;
+  GLuint vertex_buffer_object;
+  GLuint element_buffer_object;
+  GLuint instance_buffer;    // draw_instance per draw, refilled every frame
+  std::vector<draw_instance> instances;
+  GLuint frame_ubo;
+  GLuint material_ubo;       // base and overlay layer per material
+  GLuint matrix_buffer;      // world matrices, read as a texture buffer
+  GLuint matrix_texture;
+  size_t matrix_capacity;
+  std::vector<glm::mat4> world_matrices;  // CPU copy, for streaming feedback
+  texture_pools pools;
+  texture_streamer streamer;
+  std::vector<uint32_t> moved_textures;
+  std::vector<material> materials;  // 0 is the crate from init()
+  renderer_caps caps;
+  mip_options mip_opts;
+  job_system *jobs;
+  gpu_timer_pool gpu_timers;
+  // the scene renders into this framebuffer, whose 32-bit float depth
+  // the default framebuffer cannot offer, and is blitted to the window
+  GLuint scene_fbo;
+  GLuint scene_color;
+  GLuint scene_depth;        // a texture, read back by the lighting pass
+  // Deferred shading: the draws only fill the G-buffer, 8 bytes a pixel
+  // plus depth, and each light then shades the pixels of its screen
+  // rectangle, so lights cost by the pixels they cover, not per object.
+  // In wireframe the scene is drawn forward, unlit.
+  bool deferred;
+  GLuint gbuffer_fbo;        // gbuffer_albedo, gbuffer_normal, scene_depth
+  GLuint gbuffer_albedo;     // RGBA8, roughness in alpha
+  GLuint gbuffer_normal;     // RG16, octahedral
+  GLuint light_fbo;          // scene_color alone, the depth being read
+  shader_cache light_shaders;
+  GLuint light_vao;
+  GLuint light_buffer;       // the ambient light then the packet's, every frame
+  int viewport_w;
+  int viewport_h;
+
+  renderer() : shader_features(0), sprite_vao(0), sprite_buffer(0),
+               particle_vao(0), particle_buffer(0),
+               vertex_array_object(0),
+               vertex_buffer_object(0), element_buffer_object(0),
+               instance_buffer(0), frame_ubo(0), material_ubo(0),
+               matrix_buffer(0), matrix_texture(0), matrix_capacity(0),
+               jobs(nullptr), scene_fbo(0), scene_color(0), scene_depth(0),
+               deferred(false), gbuffer_fbo(0), gbuffer_albedo(0),
+               gbuffer_normal(0), light_fbo(0), light_vao(0), light_buffer(0),
+               viewport_w(0), viewport_h(0) {}
+
+  void init(const renderer_options &opts);
+  // copies the image and its mips, built on the CPU, into the pool of
+  // its size
+  texture_ref add_texture(const rgba_image &img);
+  // decoded on the CPU when the context lacks the format
+  texture_ref add_texture(const compressed_image &img);
+  // DDS and KTX2 files as they are, anything else through stb_image
+  texture_ref load_texture(const std::string &filename);
+  // only the tail is loaded now, finer levels when draws need them
+  uint32_t stream_texture(const std::string &filename);
+  // returns the material index, throws past MAX_MATERIALS
+  uint32_t add_material(const texture_ref &base, const texture_ref &overlay);
+  // only the base texture, drawn with the variant that samples one
+  uint32_t add_material(const texture_ref &base);
+  // same over streamed textures, ids from stream_texture
+  uint32_t add_streamed_material(const uint32_t base, const uint32_t overlay);
+  void write_material(const uint32_t index);
+  void request_texture_levels(const frame_packet &packet);
+  void draw(const frame_packet &packet);
+  // the packet's draws, into the G-buffer when deferred
+  void draw_scene(const frame_packet &packet);
+  // the list's runs over the bound framebuffer, blended, no depth test,
+  // with the shader variant of features, e.g. SHADER_SDF
+  void draw_sprites(const sprite_list &sprites, const uint32_t features = 0);
+  // additively blended over the bound framebuffer, no depth test
+  void draw_particles(const particle_list &particles);
+  // the packet's ambient and point lights over the G-buffer, into the
+  // scene color
+  void draw_lights(const frame_packet &packet);
+  // the packet's texts over everything else
+  void draw_text(const frame_packet &packet);
+  void upload_matrices(const frame_packet &packet);
+  void upload_instances(const frame_packet &packet);
+  void resize_targets(const int w, const int h);
+  void destroy();
+};
+
+#endif
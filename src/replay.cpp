@@ -0,0 +1,171 @@
+#include "replay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+
+#include "profiler.hpp"
+
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using std::ostream;
+using std::endl;
+using std::runtime_error;
+
+static const char LOG_MAGIC[4] = {'G', 'I', 'P', 'T'};
+static const uint8_t LOG_VERSION = 1;
+static const size_t FLUSH_BYTES = 1 << 12;
+
+enum log_record : uint8_t {
+  RECORD_FRAME = 0,
+  RECORD_FRAME_KEYS = 1,
+  RECORD_END = 2
+};
+
+/****************** varints *******************/
+static void
+put_varint(vector<uint8_t> &buf, uint64_t v) {
+  while (v >= 0x80) {
+    buf.push_back(static_cast<uint8_t>(v) | 0x80);
+    v >>= 7;
+  }
+  buf.push_back(static_cast<uint8_t>(v));
+}
+
+static uint64_t
+get_varint(const vector<uint8_t> &buf, size_t &pos) {
+  uint64_t v = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (pos >= buf.size())
+      throw runtime_error("input log: truncated varint");
+    const uint8_t b = buf[pos++];
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return v;
+  }
+  throw runtime_error("input log: bad varint");
+}
+
+static uint64_t
+to_ns(const double seconds) {
+  return static_cast<uint64_t>(std::llround(std::max(seconds, 0.0)*1e9));
+}
+
+/****************** reading *******************/
+input_log
+read_input_log(const string &filename) {
+  ifstream in(filename, std::ios::binary);
+  if (!in)
+    throw runtime_error("cannot open input log: " + filename);
+  const vector<uint8_t> buf((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+
+  if (buf.size() < sizeof(LOG_MAGIC) + 1 + sizeof(double) ||
+      memcmp(buf.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0)
+    throw runtime_error("not an input log: " + filename);
+  if (buf[4] != LOG_VERSION)
+    throw runtime_error("unsupported input log version: " + filename);
+
+  input_log log;
+  size_t pos = 5;
+  memcpy(&log.tick_hz, &buf[pos], sizeof(double));
+  pos += sizeof(double);
+  log.max_catchup_ticks = static_cast<uint32_t>(get_varint(buf, pos));
+
+  input_frame f;
+  while (pos < buf.size()) {
+    const uint8_t tag = buf[pos++];
+    if (tag == RECORD_END) {
+      const uint64_t n = get_varint(buf, pos);
+      if (n != log.frames.size())
+        throw runtime_error("input log: frame count mismatch");
+      log.checksum = get_varint(buf, pos);
+      log.has_checksum = true;
+      break;
+    }
+    if (tag == RECORD_FRAME_KEYS)
+      f.in.keys = static_cast<uint32_t>(get_varint(buf, pos));
+    else if (tag != RECORD_FRAME)
+      throw runtime_error("input log: bad record");
+    f.frame_time = get_varint(buf, pos)*1e-9;
+    log.frames.push_back(f);
+  }
+  return log;
+}
+
+/****************** recording *******************/
+input_recorder::input_recorder(const string &filename, const double tick_hz,
+                               const size_t max_catchup_ticks) :
+  out(filename, std::ios::binary), last_keys(0), frames(0), finished(false) {
+  if (!out)
+    throw runtime_error("cannot write input log: " + filename);
+  out.write(LOG_MAGIC, sizeof(LOG_MAGIC));
+  out.put(static_cast<char>(LOG_VERSION));
+  out.write(reinterpret_cast<const char *>(&tick_hz), sizeof(double));
+  put_varint(buf, max_catchup_ticks);
+}
+
+input_recorder::~input_recorder() {
+  flush();
+}
+
+double
+input_recorder::record(const input_state &in, const double frame_time) {
+  const uint64_t ns = to_ns(frame_time);
+  if (in.keys != last_keys) {
+    buf.push_back(RECORD_FRAME_KEYS);
+    put_varint(buf, in.keys);
+    last_keys = in.keys;
+  }
+  else buf.push_back(RECORD_FRAME);
+  put_varint(buf, ns);
+  ++frames;
+
+  if (buf.size() >= FLUSH_BYTES)
+    flush();
+  return ns*1e-9;
+}
+
+void
+input_recorder::finish(const uint64_t state_checksum) {
+  if (finished)
+    return;
+  buf.push_back(RECORD_END);
+  put_varint(buf, frames);
+  put_varint(buf, state_checksum);
+  finished = true;
+  flush();
+}
+
+void
+input_recorder::flush() {
+  out.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+  out.flush();
+  buf.clear();
+}
+
+/****************** report *******************/
+frame_time_report::frame_time_report(vector<double> t) :
+  frames(t.size()), total_s(0.0) {
+  std::sort(t.begin(), t.end());
+  for (const double x : t)
+    total_s += x;
+  mean_ms = t.empty() ? 0.0 : total_s*1e3/t.size();
+  p50_ms = profile_percentile(t, 0.50)*1e3;
+  p95_ms = profile_percentile(t, 0.95)*1e3;
+  p99_ms = profile_percentile(t, 0.99)*1e3;
+  max_ms = t.empty() ? 0.0 : t.back()*1e3;
+}
+
+void
+frame_time_report::print(ostream &os) const {
+  os << std::fixed << std::setprecision(3)
+     << "frames " << frames << " in " << total_s << " s" << endl
+     << "frame ms: mean " << mean_ms << " p50 " << p50_ms
+     << " p95 " << p95_ms << " p99 " << p99_ms << " max " << max_ms << endl;
+}
@@ -0,0 +1,80 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "game_state.hpp"
+
+// Input log: everything that drives the simulation, i.e. the timestep
+// settings and, per frame, the keys held and the frame time. Feeding it
+// back through the same fixed_timestep reproduces the recorded session
+// tick for tick, so performance runs can be compared on equal input.
+//
+// Layout: "GIPT", version byte, tick_hz (f64), max catch-up ticks
+// (varint), then one record per frame:
+//   FRAME       dt_ns
+//   FRAME_KEYS  keys dt_ns       (keys changed since the last frame)
+//   END         frames checksum  (state checksum after the last frame)
+// with every integer a LEB128 varint, so a frame costs 4-5 bytes.
+
+struct input_frame {
+  input_state in;
+  double frame_time;   // seconds, as the simulation saw it
+};
+
+struct input_log {
+  double tick_hz;
+  uint32_t max_catchup_ticks;
+  std::vector<input_frame> frames;
+  bool has_checksum;   // false if the recording was cut short
+  uint64_t checksum;
+
+  input_log() : tick_hz(0.0), max_catchup_ticks(0), has_checksum(false),
+                checksum(0) {}
+};
+
+input_log
+read_input_log(const std::string &filename);
+
+class input_recorder {
+public:
+  input_recorder(const std::string &filename, const double tick_hz,
+                 const size_t max_catchup_ticks);
+  ~input_recorder();
+
+  // Logs a frame and returns the frame time rounded to what a replay
+  // will read back; the live simulation must use that value.
+  double record(const input_state &in, const double frame_time);
+
+  // closes the log with the final simulation state
+  void finish(const uint64_t state_checksum);
+
+private:
+  std::ofstream out;
+  std::vector<uint8_t> buf;
+  uint32_t last_keys;
+  uint64_t frames;
+  bool finished;
+
+  void flush();
+};
+
+// percentiles of the frame times of a replay, for A/B comparisons
+struct frame_time_report {
+  size_t frames;
+  double total_s;
+  double mean_ms;
+  double p50_ms;
+  double p95_ms;
+  double p99_ms;
+  double max_ms;
+
+  explicit frame_time_report(std::vector<double> frame_times_s);
+  void print(std::ostream &os) const;
+};
+
+#endif
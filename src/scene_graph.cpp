@@ -0,0 +1,278 @@
+#include "scene_graph.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+using std::vector;
+using std::runtime_error;
+
+node_id
+scene_graph::create(const node_id parent_node) {
+  node_id n;
+  if (!free_ids.empty()) {
+    n = free_ids.back();
+    free_ids.pop_back();
+  }
+  else {
+    n = static_cast<node_id>(slot_of.size());
+    slot_of.push_back(NO_NODE);
+    parent_of.push_back(NO_NODE);
+  }
+
+  // appending keeps parents first, the parent already has a slot
+  const uint32_t s = static_cast<uint32_t>(parent.size());
+  slot_of[n] = s;
+  parent_of[n] = parent_node;
+  pos.push_back(glm::vec3(0.f));
+  rot.push_back(glm::quat(1.f, 0.f, 0.f, 0.f));
+  scl.push_back(glm::vec3(1.f));
+  parent.push_back(parent_node == NO_NODE ? NO_NODE : slot_of[parent_node]);
+  dirty.push_back(1);
+  locals.push_back(glm::mat4(1.f));
+  worlds.push_back(glm::mat4(1.f));
+  node_of.push_back(n);
+  return n;
+}
+
+void
+scene_graph::set_parent(const node_id n, const node_id parent_node) {
+  for (node_id p = parent_node; p != NO_NODE; p = parent_of[p])
+    if (p == n)
+      throw runtime_error("scene graph node cannot be its own ancestor");
+
+  parent_of[n] = parent_node;
+  const uint32_t ps = (parent_node == NO_NODE) ? NO_NODE : slot_of[parent_node];
+  parent[slot_of[n]] = ps;
+  if (ps != NO_NODE && ps > slot_of[n])
+    needs_sort = true;
+  mark_dirty(n);
+}
+
+void
+scene_graph::destroy(const node_id n) {
+  // descendants come after their ancestors, so one forward pass finds
+  // the whole subtree
+  vector<uint8_t> doomed(parent.size(), 0);
+  sort_slots();
+  doomed[slot_of[n]] = 1;
+  for (size_t s = slot_of[n] + 1; s < parent.size(); ++s)
+    if (parent[s] != NO_NODE && doomed[parent[s]])
+      doomed[s] = 1;
+
+  vector<uint32_t> remap(parent.size(), NO_NODE);
+  size_t out = 0;
+  for (size_t s = 0; s < parent.size(); ++s) {
+    if (doomed[s]) {
+      slot_of[node_of[s]] = NO_NODE;
+      parent_of[node_of[s]] = NO_NODE;
+      free_ids.push_back(node_of[s]);
+      continue;
+    }
+    remap[s] = static_cast<uint32_t>(out);
+    pos[out] = pos[s];
+    rot[out] = rot[s];
+    scl[out] = scl[s];
+    parent[out] = (parent[s] == NO_NODE) ? NO_NODE : remap[parent[s]];
+    // everything after the hole moves, so the renderer needs it again
+    dirty[out] = (out != s) ? 1 : dirty[s];
+    locals[out] = locals[s];
+    worlds[out] = worlds[s];
+    node_of[out] = node_of[s];
+    slot_of[node_of[out]] = static_cast<uint32_t>(out);
+    ++out;
+  }
+  pos.resize(out);
+  rot.resize(out);
+  scl.resize(out);
+  parent.resize(out);
+  dirty.resize(out);
+  locals.resize(out);
+  worlds.resize(out);
+  node_of.resize(out);
+}
+
+void
+scene_graph::set_position(const node_id n, const glm::vec3 &p) {
+  pos[slot_of[n]] = p;
+  mark_dirty(n);
+}
+
+void
+scene_graph::set_rotation(const node_id n, const glm::quat &q) {
+  rot[slot_of[n]] = q;
+  mark_dirty(n);
+}
+
+void
+scene_graph::set_scale(const node_id n, const glm::vec3 &s) {
+  scl[slot_of[n]] = s;
+  mark_dirty(n);
+}
+
+// reorders slots by depth after a reparent broke the parent-first order
+void
+scene_graph::sort_slots() {
+  if (!needs_sort)
+    return;
+  needs_sort = false;
+
+  const size_t n = parent.size();
+  vector<uint32_t> depth(n, 0);
+  for (size_t s = 0; s < n; ++s)
+    for (node_id p = parent_of[node_of[s]]; p != NO_NODE; p = parent_of[p])
+      ++depth[s];
+
+  vector<uint32_t> order(n);
+  std::iota(order.begin(), order.end(), 0u);
+  std::stable_sort(order.begin(), order.end(),
+                   [&depth](const uint32_t a, const uint32_t b) {
+                     return depth[a] < depth[b];
+                   });
+
+  vector<glm::vec3> new_pos(n), new_scl(n);
+  vector<glm::quat> new_rot(n);
+  vector<node_id> new_node_of(n);
+  for (size_t s = 0; s < n; ++s) {
+    new_pos[s] = pos[order[s]];
+    new_rot[s] = rot[order[s]];
+    new_scl[s] = scl[order[s]];
+    new_node_of[s] = node_of[order[s]];
+    slot_of[new_node_of[s]] = static_cast<uint32_t>(s);
+  }
+  pos.swap(new_pos);
+  rot.swap(new_rot);
+  scl.swap(new_scl);
+  node_of.swap(new_node_of);
+  for (size_t s = 0; s < n; ++s) {
+    const node_id p = parent_of[node_of[s]];
+    parent[s] = (p == NO_NODE) ? NO_NODE : slot_of[p];
+  }
+  std::fill(dirty.begin(), dirty.end(), 1);
+}
+
+// world = parent * local, column by column
+static inline void
+mul_mat4(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out) {
+#ifdef __SSE2__
+  const float *pa = &a[0][0];
+  const float *pb = &b[0][0];
+  float *po = &out[0][0];
+  const __m128 a0 = _mm_loadu_ps(pa);
+  const __m128 a1 = _mm_loadu_ps(pa + 4);
+  const __m128 a2 = _mm_loadu_ps(pa + 8);
+  const __m128 a3 = _mm_loadu_ps(pa + 12);
+  for (int c = 0; c < 4; ++c) {
+    __m128 r = _mm_mul_ps(a0, _mm_set1_ps(pb[4*c + 0]));
+    r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(pb[4*c + 1])));
+    r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(pb[4*c + 2])));
+    r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(pb[4*c + 3])));
+    _mm_storeu_ps(po + 4*c, r);
+  }
+#else
+  out = a*b;
+#endif
+}
+
+static inline void
+trs_to_mat4(const glm::vec3 &p, const glm::quat &q, const glm::vec3 &s,
+            glm::mat4 &m) {
+  const float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+  const float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+  const float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+  m[0] = glm::vec4(s.x*(1.f - 2.f*(yy + zz)), s.x*2.f*(xy + wz), s.x*2.f*(xz - wy), 0.f);
+  m[1] = glm::vec4(s.y*2.f*(xy - wz), s.y*(1.f - 2.f*(xx + zz)), s.y*2.f*(yz + wx), 0.f);
+  m[2] = glm::vec4(s.z*2.f*(xz + wy), s.z*2.f*(yz - wx), s.z*(1.f - 2.f*(xx + yy)), 0.f);
+  m[3] = glm::vec4(p, 1.f);
+}
+
+#ifdef __SSE2__
+// same as trs_to_mat4 for four slots at once, one slot per SIMD lane
+static inline void
+trs_to_mat4_x4(const glm::vec3 *p, const glm::quat *q, const glm::vec3 *s,
+               const uint32_t *slots, glm::mat4 *out) {
+#define LANES(arr, f) _mm_setr_ps(arr[slots[0]].f, arr[slots[1]].f, \
+                                  arr[slots[2]].f, arr[slots[3]].f)
+  const __m128 x = LANES(q, x), y = LANES(q, y), z = LANES(q, z), w = LANES(q, w);
+  const __m128 sx = LANES(s, x), sy = LANES(s, y), sz = LANES(s, z);
+  __m128 px = LANES(p, x), py = LANES(p, y), pz = LANES(p, z);
+#undef LANES
+  const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+  const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+  const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+  const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+  __m128 c0x = _mm_mul_ps(sx, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+  __m128 c0y = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+  __m128 c0z = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+  __m128 c1x = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+  __m128 c1y = _mm_mul_ps(sy, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+  __m128 c1z = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+  __m128 c2x = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+  __m128 c2y = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+  __m128 c2z = _mm_mul_ps(sz, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+  __m128 zero = _mm_setzero_ps(), c0w = zero, c1w = zero, c2w = zero, c3w = one;
+
+  // lanes -> columns of the four matrices
+  _MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+  _MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+  _MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+  _MM_TRANSPOSE4_PS(px, py, pz, c3w);
+  const __m128 col0[4] = {c0x, c0y, c0z, c0w};
+  const __m128 col1[4] = {c1x, c1y, c1z, c1w};
+  const __m128 col2[4] = {c2x, c2y, c2z, c2w};
+  const __m128 col3[4] = {px, py, pz, c3w};
+  for (int i = 0; i < 4; ++i) {
+    float *m = &out[slots[i]][0][0];
+    _mm_storeu_ps(m, col0[i]);
+    _mm_storeu_ps(m + 4, col1[i]);
+    _mm_storeu_ps(m + 8, col2[i]);
+    _mm_storeu_ps(m + 12, col3[i]);
+  }
+}
+#endif
+
+void
+scene_graph::update() {
+  sort_slots();
+
+  // propagate dirty flags down, parents come first
+  const size_t n = parent.size();
+  batch.clear();
+  for (size_t s = 0; s < n; ++s) {
+    if (!dirty[s] && parent[s] != NO_NODE && dirty[parent[s]])
+      dirty[s] = 1;
+    if (dirty[s])
+      batch.push_back(static_cast<uint32_t>(s));
+  }
+
+  changed_begin = changed_end = 0;
+  if (batch.empty())
+    return;
+  changed_begin = batch.front();
+  changed_end = batch.back() + 1;
+
+  // local matrices of all dirty slots, in batches of four
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= batch.size(); i += 4)
+    trs_to_mat4_x4(pos.data(), rot.data(), scl.data(), &batch[i], locals.data());
+#endif
+  for (; i < batch.size(); ++i)
+    trs_to_mat4(pos[batch[i]], rot[batch[i]], scl[batch[i]], locals[batch[i]]);
+
+  // world matrices in slot order, so parents are always done already
+  for (const uint32_t s : batch) {
+    if (parent[s] == NO_NODE)
+      worlds[s] = locals[s];
+    else
+      mul_mat4(worlds[parent[s]], locals[s], worlds[s]);
+  }
+
+  for (const uint32_t s : batch)
+    dirty[s] = 0;
+}
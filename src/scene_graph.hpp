@@ -0,0 +1,76 @@
+#ifndef SCENE_GRAPH_HPP
+#define SCENE_GRAPH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+typedef uint32_t node_id;
+static const node_id NO_NODE = UINT32_MAX;
+
+// Hierarchy of local transforms (position, rotation, scale) producing one
+// world matrix per node. Nodes are stored in slots ordered so a parent
+// always comes before its children, which lets update() walk the arrays
+// once, front to back. Only nodes whose local transform changed, and
+// their descendants, get their matrices recomputed.
+//
+// Node ids are stable handles; slots may change whenever the hierarchy
+// is reordered and are what the renderer indexes world matrices with.
+class scene_graph {
+public:
+  scene_graph() : needs_sort(false), changed_begin(0), changed_end(0) {}
+
+  node_id create(const node_id parent = NO_NODE);
+  // removes the node and its whole subtree
+  void destroy(const node_id n);
+  void set_parent(const node_id n, const node_id parent);
+
+  void set_position(const node_id n, const glm::vec3 &p);
+  void set_rotation(const node_id n, const glm::quat &q);
+  void set_scale(const node_id n, const glm::vec3 &s);
+
+  const glm::vec3 &position(const node_id n) const { return pos[slot_of[n]]; }
+  const glm::quat &rotation(const node_id n) const { return rot[slot_of[n]]; }
+
+  // recomputes the world matrices of every changed subtree
+  void update();
+
+  size_t size() const { return parent.size(); }
+  uint32_t slot(const node_id n) const { return slot_of[n]; }
+  const glm::mat4 &world(const node_id n) const { return worlds[slot_of[n]]; }
+  const std::vector<glm::mat4> &world_matrices() const { return worlds; }
+
+  // slots [changed_first(), changed_last()) were rewritten by the last
+  // update(), everything else is as it was
+  size_t changed_first() const { return changed_begin; }
+  size_t changed_last() const { return changed_end; }
+
+private:
+  void mark_dirty(const node_id n) { dirty[slot_of[n]] = 1; }
+  void sort_slots();
+
+  // per slot, structure of arrays
+  std::vector<glm::vec3> pos;
+  std::vector<glm::quat> rot;
+  std::vector<glm::vec3> scl;
+  std::vector<uint32_t> parent;   // parent slot, always lower, or NO_NODE
+  std::vector<uint8_t> dirty;
+  std::vector<glm::mat4> locals;
+  std::vector<glm::mat4> worlds;
+  std::vector<node_id> node_of;
+
+  // per node id
+  std::vector<uint32_t> slot_of;  // NO_NODE for free ids
+  std::vector<node_id> parent_of;
+  std::vector<node_id> free_ids;
+
+  std::vector<uint32_t> batch;    // scratch: dirty slots of this update
+  bool needs_sort;
+  size_t changed_begin;
+  size_t changed_end;
+};
+
+#endif
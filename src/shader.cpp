@@ -0,0 +1,297 @@
+#include "shader.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "asset_pack.hpp"
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+using std::to_string;
+
+const vector<string> &
+shader_feature_names() {
+  static const vector<string> names = {"HAS_TEXTURE2", "WIREFRAME", "SDF",
+                                         "GBUFFER"};
+  return names;
+}
+
+/****************** preprocessing *******************/
+// the directive's argument when line is `#name ...`, spaces allowed
+// around the '#'
+static bool
+is_directive(const string &line, const char *name, string &argument) {
+  size_t i = line.find_first_not_of(" \t");
+  if (i == string::npos || line[i] != '#')
+    return false;
+  i = line.find_first_not_of(" \t", i + 1);
+  const string word(name);
+  if (i == string::npos || line.compare(i, word.size(), word) != 0)
+    return false;
+  i += word.size();
+  if (i < line.size() && line[i] != ' ' && line[i] != '\t')
+    return false;
+  argument = line.substr(i);
+  return true;
+}
+
+static string
+directory_of(const string &filename) {
+  const size_t slash = filename.rfind('/');
+  return slash == string::npos ? string() : filename.substr(0, slash + 1);
+}
+
+static void
+expand_file(const string &filename, const string &included_from,
+            shader_source &src) {
+  if (std::find(src.files.begin(), src.files.end(), filename) != src.files.end())
+    return;
+  const size_t index = src.files.size();
+  src.files.push_back(filename);
+
+  asset_data data;
+  try {
+    data = load_asset(filename);
+  }
+  catch (const runtime_error &e) {
+    if (included_from.empty())
+      throw;
+    throw runtime_error(string(e.what()) + ", included from " + included_from);
+  }
+
+  // the top file starts at line 1 of string 0 anyway, and nothing but
+  // comments may come before its #version
+  if (index > 0)
+    src.text += "#line 1 " + to_string(index) + "\n";
+
+  const char *p = reinterpret_cast<const char *>(data.data);
+  const char *end = p + data.size;
+  string line, argument;
+  for (size_t number = 1; p < end; ++number) {
+    const char *eol = std::find(p, end, '\n');
+    line.assign(p, eol);
+    p = (eol == end) ? end : eol + 1;
+
+    if (index > 0 && is_directive(line, "version", argument)) {
+      src.text += "\n";  // only the top file's counts
+      continue;
+    }
+    if (!is_directive(line, "include", argument)) {
+      src.text += line;
+      src.text += '\n';
+      continue;
+    }
+
+    const string where = filename + ":" + to_string(number);
+    const size_t open = argument.find('"');
+    const size_t close = (open == string::npos) ? open : argument.find('"', open + 1);
+    if (close == string::npos || close == open + 1 ||
+        argument.find_first_not_of(" \t", close + 1) != string::npos)
+      throw runtime_error("bad #include at " + where);
+    expand_file(directory_of(filename) + argument.substr(open + 1, close - open - 1),
+                where, src);
+    src.text += "#line " + to_string(number + 1) + " " + to_string(index) + "\n";
+  }
+}
+
+shader_source
+preprocess_shader(const string &filename) {
+  shader_source src;
+  expand_file(filename, string(), src);
+  return src;
+}
+
+string
+inject_defines(const shader_source &src, const vector<string> &defines) {
+  if (defines.empty())
+    return src.text;
+
+  // after the #version line when there is one, as GLSL wants it first
+  size_t insert = 0, version_line = 0;
+  string argument;
+  for (size_t pos = 0, number = 1; pos < src.text.size(); ++number) {
+    size_t eol = src.text.find('\n', pos);
+    eol = (eol == string::npos) ? src.text.size() : eol + 1;
+    if (is_directive(src.text.substr(pos, eol - pos), "version", argument)) {
+      insert = eol;
+      version_line = number;
+      break;
+    }
+    pos = eol;
+  }
+
+  string text = src.text.substr(0, insert);
+  for (const string &d : defines)
+    text += "#define " + d + "\n";
+  text += "#line " + to_string(version_line + 1) + " 0\n";
+  text.append(src.text, insert, string::npos);
+  return text;
+}
+
+/****************** embedded shaders *******************/
+static const embedded_shader *embedded_table = nullptr;
+static size_t embedded_count = 0;
+
+void
+use_embedded_shaders(const embedded_shader *table, const size_t count) {
+  embedded_table = table;
+  embedded_count = count;
+}
+
+shader_source
+load_shader_source(const string &filename) {
+  for (size_t i = 0; i < embedded_count; ++i) {
+    const embedded_shader &e = embedded_table[i];
+    if (filename == e.name) {
+      shader_source src;
+      src.text.assign(e.text, e.size);
+      src.files.assign(e.files, e.files + e.file_count);
+      return src;
+    }
+  }
+  return preprocess_shader(filename);
+}
+
+/****************** variants *******************/
+static string
+variant_name(const uint32_t key) {
+  string name;
+  const vector<string> &features = shader_feature_names();
+  for (size_t i = 0; i < features.size(); ++i)
+    if (key & (1u << i))
+      name += (name.empty() ? "" : " ") + features[i];
+  return name.empty() ? "no features" : name;
+}
+
+static GLuint
+compile_stage(const GLenum type, const string &text, const shader_source &src,
+              const uint32_t key) {
+  const GLchar *source = text.c_str();
+  const GLint length = static_cast<GLint>(text.size());
+  const GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, &length);
+  glCompileShader(shader);
+
+  GLint success = 0;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (success)
+    return shader;
+
+  GLint log_size = 0;
+  glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_size);
+  string log(std::max(log_size, 1), '\0');
+  glGetShaderInfoLog(shader, log_size, NULL, &log[0]);
+  glDeleteShader(shader);
+  log.resize(log.find('\0'));
+
+  // the log names files by their source string number
+  string files;
+  for (size_t i = 0; i < src.files.size(); ++i)
+    files += "\n  " + to_string(i) + ": " + src.files[i];
+  throw runtime_error("problem with " + src.files[0] + " (" +
+                      variant_name(key) + "):\n" + log + "source strings:" + files);
+}
+
+void
+shader_cache::init(const string &vtx, const string &frag,
+                   std::function<void(GLuint)> on_new_program) {
+  vertex_name = vtx;
+  fragment_name = frag;
+  varyings.clear();
+  setup = on_new_program;
+}
+
+void
+shader_cache::init_feedback(const string &vtx, const vector<string> &outputs,
+                            std::function<void(GLuint)> on_new_program) {
+  if (outputs.empty())
+    throw runtime_error(vtx + ": transform feedback needs varyings");
+  vertex_name = vtx;
+  fragment_name.clear();
+  varyings = outputs;
+  setup = on_new_program;
+}
+
+GLuint
+shader_cache::compile(const uint32_t key) const {
+  vector<string> defines;
+  const vector<string> &features = shader_feature_names();
+  for (size_t i = 0; i < features.size(); ++i)
+    if (key & (1u << i))
+      defines.push_back(features[i]);
+  if (key >> features.size() != 0)
+    throw runtime_error("unknown shader features in key " + to_string(key));
+
+  const GLuint vertex_shader =
+    compile_stage(GL_VERTEX_SHADER, inject_defines(vertex, defines), vertex, key);
+  GLuint fragment_shader = 0;
+  if (!fragment_name.empty()) {
+    try {
+      fragment_shader = compile_stage(GL_FRAGMENT_SHADER,
+                                      inject_defines(fragment, defines), fragment, key);
+    }
+    catch (...) {
+      glDeleteShader(vertex_shader);
+      throw;
+    }
+  }
+
+  const GLuint program = glCreateProgram();
+  glAttachShader(program, vertex_shader);
+  if (fragment_shader != 0)
+    glAttachShader(program, fragment_shader);
+  // captured outputs have to be named before linking
+  if (!varyings.empty()) {
+    vector<const GLchar *> names;
+    for (const string &v : varyings)
+      names.push_back(v.c_str());
+    glTransformFeedbackVaryings(program, static_cast<GLsizei>(names.size()),
+                                names.data(), GL_INTERLEAVED_ATTRIBS);
+  }
+  glLinkProgram(program);
+  glDeleteShader(vertex_shader);
+  if (fragment_shader != 0)
+    glDeleteShader(fragment_shader);
+
+  GLint success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    char info_log[512];
+    glGetProgramInfoLog(program, sizeof(info_log), NULL, info_log);
+    glDeleteProgram(program);
+    throw runtime_error("problem linking " + vertex_name +
+                        (fragment_name.empty() ? "" : " and " + fragment_name) +
+                        " (" + variant_name(key) + "): " + info_log);
+  }
+  return program;
+}
+
+GLuint
+shader_cache::program(const uint32_t key) {
+  const auto found = programs.find(key);
+  if (found != programs.end())
+    return found->second;
+
+  if (vertex.files.empty()) {
+    shader_source v = load_shader_source(vertex_name);
+    if (!fragment_name.empty())
+      fragment = load_shader_source(fragment_name);
+    vertex = std::move(v);
+  }
+  const GLuint p = compile(key);
+  programs[key] = p;
+  if (setup) {
+    glUseProgram(p);
+    setup(p);
+  }
+  return p;
+}
+
+void
+shader_cache::destroy() {
+  for (const auto &p : programs)
+    glDeleteProgram(p.second);
+  programs.clear();
+  vertex = fragment = shader_source();
+}
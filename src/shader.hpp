@@ -0,0 +1,95 @@
+#ifndef SHADER_HPP
+#define SHADER_HPP
+
+#include "glad.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Features a program variant is built with, each one a #define of the
+// name without SHADER_ in both of its shaders. The bits of a variant
+// make its key.
+enum shader_feature : uint32_t {
+  SHADER_HAS_TEXTURE2 = 1u << 0,  // overlay texture mixed over the base
+  SHADER_WIREFRAME = 1u << 1,     // untextured, for polygon mode lines
+  SHADER_SDF = 1u << 2,           // texture is a distance field, e.g. text
+  SHADER_GBUFFER = 1u << 3        // writes the deferred renderer's G-buffer
+};
+
+// #define names of the features, bit i is name i
+const std::vector<std::string> &shader_feature_names();
+
+// A shader with its #includes expanded. Every file is included once
+// however often it is named, and "#line n i" keeps compiler messages
+// pointing into files[i].
+struct shader_source {
+  std::string text;
+  std::vector<std::string> files;
+};
+
+// `#include "name"` is searched next to the file it is in; files are
+// read through load_asset, so packed shaders include packed files.
+shader_source preprocess_shader(const std::string &filename);
+
+// A shader preprocessed at build time, so loading it reads no file.
+// make writes them to shaders_embedded.cpp with embed_shaders.
+struct embedded_shader {
+  const char *name;
+  const char *text;
+  size_t size;
+  const char *const *files;
+  size_t file_count;
+};
+
+// in shaders_embedded.cpp
+extern const embedded_shader EMBEDDED_SHADERS[];
+extern const size_t EMBEDDED_SHADER_COUNT;
+
+// Shaders in the table are taken from it rather than preprocessed from
+// their files. Set before anything is compiled; without it every
+// shader is read at runtime.
+void use_embedded_shaders(const embedded_shader *table, const size_t count);
+
+// the embedded shader of that name, else preprocess_shader
+shader_source load_shader_source(const std::string &filename);
+
+// the source with the defines right after its #version
+std::string inject_defines(const shader_source &src,
+                           const std::vector<std::string> &defines);
+
+// Program variants of a vertex and a fragment shader, compiled the first
+// time their key is asked for and kept until destroy(), so only the
+// variants something draws with are ever built. Sources are loaded
+// once, by load_shader_source. setup runs on every new program, bound,
+// e.g. for sampler units and block bindings. Errors throw with the
+// compiler's log. Calls must come from the thread with the GL context.
+class shader_cache {
+public:
+  shader_cache() {}
+  void init(const std::string &vertex, const std::string &fragment,
+            std::function<void(GLuint)> setup);
+  // vertex shader only programs whose outputs named in varyings are
+  // captured, interleaved in that order, by transform feedback
+  void init_feedback(const std::string &vertex,
+                     const std::vector<std::string> &varyings,
+                     std::function<void(GLuint)> setup);
+  GLuint program(const uint32_t key);
+  size_t size() const { return programs.size(); }
+  void destroy();
+
+private:
+  GLuint compile(const uint32_t key) const;
+
+  std::string vertex_name;
+  std::string fragment_name;  // empty for feedback programs
+  std::vector<std::string> varyings;
+  shader_source vertex;  // read on the first compile
+  shader_source fragment;
+  std::function<void(GLuint)> setup;
+  std::unordered_map<uint32_t, GLuint> programs;
+};
+
+#endif
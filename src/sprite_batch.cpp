@@ -0,0 +1,138 @@
+#include "sprite_batch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+using std::vector;
+using std::runtime_error;
+
+static const uint32_t MAX_POOLS = 1u << 16;
+
+// sprites copied per job, enough to outweigh scheduling
+static const size_t COPY_CHUNK = 16384;
+
+static uint32_t
+key_slot(const uint32_t key, const size_t table_size) {
+  return static_cast<uint32_t>((key*0x9e3779b1u) >> 8) & (table_size - 1);
+}
+
+void
+sprite_batch::clear() {
+  for (group &g : groups)
+    g.sprites.clear();
+  count = 0;
+}
+
+uint32_t
+sprite_batch::find_group(const uint32_t key) {
+  if (!table.empty())
+    for (uint32_t slot = key_slot(key, table.size()); table[slot] != NO_GROUP;
+         slot = (slot + 1) & (table.size() - 1))
+      if (groups[table[slot]].key == key)
+        return table[slot];
+
+  // a new group; the table stays at most half full
+  groups.push_back(group());
+  groups.back().key = key;
+  if (2*groups.size() > table.size()) {
+    table.assign(std::max<size_t>(64, 4*groups.size()), NO_GROUP);
+    for (uint32_t g = 0; g + 1 < groups.size(); ++g) {
+      uint32_t slot = key_slot(groups[g].key, table.size());
+      while (table[slot] != NO_GROUP)
+        slot = (slot + 1) & (table.size() - 1);
+      table[slot] = g;
+    }
+  }
+  uint32_t slot = key_slot(key, table.size());
+  while (table[slot] != NO_GROUP)
+    slot = (slot + 1) & (table.size() - 1);
+  table[slot] = static_cast<uint32_t>(groups.size() - 1);
+  return table[slot];
+}
+
+void
+sprite_batch::add(const sprite &s) {
+  add(&s, 1);
+}
+
+void
+sprite_batch::add(const sprite *s, const size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (s[i].texture.pool >= MAX_POOLS)
+      throw runtime_error("sprite texture pool out of range");
+    const uint32_t key = (static_cast<uint32_t>(s[i].layer) << 16) | s[i].texture.pool;
+    if (key != last_key || last_group == NO_GROUP) {
+      last_group = find_group(key);
+      last_key = key;
+    }
+
+    sprite_instance inst;
+    inst.position = s[i].position;
+    inst.size = s[i].size;
+    inst.uv_rect = s[i].uv_rect;
+    inst.rotation = s[i].rotation;
+    inst.color = s[i].color;
+    inst.layer = s[i].texture.layer;
+    inst.pad = 0;
+    groups[last_group].sprites.push_back(inst);
+  }
+  count += n;
+}
+
+void
+sprite_batch::build(sprite_list &out, job_system *jobs) {
+  PROFILE_SCOPE("sprite_batch");
+  out.instances.resize(count);
+  out.runs.clear();
+
+  order.clear();
+  for (uint32_t g = 0; g < groups.size(); ++g)
+    if (!groups[g].sprites.empty())
+      order.push_back(g);
+  std::sort(order.begin(), order.end(), [this](const uint32_t a, const uint32_t b) {
+    return groups[a].key < groups[b].key;
+  });
+
+  // runs of one texture array, across layers too
+  uint32_t first = 0;
+  for (const uint32_t g : order) {
+    const uint32_t pool = groups[g].key & 0xffff;
+    const uint32_t n = static_cast<uint32_t>(groups[g].sprites.size());
+    if (out.runs.empty() || out.runs.back().pool != pool) {
+      sprite_run r;
+      r.pool = pool;
+      r.first = first;
+      r.count = 0;
+      out.runs.push_back(r);
+    }
+    out.runs.back().count += n;
+    first += n;
+  }
+
+  // copied out in chunks, so one big group spreads over the workers too
+  const size_t chunks = (count + COPY_CHUNK - 1)/COPY_CHUNK;
+  const auto copy = [this, &out](const size_t chunk) {
+    const size_t begin = chunk*COPY_CHUNK;
+    const size_t end = std::min(count, begin + COPY_CHUNK);
+    size_t at = 0;
+    for (const uint32_t g : order) {
+      const vector<sprite_instance> &src = groups[g].sprites;
+      const size_t from = std::max(begin, at);
+      const size_t to = std::min(end, at + src.size());
+      if (from < to)
+        memcpy(&out.instances[from], &src[from - at], (to - from)*sizeof(sprite_instance));
+      at += src.size();
+      if (at >= end)
+        break;
+    }
+  };
+  if (jobs != nullptr && chunks > 1)
+    jobs->parallel_for(chunks, copy);
+  else
+    for (size_t c = 0; c < chunks; ++c)
+      copy(c);
+}
@@ -0,0 +1,69 @@
+#ifndef SPRITE_BATCH_HPP
+#define SPRITE_BATCH_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frame_packet.hpp"
+#include "texture_pool.hpp"
+
+class job_system;
+
+// A textured quad of the 2D pass, size across before it is rotated
+// about its center. Lower layers are drawn first; within a layer,
+// sprites added later go over earlier ones where they overlap.
+struct sprite {
+  glm::vec2 position;
+  glm::vec2 size;
+  float rotation;      // radians, counterclockwise
+  uint32_t color;      // RGBA8 tint, red in the low byte
+  glm::vec4 uv_rect;   // (offset, scale) in the texture, e.g. an atlas region
+  texture_ref texture;
+  uint16_t layer;
+
+  sprite() : position(0.f), size(1.f), rotation(0.f), color(0xffffffffu),
+             uv_rect(0.f, 0.f, 1.f, 1.f), layer(0) {}
+};
+
+// Collects a frame's sprites and turns them into a sprite_list: sorted
+// by layer and then texture array, so each run of one array is a single
+// instanced draw, with the order of overlapping sprites in a layer kept.
+// Sprites of one layer drawn from different arrays are assumed not to
+// overlap, or their order within the layer does not matter. add() files
+// each sprite under its layer and array right away, so build() only
+// sorts those groups and copies them out one after the other.
+class sprite_batch {
+public:
+  sprite_batch() : count(0), last_key(0), last_group(NO_GROUP) {}
+
+  // empties the groups, keeping them and their memory for the next frame
+  void clear();
+  void add(const sprite &s);
+  void add(const sprite *s, const size_t n);
+  size_t size() const { return count; }
+
+  // replaces the instances and runs of out, copying on the job system
+  // when given one; the batch keeps its sprites until clear()
+  void build(sprite_list &out, job_system *jobs = nullptr);
+
+private:
+  static constexpr uint32_t NO_GROUP = ~0u;
+
+  struct group {
+    uint32_t key;  // layer in the high half, texture array in the low
+    std::vector<sprite_instance> sprites;
+  };
+
+  uint32_t find_group(const uint32_t key);
+
+  std::vector<group> groups;    // in order of first use
+  std::vector<uint32_t> table;  // open addressing by key, group or NO_GROUP
+  std::vector<uint32_t> order;  // groups sorted by key
+  size_t count;
+  uint32_t last_key;            // runs of one group skip the table
+  uint32_t last_group;
+};
+
+#endif
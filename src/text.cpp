@@ -0,0 +1,203 @@
+#include "text.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+using std::vector;
+using std::runtime_error;
+using std::unique_lock;
+using std::lock_guard;
+using std::mutex;
+using std::cerr;
+using std::endl;
+
+// empty texels between glyphs of a page, so filtering stays inside
+static const int GLYPH_GAP = 1;
+
+void
+text_renderer::init(texture_pools *p, job_system *j, const text_options &o) {
+  if (o.raster_size <= 0.f || o.spread <= 0.f || o.page_size <= 0)
+    throw runtime_error("bad text options");
+  font.reset(new truetype_font(o.font_file));
+  opts = o;
+  pools = p;
+  jobs = j;
+  glyphs.assign(font->glyph_count, glyph_entry());
+  for (uint32_t c = 0; c < 128; ++c)
+    ascii[c] = font->glyph_index(c);
+}
+
+text_renderer::glyph_entry &
+text_renderer::entry(const uint32_t glyph) {
+  glyph_entry &e = glyphs[glyph];
+  if (e.state != GLYPH_UNSEEN)
+    return e;
+  const glyph_metrics m = font->metrics(glyph);
+  e.advance = static_cast<float>(m.advance)/font->units_per_em;
+  if (m.x_min == m.x_max || m.y_min == m.y_max)
+    e.state = GLYPH_EMPTY;
+  else {
+    e.state = GLYPH_PENDING;
+    rasterize(glyph);
+  }
+  return e;
+}
+
+void
+text_renderer::rasterize(const uint32_t glyph) {
+  if (jobs == nullptr) {
+    queued.push_back(glyph);
+    return;
+  }
+  {
+    lock_guard<mutex> lock(mtx);
+    ++in_flight;
+  }
+  jobs->submit([this, glyph] {
+    rasterized r;
+    r.glyph = glyph;
+    try {
+      PROFILE_SCOPE("rasterize_glyph");
+      r.bitmap = rasterize_sdf(*font, glyph, opts.raster_size, opts.spread);
+    }
+    catch (const std::exception &e) {
+      // drawn as nothing rather than taking the worker down
+      cerr << "glyph " << glyph << ": " << e.what() << endl;
+    }
+    lock_guard<mutex> lock(mtx);
+    done.push_back(std::move(r));
+    --in_flight;
+    cv.notify_all();
+  });
+}
+
+void
+text_renderer::update() {
+  if (!font)
+    return;
+  for (const uint32_t glyph : queued) {
+    rasterized r;
+    r.glyph = glyph;
+    try {
+      r.bitmap = rasterize_sdf(*font, glyph, opts.raster_size, opts.spread);
+    }
+    catch (const std::exception &e) {
+      // an empty bitmap, placed as GLYPH_EMPTY like on the workers
+      cerr << "glyph " << glyph << ": " << e.what() << endl;
+    }
+    uploading.push_back(std::move(r));
+  }
+  queued.clear();
+  {
+    lock_guard<mutex> lock(mtx);
+    for (rasterized &r : done)
+      uploading.push_back(std::move(r));
+    done.clear();
+  }
+  if (uploading.empty())
+    return;
+
+  PROFILE_SCOPE("upload_glyphs");
+  for (const rasterized &r : uploading)
+    place(r.glyph, r.bitmap);
+  uploading.clear();
+}
+
+void
+text_renderer::place(const uint32_t glyph, const sdf_bitmap &bmp) {
+  glyph_entry &e = glyphs[glyph];
+  const int page = opts.page_size;
+  const int w = bmp.w + GLYPH_GAP, h = bmp.h + GLYPH_GAP;
+  if (bmp.pixels.empty() || w > page || h > page) {
+    e.state = GLYPH_EMPTY;
+    return;
+  }
+
+  // next shelf when the row is full, next page when the shelves are
+  if (!pages.empty() && shelf_x + w > page) {
+    shelf_y += shelf_h;
+    shelf_x = shelf_h = 0;
+  }
+  if (pages.empty() || shelf_y + h > page) {
+    pages.push_back(pools->add_blank(page, page, GL_R8));
+    const vector<uint8_t> zeros(static_cast<size_t>(page)*page, 0);
+    pools->update(pages.back(), 0, 0, page, page, zeros.data());
+    shelf_x = shelf_y = shelf_h = 0;
+  }
+  pools->update(pages.back(), shelf_x, shelf_y, bmp.w, bmp.h, bmp.pixels.data());
+
+  const float em = 1.f/opts.raster_size;
+  e.offset = glm::vec2(bmp.left*em, bmp.bottom*em);
+  e.size = glm::vec2(bmp.w*em, bmp.h*em);
+  e.uv_rect = glm::vec4(static_cast<float>(shelf_x)/page,
+                        static_cast<float>(shelf_y + bmp.h)/page,
+                        static_cast<float>(bmp.w)/page,
+                        -static_cast<float>(bmp.h)/page);
+  e.page = pages.back();
+  e.state = GLYPH_READY;
+  shelf_x += w;
+  shelf_h = std::max(shelf_h, h);
+}
+
+glm::vec2
+text_renderer::layout(const char *text, const size_t n, const glm::vec2 pos,
+                      const float size, const uint32_t color, sprite_batch &out) {
+  if (!font)
+    return glm::vec2(0.f);
+  const float scale = size/font->units_per_em;
+  const float line_height = (font->ascent - font->descent + font->line_gap)*scale;
+  float x = pos.x, width = 0.f;
+  float baseline = pos.y + font->ascent*scale;
+  uint32_t prev = 0;
+  bool has_prev = false;
+
+  sprite s;
+  s.color = color;
+  const char *p = text, *end = text + n;
+  while (p < end) {
+    const uint32_t cp = decode_utf8(p, end);
+    if (cp == '\n') {
+      width = std::max(width, x - pos.x);
+      x = pos.x;
+      baseline += line_height;
+      has_prev = false;
+      continue;
+    }
+    const uint32_t glyph = (cp < 128) ? ascii[cp] : font->glyph_index(cp);
+    if (has_prev)
+      x += font->kerning(prev, glyph)*scale;
+    const glyph_entry &e = entry(glyph);
+    if (e.state == GLYPH_READY) {
+      // y down: the bitmap's top is above its bottom by its height
+      s.size = e.size*size;
+      s.position = glm::vec2(x + e.offset.x*size + 0.5f*s.size.x,
+                             baseline - e.offset.y*size - 0.5f*s.size.y);
+      s.uv_rect = e.uv_rect;
+      s.texture = e.page;
+      out.add(s);
+    }
+    x += e.advance*size;
+    prev = glyph;
+    has_prev = true;
+  }
+  width = std::max(width, x - pos.x);
+  return glm::vec2(width, baseline - font->descent*scale - pos.y);
+}
+
+void
+text_renderer::destroy() {
+  // the workers read the font until their last glyph is in
+  {
+    unique_lock<mutex> lock(mtx);
+    cv.wait(lock, [this] { return in_flight == 0; });
+    done.clear();
+  }
+  queued.clear();
+  font.reset();
+  glyphs.clear();
+  pages.clear();  // their layers go with the pools
+}
@@ -0,0 +1,106 @@
+#ifndef TEXT_HPP
+#define TEXT_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "sprite_batch.hpp"
+#include "texture_pool.hpp"
+#include "truetype.hpp"
+
+class job_system;
+
+struct text_options {
+  std::string font_file;  // TrueType, empty for no text
+  float raster_size;      // pixels per em of the distance fields
+  float spread;           // pixels of distance on each side of the outline
+  int page_size;          // of the atlas pages, square
+
+  text_options() : raster_size(32.f), spread(4.f), page_size(512) {}
+};
+
+// Text as sprites sampling signed distance fields of the glyphs, which
+// scale to any size from one rasterization. Glyphs are rasterized on
+// the job system the first time a string uses them and packed into R8
+// pages of the texture pools by update(); until then they are left out,
+// but already take their advance, so text does not move when they
+// arrive. Advances are cached per glyph and pairs are kerned from the
+// font's kern table. Render thread only, like the pools.
+class text_renderer {
+public:
+  text_renderer() : pools(nullptr), jobs(nullptr), in_flight(0),
+                    shelf_x(0), shelf_y(0), shelf_h(0) {}
+
+  // throws if the font cannot be read
+  void init(texture_pools *pools, job_system *jobs, const text_options &opts);
+  bool loaded() const { return font != nullptr; }
+
+  // places the glyphs of UTF-8 text, '\n' starting a new line, with the
+  // top-left of the first line at pos: pixels, y down. size is pixels
+  // per em. Returns the width and height the lines take.
+  glm::vec2 layout(const char *text, const size_t n, const glm::vec2 pos,
+                   const float size, const uint32_t color, sprite_batch &out);
+  // uploads the glyphs rasterized since the last call
+  void update();
+  // waits for the rasterizations still running
+  void destroy();
+
+private:
+  enum glyph_state : uint8_t {
+    GLYPH_UNSEEN,   // metrics not read yet
+    GLYPH_PENDING,  // being rasterized
+    GLYPH_READY,
+    GLYPH_EMPTY     // nothing to draw, e.g. a space
+  };
+
+  // sizes in ems, so any text size is one multiply away
+  struct glyph_entry {
+    float advance;
+    glm::vec2 offset;   // bottom-left of the bitmap from the pen, y up
+    glm::vec2 size;
+    glm::vec4 uv_rect;  // top row first, for a y down transform
+    texture_ref page;
+    glyph_state state;
+
+    glyph_entry() : advance(0.f), offset(0.f), size(0.f), uv_rect(0.f),
+                    state(GLYPH_UNSEEN) {}
+  };
+
+  struct rasterized {
+    uint32_t glyph;
+    sdf_bitmap bitmap;
+  };
+
+  glyph_entry &entry(const uint32_t glyph);
+  void rasterize(const uint32_t glyph);
+  void place(const uint32_t glyph, const sdf_bitmap &bmp);
+
+  std::unique_ptr<truetype_font> font;
+  text_options opts;
+  texture_pools *pools;
+  job_system *jobs;
+  std::vector<glyph_entry> glyphs;  // by glyph index
+  uint32_t ascii[128];              // glyph of each ASCII character
+
+  // finished on the workers, taken by update()
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<rasterized> done;
+  std::vector<rasterized> uploading;
+  std::vector<uint32_t> queued;     // without a job system, done in update()
+  size_t in_flight;
+
+  // shelves of the last page, filled left to right
+  std::vector<texture_ref> pages;
+  int shelf_x;
+  int shelf_y;
+  int shelf_h;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include "texture.hpp"
+
+#include <stdexcept>
+
+#include "asset_pack.hpp"
+#include "stb_image_wrapper.h"
+
+using std::runtime_error;
+using std::string;
+
+rgba_image
+decode_rgba_image(const uint8_t *data, const size_t size, const string &filename) {
+  rgba_image img;
+  int nch = 0;
+  stbi_set_flip_vertically_on_load(true);
+  unsigned char *pixels = stbi_load_from_memory(data, static_cast<int>(size),
+                                                &img.w, &img.h, &nch, 4);
+  if (!pixels)
+    throw runtime_error("cannot decode image file " + filename + ": " +
+                        stbi_failure_reason());
+  img.pixels.assign(pixels, pixels + 4*static_cast<size_t>(img.w)*img.h);
+  stbi_image_free(pixels);
+  return img;
+}
+
+rgba_image
+load_rgba_image(const string &filename) {
+  const asset_data file = load_asset(filename);
+  return decode_rgba_image(file.data, file.size, filename);
+}
@@ -0,0 +1,22 @@
+#ifndef TEXTURE_HPP
+#define TEXTURE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 8-bit RGBA pixels in memory, bottom row first like GL expects
+struct rgba_image {
+  int w;
+  int h;
+  std::vector<uint8_t> pixels;
+
+  rgba_image() : w(0), h(0) {}
+};
+
+// any format stb_image reads, converted to RGBA; files through load_asset
+rgba_image load_rgba_image(const std::string &filename);
+rgba_image decode_rgba_image(const uint8_t *data, const size_t size,
+                             const std::string &filename);
+
+#endif
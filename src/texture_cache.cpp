@@ -0,0 +1,317 @@
+#include "texture_cache.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "asset_pack.hpp"
+#include "lz4.hpp"
+#include "mapped_file.hpp"
+#include "profiler.hpp"
+
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using std::ostringstream;
+using std::runtime_error;
+using std::lock_guard;
+using std::mutex;
+using std::unordered_map;
+
+// bump when decoding or mip building changes what gets cached
+static const uint32_t CACHE_VERSION = 1;
+static const char CACHE_MAGIC[4] = {'T', 'X', 'C', 'H'};
+static const char *INDEX_NAME = "index";
+
+struct cache_header {
+  char magic[4];
+  uint32_t version;
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint32_t filter;
+  uint32_t srgb;
+  uint32_t levels;
+  uint32_t pad;
+};
+
+struct cache_level {
+  int32_t w;
+  int32_t h;
+  uint32_t lz4;  // else stored as is
+  uint32_t pad;
+  uint64_t stored_size;
+};
+
+// what the index knows of a loose file
+struct source_stamp {
+  uint64_t hash;
+  uint64_t size;
+  int64_t mtime;  // nanoseconds
+
+  source_stamp() : hash(0), size(0), mtime(0) {}
+};
+
+static mutex cache_mtx;
+static string cache_dir;
+static bool index_loaded = false;
+static unordered_map<string, source_stamp> cache_index;
+
+/****************** hashing *******************/
+static uint64_t
+read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t
+mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// four independent lanes so the multiplies overlap
+uint64_t
+content_hash(const uint8_t *data, const size_t size) {
+  static const uint64_t K = 0x9e3779b97f4a7c15ull;
+  uint64_t lane[4] = {K, K ^ 0x1234567890abcdefull, ~K, K*3};
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32)
+    for (int j = 0; j < 4; ++j)
+      lane[j] = (lane[j] ^ read64(data + i + 8*j))*K + (lane[j] >> 29);
+  uint64_t h = size;
+  for (int j = 0; j < 4; ++j)
+    h = mix(h ^ lane[j]);
+  for (; i < size; ++i)
+    h = (h ^ data[i])*0x100000001b3ull;
+  return mix(h);
+}
+
+/****************** index *******************/
+static bool
+stat_file(const string &filename, uint64_t &size, int64_t &mtime) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    return false;
+  size = static_cast<uint64_t>(st.st_size);
+  mtime = static_cast<int64_t>(st.st_mtim.tv_sec)*1000000000 + st.st_mtim.tv_nsec;
+  return true;
+}
+
+// lines of "hash size mtime path", later lines of a path win
+static void
+load_index() {
+  index_loaded = true;
+  ifstream in(cache_dir + "/" + INDEX_NAME);
+  string line;
+  while (std::getline(in, line)) {
+    std::istringstream ls(line);
+    source_stamp s;
+    string path;
+    ls >> std::hex >> s.hash >> std::dec >> s.size >> s.mtime;
+    if (ls.get() != ' ' || !std::getline(ls, path) || path.empty())
+      continue;
+    cache_index[path] = s;
+  }
+}
+
+static void
+record_stamp(const string &filename, const source_stamp &s) {
+  lock_guard<mutex> lk(cache_mtx);
+  source_stamp &known = cache_index[filename];
+  if (known.hash == s.hash && known.size == s.size && known.mtime == s.mtime)
+    return;
+  known = s;
+  ofstream out(cache_dir + "/" + INDEX_NAME, std::ios::app);
+  out << std::hex << s.hash << std::dec << " " << s.size << " " << s.mtime
+      << " " << filename << "\n";
+}
+
+// the hash of a loose file if the index has it for this size and mtime
+static bool
+known_hash(const string &filename, source_stamp &s) {
+  lock_guard<mutex> lk(cache_mtx);
+  if (!index_loaded)
+    load_index();
+  const auto it = cache_index.find(filename);
+  if (it == cache_index.end() || it->second.size != s.size ||
+      it->second.mtime != s.mtime)
+    return false;
+  s.hash = it->second.hash;
+  return true;
+}
+
+/****************** entries *******************/
+static string
+entry_path(const uint64_t hash, const mip_options &opts) {
+  char name[64];
+  snprintf(name, sizeof(name), "/%016llx-%s%s.tex",
+           static_cast<unsigned long long>(hash),
+           opts.filter == MIP_KAISER ? "kaiser" : "box", opts.srgb ? "-srgb" : "");
+  return cache_dir + name;
+}
+
+static bool
+read_entry(const string &path, const source_stamp &s, const mip_options &opts,
+           texture_file &t) {
+  if (access(path.c_str(), R_OK) != 0)
+    return false;
+  const mapped_file in(path);
+  const uint8_t *p = in.data(), *end = in.data() + in.size();
+
+  cache_header h;
+  if (in.size() < sizeof(h))
+    return false;
+  memcpy(&h, p, sizeof(h));
+  p += sizeof(h);
+  if (memcmp(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      h.version != CACHE_VERSION || h.source_hash != s.hash ||
+      h.source_size != s.size || h.filter != static_cast<uint32_t>(opts.filter) ||
+      h.srgb != static_cast<uint32_t>(opts.srgb) || h.levels == 0 || h.levels > 32)
+    return false;
+
+  // levels decompress straight from the file into the images
+  for (uint32_t level = 0; level < h.levels; ++level) {
+    cache_level l;
+    if (static_cast<size_t>(end - p) < sizeof(l))
+      return false;
+    memcpy(&l, p, sizeof(l));
+    p += sizeof(l);
+    if (l.w <= 0 || l.h <= 0 || l.w > (1 << 16) || l.h > (1 << 16) ||
+        l.stored_size > static_cast<size_t>(end - p))
+      return false;
+    rgba_image img;
+    img.w = l.w;
+    img.h = l.h;
+    img.pixels.resize(4*static_cast<size_t>(l.w)*l.h);
+    if (l.lz4)
+      lz4_decompress(p, l.stored_size, img.pixels.data(), img.pixels.size());
+    else if (l.stored_size == img.pixels.size())
+      memcpy(img.pixels.data(), p, img.pixels.size());
+    else return false;
+    p += l.stored_size;
+    if (level == 0)
+      t.image = std::move(img);
+    else t.mips.push_back(std::move(img));
+  }
+  return true;
+}
+
+// written next to the entry and renamed over it, so readers never see
+// half an entry
+static void
+write_entry(const string &path, const source_stamp &s, const mip_options &opts,
+            const texture_file &t) {
+  static std::atomic<uint32_t> serial(0);
+  ostringstream tmp;
+  tmp << path << ".tmp" << getpid() << "-" << serial++;
+  ofstream out(tmp.str(), std::ios::binary);
+  if (!out)
+    return;
+
+  cache_header h;
+  memcpy(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  h.version = CACHE_VERSION;
+  h.source_hash = s.hash;
+  h.source_size = s.size;
+  h.filter = static_cast<uint32_t>(opts.filter);
+  h.srgb = static_cast<uint32_t>(opts.srgb);
+  h.levels = static_cast<uint32_t>(t.mips.size() + 1);
+  h.pad = 0;
+  out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  for (uint32_t level = 0; level < h.levels; ++level) {
+    const rgba_image &img = (level == 0) ? t.image : t.mips[level - 1];
+    const vector<uint8_t> packed = lz4_compress(img.pixels.data(), img.pixels.size());
+    cache_level l;
+    l.w = img.w;
+    l.h = img.h;
+    l.lz4 = packed.size() < img.pixels.size();
+    l.pad = 0;
+    const vector<uint8_t> &stored = l.lz4 ? packed : img.pixels;
+    l.stored_size = stored.size();
+    out.write(reinterpret_cast<const char *>(&l), sizeof(l));
+    out.write(reinterpret_cast<const char *>(stored.data()), stored.size());
+  }
+  out.close();
+  if (!out || rename(tmp.str().c_str(), path.c_str()) != 0) {
+    std::cerr << "texture cache: cannot write " << path << std::endl;
+    remove(tmp.str().c_str());
+  }
+}
+
+/****************** loading *******************/
+void
+set_texture_cache(const string &dir) {
+  lock_guard<mutex> lk(cache_mtx);
+  cache_dir = dir;
+  index_loaded = false;
+  cache_index.clear();
+  if (!dir.empty() && mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+    throw runtime_error("cannot create texture cache " + dir);
+}
+
+texture_file
+load_texture_file(const string &filename, const mip_options &opts,
+                  job_system *jobs) {
+  texture_file t;
+  const bool cached = !cache_dir.empty();
+
+  // warm start: the index vouches for the file, which is never read.
+  // Stamped before reading, so a file changed meanwhile is hashed again
+  // next time.
+  source_stamp s;
+  const bool stamped = cached && !asset_is_packed(filename) &&
+                       stat_file(filename, s.size, s.mtime);
+  if (stamped && known_hash(filename, s)) {
+    PROFILE_SCOPE("texture cache read");
+    try {
+      if (read_entry(entry_path(s.hash, opts), s, opts, t))
+        return t;
+    }
+    catch (const runtime_error &) {
+      // a damaged entry is rebuilt below
+    }
+    t = texture_file();
+  }
+
+  const asset_data file = load_asset(filename);
+  if (is_compressed_image(file.data, file.size)) {
+    t.blocks = parse_compressed_image(file.data, file.size, filename);
+    return t;
+  }
+  if (cached) {
+    // the same contents may be cached under another name or stamp
+    s.hash = content_hash(file.data, file.size);
+    if (stamped && s.size == file.size)
+      record_stamp(filename, s);
+    s.size = file.size;
+    try {
+      if (read_entry(entry_path(s.hash, opts), s, opts, t))
+        return t;
+    }
+    catch (const runtime_error &) {
+    }
+    t = texture_file();
+  }
+
+  t.image = decode_rgba_image(file.data, file.size, filename);
+  t.mips = build_mips(t.image, opts, jobs);
+  if (cached)
+    write_entry(entry_path(s.hash, opts), s, opts, t);
+  return t;
+}
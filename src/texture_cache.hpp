@@ -0,0 +1,37 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include "compressed_texture.hpp"
+#include "mipmap.hpp"
+#include "texture.hpp"
+
+class job_system;
+
+// A texture file as it is uploaded: the blocks of DDS and KTX2 files,
+// the decoded image and its mips for anything else.
+struct texture_file {
+  compressed_image blocks;  // no levels unless DDS or KTX2
+  rgba_image image;
+  std::vector<rgba_image> mips;
+};
+
+// Decoded images and their mips are kept on disk in dir, named by the
+// content hash of the source file and the mip options. An index maps
+// each loose file to its hash, trusted while the file's size and mtime
+// are unchanged, so warm starts read neither the source nor the
+// decoder; packed files are hashed from the mapping. Set before other
+// threads load textures; an empty dir turns the cache off.
+void set_texture_cache(const std::string &dir);
+
+// through the cache when it is on; mips are built with jobs on a miss
+texture_file load_texture_file(const std::string &filename,
+                               const mip_options &opts,
+                               job_system *jobs = nullptr);
+
+// 64-bit hash of file contents, 32 bytes a step
+uint64_t content_hash(const uint8_t *data, const size_t size);
+
+#endif
@@ -0,0 +1,85 @@
+// Offline texture compressor: encodes images into block compressed DDS
+// files that upload without decoding (renderer::load_texture).
+//
+//   src/texture_compress [--format bc1|bc3|bc5|bc7] [--no-mips]
+//                        [--filter box|kaiser] [--srgb] in.png out.dds
+//
+// The default format is bc7, bc1 suits opaque color, bc5 normal maps.
+// --srgb filters mips in linear light, right for color but not for
+// normal maps or masks.
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "compressed_texture.hpp"
+#include "job_system.hpp"
+#include "mipmap.hpp"
+
+using std::string;
+using std::cerr;
+using std::endl;
+using std::runtime_error;
+
+static block_format
+parse_format(const string &name) {
+  const block_format formats[] = {BLOCK_BC1, BLOCK_BC3, BLOCK_BC5, BLOCK_BC7};
+  for (const block_format f : formats)
+    if (name == block_format_name(f))
+      return f;
+  throw runtime_error("unknown format: " + name);
+}
+
+int
+main(int argc, const char **argv) {
+  try {
+    block_format format = BLOCK_BC7;
+    bool mips = true;
+    mip_options mip_opts;
+    string in_file, out_file;
+    for (int i = 1; i < argc; ++i) {
+      const string arg = argv[i];
+      const bool has_value = (i + 1 < argc);
+      if (arg == "--format" && has_value)
+        format = parse_format(argv[++i]);
+      else if (arg == "--no-mips")
+        mips = false;
+      else if (arg == "--filter" && has_value) {
+        const string filter = argv[++i];
+        if (filter != "box" && filter != "kaiser")
+          throw runtime_error("unknown filter: " + filter);
+        mip_opts.filter = (filter == "kaiser") ? MIP_KAISER : MIP_BOX;
+      }
+      else if (arg == "--srgb")
+        mip_opts.srgb = true;
+      else if (arg.compare(0, 2, "--") == 0)
+        throw runtime_error("unknown argument: " + arg);
+      else if (in_file.empty())
+        in_file = arg;
+      else if (out_file.empty())
+        out_file = arg;
+      else throw runtime_error("unexpected argument: " + arg);
+    }
+    if (in_file.empty() || out_file.empty())
+      throw runtime_error("usage: texture_compress [options] in.png out.dds");
+
+    job_system jobs;
+    const rgba_image img = load_rgba_image(in_file);
+    const compressed_image out =
+      compress_image(img, mips ? build_mips(img, mip_opts, &jobs)
+                               : std::vector<rgba_image>(), format, &jobs);
+    write_dds(out_file, out);
+
+    size_t bytes = 0;
+    for (const auto &level : out.levels)
+      bytes += level.size();
+    cerr << in_file << ": " << img.w << "x" << img.h << " "
+         << block_format_name(format) << ", " << out.levels.size()
+         << " level(s), " << bytes << " bytes" << endl;
+  }
+  catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
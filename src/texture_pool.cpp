@@ -0,0 +1,298 @@
+#include "texture_pool.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "mipmap.hpp"
+
+using std::runtime_error;
+
+static const size_t INITIAL_POOL_BYTES = 16 << 20;  // level 0 of new arrays
+static const uint32_t INITIAL_MAX_LAYERS = 16;
+
+static int
+mip_levels(const int w, const int h) {
+  int levels = 1;
+  while ((std::max(w, h) >> levels) > 0)
+    ++levels;
+  return levels;
+}
+
+static int
+level_width(const texture_array &a, const int level) {
+  return std::max(a.width >> level, 1);
+}
+
+static int
+level_height(const texture_array &a, const int level) {
+  return std::max(a.height >> level, 1);
+}
+
+// uncompressed arrays are RGBA8 or single channel R8
+static GLenum
+pixel_format(const GLenum format) {
+  return (format == GL_R8) ? GL_RED : GL_RGBA;
+}
+
+// bytes of one layer of a level
+static size_t
+level_bytes(const texture_array &a, const int level) {
+  if (a.block_bytes == 0)
+    return (a.format == GL_R8 ? 1 : 4)*
+           static_cast<size_t>(level_width(a, level))*level_height(a, level);
+  return a.block_bytes*((level_width(a, level) + 3)/4)*
+         static_cast<size_t>((level_height(a, level) + 3)/4);
+}
+
+// small textures start with a few layers, big ones with one
+static uint32_t
+initial_capacity(const texture_array &a, const GLint max_layers) {
+  const uint32_t capacity = static_cast<uint32_t>(std::max<size_t>(1,
+    std::min<size_t>(INITIAL_POOL_BYTES/level_bytes(a, 0), INITIAL_MAX_LAYERS)));
+  return std::min(capacity, static_cast<uint32_t>(max_layers));
+}
+
+uint32_t
+texture_pools::pool_for(const int w, const int h, const GLenum format,
+                        const int levels, const size_t block_bytes) {
+  if (max_layers == 0)
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+
+  for (size_t i = 0; i < arrays.size(); ++i) {
+    const texture_array &a = arrays[i];
+    if (a.width == w && a.height == h && a.format == format &&
+        a.levels == levels &&
+        (a.layers < a.capacity || !a.free_layers.empty() ||
+         a.capacity < static_cast<uint32_t>(max_layers)))
+      return static_cast<uint32_t>(i);
+  }
+
+  texture_array a;
+  a.texture = 0;
+  a.width = w;
+  a.height = h;
+  a.levels = levels;
+  a.format = format;
+  a.block_bytes = block_bytes;
+  a.layers = 0;
+  a.capacity = 0;
+  arrays.push_back(a);
+  return static_cast<uint32_t>(arrays.size() - 1);
+}
+
+uint32_t
+texture_pools::take_layer(texture_array &a) {
+  if (!a.free_layers.empty()) {
+    const uint32_t layer = a.free_layers.back();
+    a.free_layers.pop_back();
+    return layer;
+  }
+  if (a.capacity == 0)
+    allocate(a, initial_capacity(a, max_layers));
+  else if (a.layers == a.capacity)
+    grow(a);
+  return a.layers++;
+}
+
+void
+texture_pools::allocate(texture_array &a, const uint32_t capacity) {
+  glGenTextures(1, &a.texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, a.texture);
+  for (int level = 0; level < a.levels; ++level) {
+    if (a.block_bytes)
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, a.format,
+                             level_width(a, level), level_height(a, level),
+                             capacity, 0, level_bytes(a, level)*capacity, NULL);
+    else glTexImage3D(GL_TEXTURE_2D_ARRAY, level, a.format,
+                      level_width(a, level), level_height(a, level),
+                      capacity, 0, pixel_format(a.format), GL_UNSIGNED_BYTE, NULL);
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, a.levels - 1);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  a.capacity = capacity;
+}
+
+void
+texture_pools::grow(texture_array &a) {
+  texture_array bigger = a;
+  allocate(bigger, std::min(2*a.capacity, static_cast<uint32_t>(max_layers)));
+
+  // every level of the layers handed out
+  for (int level = 0; level < a.levels; ++level)
+    copy_layers(a, level, 0, bigger, level, 0, a.layers);
+
+  glDeleteTextures(1, &a.texture);
+  a = bigger;
+}
+
+// count layers of one level into another array's level of the same
+// size, on the GPU
+void
+texture_pools::copy_layers(const texture_array &src, const int src_level,
+                           const uint32_t src_layer, const texture_array &dst,
+                           const int dst_level, const uint32_t dst_layer,
+                           const uint32_t count) {
+  const int w = level_width(dst, dst_level), h = level_height(dst, dst_level);
+  if (GLAD_GL_VERSION_4_3 && glCopyImageSubData != NULL) {
+    glCopyImageSubData(src.texture, GL_TEXTURE_2D_ARRAY, src_level, 0, 0, src_layer,
+                       dst.texture, GL_TEXTURE_2D_ARRAY, dst_level, 0, 0, dst_layer,
+                       w, h, count);
+  }
+  else if (src.block_bytes) {
+    // compressed textures cannot be framebuffer attachments, so the
+    // blocks take a trip through memory
+    const size_t layer_bytes = level_bytes(src, src_level);
+    std::vector<uint8_t> blocks(layer_bytes*src.capacity);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, src.texture);
+    glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, src_level, blocks.data());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, dst.texture);
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, dst_level, 0, 0, dst_layer,
+                              w, h, count, dst.format, layer_bytes*count,
+                              blocks.data() + layer_bytes*src_layer);
+  }
+  else {
+    if (copy_fbo == 0)
+      glGenFramebuffers(1, &copy_fbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_fbo);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, dst.texture);
+    for (uint32_t i = 0; i < count; ++i) {
+      glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                src.texture, src_level, src_layer + i);
+      glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, dst_level, 0, 0, dst_layer + i,
+                          0, 0, w, h);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  }
+}
+
+texture_ref
+texture_pools::add(const rgba_image &img) {
+  return add(img, build_mips(img));
+}
+
+texture_ref
+texture_pools::add(const rgba_image &img, const std::vector<rgba_image> &mips) {
+  if (img.w <= 0 || img.h <= 0)
+    throw runtime_error("cannot pool an empty image");
+  if (mips.size() + 1 > static_cast<size_t>(mip_levels(img.w, img.h)))
+    throw runtime_error("too many mip levels");
+
+  texture_ref ref;
+  ref.pool = pool_for(img.w, img.h, GL_RGBA8, static_cast<int>(mips.size()) + 1, 0);
+  texture_array &a = arrays[ref.pool];
+  ref.layer = take_layer(a);
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, a.texture);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, ref.layer, img.w, img.h, 1,
+                  GL_RGBA, GL_UNSIGNED_BYTE, img.pixels.data());
+  for (int level = 1; level < a.levels; ++level) {
+    const rgba_image &mip = mips[level - 1];
+    if (mip.w != level_width(a, level) || mip.h != level_height(a, level))
+      throw runtime_error("mip level " + std::to_string(level) + " has the wrong size");
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, ref.layer, mip.w, mip.h,
+                    1, GL_RGBA, GL_UNSIGNED_BYTE, mip.pixels.data());
+  }
+  return ref;
+}
+
+texture_ref
+texture_pools::add(const compressed_image &img) {
+  if (img.levels.empty())
+    throw runtime_error("cannot pool an empty image");
+
+  texture_ref ref;
+  ref.pool = pool_for(img.w, img.h, block_gl_format(img.format),
+                      static_cast<int>(img.levels.size()), block_bytes(img.format));
+  texture_array &a = arrays[ref.pool];
+  ref.layer = take_layer(a);
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, a.texture);
+  for (int level = 0; level < a.levels; ++level)
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, ref.layer,
+                              level_width(a, level), level_height(a, level), 1,
+                              a.format, img.levels[level].size(),
+                              img.levels[level].data());
+  return ref;
+}
+
+texture_ref
+texture_pools::add_blank(const int w, const int h, const GLenum format) {
+  if (w <= 0 || h <= 0)
+    throw runtime_error("cannot pool an empty image");
+  if (format != GL_RGBA8 && format != GL_R8)
+    throw runtime_error("blank textures are RGBA8 or R8");
+  texture_ref ref;
+  ref.pool = pool_for(w, h, format, 1, 0);
+  ref.layer = take_layer(arrays[ref.pool]);
+  return ref;
+}
+
+void
+texture_pools::update(const texture_ref &ref, const int x, const int y,
+                      const int w, const int h, const uint8_t *pixels) {
+  const texture_array &a = arrays[ref.pool];
+  if (a.block_bytes != 0 || x < 0 || y < 0 || x + w > a.width || y + h > a.height)
+    throw runtime_error("bad texture update");
+  // R8 rows are not padded to 4 bytes
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, a.texture);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, ref.layer, w, h, 1,
+                  pixel_format(a.format), GL_UNSIGNED_BYTE, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+texture_ref
+texture_pools::add_levels(const texture_ref &src, const int first) {
+  // a copy, pool_for may reallocate the arrays
+  const texture_array from = arrays[src.pool];
+  if (first <= 0 || first >= from.levels)
+    throw runtime_error("no mip level " + std::to_string(first) + " to keep");
+
+  texture_ref ref;
+  ref.pool = pool_for(level_width(from, first), level_height(from, first),
+                      from.format, from.levels - first, from.block_bytes);
+  texture_array &a = arrays[ref.pool];
+  ref.layer = take_layer(a);
+  for (int level = 0; level < a.levels; ++level)
+    copy_layers(from, first + level, src.layer, a, level, ref.layer, 1);
+  return ref;
+}
+
+void
+texture_pools::release(const texture_ref &ref) {
+  texture_array &a = arrays[ref.pool];
+  a.free_layers.push_back(ref.layer);
+  if (a.free_layers.size() < a.layers)
+    return;
+
+  // nothing left in the array, its index stays for the next add
+  glDeleteTextures(1, &a.texture);
+  a.texture = 0;
+  a.layers = 0;
+  a.capacity = 0;
+  a.free_layers.clear();
+}
+
+size_t
+texture_pools::allocated_bytes() const {
+  size_t bytes = 0;
+  for (const texture_array &a : arrays)
+    for (int level = 0; level < a.levels; ++level)
+      bytes += level_bytes(a, level)*a.capacity;
+  return bytes;
+}
+
+void
+texture_pools::destroy() {
+  for (texture_array &a : arrays)
+    glDeleteTextures(1, &a.texture);
+  arrays.clear();
+  if (copy_fbo != 0)
+    glDeleteFramebuffers(1, &copy_fbo);
+  copy_fbo = 0;
+}
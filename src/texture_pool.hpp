@@ -0,0 +1,85 @@
+#ifndef TEXTURE_POOL_HPP
+#define TEXTURE_POOL_HPP
+
+#include "glad.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "compressed_texture.hpp"
+#include "texture.hpp"
+
+// a texture living in a pool: which array and which layer of it
+struct texture_ref {
+  uint32_t pool;
+  uint32_t layer;
+
+  texture_ref() : pool(0), layer(0) {}
+};
+
+// One GL_TEXTURE_2D_ARRAY of same sized, same format textures with the
+// same number of mip levels. Grows by doubling; layers keep their index when it does.
+// Released layers are reused, and the storage is freed once all are.
+struct texture_array {
+  GLuint texture;     // 0 while no layer is in use
+  int width;
+  int height;
+  int levels;
+  GLenum format;
+  size_t block_bytes; // 0 when not block compressed
+  uint32_t layers;    // handed out, released ones included
+  uint32_t capacity;  // allocated
+  std::vector<uint32_t> free_layers;
+};
+
+// Texture arrays grouped by size and format, so that any number of
+// textures of one group can be sampled without rebinding, picking the
+// layer per draw. Must be used on the GL thread.
+class texture_pools {
+public:
+  texture_pools() : copy_fbo(0), max_layers(0) {}
+
+  // uploads an RGBA8 image with its mips, box filtered here if not given
+  texture_ref add(const rgba_image &img);
+  texture_ref add(const rgba_image &img, const std::vector<rgba_image> &mips);
+  // uploads the blocks and mips as they are; the context must support
+  // the format
+  texture_ref add(const compressed_image &img);
+  // one level of undefined contents, filled in with update(); format
+  // GL_RGBA8 or GL_R8
+  texture_ref add_blank(const int w, const int h, const GLenum format);
+  // level 0 pixels of a rectangle of an uncompressed texture, rows
+  // packed, bottom row first
+  void update(const texture_ref &ref, const int x, const int y,
+              const int w, const int h, const uint8_t *pixels);
+  // copies levels first and down of a pooled texture, on the GPU, into
+  // the pool of that size: the texture without its finest levels
+  texture_ref add_levels(const texture_ref &src, const int first);
+  // the layer goes back to its pool; the ref must not be used again
+  void release(const texture_ref &ref);
+
+  GLuint texture(const uint32_t pool) const { return arrays[pool].texture; }
+  const texture_array &array(const uint32_t pool) const { return arrays[pool]; }
+  size_t size() const { return arrays.size(); }
+  // storage of all arrays, unused layers included
+  size_t allocated_bytes() const;
+
+  void destroy();
+
+private:
+  std::vector<texture_array> arrays;
+  GLuint copy_fbo;     // for growing without glCopyImageSubData
+  GLint max_layers;
+
+  uint32_t pool_for(const int w, const int h, const GLenum format,
+                    const int levels, const size_t block_bytes);
+  uint32_t take_layer(texture_array &a);
+  void allocate(texture_array &a, const uint32_t capacity);
+  void grow(texture_array &a);
+  void copy_layers(const texture_array &src, const int src_level,
+                   const uint32_t src_layer, const texture_array &dst,
+                   const int dst_level, const uint32_t dst_layer,
+                   const uint32_t count);
+};
+
+#endif
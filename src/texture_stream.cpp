@@ -0,0 +1,317 @@
+#include "texture_stream.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#include "job_system.hpp"
+#include "profiler.hpp"
+#include "texture_cache.hpp"
+
+using std::vector;
+using std::string;
+using std::cerr;
+using std::endl;
+using std::lock_guard;
+using std::unique_lock;
+using std::mutex;
+
+static const uint32_t NO_TEXTURE = ~0u;
+
+// first level no larger than tail_size, or the last one there is
+static int
+tail_level(const int w, const int h, const int levels, const int tail_size) {
+  int level = 0;
+  while (level + 1 < levels && std::max(w >> level, h >> level) > tail_size)
+    ++level;
+  return level;
+}
+
+void
+texture_streamer::init(texture_pools *p, const texture_stream_options &o,
+                       const mip_options &mips, job_system *j,
+                       const uint32_t formats) {
+  pools = p;
+  opts = o;
+  mip_opts = mips;
+  jobs = j;
+  gpu_formats = formats;
+}
+
+/****************** loading *******************/
+// top < 0 loads the tail
+level_chain
+texture_streamer::load(const string &filename, const int top,
+                       job_system *workers) const {
+  level_chain c;
+  texture_file file = load_texture_file(filename, mip_opts, workers);
+  if (!file.blocks.levels.empty()) {
+    compressed_image &img = file.blocks;
+    c.width = img.w;
+    c.height = img.h;
+    c.levels = static_cast<int>(img.levels.size());
+    c.top = (top < 0) ? tail_level(c.width, c.height, c.levels, opts.tail_size)
+                      : std::min(top, c.levels - 1);
+    if (gpu_formats & (1u << img.format)) {
+      c.blocks.format = img.format;
+      c.blocks.w = img.level_width(c.top);
+      c.blocks.h = img.level_height(c.top);
+      c.blocks.levels.assign(std::make_move_iterator(img.levels.begin() + c.top),
+                             std::make_move_iterator(img.levels.end()));
+    }
+    else {
+      c.image = decompress_level(img, c.top);
+      for (int level = c.top + 1; level < c.levels; ++level)
+        c.mips.push_back(decompress_level(img, level));
+    }
+    return c;
+  }
+
+  rgba_image &img = file.image;
+  vector<rgba_image> &mips = file.mips;
+  c.width = img.w;
+  c.height = img.h;
+  c.levels = static_cast<int>(mips.size()) + 1;
+  c.top = (top < 0) ? tail_level(c.width, c.height, c.levels, opts.tail_size)
+                    : std::min(top, c.levels - 1);
+  if (c.top == 0) {
+    c.image = std::move(img);
+    c.mips = std::move(mips);
+  }
+  else {
+    c.image = std::move(mips[c.top - 1]);
+    c.mips.assign(std::make_move_iterator(mips.begin() + c.top),
+                  std::make_move_iterator(mips.end()));
+  }
+  return c;
+}
+
+void
+texture_streamer::start_load(const uint32_t id, const int top) {
+  streamed_texture &t = textures[id];
+  t.loading = true;
+  ++loads;
+  {
+    lock_guard<mutex> lk(mtx);
+    ++in_flight;
+  }
+
+  const string filename = t.filename;
+  auto task = [this, id, top, filename]() {
+    level_chain c;
+    try {
+      PROFILE_SCOPE("texture stream load");
+      c = load(filename, top, jobs);
+    }
+    catch (const std::exception &e) {
+      c.error = e.what();
+    }
+    c.id = id;
+    lock_guard<mutex> lk(mtx);
+    loaded.push_back(std::move(c));
+    --in_flight;
+    cv.notify_all();
+  };
+  if (jobs != nullptr)
+    jobs->submit(task);
+  else task();
+}
+
+texture_ref
+texture_streamer::upload(const level_chain &c, const int top) {
+  const size_t skip = top - c.top;
+  if (!c.blocks.levels.empty()) {
+    if (skip == 0)
+      return pools->add(c.blocks);
+    compressed_image sub;
+    sub.format = c.blocks.format;
+    sub.w = c.blocks.level_width(skip);
+    sub.h = c.blocks.level_height(skip);
+    sub.levels.assign(c.blocks.levels.begin() + skip, c.blocks.levels.end());
+    return pools->add(sub);
+  }
+  if (skip == 0)
+    return pools->add(c.image, c.mips);
+  return pools->add(c.mips[skip - 1],
+                    vector<rgba_image>(c.mips.begin() + skip, c.mips.end()));
+}
+
+uint32_t
+texture_streamer::add(const string &filename) {
+  const level_chain c = load(filename, -1, jobs);
+  streamed_texture t;
+  t.filename = filename;
+  t.width = c.width;
+  t.height = c.height;
+  t.levels = c.levels;
+  t.format = c.blocks.format;
+  t.blocks = !c.blocks.levels.empty();
+  t.tail = t.top = t.wanted = c.top;
+  t.last_used = 0;
+  t.loading = false;
+  t.failed = false;
+  t.ref = upload(c, c.top);
+  resident += chain_bytes(t, t.top);
+  textures.push_back(t);
+  return static_cast<uint32_t>(textures.size() - 1);
+}
+
+/****************** budget *******************/
+size_t
+texture_streamer::chain_bytes(const streamed_texture &t, const int top) const {
+  size_t bytes = 0;
+  for (int level = top; level < t.levels; ++level) {
+    const int w = std::max(t.width >> level, 1), h = std::max(t.height >> level, 1);
+    bytes += t.blocks ? compressed_size(t.format, w, h)
+                      : 4*static_cast<size_t>(w)*h;
+  }
+  return bytes;
+}
+
+// what eviction may take the texture down to: its tail when it was not
+// drawn this frame, else the level it was drawn at
+int
+texture_streamer::evictable_until(const streamed_texture &t) const {
+  return (t.last_used < frame) ? t.tail : std::max(t.top, t.wanted);
+}
+
+size_t
+texture_streamer::evictable_bytes(const uint32_t keep) const {
+  size_t bytes = 0;
+  for (uint32_t i = 0; i < textures.size(); ++i)
+    if (i != keep) {
+      const streamed_texture &t = textures[i];
+      bytes += chain_bytes(t, t.top) - chain_bytes(t, evictable_until(t));
+    }
+  return bytes;
+}
+
+// finest level from top up that fits once the others are evicted, the
+// resident level when none does
+int
+texture_streamer::fitting_level(const uint32_t id, int top) const {
+  const streamed_texture &t = textures[id];
+  const size_t limit = opts.budget_bytes + evictable_bytes(id);
+  const size_t current = chain_bytes(t, t.top);
+  for (; top < t.top; ++top)
+    if (resident + chain_bytes(t, top) - current <= limit)
+      break;
+  return top;
+}
+
+void
+texture_streamer::demote(const uint32_t id, vector<uint32_t> &moved) {
+  streamed_texture &t = textures[id];
+  const texture_ref ref = pools->add_levels(t.ref, 1);
+  pools->release(t.ref);
+  resident -= chain_bytes(t, t.top) - chain_bytes(t, t.top + 1);
+  t.ref = ref;
+  ++t.top;
+  moved.push_back(id);
+}
+
+// evicts the finest level of the least recently drawn texture until
+// bytes more fit
+bool
+texture_streamer::make_room(const size_t bytes, const uint32_t keep,
+                            vector<uint32_t> &moved) {
+  while (resident + bytes > opts.budget_bytes) {
+    uint32_t victim = NO_TEXTURE;
+    for (uint32_t i = 0; i < textures.size(); ++i) {
+      const streamed_texture &t = textures[i];
+      if (i != keep && t.top < evictable_until(t) &&
+          (victim == NO_TEXTURE || t.last_used < textures[victim].last_used))
+        victim = i;
+    }
+    if (victim == NO_TEXTURE)
+      return false;
+    demote(victim, moved);
+  }
+  return true;
+}
+
+/****************** requests *******************/
+void
+texture_streamer::request(const uint32_t id, const float pixels_per_uv) {
+  streamed_texture &t = textures[id];
+  t.last_used = frame;
+  // a level per halving of the texels that land on each pixel
+  const float texels = static_cast<float>(std::max(t.width, t.height));
+  const int level = (pixels_per_uv >= texels) ? 0 :
+    static_cast<int>(std::log2(texels/std::max(pixels_per_uv, 1e-3f)));
+  t.wanted = std::min(t.wanted, level);
+}
+
+void
+texture_streamer::update(vector<uint32_t> &moved) {
+  PROFILE_SCOPE("texture streaming");
+  {
+    lock_guard<mutex> lk(mtx);
+    std::move(loaded.begin(), loaded.end(), std::back_inserter(ready));
+    loaded.clear();
+  }
+
+  // finished loads, in the order they finished, until the upload budget
+  // of the frame is spent
+  size_t uploaded = 0, done = 0;
+  for (; done < ready.size() && (uploaded == 0 || uploaded < opts.upload_bytes); ++done) {
+    const level_chain &c = ready[done];
+    streamed_texture &t = textures[c.id];
+    t.loading = false;
+    --loads;
+    if (!c.error.empty()) {
+      cerr << "texture streaming: " << t.filename << ": " << c.error << endl;
+      t.failed = true;
+      continue;
+    }
+
+    // less than asked for if others were drawn since
+    const int top = fitting_level(c.id, c.top);
+    if (top >= t.top)
+      continue;
+    const size_t bytes = chain_bytes(t, top) - chain_bytes(t, t.top);
+    make_room(bytes, c.id, moved);
+    const texture_ref ref = upload(c, top);
+    pools->release(t.ref);
+    t.ref = ref;
+    t.top = top;
+    resident += bytes;
+    uploaded += bytes;
+    moved.push_back(c.id);
+  }
+  ready.erase(ready.begin(), ready.begin() + done);
+
+  // new loads, textures furthest from what they were drawn at first
+  vector<uint32_t> wanting;
+  for (uint32_t i = 0; i < textures.size(); ++i) {
+    const streamed_texture &t = textures[i];
+    if (!t.loading && !t.failed && t.wanted < t.top)
+      wanting.push_back(i);
+  }
+  std::sort(wanting.begin(), wanting.end(), [this](uint32_t a, uint32_t b) {
+    return textures[a].top - textures[a].wanted > textures[b].top - textures[b].wanted;
+  });
+  for (size_t i = 0; i < wanting.size() && loads < opts.max_loads; ++i) {
+    const streamed_texture &t = textures[wanting[i]];
+    const int top = fitting_level(wanting[i], t.wanted);
+    if (top < t.top)
+      start_load(wanting[i], top);
+  }
+
+  for (streamed_texture &t : textures)
+    t.wanted = t.tail;
+  ++frame;
+}
+
+void
+texture_streamer::destroy() {
+  unique_lock<mutex> lk(mtx);
+  cv.wait(lk, [this]() { return in_flight == 0; });
+  loaded.clear();
+  ready.clear();
+  textures.clear();
+  resident = 0;
+  loads = 0;
+}
@@ -0,0 +1,128 @@
+#ifndef TEXTURE_STREAM_HPP
+#define TEXTURE_STREAM_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "compressed_texture.hpp"
+#include "mipmap.hpp"
+#include "texture.hpp"
+#include "texture_pool.hpp"
+
+class job_system;
+
+struct texture_stream_options {
+  size_t budget_bytes;  // resident levels of all streamed textures
+  int tail_size;        // levels this size and smaller are always resident
+  size_t upload_bytes;  // per update, at least one texture goes up
+  uint32_t max_loads;   // files read and decoded at the same time
+
+  texture_stream_options() : budget_bytes(256 << 20), tail_size(64),
+                             upload_bytes(32 << 20), max_loads(2) {}
+};
+
+// levels of a file from top down, as they are uploaded: blocks when the
+// context takes the format, RGBA8 otherwise
+struct level_chain {
+  uint32_t id;
+  int width;   // of level 0
+  int height;
+  int levels;
+  int top;
+  compressed_image blocks;
+  rgba_image image;
+  std::vector<rgba_image> mips;
+  std::string error;
+
+  level_chain() : id(0), width(0), height(0), levels(0), top(0) {}
+};
+
+// a file whose finest levels come and go
+struct streamed_texture {
+  std::string filename;
+  int width;           // of level 0
+  int height;
+  int levels;          // in the file, or the full chain for images
+  block_format format;
+  bool blocks;         // uploaded as blocks of format, else RGBA8
+  int tail;            // first level that is never evicted
+  int top;             // first resident level
+  int wanted;          // finest level drawn since the last update
+  uint64_t last_used;  // update count when last drawn
+  bool loading;
+  bool failed;         // a load threw, no more are tried
+  texture_ref ref;
+};
+
+// Texture streaming: a texture starts with its tail (the levels up to
+// tail_size) and its finer levels are loaded on the workers when the
+// renderer reports it drawn big enough to need them. When that would
+// pass the budget, the least recently drawn textures lose their finest
+// levels first. A texture moves to the pool of its resident size, so
+// refs change; update() reports which. Must be used on the GL thread.
+class texture_streamer {
+public:
+  texture_streamer() : pools(nullptr), jobs(nullptr), gpu_formats(0),
+                       frame(1), resident(0), loads(0), in_flight(0) {}
+
+  // gpu_formats has bit (1 << f) set for every block_format the
+  // context samples; the others are decoded
+  void init(texture_pools *pools, const texture_stream_options &opts,
+            const mip_options &mips, job_system *jobs,
+            const uint32_t gpu_formats);
+
+  // reads the file and uploads its tail
+  uint32_t add(const std::string &filename);
+
+  // the texture was drawn at pixels_per_uv screen pixels across its
+  // whole width (or height, the larger)
+  void request(const uint32_t id, const float pixels_per_uv);
+
+  // uploads finished loads, evicting what the budget needs, and starts
+  // the loads of this frame's requests; ids whose ref changed are
+  // appended to moved
+  void update(std::vector<uint32_t> &moved);
+
+  const texture_ref &ref(const uint32_t id) const { return textures[id].ref; }
+  const streamed_texture &texture(const uint32_t id) const { return textures[id]; }
+  size_t size() const { return textures.size(); }
+  size_t resident_bytes() const { return resident; }
+
+  // waits for the loads in flight; the pools are destroyed separately
+  void destroy();
+
+private:
+  texture_pools *pools;
+  job_system *jobs;
+  texture_stream_options opts;
+  mip_options mip_opts;
+  uint32_t gpu_formats;
+  std::vector<streamed_texture> textures;
+  uint64_t frame;
+  size_t resident;
+  uint32_t loads;  // textures loading, ready ones included
+
+  // filled by the workers
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<level_chain> loaded;
+  uint32_t in_flight;
+  std::vector<level_chain> ready;  // loaded, waiting for upload budget
+
+  level_chain load(const std::string &filename, const int top,
+                   job_system *workers) const;
+  void start_load(const uint32_t id, const int top);
+  size_t chain_bytes(const streamed_texture &t, const int top) const;
+  int evictable_until(const streamed_texture &t) const;
+  size_t evictable_bytes(const uint32_t keep) const;
+  int fitting_level(const uint32_t id, int top) const;
+  bool make_room(const size_t bytes, const uint32_t keep,
+                 std::vector<uint32_t> &moved);
+  void demote(const uint32_t id, std::vector<uint32_t> &moved);
+  texture_ref upload(const level_chain &c, const int top);
+};
+
+#endif
@@ -0,0 +1,277 @@
+#include "trace_export.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::ofstream;
+using std::runtime_error;
+
+static const int TRACE_PID = 1;
+
+static bool
+ends_with(const string &s, const string &suffix) {
+  return s.size() >= suffix.size() &&
+    s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static string
+json_escape(const string &s) {
+  string out;
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    }
+    else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    }
+    else out += c;
+  }
+  return out;
+}
+
+// earliest timestamp, so the trace starts near zero
+static uint64_t
+capture_origin(const profile_capture &cap) {
+  uint64_t origin = UINT64_MAX;
+  for (const profile_event &e : cap.events)
+    origin = std::min(origin, e.begin_ns);
+  return (origin == UINT64_MAX) ? 0 : origin;
+}
+
+void
+write_chrome_trace(const string &filename, const profile_capture &cap) {
+  ofstream out(filename);
+  if (!out.good())
+    throw runtime_error("cannot open trace file " + filename);
+
+  const uint64_t origin = capture_origin(cap);
+  char buf[128];
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << TRACE_PID
+      << ",\"args\":{\"name\":\"game\"}}";
+
+  for (size_t t = 0; t < cap.tracks.size(); ++t)
+    out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << TRACE_PID
+        << ",\"tid\":" << t << ",\"args\":{\"name\":\""
+        << json_escape(cap.tracks[t]) << "\"}}";
+
+  for (const profile_event &e : cap.events) {
+    const string name = json_escape(e.name);
+    // microseconds with nanosecond precision
+    snprintf(buf, sizeof(buf), "%.3f", (e.begin_ns - origin)*1e-3);
+    if (e.kind == PROFILE_COUNTER_EVENT) {
+      out << ",\n{\"name\":\"" << name << "\",\"ph\":\"C\",\"ts\":" << buf
+          << ",\"pid\":" << TRACE_PID << ",\"tid\":" << e.thread
+          << ",\"args\":{\"value\":" << e.value << "}}";
+      continue;
+    }
+    out << ",\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"ts\":" << buf;
+    snprintf(buf, sizeof(buf), "%.3f", (e.end_ns - e.begin_ns)*1e-3);
+    out << ",\"dur\":" << buf << ",\"pid\":" << TRACE_PID
+        << ",\"tid\":" << e.thread
+        << ",\"args\":{\"frame\":" << e.frame << "}}";
+  }
+  out << "\n]}\n";
+  if (!out.good())
+    throw runtime_error("failed writing trace file " + filename);
+}
+
+/*************** minimal protobuf writer for perfetto ***************/
+
+// field numbers from perfetto's protos/perfetto/trace/*.proto
+enum perfetto_field {
+  TRACE_PACKET = 1,                  // Trace
+  PACKET_TIMESTAMP = 8,              // TracePacket
+  PACKET_SEQUENCE_ID = 10,
+  PACKET_TRACK_EVENT = 11,
+  PACKET_SEQUENCE_FLAGS = 13,
+  PACKET_TRACK_DESCRIPTOR = 60,
+  TRACK_UUID = 1,                    // TrackDescriptor
+  TRACK_NAME = 2,
+  TRACK_PROCESS = 3,
+  TRACK_THREAD = 4,
+  TRACK_PARENT_UUID = 5,
+  TRACK_COUNTER = 8,
+  PROCESS_PID = 1,                   // ProcessDescriptor
+  PROCESS_NAME = 6,
+  THREAD_PID = 1,                    // ThreadDescriptor
+  THREAD_TID = 2,
+  THREAD_NAME = 5,
+  EVENT_TYPE = 9,                    // TrackEvent
+  EVENT_TRACK_UUID = 11,
+  EVENT_NAME = 23,
+  EVENT_COUNTER_VALUE = 30
+};
+
+enum track_event_type {
+  TYPE_SLICE_BEGIN = 1,
+  TYPE_SLICE_END = 2,
+  TYPE_COUNTER = 4
+};
+
+static const uint32_t SEQ_INCREMENTAL_STATE_CLEARED = 1;
+static const uint32_t SEQUENCE_ID = 1;
+static const uint64_t PROCESS_UUID = 1;
+
+struct proto_writer {
+  string bytes;
+
+  void varint(uint64_t v) {
+    while (v >= 0x80) {
+      bytes += static_cast<char>((v & 0x7f) | 0x80);
+      v >>= 7;
+    }
+    bytes += static_cast<char>(v);
+  }
+  void tag(const uint32_t field, const uint32_t wire_type) {
+    varint((static_cast<uint64_t>(field) << 3) | wire_type);
+  }
+  void uint(const uint32_t field, const uint64_t v) {
+    tag(field, 0);
+    varint(v);
+  }
+  void sint(const uint32_t field, const int64_t v) {
+    // int64 fields use plain two's complement varints
+    uint(field, static_cast<uint64_t>(v));
+  }
+  void bytes_field(const uint32_t field, const string &v) {
+    tag(field, 2);
+    varint(v.size());
+    bytes += v;
+  }
+  void message(const uint32_t field, const proto_writer &m) {
+    bytes_field(field, m.bytes);
+  }
+};
+
+static uint64_t
+thread_track_uuid(const uint32_t thread) {
+  return 0x1000 + thread;
+}
+
+static uint64_t
+counter_track_uuid(const uint32_t index) {
+  return 0x100000 + index;
+}
+
+struct timed_packet {
+  uint64_t ts;
+  int order;     // ends before begins at the same timestamp
+  string bytes;  // serialized TracePacket
+};
+
+void
+write_perfetto_trace(const string &filename, const profile_capture &cap) {
+  proto_writer trace;
+
+  // descriptors first: the process, one track per thread, one per counter
+  {
+    proto_writer proc, desc, packet;
+    proc.uint(PROCESS_PID, TRACE_PID);
+    proc.bytes_field(PROCESS_NAME, "game");
+    desc.uint(TRACK_UUID, PROCESS_UUID);
+    desc.message(TRACK_PROCESS, proc);
+    packet.uint(PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    packet.uint(PACKET_SEQUENCE_FLAGS, SEQ_INCREMENTAL_STATE_CLEARED);
+    packet.message(PACKET_TRACK_DESCRIPTOR, desc);
+    trace.message(TRACE_PACKET, packet);
+  }
+  for (size_t t = 0; t < cap.tracks.size(); ++t) {
+    proto_writer thread, desc, packet;
+    thread.uint(THREAD_PID, TRACE_PID);
+    thread.uint(THREAD_TID, t + 1);
+    thread.bytes_field(THREAD_NAME, cap.tracks[t]);
+    desc.uint(TRACK_UUID, thread_track_uuid(t));
+    desc.uint(TRACK_PARENT_UUID, PROCESS_UUID);
+    desc.message(TRACK_THREAD, thread);
+    packet.uint(PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    packet.message(PACKET_TRACK_DESCRIPTOR, desc);
+    trace.message(TRACE_PACKET, packet);
+  }
+
+  vector<string> counters;
+  for (const profile_event &e : cap.events) {
+    if (e.kind != PROFILE_COUNTER_EVENT ||
+        std::find(counters.begin(), counters.end(), e.name) != counters.end())
+      continue;
+    counters.push_back(e.name);
+    proto_writer counter, desc, packet;
+    desc.uint(TRACK_UUID, counter_track_uuid(counters.size() - 1));
+    desc.uint(TRACK_PARENT_UUID, PROCESS_UUID);
+    desc.bytes_field(TRACK_NAME, e.name);
+    desc.message(TRACK_COUNTER, counter);
+    packet.uint(PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    packet.message(PACKET_TRACK_DESCRIPTOR, desc);
+    trace.message(TRACE_PACKET, packet);
+  }
+
+  // events, as begin/end pairs sorted by time so slices nest properly
+  vector<timed_packet> timed;
+  const auto add_event = [&timed](const uint64_t ts, const int order,
+                                  const proto_writer &event) {
+    proto_writer packet;
+    packet.uint(PACKET_TIMESTAMP, ts);
+    packet.uint(PACKET_SEQUENCE_ID, SEQUENCE_ID);
+    packet.message(PACKET_TRACK_EVENT, event);
+    timed_packet tp;
+    tp.ts = ts;
+    tp.order = order;
+    tp.bytes = packet.bytes;
+    timed.push_back(tp);
+  };
+
+  for (const profile_event &e : cap.events) {
+    if (e.kind == PROFILE_COUNTER_EVENT) {
+      const size_t index = std::find(counters.begin(), counters.end(), e.name) -
+        counters.begin();
+      proto_writer event;
+      event.uint(EVENT_TYPE, TYPE_COUNTER);
+      event.uint(EVENT_TRACK_UUID, counter_track_uuid(index));
+      event.sint(EVENT_COUNTER_VALUE, e.value);
+      add_event(e.begin_ns, 1, event);
+      continue;
+    }
+    proto_writer begin, end;
+    begin.uint(EVENT_TYPE, TYPE_SLICE_BEGIN);
+    begin.uint(EVENT_TRACK_UUID, thread_track_uuid(e.thread));
+    begin.bytes_field(EVENT_NAME, e.name);
+    // deeper scopes begin later and end earlier at equal timestamps
+    add_event(e.begin_ns, 2 + static_cast<int>(e.depth), begin);
+    end.uint(EVENT_TYPE, TYPE_SLICE_END);
+    end.uint(EVENT_TRACK_UUID, thread_track_uuid(e.thread));
+    add_event(e.end_ns, -static_cast<int>(e.depth), end);
+  }
+  std::stable_sort(timed.begin(), timed.end(),
+                   [](const timed_packet &a, const timed_packet &b) {
+                     return (a.ts != b.ts) ? a.ts < b.ts : a.order < b.order;
+                   });
+  for (const timed_packet &tp : timed) {
+    trace.tag(TRACE_PACKET, 2);
+    trace.varint(tp.bytes.size());
+    trace.bytes += tp.bytes;
+  }
+
+  ofstream out(filename, std::ios::binary);
+  if (!out.good())
+    throw runtime_error("cannot open trace file " + filename);
+  out.write(trace.bytes.data(), trace.bytes.size());
+  if (!out.good())
+    throw runtime_error("failed writing trace file " + filename);
+}
+
+void
+write_trace(const string &filename, const profile_capture &cap) {
+  if (ends_with(filename, ".pftrace") || ends_with(filename, ".perfetto-trace"))
+    write_perfetto_trace(filename, cap);
+  else
+    write_chrome_trace(filename, cap);
+}
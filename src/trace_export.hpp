@@ -0,0 +1,21 @@
+#ifndef TRACE_EXPORT_HPP
+#define TRACE_EXPORT_HPP
+
+#include <string>
+
+#include "profiler.hpp"
+
+// Chrome Trace Event JSON, opens in chrome://tracing and ui.perfetto.dev
+void
+write_chrome_trace(const std::string &filename, const profile_capture &cap);
+
+// native Perfetto protobuf trace (TrackEvent), opens in ui.perfetto.dev
+void
+write_perfetto_trace(const std::string &filename, const profile_capture &cap);
+
+// picks the format from the extension: .pftrace or .perfetto-trace
+// for protobuf, JSON otherwise
+void
+write_trace(const std::string &filename, const profile_capture &cap);
+
+#endif
@@ -0,0 +1,528 @@
+#include "truetype.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+/****************** reading *******************/
+static uint16_t
+u16(const uint8_t *p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static int16_t
+s16(const uint8_t *p) {
+  return static_cast<int16_t>(u16(p));
+}
+
+static uint32_t
+u32(const uint8_t *p) {
+  return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// throws unless size bytes at offset are in the file
+static const uint8_t *
+at(const asset_data &file, const size_t offset, const size_t size,
+   const string &filename) {
+  if (offset > file.size || size > file.size - offset)
+    throw runtime_error("truncated font: " + filename);
+  return file.data + offset;
+}
+
+truetype_font::truetype_font(const string &fn)
+  : units_per_em(0), ascent(0), descent(0), line_gap(0), glyph_count(0),
+    filename(fn), file(load_asset(fn)), cmap(0), cmap_format(0), loca(0),
+    glyf(0), glyf_size(0), long_loca(false), hmtx(0), long_metrics(0),
+    kern_pairs(0), kern_count(0) {
+  const uint32_t version = u32(at(file, 0, 12, filename));
+  if (version == 0x4f54544fu)  // OTTO
+    throw runtime_error("CFF outlines are not supported: " + filename);
+  if (version != 0x00010000u && version != 0x74727565u)  // 1.0, true
+    throw runtime_error("not a TrueType font: " + filename);
+
+  // table directory
+  const uint16_t tables = u16(file.data + 4);
+  size_t head = 0, hhea = 0, maxp = 0, cmap_table = 0, kern = 0, kern_size = 0;
+  size_t hmtx_size = 0, loca_size = 0;
+  for (uint16_t i = 0; i < tables; ++i) {
+    const uint8_t *t = at(file, 12 + 16*i, 16, filename);
+    const uint32_t offset = u32(t + 8), size = u32(t + 12);
+    at(file, offset, size, filename);
+    if (memcmp(t, "head", 4) == 0 && size >= 54) head = offset;
+    else if (memcmp(t, "hhea", 4) == 0 && size >= 36) hhea = offset;
+    else if (memcmp(t, "maxp", 4) == 0 && size >= 6) maxp = offset;
+    else if (memcmp(t, "cmap", 4) == 0 && size >= 4) cmap_table = offset;
+    else if (memcmp(t, "hmtx", 4) == 0) { hmtx = offset; hmtx_size = size; }
+    else if (memcmp(t, "loca", 4) == 0) { loca = offset; loca_size = size; }
+    else if (memcmp(t, "glyf", 4) == 0) { glyf = offset; glyf_size = size; }
+    else if (memcmp(t, "kern", 4) == 0) { kern = offset; kern_size = size; }
+  }
+  if (!head || !hhea || !maxp || !cmap_table || !hmtx || !loca || !glyf)
+    throw runtime_error("font lacks a required table: " + filename);
+
+  units_per_em = u16(file.data + head + 18);
+  long_loca = s16(file.data + head + 50) != 0;
+  glyph_count = u16(file.data + maxp + 4);
+  ascent = s16(file.data + hhea + 4);
+  descent = s16(file.data + hhea + 6);
+  line_gap = s16(file.data + hhea + 8);
+  long_metrics = u16(file.data + hhea + 34);
+  if (units_per_em == 0 || long_metrics == 0 || glyph_count == 0 ||
+      4*static_cast<size_t>(long_metrics) > hmtx_size ||
+      (long_loca ? 4 : 2)*(static_cast<size_t>(glyph_count) + 1) > loca_size)
+    throw runtime_error("bad font header in " + filename);
+  if (long_metrics > glyph_count)
+    long_metrics = glyph_count;
+  if (4*long_metrics + 2*static_cast<size_t>(glyph_count - long_metrics) > hmtx_size)
+    throw runtime_error("bad hmtx table in " + filename);
+
+  // Unicode subtable, full repertoire (format 12) before BMP (format 4)
+  const uint16_t subtables = u16(file.data + cmap_table + 2);
+  int best = 0;
+  for (uint16_t i = 0; i < subtables; ++i) {
+    const uint8_t *rec = at(file, cmap_table + 4 + 8*i, 8, filename);
+    const uint16_t platform = u16(rec), encoding = u16(rec + 2);
+    const size_t offset = cmap_table + u32(rec + 4);
+    const uint16_t format = u16(at(file, offset, 2, filename));
+    const bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+    const int score = !unicode ? 0 : (format == 12) ? 2 : (format == 4) ? 1 : 0;
+    if (score > best) {
+      best = score;
+      cmap = offset;
+      cmap_format = format;
+    }
+  }
+  if (cmap_format == 4)
+    at(file, cmap, u16(at(file, cmap, 4, filename) + 2), filename);
+  else if (cmap_format == 12)
+    at(file, cmap, 16 + 12*static_cast<size_t>(u32(at(file, cmap, 16, filename) + 12)),
+       filename);
+
+  // first subtable of the old kern table, when it is horizontal format 0
+  if (kern && kern_size >= 18 && u16(file.data + kern) == 0 &&
+      u16(file.data + kern + 2) > 0) {
+    const uint16_t coverage = u16(file.data + kern + 8);
+    if ((coverage >> 8) == 0 && (coverage & 1)) {
+      // the subtable's length field overflows in big tables, so the
+      // pair count is bounded by the table instead
+      kern_pairs = kern + 18;
+      kern_count = std::min<uint32_t>(u16(file.data + kern + 10),
+                                      (kern_size - 18)/6);
+    }
+  }
+}
+
+uint32_t
+truetype_font::glyph_index(const uint32_t cp) const {
+  uint32_t glyph = 0;
+  if (cmap_format == 4 && cp <= 0xffff) {
+    const uint32_t segments = u16(file.data + cmap + 6)/2;
+    const size_t ends = cmap + 14, starts = ends + 2*segments + 2;
+    const size_t deltas = starts + 2*segments, ranges = deltas + 2*segments;
+    at(file, ranges, 2*segments, filename);
+    // first segment ending at or after cp
+    uint32_t lo = 0, hi = segments;
+    while (lo < hi) {
+      const uint32_t mid = (lo + hi)/2;
+      if (u16(file.data + ends + 2*mid) < cp)
+        lo = mid + 1;
+      else hi = mid;
+    }
+    if (lo == segments || u16(file.data + starts + 2*lo) > cp)
+      return 0;
+    const uint16_t delta = u16(file.data + deltas + 2*lo);
+    const uint16_t range = u16(file.data + ranges + 2*lo);
+    if (range == 0)
+      glyph = (cp + delta) & 0xffff;
+    else {
+      const size_t where = ranges + 2*lo + range +
+                           2*(cp - u16(file.data + starts + 2*lo));
+      if (where + 2 > file.size)
+        return 0;
+      glyph = u16(file.data + where);
+      if (glyph != 0)
+        glyph = (glyph + delta) & 0xffff;
+    }
+  }
+  else if (cmap_format == 12) {
+    const uint32_t groups = u32(file.data + cmap + 12);
+    uint32_t lo = 0, hi = groups;
+    while (lo < hi) {
+      const uint32_t mid = (lo + hi)/2;
+      const uint8_t *g = file.data + cmap + 16 + 12*static_cast<size_t>(mid);
+      if (cp < u32(g))
+        hi = mid;
+      else if (cp > u32(g + 4))
+        lo = mid + 1;
+      else {
+        glyph = u32(g + 8) + (cp - u32(g));
+        break;
+      }
+    }
+  }
+  return glyph < glyph_count ? glyph : 0;
+}
+
+size_t
+truetype_font::glyph_offset(const uint32_t glyph, size_t &size) const {
+  size_t begin, end;
+  if (long_loca) {
+    begin = u32(file.data + loca + 4*glyph);
+    end = u32(file.data + loca + 4*glyph + 4);
+  }
+  else {
+    begin = 2*static_cast<size_t>(u16(file.data + loca + 2*glyph));
+    end = 2*static_cast<size_t>(u16(file.data + loca + 2*glyph + 2));
+  }
+  if (end < begin || end > glyf_size || (end > begin && end - begin < 10))
+    throw runtime_error("bad glyph offset in " + filename);
+  size = end - begin;
+  return glyf + begin;
+}
+
+glyph_metrics
+truetype_font::metrics(const uint32_t glyph) const {
+  glyph_metrics m;
+  memset(&m, 0, sizeof(m));
+  if (glyph >= glyph_count)
+    return m;
+  if (glyph < long_metrics) {
+    m.advance = u16(file.data + hmtx + 4*glyph);
+    m.left_bearing = s16(file.data + hmtx + 4*glyph + 2);
+  }
+  else {
+    m.advance = u16(file.data + hmtx + 4*(long_metrics - 1));
+    m.left_bearing = s16(file.data + hmtx + 4*long_metrics + 2*(glyph - long_metrics));
+  }
+  size_t size;
+  const size_t offset = glyph_offset(glyph, size);
+  if (size > 0) {
+    m.x_min = s16(file.data + offset + 2);
+    m.y_min = s16(file.data + offset + 4);
+    m.x_max = s16(file.data + offset + 6);
+    m.y_max = s16(file.data + offset + 8);
+  }
+  return m;
+}
+
+int
+truetype_font::kerning(const uint32_t left, const uint32_t right) const {
+  const uint32_t key = (left << 16) | right;
+  uint32_t lo = 0, hi = kern_count;
+  while (lo < hi) {
+    const uint32_t mid = (lo + hi)/2;
+    const uint8_t *pair = file.data + kern_pairs + 6*static_cast<size_t>(mid);
+    const uint32_t k = u32(pair);
+    if (k == key)
+      return s16(pair + 4);
+    if (k < key)
+      lo = mid + 1;
+    else hi = mid;
+  }
+  return 0;
+}
+
+glyph_outline
+truetype_font::outline(const uint32_t glyph) const {
+  glyph_outline out;
+  if (glyph < glyph_count)
+    outline(glyph, 0, out);
+  return out;
+}
+
+void
+truetype_font::outline(const uint32_t glyph, const int depth,
+                       glyph_outline &out) const {
+  size_t size;
+  const size_t offset = glyph_offset(glyph, size);
+  if (size == 0)
+    return;
+  const size_t end = offset + size;
+  const int16_t contours = s16(file.data + offset);
+  size_t p = offset + 10;
+
+  if (contours >= 0) {
+    // end points, instructions, then flags and coordinates of the points
+    const uint32_t first = static_cast<uint32_t>(out.points.size());
+    at(file, p, 2*static_cast<size_t>(contours) + 2, filename);
+    uint32_t points = 0;
+    for (int16_t c = 0; c < contours; ++c) {
+      const uint32_t last = u16(file.data + p + 2*c) + 1u;
+      if (last <= points && c > 0)
+        throw runtime_error("bad contour in " + filename);
+      points = last;
+      out.contour_ends.push_back(first + last);
+    }
+    p += 2*static_cast<size_t>(contours);
+    p += 2 + u16(file.data + p);
+
+    vector<uint8_t> flags(points);
+    for (uint32_t i = 0; i < points; ) {
+      const uint8_t f = *at(file, p++, 1, filename);
+      uint32_t repeat = 1;
+      if (f & 8)
+        repeat += *at(file, p++, 1, filename);
+      for (; repeat > 0 && i < points; --repeat)
+        flags[i++] = f;
+    }
+    out.points.resize(first + points);
+    // x: short is a byte with the sign in bit 4, else bit 4 means same
+    int value = 0;
+    for (uint32_t i = 0; i < points; ++i) {
+      const uint8_t f = flags[i];
+      if (f & 2) {
+        const int d = *at(file, p++, 1, filename);
+        value += (f & 16) ? d : -d;
+      }
+      else if (!(f & 16)) {
+        value += s16(at(file, p, 2, filename));
+        p += 2;
+      }
+      out.points[first + i].x = static_cast<float>(value);
+      out.points[first + i].on_curve = (f & 1) != 0;
+    }
+    value = 0;
+    for (uint32_t i = 0; i < points; ++i) {
+      const uint8_t f = flags[i];
+      if (f & 4) {
+        const int d = *at(file, p++, 1, filename);
+        value += (f & 32) ? d : -d;
+      }
+      else if (!(f & 32)) {
+        value += s16(at(file, p, 2, filename));
+        p += 2;
+      }
+      out.points[first + i].y = static_cast<float>(value);
+    }
+    if (p > end)
+      throw runtime_error("bad glyph outline in " + filename);
+    return;
+  }
+
+  // composite: transformed outlines of other glyphs
+  if (depth > 8)
+    throw runtime_error("composite glyphs nested too deep in " + filename);
+  for (bool more = true; more; ) {
+    const uint8_t *c = at(file, p, 4, filename);
+    const uint16_t flags = u16(c);
+    const uint32_t component = u16(c + 2);
+    if (component >= glyph_count)
+      throw runtime_error("bad composite glyph in " + filename);
+    p += 4;
+    float dx = 0.f, dy = 0.f;
+    if (flags & 1) {
+      c = at(file, p, 4, filename);
+      dx = s16(c);
+      dy = s16(c + 2);
+      p += 4;
+    }
+    else {
+      c = at(file, p, 2, filename);
+      dx = static_cast<int8_t>(c[0]);
+      dy = static_cast<int8_t>(c[1]);
+      p += 2;
+    }
+    if (!(flags & 2))
+      dx = dy = 0.f;  // matching points, not supported
+    // 2.14 fixed point scale or matrix
+    float m[4] = {1.f, 0.f, 0.f, 1.f};
+    if (flags & 8) {
+      m[0] = m[3] = s16(at(file, p, 2, filename))/16384.f;
+      p += 2;
+    }
+    else if (flags & 0x40) {
+      c = at(file, p, 4, filename);
+      m[0] = s16(c)/16384.f;
+      m[3] = s16(c + 2)/16384.f;
+      p += 4;
+    }
+    else if (flags & 0x80) {
+      c = at(file, p, 8, filename);
+      for (int i = 0; i < 4; ++i)
+        m[i] = s16(c + 2*i)/16384.f;
+      p += 8;
+    }
+
+    const size_t first = out.points.size();
+    outline(component, depth + 1, out);
+    for (size_t i = first; i < out.points.size(); ++i) {
+      outline_point &pt = out.points[i];
+      const float x = pt.x, y = pt.y;
+      pt.x = m[0]*x + m[2]*y + dx;
+      pt.y = m[1]*x + m[3]*y + dy;
+    }
+    more = (flags & 0x20) != 0;
+  }
+}
+
+/****************** signed distance fields *******************/
+struct sdf_segment {
+  float ax, ay, bx, by;
+};
+
+// quadratic from a through control c to b, split until it is within
+// a tenth of a pixel of its chords
+static void
+add_curve(vector<sdf_segment> &segs, const float ax, const float ay,
+          const float cx, const float cy, const float bx, const float by) {
+  const float dx = ax - 2.f*cx + bx, dy = ay - 2.f*cy + by;
+  const float deviation = 0.25f*std::sqrt(dx*dx + dy*dy);
+  const int n = std::min(32, std::max(1, static_cast<int>(std::ceil(std::sqrt(deviation/0.1f)))));
+  float px = ax, py = ay;
+  for (int i = 1; i <= n; ++i) {
+    const float t = static_cast<float>(i)/n, u = 1.f - t;
+    const float x = u*u*ax + 2.f*u*t*cx + t*t*bx;
+    const float y = u*u*ay + 2.f*u*t*cy + t*t*by;
+    segs.push_back({px, py, x, y});
+    px = x;
+    py = y;
+  }
+}
+
+// the contours as line segments, scaled to pixels
+static vector<sdf_segment>
+flatten(const glyph_outline &o, const float scale) {
+  vector<sdf_segment> segs;
+  uint32_t begin = 0;
+  for (const uint32_t end : o.contour_ends) {
+    const uint32_t n = end - begin;
+    if (n < 2 || end > o.points.size()) {
+      begin = end;
+      continue;
+    }
+    const auto pt = [&](const uint32_t i, float &x, float &y) {
+      x = o.points[begin + i].x*scale;
+      y = o.points[begin + i].y*scale;
+    };
+
+    // start on an on-curve point, implied if both ends are controls
+    float sx, sy;
+    uint32_t first = 0, count = n;
+    if (o.points[begin].on_curve) {
+      pt(0, sx, sy);
+      first = 1;
+      count = n - 1;
+    }
+    else if (o.points[end - 1].on_curve) {
+      pt(n - 1, sx, sy);
+      count = n - 1;
+    }
+    else {
+      float x0, y0, x1, y1;
+      pt(0, x0, y0);
+      pt(n - 1, x1, y1);
+      sx = 0.5f*(x0 + x1);
+      sy = 0.5f*(y0 + y1);
+    }
+
+    float px = sx, py = sy, cx = 0.f, cy = 0.f;
+    bool control = false;
+    for (uint32_t k = 0; k < count; ++k) {
+      const uint32_t i = first + k;
+      float x, y;
+      pt(i, x, y);
+      if (o.points[begin + i].on_curve) {
+        if (control)
+          add_curve(segs, px, py, cx, cy, x, y);
+        else segs.push_back({px, py, x, y});
+        px = x;
+        py = y;
+        control = false;
+      }
+      else {
+        if (control) {
+          const float mx = 0.5f*(cx + x), my = 0.5f*(cy + y);
+          add_curve(segs, px, py, cx, cy, mx, my);
+          px = mx;
+          py = my;
+        }
+        cx = x;
+        cy = y;
+        control = true;
+      }
+    }
+    if (control)
+      add_curve(segs, px, py, cx, cy, sx, sy);
+    else segs.push_back({px, py, sx, sy});
+    begin = end;
+  }
+  return segs;
+}
+
+sdf_bitmap
+rasterize_sdf(const truetype_font &font, const uint32_t glyph,
+              const float pixel_size, const float spread) {
+  sdf_bitmap bmp;
+  const glyph_outline o = font.outline(glyph);
+  if (o.points.empty())
+    return bmp;
+  const float scale = pixel_size/font.units_per_em;
+  const vector<sdf_segment> segs = flatten(o, scale);
+
+  // outline bounds, the points hold the curves, plus the spread
+  float x0 = o.points[0].x, y0 = o.points[0].y, x1 = x0, y1 = y0;
+  for (const outline_point &p : o.points) {
+    x0 = std::min(x0, p.x);
+    y0 = std::min(y0, p.y);
+    x1 = std::max(x1, p.x);
+    y1 = std::max(y1, p.y);
+  }
+  const int pad = static_cast<int>(std::ceil(spread)) + 1;
+  const int left = static_cast<int>(std::floor(x0*scale)) - pad;
+  const int bottom = static_cast<int>(std::floor(y0*scale)) - pad;
+  bmp.w = static_cast<int>(std::ceil(x1*scale)) + pad - left;
+  bmp.h = static_cast<int>(std::ceil(y1*scale)) + pad - bottom;
+  bmp.left = static_cast<float>(left);
+  bmp.bottom = static_cast<float>(bottom);
+  bmp.pixels.resize(static_cast<size_t>(bmp.w)*bmp.h);
+
+  // nearest segment for the distance, nonzero winding for the sign
+  for (int y = 0; y < bmp.h; ++y) {
+    const float py = bottom + y + 0.5f;
+    for (int x = 0; x < bmp.w; ++x) {
+      const float px = left + x + 0.5f;
+      float best = 1e30f;
+      int winding = 0;
+      for (const sdf_segment &s : segs) {
+        const float ex = s.bx - s.ax, ey = s.by - s.ay;
+        const float wx = px - s.ax, wy = py - s.ay;
+        const float len2 = ex*ex + ey*ey;
+        const float t = (len2 > 0.f) ? std::min(1.f, std::max(0.f, (wx*ex + wy*ey)/len2)) : 0.f;
+        const float qx = wx - t*ex, qy = wy - t*ey;
+        best = std::min(best, qx*qx + qy*qy);
+        if ((s.ay <= py) != (s.by <= py) &&
+            s.ax + (py - s.ay)/ey*ex > px)
+          winding += (s.by > s.ay) ? 1 : -1;
+      }
+      const float d = (winding != 0 ? 1.f : -1.f)*std::sqrt(best);
+      const float v = std::min(1.f, std::max(0.f, 0.5f + 0.5f*d/spread));
+      bmp.pixels[static_cast<size_t>(y)*bmp.w + x] = static_cast<uint8_t>(v*255.f + 0.5f);
+    }
+  }
+  return bmp;
+}
+
+/****************** text *******************/
+uint32_t
+decode_utf8(const char *&p, const char *end) {
+  const uint8_t c = static_cast<uint8_t>(*p++);
+  if (c < 0x80)
+    return c;
+  const int extra = (c >= 0xf0 && c < 0xf8) ? 3 : (c >= 0xe0) ? 2 : (c >= 0xc0) ? 1 : -1;
+  if (extra < 0 || c >= 0xf8 || end - p < extra)
+    return 0xfffd;
+  uint32_t cp = c & (0x3f >> extra);
+  for (int i = 0; i < extra; ++i) {
+    const uint8_t next = static_cast<uint8_t>(p[i]);
+    if ((next & 0xc0) != 0x80)
+      return 0xfffd;
+    cp = (cp << 6) | (next & 0x3f);
+  }
+  p += extra;
+  return cp;
+}
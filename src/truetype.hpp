@@ -0,0 +1,91 @@
+#ifndef TRUETYPE_HPP
+#define TRUETYPE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "asset_pack.hpp"
+
+// A point of a glyph outline in font units. Off-curve points are the
+// controls of quadratic curves; two in a row imply an on-curve point
+// halfway between them.
+struct outline_point {
+  float x;
+  float y;
+  bool on_curve;
+};
+
+struct glyph_outline {
+  std::vector<outline_point> points;
+  std::vector<uint32_t> contour_ends;  // one past the last point of each
+};
+
+// in font units, y up from the baseline
+struct glyph_metrics {
+  int advance;
+  int left_bearing;
+  int x_min, y_min, x_max, y_max;  // all 0 for empty glyphs
+};
+
+// A TrueType font with glyf outlines (not CFF), read from the file's
+// bytes as they are: cmap formats 4 and 12 for characters, hmtx for
+// advances and the format 0 kern table for kerning pairs; GPOS kerning
+// is not read. Offsets are checked against the file and bad ones
+// throw. Const methods may be called from any thread.
+class truetype_font {
+public:
+  explicit truetype_font(const std::string &filename);
+
+  // glyph of a code point, 0 (the missing glyph) for none
+  uint32_t glyph_index(const uint32_t codepoint) const;
+  glyph_metrics metrics(const uint32_t glyph) const;
+  // added to the advance of left when right follows, font units
+  int kerning(const uint32_t left, const uint32_t right) const;
+  // composite glyphs come out with their components merged
+  glyph_outline outline(const uint32_t glyph) const;
+
+  int units_per_em;
+  int ascent;     // above the baseline, positive
+  int descent;    // below it, negative
+  int line_gap;
+  uint32_t glyph_count;
+
+private:
+  void outline(const uint32_t glyph, const int depth, glyph_outline &out) const;
+  size_t glyph_offset(const uint32_t glyph, size_t &size) const;
+
+  std::string filename;
+  asset_data file;
+  size_t cmap;           // offset of the chosen subtable, 0 for none
+  int cmap_format;
+  size_t loca, glyf, glyf_size;
+  bool long_loca;
+  size_t hmtx;
+  uint32_t long_metrics;  // entries of hmtx with an advance
+  size_t kern_pairs;      // offset of the first pair, 0 for none
+  uint32_t kern_count;
+};
+
+// A signed distance field of a glyph, 0.5 (128) on the outline and
+// spread pixels away reaching 0 outside and 1 inside. Rows bottom first;
+// left and bottom place pixel (0, 0) relative to the glyph origin on the
+// baseline, in pixels at the size it was rasterized.
+struct sdf_bitmap {
+  int w;
+  int h;
+  float left;
+  float bottom;
+  std::vector<uint8_t> pixels;
+
+  sdf_bitmap() : w(0), h(0), left(0.f), bottom(0.f) {}
+};
+
+// the glyph at pixel_size pixels per em; empty glyphs give an empty bitmap
+sdf_bitmap rasterize_sdf(const truetype_font &font, const uint32_t glyph,
+                         const float pixel_size, const float spread);
+
+// next code point of UTF-8 text, U+FFFD for malformed bytes
+uint32_t decode_utf8(const char *&p, const char *end);
+
+#endif